@@ -7,6 +7,9 @@ set -euo pipefail
 : "${POLY:=z3-1}"
 : "${BOUNDS:="-2 2 -2 2"}"
 : "${BIN:=./newton_fractals}"
+# Thread counts to run; by default powers of two up to 64, capped at the
+# number of hardware threads (oversubscribed runs say nothing about scaling)
+: "${THREADS:=}"
 
 # --- pick a timing command: gtime (Homebrew), GNU time, or fall back to bash 'time -p'
 pick_time() {
@@ -25,9 +28,21 @@ if ! grep -qE "\b$POLY\b" <<<"$help_out"; then
   exit 1
 fi
 
-echo "cores,size,iters,seconds"
+if [[ -z "$THREADS" ]]; then
+  ncpu="$(nproc 2>/dev/null || sysctl -n hw.ncpu 2>/dev/null || echo 1)"
+  for t in 1 2 4 8 16 32 64; do
+    (( t <= ncpu )) && THREADS+="$t "
+  done
+fi
+
+# seconds: whole process (includes PNG encoding); render_s: the parallel
+# render only, which speedup and efficiency are based on; idle_pct: the
+# largest per-thread idle share reported by the tile pool; colorize_s: both
+# colorization passes, timed apart from the render
+echo "cores,size,iters,seconds,render_s,speedup,efficiency,idle_pct,colorize_s"
 
-for t in 1 2 4 8 16; do
+base=""
+for t in $THREADS; do
   log="/tmp/bench_${t}.log"
   : > "$log"
 
@@ -66,5 +81,11 @@ for t in 1 2 4 8 16; do
     continue
   fi
 
-  echo "$t,$IMG,$ITERS,$sec"
+  render="$(awk '/^Computed in/{print $3; exit}' "$log")"
+  colorize="$(awk '/^Colorized in/{print $3; exit}' "$log")"
+  idle="$(sed -n 's/.*idle max .* s (\([0-9.]*\)%).*/\1/p' "$log" | head -n1)"
+  [[ -z "$base" ]] && base="$render"
+  read -r speedup eff < <(awk -v b="$base" -v r="$render" -v t="$t" \
+    'BEGIN { s = r > 0 ? b / r : 0; printf "%.2f %.2f\n", s, s / t }')
+  echo "$t,$IMG,$ITERS,$sec,$render,$speedup,$eff,${idle:-},${colorize:-}"
 done
@@ -2,8 +2,12 @@
 set -euo pipefail
 mkdir -p run
 
-./newton_fractals --poly z3-1 --size 1920x1080 --max-iters 200 --tol 1e-12 --damping 1.0 --bounds -2 2 -1.5 1.5 --threads 8 --out run/z3
-./newton_fractals --poly z5-1 --size 1920x1080 --max-iters 300 --tol 1e-12 --damping 1.0 --bounds -2 2 -2 2 --threads 8 --out run/z5
-./newton_fractals --poly z3-2z+2 --size 1920x1080 --max-iters 400 --tol 1e-12 --damping 1.0 --bounds -2.5 2.5 -2.0 2.0 --threads 8 --out run/z3m2zp2
+# One process for all figures: see "Batch manifests" in the README
+cat > run/figures.jsonl <<'JOBS'
+{"poly": "z3-1", "max-iters": 200, "bounds": [-2, 2, -1.5, 1.5], "out": "run/z3"}
+{"poly": "z5-1", "max-iters": 300, "bounds": [-2, 2, -2, 2], "out": "run/z5"}
+{"poly": "z3-2z+2", "max-iters": 400, "bounds": [-2.5, 2.5, -2.0, 2.0], "out": "run/z3m2zp2"}
+JOBS
+./newton_fractals --batch run/figures.jsonl --size 1920x1080 --tol 1e-12 --damping 1.0 --threads 8
 
-echo "Figures written to ./run"
+echo "Figures written to ./run (timings in run/figures.summary.tsv)"
@@ -0,0 +1,359 @@
+#include "animate.h"
+#include "pipeline.h"
+#include "timing.h"
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <csignal>
+#define NF_HAVE_SIGPIPE 1
+#endif
+
+namespace {
+
+// Ignores SIGPIPE while alive, so writing to a pipe whose reader has gone
+// fails with EPIPE instead of ending the process
+struct IgnoreSigpipe {
+#if defined(NF_HAVE_SIGPIPE)
+  void (*old)(int) = std::signal(SIGPIPE, SIG_IGN);
+  ~IgnoreSigpipe() {
+    if (old != SIG_ERR)
+      std::signal(SIGPIPE, old);
+  }
+#endif
+};
+
+// Grids this close to a whole number of pixels apart count as aligned; the
+// new view is snapped onto the old grid
+constexpr double kAlignTol = 1e-6;
+
+// One frame in flight: computed into, then encoded from
+struct Slot {
+  int frame = 0;
+  Viewport view;
+  NewtonParams np;
+  BasinResult res;
+  ImageRGBA img;
+  bool valid = false; // res holds view's frame
+};
+
+bool same_params(const NewtonParams &a, const NewtonParams &b) {
+  return a.max_iters == b.max_iters && a.tol == b.tol &&
+         a.damping == b.damping;
+}
+
+// Copies the w x h block at (sx, sy) of src to (dx, dy) of dst.
+void copy_block(const BasinResult &src, int sx, int sy, BasinResult &dst,
+                int dx, int dy, int w, int h) {
+  for (int y = 0; y < h; y++) {
+    const size_t s = (size_t)(sy + y) * (size_t)src.W + (size_t)sx;
+    const size_t d = (size_t)(dy + y) * (size_t)dst.W + (size_t)dx;
+    if (src.wide)
+      std::memcpy(&dst.label16[d], &src.label16[s],
+                  (size_t)w * sizeof(uint16_t));
+    else
+      std::memcpy(&dst.label[d], &src.label[s], (size_t)w);
+    std::memcpy(&dst.iters[d], &src.iters[s], (size_t)w * sizeof(uint16_t));
+  }
+}
+
+// BT.601 studio range, as y4m readers assume; planes Y, Cb, Cr at full
+// resolution (C444)
+void to_y4m(const ImageRGBA &img, std::vector<uint8_t> &out) {
+  const size_t n = img.pixels.size();
+  static const char kTag[] = "FRAME\n";
+  const size_t tag = sizeof kTag - 1;
+  out.resize(tag + 3 * n);
+  std::memcpy(out.data(), kTag, tag);
+  uint8_t *Y = out.data() + tag, *U = Y + n, *V = U + n;
+  const RGBA *p = img.pixels.data();
+  const long long N = (long long)n;
+#pragma omp parallel for schedule(static) if (N > 65536)
+  for (long long i = 0; i < N; i++) {
+    const int r = p[i].r, g = p[i].g, b = p[i].b;
+    Y[i] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    U[i] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    V[i] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+  }
+}
+
+} // namespace
+
+bool load_keyframes(const std::string &path, const NewtonParams &base,
+                    std::vector<Keyframe> &keys, std::string &err) {
+  keys.clear();
+  std::ifstream in(path);
+  if (!in) {
+    err = "cannot open " + path;
+    return false;
+  }
+  int line_no = 0;
+  for (std::string line; std::getline(in, line);) {
+    ++line_no;
+    const std::string where = path + ":" + std::to_string(line_no) + ": ";
+    const size_t hash = line.find('#');
+    if (hash != std::string::npos)
+      line.resize(hash);
+    std::istringstream ls(line);
+    std::string f, re, im, w;
+    if (!(ls >> f))
+      continue;
+    if (!(ls >> re >> im >> w)) {
+      err = where + "expected FRAME RE IM WIDTH";
+      return false;
+    }
+    Keyframe k;
+    if (keys.empty()) {
+      k.max_iters = base.max_iters;
+      k.damping = base.damping;
+      k.tol = base.tol;
+    } else {
+      k = keys.back();
+    }
+    char *end = nullptr;
+    k.frame = (int)std::strtol(f.c_str(), &end, 10);
+    if (*end || k.frame < 0 ||
+        (!keys.empty() && k.frame <= keys.back().frame)) {
+      err = where + "frames must be integers >= 0, increasing";
+      return false;
+    }
+    k.width = std::strtod(w.c_str(), &end);
+    if (*end || !(k.width > 0.0) || !std::isfinite(k.width)) {
+      err = where + "bad width " + w;
+      return false;
+    }
+    try {
+      k.re = parse_dd(re);
+      k.im = parse_dd(im);
+    } catch (const std::exception &e) {
+      err = where + e.what();
+      return false;
+    }
+    for (std::string kv; ls >> kv;) {
+      const size_t eq = kv.find('=');
+      const std::string key = kv.substr(0, eq);
+      const char *val = eq == std::string::npos ? "" : kv.c_str() + eq + 1;
+      bool ok = *val != 0;
+      if (key == "max_iters") {
+        const long m = std::strtol(val, &end, 10);
+        ok = ok && !*end && m >= 1 && m <= kMaxResultIters;
+        k.max_iters = (int)m;
+      } else if (key == "damping") {
+        k.damping = std::strtod(val, &end);
+        ok = ok && !*end && k.damping > 0.0;
+      } else if (key == "tol") {
+        k.tol = std::strtod(val, &end);
+        ok = ok && !*end && k.tol > 0.0;
+      } else {
+        ok = false;
+      }
+      if (!ok) {
+        err = where + "bad parameter " + kv;
+        return false;
+      }
+    }
+    keys.push_back(k);
+  }
+  if (keys.empty()) {
+    err = path + ": no keyframes";
+    return false;
+  }
+  return true;
+}
+
+void frame_at(const std::vector<Keyframe> &keys, int f, int W, int H,
+              const NewtonParams &base, Viewport &v, NewtonParams &np) {
+  size_t i = 0;
+  while (i + 2 < keys.size() && f > keys[i + 1].frame)
+    i++;
+  const Keyframe &a = keys[i];
+  const Keyframe &b = keys.size() > 1 ? keys[i + 1] : a;
+  double t = 0.0;
+  if (b.frame > a.frame)
+    t = std::clamp(double(f - a.frame) / double(b.frame - a.frame), 0.0,
+                   1.0);
+  const double w = a.width * std::pow(b.width / a.width, t);
+  dd cx, cy;
+  if (a.width == b.width) {
+    cx = a.re + (b.re - a.re) * dd(t);
+    cy = a.im + (b.im - a.im) * dd(t);
+  } else {
+    // Around the fixed point p of the zoom: c = p + (a - b) w / (wa - wb),
+    // each term small where it has to be exact
+    const double r = b.width / (a.width - b.width);
+    const double s = w / (a.width - b.width);
+    cx = b.re + (b.re - a.re) * dd(r) + (a.re - b.re) * dd(s);
+    cy = b.im + (b.im - a.im) * dd(r) + (a.im - b.im) * dd(s);
+  }
+  v = Viewport{};
+  v.W = W;
+  v.H = H;
+  v.set_center(cx, cy, w);
+  np = base;
+  np.max_iters =
+      (int)std::lround(a.max_iters + (b.max_iters - a.max_iters) * t);
+  np.damping = a.damping + (b.damping - a.damping) * t;
+  np.tol = a.tol * std::pow(b.tol / a.tol, t);
+}
+
+AnimateStats render_animation(const Poly &poly,
+                              const std::vector<std::complex<double>> &roots,
+                              const NewtonParams &base, int W, int H,
+                              const std::vector<Keyframe> &keys,
+                              const KernelVariant *kernel,
+                              const std::vector<RGBA> &colors,
+                              const RenderOptions &opt,
+                              const AnimateOptions &ao) {
+  Timer wall;
+  AnimateStats as;
+  const bool y4m = ao.format == "y4m";
+  if ((!y4m && ao.format != "rgba") || keys.empty() || W <= 0 || H <= 0 ||
+      ao.fps < 1) {
+    as.error = "bad animation options";
+    return as;
+  }
+  const bool to_stdout = ao.out == "-";
+  std::FILE *out = to_stdout ? stdout : std::fopen(ao.out.c_str(), "wb");
+  if (!out) {
+    as.error = "cannot write " + ao.out;
+    return as;
+  }
+  const IgnoreSigpipe no_sigpipe;
+  std::atomic<bool> write_ok{true}; // the producer stops when it drops
+  auto put = [&](const void *p, size_t n) {
+    if (std::fwrite(p, 1, n, out) != n)
+      write_ok = false;
+    as.bytes += n;
+  };
+  if (y4m) {
+    char head[96];
+    const int n = std::snprintf(head, sizeof head,
+                                "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", W,
+                                H, ao.fps);
+    put(head, (size_t)n);
+  }
+
+  std::vector<uint8_t> planes;
+  auto encode = [&](Slot &s) {
+    Timer te;
+    if (ao.iters)
+      colorize_iterations(s.res, s.np.max_iters, s.img, ao.colormap);
+    else
+      colorize_basins(s.res, colors, s.img);
+    if (y4m) {
+      to_y4m(s.img, planes);
+      put(planes.data(), planes.size());
+    } else {
+      put(s.img.pixels.data(), s.img.pixels.size() * sizeof(RGBA));
+    }
+    as.encode_seconds += te.seconds();
+  };
+
+  EncodePipeline<Slot> encoder(encode);
+
+  RenderOptions full = opt;
+  full.row0 = full.rows = full.col0 = full.cols = 0;
+  BasinResult strip;
+  // Renders the w x h block at (c0, r0) of s's view into s.res
+  auto fill = [&](Slot &s, int c0, int r0, int w, int h) {
+    if (w <= 0 || h <= 0)
+      return;
+    RenderOptions o = opt;
+    o.col0 = c0;
+    o.cols = w;
+    o.row0 = r0;
+    o.rows = h;
+    render_basins(poly, roots, s.np, s.view, kernel, strip, o);
+    copy_block(strip, 0, 0, s.res, c0, r0, w, h);
+  };
+  // Builds s from p when the two grids are a whole number of pixels apart:
+  // the overlap is copied and the rest rendered. False when they are not.
+  auto shift = [&](const Slot &p, Slot &s) {
+    const Viewport &pv = p.view;
+    Viewport &v = s.view;
+    if (!same_params(p.np, s.np) || v.span_x != pv.span_x ||
+        v.span_y != pv.span_y)
+      return false;
+    const double dx = v.dx(), dy = v.dy();
+    const dd px(pv.xmin, pv.xmin_lo), py(pv.ymin, pv.ymin_lo);
+    const double ox = (dd(v.xmin, v.xmin_lo) - px).hi / dx;
+    const double oy = (dd(v.ymin, v.ymin_lo) - py).hi / dy;
+    if (!(std::abs(ox) < W) || !(std::abs(oy) < H))
+      return false;
+    const int kx = (int)std::lround(ox), ky = (int)std::lround(oy);
+    if (std::abs(ox - kx) > kAlignTol || std::abs(oy - ky) > kAlignTol ||
+        std::abs(kx) >= W || std::abs(ky) >= H)
+      return false;
+    const dd x0 = px + dd(kx) * dd(dx), y0 = py + dd(ky) * dd(dy);
+    v.xmin = x0.hi;
+    v.xmin_lo = x0.lo;
+    v.xmax = (x0 + dd(v.span_x)).hi;
+    v.ymin = y0.hi;
+    v.ymin_lo = y0.lo;
+    v.ymax = (y0 + dd(v.span_y)).hi;
+    // New pixel (x, y) is old pixel (x + kx, y + ky)
+    const int ax0 = std::max(0, -kx), ax1 = std::min(W, W - kx);
+    const int ay0 = std::max(0, -ky), ay1 = std::min(H, H - ky);
+    BasinResult &r = s.res;
+    r.W = W;
+    r.H = H;
+    r.wide = p.res.wide;
+    r.label.resize(r.wide ? 0 : (size_t)W * (size_t)H);
+    r.label16.resize(r.wide ? (size_t)W * (size_t)H : 0);
+    r.iters.resize((size_t)W * (size_t)H);
+    r.aa = 1;
+    r.aa_pixel.clear();
+    r.aa_label.clear();
+    r.aa_label16.clear();
+    copy_block(p.res, ax0 + kx, ay0 + ky, r, ax0, ay0, ax1 - ax0, ay1 - ay0);
+    fill(s, 0, 0, W, ay0);
+    fill(s, 0, ay1, W, H - ay1);
+    fill(s, 0, ay0, ax0, ay1 - ay0);
+    fill(s, ax1, ay0, W - ax1, ay1 - ay0);
+    as.reused_pixels += (long long)(ax1 - ax0) * (ay1 - ay0);
+    return true;
+  };
+
+  // Refinement looks at neighbours across the seam, so --aa renders whole
+  const bool reuse = ao.reuse && opt.aa <= 1;
+  std::array<Slot, 2> slots;
+  try {
+    for (int f = keys.front().frame; f <= keys.back().frame && write_ok;
+         f++) {
+      // The other slot holds frame f - 1, which may still be encoding
+      Slot &s = slots[(size_t)(f & 1)];
+      const Slot &p = slots[(size_t)((f + 1) & 1)];
+      s.frame = f;
+      frame_at(keys, f, W, H, base, s.view, s.np);
+      Timer tc;
+      if (reuse && p.valid && shift(p, s))
+        ++as.shifted_frames;
+      else
+        render_basins(poly, roots, s.np, s.view, kernel, s.res, full);
+      s.valid = true;
+      as.compute_seconds += tc.seconds();
+      as.pixels += (long long)W * H;
+      encoder.finish();
+      encoder.push(s);
+      ++as.frames;
+    }
+  } catch (const std::exception &e) {
+    as.error = e.what();
+  }
+  encoder.close();
+  const bool closed =
+      (to_stdout ? std::fflush(out) : std::fclose(out)) == 0;
+  if (!(closed && write_ok) && as.error.empty())
+    as.error = "could not write " + (to_stdout ? std::string("stdout")
+                                               : ao.out);
+  as.ok = as.error.empty();
+  as.seconds = wall.seconds();
+  return as;
+}
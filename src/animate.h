@@ -0,0 +1,74 @@
+#pragma once
+// Zoom / pan animations (--animate): keyframes give a center, a width and
+// optionally parameters at some frame numbers; the frames between are
+// interpolated, rendered and streamed as raw video (y4m or bare RGBA) to a
+// file, a named pipe or stdout, for an external encoder.
+//
+// Keyframe file, one per line, '#' comments:
+//
+//   FRAME  CENTER_RE  CENTER_IM  WIDTH  [max_iters=N] [damping=A] [tol=E]
+//
+// Centers are read to ~32 digits (double-double), so deep zooms work.
+// Between two keyframes the width changes geometrically and the center
+// moves so that the point the zoom converges on stays still on screen (a
+// plain pan when the widths are equal). max_iters and damping go linearly,
+// tol geometrically; a parameter a keyframe leaves out keeps the previous
+// keyframe's value (the command line's for the first).
+//
+// Frame k + 1 is computed while frame k is colorized and written on an
+// encoder thread. When consecutive frames have the same pixel size and
+// parameters and their grids are a whole number of pixels apart (integer
+// pans), the overlap is copied from the previous frame and only the newly
+// exposed rows and columns are rendered.
+#include "render.h"
+#include <string>
+#include <vector>
+
+struct Keyframe {
+  int frame = 0;
+  dd re, im;
+  double width = 0.0;
+  int max_iters = 0;
+  double damping = 0.0, tol = 0.0;
+};
+
+// Reads keyframes, filling unset parameters from the previous keyframe
+// (base for the first); frames must increase. False with err set otherwise.
+bool load_keyframes(const std::string &path, const NewtonParams &base,
+                    std::vector<Keyframe> &keys, std::string &err);
+
+// The view (W x H) and parameters of frame f; base supplies the rest.
+void frame_at(const std::vector<Keyframe> &keys, int f, int W, int H,
+              const NewtonParams &base, Viewport &v, NewtonParams &np);
+
+struct AnimateOptions {
+  std::string out = "-";      // path or named pipe; "-" = stdout
+  std::string format = "y4m"; // y4m (4:4:4, BT.601) | rgba
+  int fps = 30;
+  bool iters = false; // the iteration image instead of basins
+  IterColormap colormap = IterColormap::Turbo;
+  bool reuse = true; // copy the overlap on integer pans
+};
+
+struct AnimateStats {
+  int frames = 0;
+  int shifted_frames = 0;      // that reused part of the frame before
+  long long pixels = 0;        // all frames
+  long long reused_pixels = 0; // copied instead of rendered
+  double compute_seconds = 0.0, encode_seconds = 0.0, seconds = 0.0;
+  uint64_t bytes = 0; // written
+  bool ok = false;
+  std::string error;
+};
+
+// Renders frames keys.front().frame .. keys.back().frame. The iteration
+// image is normalised by each frame's max_iters, so colors hold still.
+// opt.aa > 1 turns reuse off: refinement looks across the seam.
+AnimateStats render_animation(const Poly &poly,
+                              const std::vector<std::complex<double>> &roots,
+                              const NewtonParams &base, int W, int H,
+                              const std::vector<Keyframe> &keys,
+                              const KernelVariant *kernel,
+                              const std::vector<RGBA> &colors,
+                              const RenderOptions &opt,
+                              const AnimateOptions &ao);
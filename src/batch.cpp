@@ -0,0 +1,393 @@
+#include "batch.h"
+#include "pipeline.h"
+#include "poly_cache.h"
+#include "png.h"
+#include "timing.h"
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// A manifest value: a string, the text of a number or literal, or a flat
+// array of those
+struct Value {
+  bool string = false, array = false;
+  std::string text;
+  std::vector<Value> items;
+};
+
+// Just the JSON a manifest line needs: one object of scalars and flat
+// arrays.
+class LineParser {
+public:
+  explicit LineParser(const std::string &s) : s_(s) {}
+
+  bool object(std::vector<std::pair<std::string, Value>> &out,
+              std::string &err) {
+    if (!eat('{'))
+      return fail(err, "expected {");
+    if (eat('}'))
+      return end(err);
+    do {
+      Value key, v;
+      if (!scalar(key) || !key.string)
+        return fail(err, "expected a key");
+      if (!eat(':'))
+        return fail(err, "expected : after \"" + key.text + "\"");
+      if (eat('[')) {
+        v.array = true;
+        if (!eat(']')) {
+          do {
+            v.items.emplace_back();
+            if (!scalar(v.items.back()))
+              return fail(err, "bad array item for \"" + key.text + "\"");
+          } while (eat(','));
+          if (!eat(']'))
+            return fail(err, "expected ] for \"" + key.text + "\"");
+        }
+      } else if (!scalar(v)) {
+        return fail(err, "bad value for \"" + key.text + "\"");
+      }
+      out.emplace_back(key.text, std::move(v));
+    } while (eat(','));
+    if (!eat('}'))
+      return fail(err, "expected , or }");
+    return end(err);
+  }
+
+private:
+  void skip() {
+    while (i_ < s_.size() && (s_[i_] == ' ' || s_[i_] == '\t' ||
+                              s_[i_] == '\r' || s_[i_] == '\n'))
+      i_++;
+  }
+  bool eat(char c) {
+    skip();
+    if (i_ < s_.size() && s_[i_] == c) {
+      i_++;
+      return true;
+    }
+    return false;
+  }
+  bool end(std::string &err) {
+    skip();
+    return i_ == s_.size() || fail(err, "text after the object");
+  }
+  static bool fail(std::string &err, const std::string &msg) {
+    err = msg;
+    return false;
+  }
+  // A string, number, true, false or null
+  bool scalar(Value &v) {
+    skip();
+    if (i_ < s_.size() && s_[i_] == '"') {
+      v.string = true;
+      for (i_++; i_ < s_.size() && s_[i_] != '"'; i_++) {
+        if (s_[i_] != '\\') {
+          v.text += s_[i_];
+          continue;
+        }
+        if (++i_ == s_.size())
+          return false;
+        const char e = s_[i_];
+        if (e == 'u') { // \uXXXX, as UTF-8 (no surrogate pairs)
+          if (i_ + 4 >= s_.size())
+            return false;
+          const unsigned c =
+              (unsigned)std::strtoul(s_.substr(i_ + 1, 4).c_str(), nullptr,
+                                     16);
+          i_ += 4;
+          if (c < 0x80) {
+            v.text += (char)c;
+          } else if (c < 0x800) {
+            v.text += (char)(0xc0 | c >> 6);
+            v.text += (char)(0x80 | (c & 0x3f));
+          } else {
+            v.text += (char)(0xe0 | c >> 12);
+            v.text += (char)(0x80 | (c >> 6 & 0x3f));
+            v.text += (char)(0x80 | (c & 0x3f));
+          }
+          continue;
+        }
+        static const std::string from = "\"\\/bfnrt", to = "\"\\/\b\f\n\r\t";
+        const size_t k = from.find(e);
+        if (k == std::string::npos)
+          return false;
+        v.text += to[k];
+      }
+      return i_++ < s_.size();
+    }
+    const size_t j = i_;
+    while (i_ < s_.size() && (std::isalnum((unsigned char)s_[i_]) ||
+                              s_[i_] == '-' || s_[i_] == '+' ||
+                              s_[i_] == '.'))
+      i_++;
+    v.text = s_.substr(j, i_ - j);
+    return !v.text.empty();
+  }
+
+  const std::string &s_;
+  size_t i_ = 0;
+};
+
+bool number(const Value &v, double &d) {
+  char *end = nullptr;
+  d = std::strtod(v.text.c_str(), &end);
+  return !v.string && !v.array && !v.text.empty() && *end == '\0' &&
+         std::isfinite(d);
+}
+
+bool integer(const Value &v, int &n) {
+  double d = 0.0;
+  if (!number(v, d) || d != std::floor(d) || std::abs(d) > 1e9)
+    return false;
+  n = (int)d;
+  return true;
+}
+
+bool boolean(const Value &v, bool &b) {
+  b = v.text == "true";
+  return !v.string && !v.array && (b || v.text == "false");
+}
+
+// One job in flight: computed into, then encoded from
+struct Slot {
+  int line = 0;
+  BatchJob job;
+  std::shared_ptr<const PolyEntry> poly;
+  BasinResult res;
+  ImageRGBA img;
+  RenderStats st;
+  double setup = 0.0;
+};
+
+} // namespace
+
+bool parse_batch_job(const std::string &line, BatchJob &job,
+                     std::string &err) {
+  std::vector<std::pair<std::string, Value>> kv;
+  if (!LineParser(line).object(kv, err))
+    return false;
+  bool bounds = false, center = false;
+  for (const auto &[k, v] : kv) {
+    bool ok = true;
+    if (k == "poly") {
+      ok = v.string;
+      job.poly = v.text;
+    } else if (k == "size") {
+      const size_t x = v.text.find('x');
+      ok = v.string && x != std::string::npos;
+      if (ok) {
+        job.view.W = std::atoi(v.text.substr(0, x).c_str());
+        job.view.H = std::atoi(v.text.substr(x + 1).c_str());
+        ok = job.view.W > 0 && job.view.H > 0;
+      }
+    } else if (k == "max-iters") {
+      ok = integer(v, job.np.max_iters) && job.np.max_iters >= 1 &&
+           job.np.max_iters <= kMaxResultIters;
+    } else if (k == "tol") {
+      ok = number(v, job.np.tol) && job.np.tol > 0.0;
+    } else if (k == "damping") {
+      ok = number(v, job.np.damping) && job.np.damping > 0.0;
+    } else if (k == "cycle-tol") {
+      ok = number(v, job.np.cycle_tol) && job.np.cycle_tol >= 0.0;
+    } else if (k == "traps") {
+      ok = boolean(v, job.np.root_traps);
+    } else if (k == "method") {
+      ok = v.string && parse_method(v.text, job.np.method);
+    } else if (k == "bounds") {
+      double b[4];
+      ok = v.array && v.items.size() == 4;
+      for (size_t i = 0; ok && i < 4; i++)
+        ok = number(v.items[i], b[i]);
+      ok = ok && b[1] > b[0] && b[3] > b[2];
+      if (ok) {
+        const int W = job.view.W, H = job.view.H;
+        job.view = Viewport{};
+        job.view.W = W;
+        job.view.H = H;
+        job.view.xmin = b[0];
+        job.view.xmax = b[1];
+        job.view.ymin = b[2];
+        job.view.ymax = b[3];
+        bounds = true;
+      }
+    } else if (k == "center") {
+      ok = v.array && v.items.size() == 2 && !v.items[0].array &&
+           !v.items[1].array;
+      if (ok) {
+        job.center_re = v.items[0].text;
+        job.center_im = v.items[1].text;
+        center = true;
+      }
+    } else if (k == "width") {
+      ok = number(v, job.width) && job.width > 0.0;
+    } else if (k == "precision") {
+      ok = v.text == "double" || v.text == "mixed";
+      job.np.mixed_precision = v.text == "mixed";
+    } else if (k == "adaptive") {
+      ok = boolean(v, job.ro.adaptive);
+    } else if (k == "adaptive-band") {
+      ok = integer(v, job.ro.band);
+    } else if (k == "aa") {
+      ok = integer(v, job.ro.aa) && job.ro.aa >= 1 && job.ro.aa <= kMaxAA;
+    } else if (k == "symmetry") {
+      ok = boolean(v, job.ro.symmetry);
+    } else if (k == "colormap") {
+      ok = v.string && parse_colormap(v.text, job.colormap);
+    } else if (k == "out") {
+      ok = v.string && !v.text.empty();
+      job.out = v.text;
+    } else if (k == "png-level") {
+      ok = integer(v, job.png_level) && job.png_level >= 0 &&
+           job.png_level <= 9;
+    } else {
+      err = "unknown key \"" + k + "\"";
+      return false;
+    }
+    if (!ok) {
+      err = "bad value for \"" + k + "\"";
+      return false;
+    }
+  }
+  // Bounds in the line beat a center from the command line
+  if (bounds && !center) {
+    job.center_re.clear();
+    job.center_im.clear();
+    job.width = 0.0;
+  }
+  if (!job.center_re.empty() || job.width > 0.0) {
+    if (job.center_re.empty() || !(job.width > 0.0)) {
+      err = "center and width go together";
+      return false;
+    }
+    try {
+      job.view.set_center(parse_dd(job.center_re), parse_dd(job.center_im),
+                          job.width);
+    } catch (const std::exception &e) {
+      err = e.what();
+      return false;
+    }
+  }
+  return true;
+}
+
+BatchStats run_batch(const std::string &manifest, const BatchJob &defaults,
+                     const KernelVariant *kernel,
+                     const std::string &summary_path) {
+  Timer wall;
+  BatchStats bs;
+  std::ifstream in(manifest);
+  if (!in) {
+    bs.error = "cannot open " + manifest;
+    return bs;
+  }
+  std::FILE *sum = std::fopen(summary_path.c_str(), "w");
+  if (!sum) {
+    bs.error = "cannot write " + summary_path;
+    return bs;
+  }
+  std::fprintf(sum, "line\tout\tpoly\tsize\tmethod\tstatus\tsetup_s\t"
+                    "compute_s\tencode_s\tmean_iters\tp99_iters\tpng_bytes\n");
+  auto row = [&](const Slot &s, const std::string &status, double encode,
+                 unsigned long long bytes) {
+    std::fprintf(sum, "%d\t%s\t%s\t%dx%d\t%s\t%s\t%.6f\t%.6f\t%.6f\t%.3f\t"
+                      "%d\t%llu\n",
+                 s.line, s.job.out.c_str(), s.job.poly.c_str(), s.job.view.W,
+                 s.job.view.H, method_name(s.job.np.method), status.c_str(),
+                 s.setup, s.st.seconds, encode, s.st.mean_iters,
+                 s.st.p99_iters, bytes);
+    ++bs.jobs;
+    if (status != "ok") {
+      ++bs.failed;
+      std::fprintf(stderr, "%s:%d: %s\n", manifest.c_str(), s.line,
+                   status.c_str());
+    }
+  };
+
+  auto encode = [&](Slot &s) {
+    Timer te;
+    const std::string out_b = s.job.out + "_basins.png";
+    const std::string out_i = s.job.out + "_iters.png";
+    std::error_code ec;
+    const auto dir = std::filesystem::path(s.job.out).parent_path();
+    if (!dir.empty())
+      std::filesystem::create_directories(dir, ec);
+    PngOptions po;
+    po.level = s.job.png_level;
+    colorize_basins(s.res, s.poly->colors, s.img);
+    bool saved = write_png(out_b, s.img, po);
+    colorize_iterations(s.res, s.st.max_k, s.img, s.job.colormap);
+    saved = write_png(out_i, s.img, po) && saved;
+    const double e = te.seconds();
+    bs.encode_seconds += e;
+    const auto bytes = std::filesystem::file_size(out_b, ec) +
+                       std::filesystem::file_size(out_i, ec);
+    row(s, saved ? "ok" : "could not write " + out_b + " / " + out_i, e,
+        saved ? bytes : 0);
+  };
+
+  EncodePipeline<Slot> encoder(encode);
+
+  PolyCache polys;
+  std::array<Slot, 2> slots;
+  int k = 0, line_no = 0;
+  for (std::string line; std::getline(in, line);) {
+    ++line_no;
+    const size_t first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#')
+      continue;
+    Slot &s = slots[(size_t)(k & 1)];
+    // The other slot may still be encoding
+    s.line = line_no;
+    s.job = defaults;
+    s.st = RenderStats{};
+    s.setup = 0.0;
+    std::string err;
+    Timer ts;
+    bool ok = parse_batch_job(line, s.job, err);
+    if (ok && s.job.np.mixed_precision && !kernel) {
+      err = "precision mixed needs the ENABLE_SIMD kernels";
+      ok = false;
+    }
+    if (ok) {
+      s.poly = polys.get(s.job.poly, err);
+      ok = s.poly != nullptr;
+    }
+    s.setup = ts.seconds();
+    bs.setup_seconds += s.setup;
+    if (ok) {
+      try {
+        s.st = render_basins(*s.poly->poly, s.poly->roots, s.job.np,
+                             s.job.view, kernel, s.res, s.job.ro);
+      } catch (const std::exception &ex) {
+        err = ex.what();
+        ok = false;
+      }
+      bs.compute_seconds += s.st.seconds;
+    }
+    encoder.finish(); // job k - 1 is written before job k's row
+    if (!ok) {
+      row(s, err, 0.0, 0);
+      continue;
+    }
+    bs.pixels += (long long)s.job.view.W * s.job.view.H;
+    encoder.push(s);
+    ++k;
+  }
+  encoder.close();
+  bs.ok = std::fclose(sum) == 0;
+  if (!bs.ok)
+    bs.error = "could not write " + summary_path;
+  bs.seconds = wall.seconds();
+  return bs;
+}
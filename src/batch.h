@@ -0,0 +1,58 @@
+#pragma once
+// Batch mode (--batch jobs.jsonl): many renders in one process. Each line
+// of the manifest is a JSON object describing one render, keyed by the
+// command-line flags without their dashes; flags it leaves out keep the
+// values given on the command line:
+//
+//   {"poly": "z5-1", "size": "256x256", "bounds": [-2, 2, -2, 2],
+//    "max-iters": 300, "method": "halley", "out": "thumbs/z5_halley"}
+//
+// Keys: poly, size, max-iters, tol, damping, cycle-tol, traps, method,
+// bounds, center (two numbers or strings, read to ~32 digits) with width,
+// precision, adaptive, adaptive-band, aa, symmetry, colormap, out,
+// png-level. Blank lines and lines starting with # are skipped.
+//
+// Jobs run in order through one scheduler: the OpenMP team stays up,
+// polynomials are built once per id, and two result / image slots are
+// reused from job to job. Job k + 1 is computed while job k is colorized,
+// compressed and written on another thread, as --strip-rows does with
+// strips. A job that fails (bad line, unwritable output) is reported and
+// the rest still run.
+#include "render.h"
+#include <string>
+
+struct BatchJob {
+  std::string poly = "z3-1";
+  Viewport view; // size and bounds; a center, if set, replaces the bounds
+  std::string center_re, center_im;
+  double width = 0.0;
+  NewtonParams np;
+  RenderOptions ro;
+  IterColormap colormap = IterColormap::Turbo;
+  int png_level = 6;
+  std::string out = "run/out"; // writes out_basins.png and out_iters.png
+};
+
+// Applies one manifest line to job (the defaults going in); false with err
+// set when the line is not a JSON object of known keys with valid values.
+bool parse_batch_job(const std::string &line, BatchJob &job,
+                     std::string &err);
+
+struct BatchStats {
+  int jobs = 0, failed = 0;
+  long long pixels = 0;
+  // Sums over jobs; compute and encode overlap, so together they exceed
+  // the wall time by what the pipeline saved
+  double setup_seconds = 0.0, compute_seconds = 0.0, encode_seconds = 0.0;
+  double seconds = 0.0; // wall
+  bool ok = false;      // the manifest and summary could be opened
+  std::string error;
+};
+
+// Runs every job of the manifest over defaults. One tab-separated row per
+// job goes to summary_path (with a header line): line, out, poly, size,
+// method, status, setup / compute / encode seconds, mean and p99
+// iterations, and the PNG bytes.
+BatchStats run_batch(const std::string &manifest, const BatchJob &defaults,
+                     const KernelVariant *kernel,
+                     const std::string &summary_path);
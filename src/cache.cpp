@@ -0,0 +1,380 @@
+#include "cache.h"
+#include "timing.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char kTileMagic[8] = {'N', 'F', 'T', 'I', 'L', 'E', '\r', '\n'};
+constexpr uint32_t kTileFormat = 2; // 2: --aa jitter by global pixel
+
+struct TileHeader {
+  char magic[8];
+  uint32_t format, key_bytes;
+  int32_t w, h, aa, reserved;
+  uint64_t aa_count;
+};
+
+// One tile's planes, kCacheTile square; aa_pixel indexes the tile.
+struct TileData {
+  std::vector<uint8_t> label;
+  std::vector<uint16_t> iters;
+  std::vector<uint32_t> aa_pixel;
+  std::vector<uint8_t> aa_label;
+};
+
+// The grid a view is cut from (see cache.h): global pixel (gx, gy) samples
+// origin + (gx + 0.5, gy + 0.5) * (dx, dy); view pixel (0, 0) is global
+// (gx0, gy0).
+struct Grid {
+  dd ox, oy;
+  double dx = 0.0, dy = 0.0;
+  bool canonical = false;
+  long long gx0 = 0, gy0 = 0;
+};
+
+Grid grid_of(const Viewport &v) {
+  Grid g;
+  g.dx = v.dx();
+  g.dy = v.dy();
+  g.canonical = grid_origin(v, g.gx0, g.gy0);
+  if (!g.canonical) {
+    g.ox = dd(v.xmin, v.xmin_lo);
+    g.oy = dd(v.ymin, v.ymin_lo);
+  }
+  return g;
+}
+
+long long floor_div(long long a, long long b) {
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// View of tile (tx, ty): kCacheTile pixels square.
+Viewport tile_view(const Grid &g, long long tx, long long ty) {
+  const int n = kCacheTile;
+  const dd x0 = g.ox + dd(double(tx * kCacheTile) * g.dx);
+  const dd y0 = g.oy + dd(double(ty * kCacheTile) * g.dy);
+  Viewport t;
+  t.W = t.H = n;
+  t.xmin = x0.hi;
+  t.xmin_lo = x0.lo;
+  t.ymin = y0.hi;
+  t.ymin_lo = y0.lo;
+  t.span_x = n * g.dx;
+  t.span_y = n * g.dy;
+  t.xmax = t.xmin + t.span_x;
+  t.ymax = t.ymin + t.span_y;
+  return t;
+}
+
+std::string hexf(double d) {
+  char b[40];
+  std::snprintf(b, sizeof b, "%a", d);
+  return b;
+}
+
+std::string tile_key(const Poly &poly,
+                     const std::vector<std::complex<double>> &roots,
+                     const NewtonParams &np, const Grid &g,
+                     const KernelVariant *kernel, const RenderOptions &opt,
+                     long long tx, long long ty) {
+  std::string k = "newton-tile " + std::to_string(kTileFormat) + "\n";
+  k += std::string("kernel ") + (kernel ? kernel->name : "scalar-loop") +
+       " " + std::to_string(kKernelVersion) + "\n";
+  k += std::string("poly ") + poly.id() + "\ncoeffs";
+  auto point = [&](std::complex<double> z) {
+    k.append(" ").append(hexf(z.real())).append(",").append(hexf(z.imag()));
+  };
+  for (const auto &c : poly.coeffs())
+    point(c);
+  k += "\nroots";
+  for (const auto &r : roots)
+    point(r);
+  char b[512];
+  std::snprintf(b, sizeof b,
+                "\nmethod %d max_iters %d tol %a damping %a cycle_tol %a "
+                "traps %d mixed %d\nadaptive %d band %d aa %d\n"
+                "grid %a %a %a %a %a %a\ntile %lld %lld %d\n",
+                (int)np.method, np.max_iters, np.tol, np.damping,
+                np.cycle_tol, np.root_traps, np.mixed_precision, opt.adaptive,
+                opt.adaptive ? opt.band : 0, std::max(opt.aa, 1), g.ox.hi,
+                g.ox.lo, g.oy.hi, g.oy.lo, g.dx, g.dy, tx, ty, kCacheTile);
+  return k + b;
+}
+
+// 128 bits of two differently seeded FNV-1a hashes, as 32 hex digits.
+std::string key_hash(const std::string &key) {
+  uint64_t a = 0xcbf29ce484222325ull, b = 0x6c62272e07bb0142ull;
+  for (unsigned char c : key) {
+    a = (a ^ c) * 0x100000001b3ull;
+    b = (b ^ c ^ 0x5a) * 0x100000001b3ull;
+  }
+  char s[40];
+  std::snprintf(s, sizeof s, "%016llx%016llx", (unsigned long long)a,
+                (unsigned long long)b);
+  return s;
+}
+
+std::string tile_path(const std::string &dir, const std::string &key) {
+  const std::string h = key_hash(key);
+  return dir + "/" + h.substr(0, 2) + "/" + h.substr(2) + ".nft";
+}
+
+bool load_tile(const std::string &path, const std::string &key, int aa,
+               TileData &t) {
+  std::FILE *f = std::fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+  const size_t n = (size_t)kCacheTile * kCacheTile, nn = (size_t)aa * aa;
+  TileHeader h{};
+  std::string k(key.size(), '\0');
+  bool ok = std::fread(&h, sizeof h, 1, f) == 1 &&
+            std::memcmp(h.magic, kTileMagic, sizeof kTileMagic) == 0 &&
+            h.format == kTileFormat && h.key_bytes == key.size() &&
+            h.w == kCacheTile && h.h == kCacheTile && h.aa == aa &&
+            h.aa_count <= n && (aa > 1 || h.aa_count == 0) &&
+            std::fread(k.data(), 1, k.size(), f) == k.size() && k == key;
+  if (ok) {
+    t.label.resize(n);
+    t.iters.resize(n);
+    t.aa_pixel.resize(h.aa_count);
+    t.aa_label.resize(h.aa_count * nn);
+    ok = std::fread(t.label.data(), 1, n, f) == n &&
+         std::fread(t.iters.data(), 2, n, f) == n &&
+         std::fread(t.aa_pixel.data(), 4, t.aa_pixel.size(), f) ==
+             t.aa_pixel.size() &&
+         std::fread(t.aa_label.data(), 1, t.aa_label.size(), f) ==
+             t.aa_label.size();
+    for (size_t j = 0; ok && j < t.aa_pixel.size(); j++)
+      ok = t.aa_pixel[j] < n;
+  }
+  std::fclose(f);
+  return ok;
+}
+
+// Writes to dir/tmp and renames into place; returns the bytes written or 0.
+uint64_t store_tile(const std::string &dir, const std::string &path,
+                    const std::string &key, int aa, const TileData &t) {
+  static thread_local std::mt19937_64 rng{std::random_device{}()};
+  char name[40];
+  std::snprintf(name, sizeof name, "%016llx.tmp",
+                (unsigned long long)rng());
+  const std::string tmp = dir + "/tmp/" + name;
+  std::FILE *f = std::fopen(tmp.c_str(), "wb");
+  if (!f)
+    return 0;
+  TileHeader h{};
+  std::memcpy(h.magic, kTileMagic, sizeof h.magic);
+  h.format = kTileFormat;
+  h.key_bytes = (uint32_t)key.size();
+  h.w = h.h = kCacheTile;
+  h.aa = aa;
+  h.aa_count = t.aa_pixel.size();
+  const size_t n = t.label.size();
+  bool ok = std::fwrite(&h, sizeof h, 1, f) == 1 &&
+            std::fwrite(key.data(), 1, key.size(), f) == key.size() &&
+            std::fwrite(t.label.data(), 1, n, f) == n &&
+            std::fwrite(t.iters.data(), 2, n, f) == n &&
+            std::fwrite(t.aa_pixel.data(), 4, t.aa_pixel.size(), f) ==
+                t.aa_pixel.size() &&
+            std::fwrite(t.aa_label.data(), 1, t.aa_label.size(), f) ==
+                t.aa_label.size();
+  ok = std::fclose(f) == 0 && ok;
+  std::error_code ec;
+  if (ok) {
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    fs::rename(tmp, path, ec); // atomic: readers never see half a tile
+  }
+  if (!ok || ec) {
+    fs::remove(tmp, ec);
+    return 0;
+  }
+  return sizeof h + key.size() + 3 * n + 4 * t.aa_pixel.size() +
+         t.aa_label.size();
+}
+
+} // namespace
+
+RenderStats render_cached(const Poly &poly,
+                          const std::vector<std::complex<double>> &roots,
+                          const NewtonParams &np, const Viewport &v,
+                          const KernelVariant *kernel, BasinResult &out,
+                          const RenderOptions &opt, const CacheOptions &co,
+                          CacheStats &cs) {
+  Timer wall;
+  if (roots.size() > (size_t)kMaxLabelRoots)
+    throw std::runtime_error("cached tiles hold at most " +
+                             std::to_string(kMaxLabelRoots) + " roots");
+  cs = CacheStats{};
+  const Grid g = grid_of(v);
+  if (g.canonical) {
+    cs.shift_x = double(g.gx0) - v.xmin / g.dx;
+    cs.shift_y = double(g.gy0) - v.ymin / g.dy;
+  }
+  const int aa = std::max(opt.aa, 1);
+  const long long tx0 = floor_div(g.gx0, kCacheTile);
+  const long long ty0 = floor_div(g.gy0, kCacheTile);
+  const int ntx = (int)(floor_div(g.gx0 + v.W - 1, kCacheTile) - tx0 + 1);
+  const int nty = (int)(floor_div(g.gy0 + v.H - 1, kCacheTile) - ty0 + 1);
+  const int n = ntx * nty;
+  cs.tiles = n;
+  std::vector<TileData> td((size_t)n);
+  std::vector<std::string> keys((size_t)n), paths((size_t)n);
+  std::vector<char> hit((size_t)n, 0);
+  for (int i = 0; i < n; i++) {
+    keys[(size_t)i] = tile_key(poly, roots, np, g, kernel, opt,
+                               tx0 + i % ntx, ty0 + i / ntx);
+    paths[(size_t)i] = tile_path(co.dir, keys[(size_t)i]);
+  }
+  std::error_code ec;
+  fs::create_directories(co.dir + "/tmp", ec);
+
+  Timer t;
+  int hits = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+ : hits)
+  for (int i = 0; i < n; i++) {
+    hit[(size_t)i] = load_tile(paths[(size_t)i], keys[(size_t)i], aa,
+                               td[(size_t)i]);
+    if (hit[(size_t)i]) {
+      std::error_code e; // LRU: a hit is a use
+      fs::last_write_time(paths[(size_t)i],
+                          fs::file_time_type::clock::now(), e);
+      ++hits;
+    }
+  }
+  cs.hits = hits;
+  cs.read_seconds = t.seconds();
+
+  // Misses one at a time, each over the whole tile pool
+  t.reset();
+  RenderStats st;
+  BasinResult tr;
+  RenderOptions o = opt;
+  o.symmetry = false;
+  o.col0 = o.row0 = o.cols = o.rows = 0;
+  for (int i = 0; i < n; i++) {
+    if (hit[(size_t)i])
+      continue;
+    const long long tx = tx0 + i % ntx, ty = ty0 + i / ntx;
+    // Jitter keyed on global pixels, as a render of the view has it, and
+    // --aa edges read into the neighboring tiles
+    o.with_grid = true;
+    o.grid_x = tx * kCacheTile;
+    o.grid_y = ty * kCacheTile;
+    merge_stats(st, render_window(poly, roots, np, tile_view(g, tx, ty),
+                                  kernel, tr, o, true));
+    TileData &d = td[(size_t)i];
+    d.label = tr.label;
+    d.iters = tr.iters;
+    d.aa_pixel = tr.aa_pixel;
+    d.aa_label = tr.aa_label;
+  }
+  cs.compute_seconds = t.seconds();
+
+  t.reset();
+  unsigned long long written = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+ : written)
+  for (int i = 0; i < n; i++)
+    if (!hit[(size_t)i])
+      written += store_tile(co.dir, paths[(size_t)i], keys[(size_t)i], aa,
+                            td[(size_t)i]);
+  cs.bytes_written = written;
+  cs.write_seconds = t.seconds();
+
+  // The view, cut from its tiles
+  const size_t npix = (size_t)v.W * (size_t)v.H, nn = (size_t)aa * aa;
+  out.W = v.W;
+  out.H = v.H;
+  out.label.resize(npix);
+  out.iters.resize(npix);
+  out.aa = aa;
+  out.aa_pixel.clear();
+  out.aa_label.clear();
+  for (int i = 0; i < n; i++) {
+    const TileData &d = td[(size_t)i];
+    // The tile's corner in view pixels
+    const long long cx = (tx0 + i % ntx) * kCacheTile - g.gx0;
+    const long long cy = (ty0 + i / ntx) * kCacheTile - g.gy0;
+    const int x0 = (int)std::max(cx, 0LL);
+    const int x1 = (int)std::min(cx + kCacheTile, (long long)v.W);
+    const int y0 = (int)std::max(cy, 0LL);
+    const int y1 = (int)std::min(cy + kCacheTile, (long long)v.H);
+    for (int y = y0; y < y1; y++) {
+      const size_t src = (size_t)(y - cy) * kCacheTile + (size_t)(x0 - cx);
+      const size_t dst = (size_t)y * (size_t)v.W + (size_t)x0;
+      std::copy_n(&d.label[src], x1 - x0, &out.label[dst]);
+      std::copy_n(&d.iters[src], x1 - x0, &out.iters[dst]);
+    }
+    for (size_t j = 0; j < d.aa_pixel.size(); j++) {
+      const long long x = cx + d.aa_pixel[j] % kCacheTile;
+      const long long y = cy + d.aa_pixel[j] / kCacheTile;
+      if (x < x0 || x >= x1 || y < y0 || y >= y1)
+        continue;
+      out.aa_pixel.push_back((uint32_t)(y * v.W + x));
+      out.aa_label.insert(out.aa_label.end(),
+                          d.aa_label.begin() + (ptrdiff_t)(j * nn),
+                          d.aa_label.begin() + (ptrdiff_t)((j + 1) * nn));
+    }
+  }
+
+  // Pixel counts from the view itself: hits carry no stats, and computed
+  // tiles reach past its edges
+  st.hist.assign((size_t)np.max_iters + 1, 0);
+  st.cycle_pixels = st.no_root_pixels = 0;
+  for (size_t i = 0; i < npix; i++) {
+    ++st.hist[std::min<size_t>(out.iters[i], st.hist.size() - 1)];
+    st.cycle_pixels += out.label[i] == kLabelCycle;
+    st.no_root_pixels += out.label[i] == kLabelNoRoot;
+  }
+  st.aa_pixels = (long long)out.aa_pixel.size();
+  st.deep = v.needs_dd() && np.method == Method::Newton;
+  summarize_iterations(st);
+  cs.bytes_total = trim_cache(co.dir, co.max_bytes, &cs.evicted);
+  st.seconds = wall.seconds();
+  return st;
+}
+
+uint64_t trim_cache(const std::string &dir, uint64_t max_bytes,
+                    int *evicted) {
+  struct Entry {
+    fs::file_time_type used;
+    uint64_t bytes;
+    fs::path path;
+  };
+  std::vector<Entry> files;
+  uint64_t total = 0;
+  std::error_code ec;
+  for (auto it = fs::recursive_directory_iterator(dir, ec);
+       !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+    if (!it->is_regular_file(ec) || it->path().extension() != ".nft")
+      continue;
+    const uint64_t b = it->file_size(ec);
+    const auto used = it->last_write_time(ec);
+    if (ec) { // removed by another process meanwhile
+      ec.clear();
+      continue;
+    }
+    files.push_back({used, b, it->path()});
+    total += b;
+  }
+  if (total <= max_bytes)
+    return total;
+  std::sort(files.begin(), files.end(),
+            [](const Entry &a, const Entry &b) { return a.used < b.used; });
+  for (const Entry &e : files) {
+    if (total <= max_bytes)
+      break;
+    if (fs::remove(e.path, ec) && evicted)
+      ++*evicted;
+    total -= e.bytes;
+  }
+  return total;
+}
@@ -0,0 +1,61 @@
+#pragma once
+// Persistent tile cache. Views are cut from a canonical grid: at a given
+// pixel size (dx, dy), global pixel (gx, gy) samples the plane near
+// ((gx + 0.5) dx, (gy + 0.5) dy), and tile (tx, ty) holds global pixels
+// [tx * kCacheTile, (tx + 1) * kCacheTile) in x and likewise in y. A view is
+// snapped to the grid (by at most half a pixel), so any view at the same
+// scale, panned anywhere, shares tiles. Deep-zoom views, whose pixel
+// indices would not fit a double, use a grid anchored at their own corner.
+//
+// A tile's file is named by a hash of its key: the polynomial (id,
+// coefficients, roots), the grid, the tile coordinates, NewtonParams, the
+// render options and the kernel with kKernelVersion. The file repeats the
+// key, which is compared on load, so a hash collision is a miss and never
+// a wrong tile. Values are the label and iteration planes (and --aa
+// samples, jittered by global pixel as in a render of the whole view) of
+// the tile, 3 bytes per pixel.
+//
+// Files are written to a temporary name and renamed into place, so several
+// processes can share one directory: a reader sees a whole tile or none.
+// Hits refresh a file's mtime, and after each render the least recently
+// used tiles are removed until the directory is under max_bytes.
+#include "render.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+constexpr int kCacheTile = 256;
+
+struct CacheOptions {
+  std::string dir;
+  uint64_t max_bytes = 1024ull << 20;
+};
+
+struct CacheStats {
+  int tiles = 0, hits = 0;
+  double shift_x = 0.0, shift_y = 0.0; // grid snap, in pixels
+  double read_seconds = 0.0, compute_seconds = 0.0, write_seconds = 0.0;
+  uint64_t bytes_written = 0;
+  uint64_t bytes_total = 0; // in the cache after trimming
+  int evicted = 0;
+};
+
+// As render_basins, for v snapped to the cache grid, computing only the
+// tiles missing from co.dir and storing them there. Missing tiles are
+// rendered whole, with a one-pixel halo when opt.aa > 1 so that edge
+// detection sees their neighbors; symmetry is not used. Pixel counts in
+// the stats cover the view; iterated_pixels, redone_pixels, aa_samples and
+// the pool counters cover the tiles computed. seconds is the whole call.
+// Tiles hold 8-bit labels: throws std::runtime_error for more than
+// kMaxLabelRoots roots.
+RenderStats render_cached(const Poly &poly,
+                          const std::vector<std::complex<double>> &roots,
+                          const NewtonParams &np, const Viewport &v,
+                          const KernelVariant *kernel, BasinResult &out,
+                          const RenderOptions &opt, const CacheOptions &co,
+                          CacheStats &cs);
+
+// Removes the least recently used tiles until the cache holds at most
+// max_bytes; returns the bytes left and adds the removed files to *evicted.
+uint64_t trim_cache(const std::string &dir, uint64_t max_bytes,
+                    int *evicted = nullptr);
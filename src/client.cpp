@@ -0,0 +1,190 @@
+// newton_client: fetches from a tile server (newton_fractals --serve), or
+// load-tests it: C connections each send their share of N requests for
+// random tiles, one at a time with keep-alive, and the client reports
+// throughput, latency percentiles and the server's /stats.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "net.h"
+#include "timing.h"
+
+static void usage() {
+  std::puts("newton_client ADDR PATH        (GET PATH, e.g. /stats or\n"
+            "                                /tile/2/1/3.png?poly=z5-1)\n"
+            "  --out FILE          (write the body to FILE)\n"
+            "newton_client ADDR --bench N   (N random tile requests)\n"
+            "  --concurrency C     (connections; default 8)\n"
+            "  --zoom Z            (zoom levels 0..Z, each equally\n"
+            "                       likely; default 4)\n"
+            "  --query Q           (appended to every tile URL, e.g.\n"
+            "                       poly=z5-1&image=iters)\n"
+            "  --seed S            (default 1)\n"
+            "ADDR: unix:PATH, HOST:PORT or PORT");
+}
+
+// One request on an open connection; false when the connection failed.
+static bool get(int fd, const std::string &path, std::string &buf,
+                HttpMessage &reply) {
+  const std::string req =
+      "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  return send_all(fd, req.data(), req.size()) && read_http(fd, buf, reply);
+}
+
+static int status_of(const HttpMessage &m) {
+  const size_t sp = m.start.find(' ');
+  return sp == std::string::npos ? 0 : std::atoi(m.start.c_str() + sp + 1);
+}
+
+int main(int argc, char **argv) {
+  std::string addr, path, out, query;
+  long long bench = 0;
+  int concurrency = 8, zoom = 4;
+  unsigned seed = 1;
+  for (int i = 1; i < argc; i++) {
+    const std::string k = argv[i];
+    if (k == "--out" && i + 1 < argc)
+      out = argv[++i];
+    else if (k == "--bench" && i + 1 < argc)
+      bench = std::atoll(argv[++i]);
+    else if (k == "--concurrency" && i + 1 < argc)
+      concurrency = std::atoi(argv[++i]);
+    else if (k == "--zoom" && i + 1 < argc)
+      zoom = std::atoi(argv[++i]);
+    else if (k == "--query" && i + 1 < argc)
+      query = argv[++i];
+    else if (k == "--seed" && i + 1 < argc)
+      seed = (unsigned)std::atoi(argv[++i]);
+    else if (addr.empty() && k.rfind("--", 0) != 0)
+      addr = k;
+    else if (path.empty() && k.rfind("--", 0) != 0)
+      path = k;
+    else {
+      usage();
+      return 1;
+    }
+  }
+  if (addr.empty() || (path.empty() == (bench <= 0)) || concurrency < 1 ||
+      zoom < 0 || zoom > 30) {
+    usage();
+    return 1;
+  }
+
+  std::string err;
+  if (!path.empty()) {
+    const int fd = connect_to(addr, &err);
+    std::string buf;
+    HttpMessage m;
+    if (fd < 0 || !get(fd, path, buf, m)) {
+      std::fprintf(stderr, "%s\n", fd < 0 ? err.c_str() : "no reply");
+      return 1;
+    }
+    close_socket(fd);
+    std::fprintf(stderr, "%s (%zu bytes%s%s)\n", m.start.c_str(),
+                 m.body.size(), m.header("x-tile-source").empty() ? "" : ", ",
+                 m.header("x-tile-source").c_str());
+    if (out.empty()) {
+      std::fwrite(m.body.data(), 1, m.body.size(), stdout);
+    } else {
+      std::FILE *f = std::fopen(out.c_str(), "wb");
+      const bool ok = f && std::fwrite(m.body.data(), 1, m.body.size(),
+                                       f) == m.body.size();
+      if (!f || std::fclose(f) != 0 || !ok) {
+        std::fprintf(stderr, "could not write %s\n", out.c_str());
+        return 1;
+      }
+    }
+    return status_of(m) == 200 ? 0 : 1;
+  }
+
+  // Load test
+  std::mutex mu;
+  std::vector<double> ms;
+  long long hits = 0, coalesced = 0, rendered = 0, failed = 0;
+  long long bytes = 0;
+  Timer wall;
+  std::vector<std::thread> threads;
+  for (int c = 0; c < concurrency; c++)
+    threads.emplace_back([&, c] {
+      const long long n =
+          bench * (c + 1) / concurrency - bench * c / concurrency;
+      std::mt19937_64 rng(seed * 7919u + (unsigned)c);
+      std::string buf, e;
+      HttpMessage m;
+      std::vector<double> mine;
+      long long h = 0, co = 0, r = 0, f = 0, b = 0;
+      int fd = connect_to(addr, &e);
+      for (long long i = 0; i < n; i++) {
+        const int z = (int)(rng() % (uint64_t)(zoom + 1));
+        const uint64_t side = 1ull << z;
+        char p[96];
+        std::snprintf(p, sizeof p, "/tile/%d/%llu/%llu.png", z,
+                      (unsigned long long)(rng() % side),
+                      (unsigned long long)(rng() % side));
+        const std::string url = query.empty() ? p : p + ("?" + query);
+        Timer t;
+        if (fd < 0 || !get(fd, url, buf, m)) { // reconnect once
+          if (fd >= 0)
+            close_socket(fd);
+          buf.clear();
+          fd = connect_to(addr, &e);
+          if (fd < 0 || !get(fd, url, buf, m)) {
+            ++f;
+            continue;
+          }
+        }
+        mine.push_back(1e3 * t.seconds());
+        const std::string src = m.header("x-tile-source");
+        h += src == "hit";
+        co += src == "coalesced";
+        r += src == "rendered";
+        f += status_of(m) != 200;
+        b += (long long)m.body.size();
+      }
+      if (fd >= 0)
+        close_socket(fd);
+      std::lock_guard<std::mutex> lk(mu);
+      ms.insert(ms.end(), mine.begin(), mine.end());
+      hits += h;
+      coalesced += co;
+      rendered += r;
+      failed += f;
+      bytes += b;
+      if (fd < 0 && !e.empty())
+        err = e;
+    });
+  for (auto &t : threads)
+    t.join();
+  const double secs = wall.seconds();
+  if (ms.empty()) {
+    std::fprintf(stderr, "no replies%s%s\n", err.empty() ? "" : ": ",
+                 err.c_str());
+    return 1;
+  }
+  std::sort(ms.begin(), ms.end());
+  auto pct = [&](double p) {
+    return ms[std::min(ms.size() - 1, (size_t)(p * (double)ms.size()))];
+  };
+  std::printf("%zu replies in %.3f seconds (%.1f/s, %.1f MiB) over %d "
+              "connections, zoom 0..%d\n",
+              ms.size(), secs, (double)ms.size() / secs,
+              (double)bytes / (1024.0 * 1024.0), concurrency, zoom);
+  std::printf("Latency p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+              pct(0.50), pct(0.90), pct(0.99), ms.back());
+  std::printf("Sources: %lld hit, %lld coalesced, %lld rendered; %lld "
+              "failed\n",
+              hits, coalesced, rendered, failed);
+  const int fd = connect_to(addr, &err);
+  std::string buf;
+  HttpMessage m;
+  if (fd >= 0 && get(fd, "/stats", buf, m))
+    std::printf("Server: %s", m.body.c_str()); // ends in a newline
+  if (fd >= 0)
+    close_socket(fd);
+  return failed == 0 ? 0 : 1;
+}
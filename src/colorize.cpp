@@ -0,0 +1,102 @@
+// newton_colorize: turns a raw result file (--format raw) into the basin and
+// iteration PNGs that newton_fractals would have written, without iterating
+// anything. The planes are read in place from the mapped file.
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+#include "image.h"
+#include "raw.h"
+#include "render.h"
+#include "timing.h"
+
+static void usage() {
+  std::puts("newton_colorize FILE.nfr\n"
+            "  --out PREFIX        (default: FILE without .nfr)\n"
+            "  --colormap C        (iteration image: turbo | hsv;\n"
+            "                       default turbo)\n"
+            "  --png-level L       (deflate effort 0-9; default 6)\n"
+            "  --info              (print the header only)");
+}
+
+int main(int argc, char **argv) {
+  std::string in, prefix, colormap = "turbo";
+  int png_level = 6;
+  bool info_only = false;
+  for (int i = 1; i < argc; i++) {
+    const std::string k = argv[i];
+    if (k == "--out" && i + 1 < argc)
+      prefix = argv[++i];
+    else if (k == "--colormap" && i + 1 < argc)
+      colormap = argv[++i];
+    else if (k == "--png-level" && i + 1 < argc)
+      png_level = std::atoi(argv[++i]);
+    else if (k == "--info")
+      info_only = true;
+    else if (in.empty() && k.rfind("--", 0) != 0)
+      in = k;
+    else {
+      usage();
+      return 1;
+    }
+  }
+  IterColormap cmap;
+  if (in.empty() || !parse_colormap(colormap, cmap) || png_level < 0 ||
+      png_level > 9) {
+    usage();
+    return 1;
+  }
+  if (prefix.empty())
+    prefix = std::filesystem::path(in).replace_extension().string();
+
+  Timer t;
+  RawFile f;
+  std::string err;
+  if (!f.open(in, &err)) {
+    std::fprintf(stderr, "%s\n", err.c_str());
+    return 1;
+  }
+  const RawInfo info = f.info();
+  const BasinView r = f.view();
+  std::printf("%s: %s, %dx%d, %s, max_iters=%d, tol %g, damping %g, "
+              "%zu roots, max count %d\n",
+              in.c_str(), info.poly.c_str(), r.W, r.H,
+              method_name(info.np.method), info.np.max_iters, info.np.tol,
+              info.np.damping, info.roots.size(), info.max_k);
+  std::printf("View [%.17g, %.17g] x [%.17g, %.17g]", info.view.xmin,
+              info.view.xmax, info.view.ymin, info.view.ymax);
+  if (r.aa > 1)
+    std::printf(", %zu pixels with %dx%d samples", r.aa_count, r.aa, r.aa);
+  std::printf("\nMapped in %.6f seconds\n", t.seconds());
+  if (info_only)
+    return 0;
+
+  // The palette main.cpp uses, from the stored roots
+  const auto colors = make_basin_palette((int)info.roots.size(),
+                                         BasinPalette::Pastel, &info.roots);
+  const std::string out_b = prefix + "_basins.png";
+  const std::string out_i = prefix + "_iters.png";
+  ImageRGBA img;
+  t.reset();
+  colorize_basins(r, colors, img);
+  double col = t.seconds();
+  t.reset();
+  bool saved = img.save_png(out_b, png_level);
+  double enc = t.seconds();
+  t.reset();
+  colorize_iterations(r, info.max_k, img, cmap);
+  col += t.seconds();
+  t.reset();
+  saved = img.save_png(out_i, png_level) && saved;
+  enc += t.seconds();
+  if (!saved) {
+    std::fprintf(stderr, "could not write %s / %s\n", out_b.c_str(),
+                 out_i.c_str());
+    return 1;
+  }
+  std::printf("Colorized in %.6f seconds, encoded PNGs in %.6f seconds\n",
+              col, enc);
+  std::printf("Wrote %s and %s\n", out_b.c_str(), out_i.c_str());
+  return 0;
+}
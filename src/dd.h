@@ -0,0 +1,92 @@
+#pragma once
+// Double-double numbers (hi + lo, about 32 significant digits) for deep-zoom
+// view coordinates. The deep-zoom iteration itself runs on SIMD lanes
+// (newton_block_dd in newton_simd.h).
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+struct dd {
+  double hi = 0.0, lo = 0.0;
+  dd() = default;
+  dd(double h) : hi(h) {}
+  dd(double h, double l) : hi(h), lo(l) {}
+};
+
+// a + b exactly, as hi + lo.
+inline dd two_sum(double a, double b) {
+  const double s = a + b, bb = s - a;
+  return {s, (a - (s - bb)) + (b - bb)};
+}
+// As two_sum, for |a| >= |b|.
+inline dd quick_two_sum(double a, double b) {
+  const double s = a + b;
+  return {s, b - (s - a)};
+}
+// a * b exactly, as hi + lo.
+inline dd two_prod(double a, double b) {
+  const double p = a * b;
+  return {p, std::fma(a, b, -p)};
+}
+
+inline dd operator+(dd a, dd b) {
+  const dd s = two_sum(a.hi, b.hi), t = two_sum(a.lo, b.lo);
+  const dd u = quick_two_sum(s.hi, s.lo + t.hi);
+  return quick_two_sum(u.hi, u.lo + t.lo);
+}
+inline dd operator-(dd a) { return {-a.hi, -a.lo}; }
+inline dd operator-(dd a, dd b) { return a + (-b); }
+inline dd operator*(dd a, dd b) {
+  const dd p = two_prod(a.hi, b.hi);
+  return quick_two_sum(p.hi, p.lo + (a.hi * b.lo + a.lo * b.hi));
+}
+inline dd operator/(dd a, dd b) {
+  const double q1 = a.hi / b.hi;
+  const dd r = a - b * dd(q1);
+  const double q2 = r.hi / b.hi;
+  const dd r2 = r - b * dd(q2);
+  return quick_two_sum(q1, q2) + dd(r2.hi / b.hi);
+}
+
+// Decimal string ("-0.7937005259840997373758528196", "1.5e-3") to dd, exact
+// to the last few bits. Throws std::runtime_error on malformed input.
+inline dd parse_dd(const std::string &s) {
+  size_t i = 0;
+  bool neg = false;
+  if (i < s.size() && (s[i] == '+' || s[i] == '-'))
+    neg = s[i++] == '-';
+  dd v;
+  int e10 = 0, digits = 0;
+  bool dot = false;
+  for (; i < s.size(); ++i) {
+    const char ch = s[i];
+    if (std::isdigit((unsigned char)ch)) {
+      v = v * dd(10.0) + dd(double(ch - '0'));
+      e10 -= dot;
+      ++digits;
+    } else if (ch == '.' && !dot) {
+      dot = true;
+    } else {
+      break;
+    }
+  }
+  if (digits == 0)
+    throw std::runtime_error("bad number: " + s);
+  if (i < s.size() && (s[i] == 'e' || s[i] == 'E')) {
+    size_t used = 0;
+    try {
+      e10 += std::stoi(s.substr(i + 1), &used);
+    } catch (const std::exception &) {
+      throw std::runtime_error("bad number: " + s);
+    }
+    i += 1 + used;
+  }
+  if (i != s.size())
+    throw std::runtime_error("bad number: " + s);
+  for (; e10 > 0; --e10)
+    v = v * dd(10.0);
+  for (; e10 < 0; ++e10)
+    v = v / dd(10.0);
+  return neg ? -v : v;
+}
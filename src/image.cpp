@@ -1,13 +1,11 @@
 #include "image.h"
+#include "png.h"
 #include <algorithm>
 #include <array>
 #include <numbers>
 #include <string>
 #include <vector>
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
-
 static inline uint8_t clamp8(int v) {
   return (uint8_t)std::min(255, std::max(0, v));
 }
@@ -16,11 +14,10 @@ RGBA make_rgba(int r, int g, int b, int a) {
   return RGBA{clamp8(r), clamp8(g), clamp8(b), clamp8(a)};
 }
 
-bool ImageRGBA::save_png(const std::string &path) const {
-  if (width <= 0 || height <= 0 || pixels.size() != (size_t)width * height)
-    return false;
-  return stbi_write_png(path.c_str(), width, height, 4, pixels.data(),
-                        width * 4) != 0;
+bool ImageRGBA::save_png(const std::string &path, int level) const {
+  PngOptions opt;
+  opt.level = level;
+  return write_png(path, *this, opt);
 }
 
 // Turbo colormap approximation (Google's Turbo)
@@ -87,6 +84,30 @@ static RGBA hsv(double h, double s, double v) {
   return RGBA{(uint8_t)(255 * r), (uint8_t)(255 * g), (uint8_t)(255 * b), 255};
 }
 
+const std::vector<RGBA> &colormap_lut(IterColormap cm) {
+  auto sample = [](auto f) {
+    std::vector<RGBA> t((size_t)kColormapLutSize);
+    for (int i = 0; i < kColormapLutSize; i++)
+      t[(size_t)i] = f(i / double(kColormapLutSize - 1));
+    return t;
+  };
+  static const std::vector<RGBA> turbo = sample(turbo_colormap);
+  // Blue through green to red; stops short of wrapping back to magenta
+  static const std::vector<RGBA> hue =
+      sample([](double x) { return hsv(240.0 * (1.0 - x), 0.9, 0.95); });
+  return cm == IterColormap::Hsv ? hue : turbo;
+}
+
+bool parse_colormap(const std::string &s, IterColormap &cm) {
+  if (s == "turbo")
+    cm = IterColormap::Turbo;
+  else if (s == "hsv")
+    cm = IterColormap::Hsv;
+  else
+    return false;
+  return true;
+}
+
 std::vector<RGBA>
 make_basin_palette(int N, BasinPalette pal,
                    const std::vector<std::complex<double>> *roots) {
@@ -22,7 +22,8 @@ struct ImageRGBA {
     ImageRGBA(int w,int h):width(w),height(h),pixels((size_t)w*h) {}
     RGBA& at(int x,int y){ return pixels[(size_t)y*width + x]; }
     const RGBA& at(int x,int y) const { return pixels[(size_t)y*width + x]; }
-    bool save_png(const std::string& path) const; // implemented in image.cpp
+    // Compressed, palette-indexed when there are few colors (png.h)
+    bool save_png(const std::string& path, int level = 6) const;
 };
 
 // Palettes implemented in image.cpp
@@ -31,4 +32,11 @@ std::vector<RGBA> make_basin_palette(int N, BasinPalette pal,
 
 RGBA make_rgba(int r,int g,int b,int a=255);
 RGBA turbo_colormap(double x);
+
+// Colormaps for iteration images, sampled once into kColormapLutSize entries
+// so coloring a pixel is a table lookup.
+enum class IterColormap { Turbo, Hsv };
+constexpr int kColormapLutSize = 4096;
+const std::vector<RGBA>& colormap_lut(IterColormap cm);
+bool parse_colormap(const std::string& s, IterColormap& cm);
 RGBA label_color(int label);
@@ -0,0 +1,145 @@
+#include "kernels.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+#define NF_DECLARE_KERNEL(ns)                                                  \
+  namespace simd::ns {                                                         \
+  void newton_row(const double *, const double *, int, const KernelPoly &,     \
+                  const NewtonParams &, int *, int *);                         \
+  int newton_row_mixed(const double *, const double *, int,                    \
+                       const KernelPoly &, const NewtonParams &, int *,        \
+                       int *);                                                 \
+  void newton_row_dd(const double *, const double *, const double *,           \
+                     const double *, int, const KernelPoly &,                  \
+                     const NewtonParams &, int *, int *);                      \
+  void newton_row_sweep(const double *, const double *, const double *,        \
+                        const double *, const int *, int, const KernelPoly &,  \
+                        const NewtonParams &, int *, int *);                   \
+  int lanes();                                                                 \
+  }
+
+NF_DECLARE_KERNEL(scalar)
+#ifdef NF_HAVE_ISA_sse2
+NF_DECLARE_KERNEL(sse2)
+#endif
+#ifdef NF_HAVE_ISA_avx2
+NF_DECLARE_KERNEL(avx2)
+#endif
+#ifdef NF_HAVE_ISA_avx512
+NF_DECLARE_KERNEL(avx512)
+#endif
+
+namespace {
+
+enum class Feature { SSE2, AVX2_FMA, AVX512F };
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+[[maybe_unused]] bool cpu_has(Feature f) {
+  int r[4];
+  __cpuid(r, 0);
+  const int max_leaf = r[0];
+  __cpuid(r, 1);
+  const bool sse2 = (r[3] >> 26) & 1, fma = (r[2] >> 12) & 1;
+  const bool osxsave = (r[2] >> 27) & 1, avx = (r[2] >> 28) & 1;
+  if (f == Feature::SSE2)
+    return sse2;
+  if (!osxsave || !avx || max_leaf < 7)
+    return false;
+  const unsigned long long xcr0 = _xgetbv(0);
+  __cpuidex(r, 7, 0);
+  if (f == Feature::AVX2_FMA)
+    return (xcr0 & 0x6) == 0x6 && fma && ((r[1] >> 5) & 1);
+  return (xcr0 & 0xe6) == 0xe6 && ((r[1] >> 16) & 1);
+}
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+[[maybe_unused]] bool cpu_has(Feature f) {
+  // libgcc/compiler-rt read CPUID and check XCR0 for OS register support
+  __builtin_cpu_init();
+  switch (f) {
+  case Feature::SSE2:
+    return __builtin_cpu_supports("sse2");
+  case Feature::AVX2_FMA:
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  case Feature::AVX512F:
+    return __builtin_cpu_supports("avx512f");
+  }
+  return false;
+}
+#else
+[[maybe_unused]] bool cpu_has(Feature) { return false; }
+#endif
+
+struct Entry {
+  KernelVariant v;
+  bool (*supported)();
+};
+
+const std::vector<Entry> &entries() {
+  static const std::vector<Entry> E = [] {
+    std::vector<Entry> e;
+    e.push_back({{"scalar", simd::scalar::lanes(), simd::scalar::newton_row,
+                  simd::scalar::newton_row_mixed,
+                  simd::scalar::newton_row_dd,
+                  simd::scalar::newton_row_sweep},
+                 [] { return true; }});
+#ifdef NF_HAVE_ISA_sse2
+    e.push_back({{"sse2", simd::sse2::lanes(), simd::sse2::newton_row,
+                  simd::sse2::newton_row_mixed,
+                  simd::sse2::newton_row_dd,
+                  simd::sse2::newton_row_sweep},
+                 [] { return cpu_has(Feature::SSE2); }});
+#endif
+#ifdef NF_HAVE_ISA_avx2
+    e.push_back({{"avx2", simd::avx2::lanes(), simd::avx2::newton_row,
+                  simd::avx2::newton_row_mixed,
+                  simd::avx2::newton_row_dd,
+                  simd::avx2::newton_row_sweep},
+                 [] { return cpu_has(Feature::AVX2_FMA); }});
+#endif
+#ifdef NF_HAVE_ISA_avx512
+    e.push_back({{"avx512", simd::avx512::lanes(), simd::avx512::newton_row,
+                  simd::avx512::newton_row_mixed,
+                  simd::avx512::newton_row_dd,
+                  simd::avx512::newton_row_sweep},
+                 [] { return cpu_has(Feature::AVX512F); }});
+#endif
+    return e;
+  }();
+  return E;
+}
+
+} // namespace
+
+const std::vector<KernelVariant> &kernel_variants() {
+  static const std::vector<KernelVariant> V = [] {
+    std::vector<KernelVariant> v;
+    for (const auto &e : entries())
+      v.push_back(e.v);
+    return v;
+  }();
+  return V;
+}
+
+bool kernel_supported(const KernelVariant &k) {
+  for (const auto &e : entries())
+    if (e.v.row == k.row)
+      return e.supported();
+  return false;
+}
+
+const KernelVariant *select_kernel(const std::string &isa) {
+  const auto &E = entries();
+  if (isa == "auto") {
+    for (auto it = E.rbegin(); it != E.rend(); ++it)
+      if (it->supported())
+        return &it->v;
+    return nullptr;
+  }
+  for (const auto &e : E)
+    if (isa == e.v.name)
+      return e.supported() ? &e.v : nullptr;
+  return nullptr;
+}
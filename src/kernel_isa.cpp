@@ -0,0 +1,36 @@
+// Compiled once per ISA level with NF_SIMD_NS naming the variant and matching
+// target flags (see NF_ISA_VARIANTS in CMakeLists.txt).
+#include "newton_simd.h"
+
+namespace simd {
+namespace NF_SIMD_NS {
+
+void newton_row(const double *zr, const double *zi, int n, const KernelPoly &c,
+                const NewtonParams &p, int *rid, int *iters) {
+  newton_row_block(zr, zi, n, c, p, rid, iters);
+}
+
+int newton_row_mixed(const double *zr, const double *zi, int n,
+                     const KernelPoly &c, const NewtonParams &p, int *rid,
+                     int *iters) {
+  return newton_row_mixed_block(zr, zi, n, c, p, rid, iters);
+}
+
+void newton_row_dd(const double *zr, const double *zr_lo, const double *zi,
+                   const double *zi_lo, int n, const KernelPoly &c,
+                   const NewtonParams &p, int *rid, int *iters) {
+  newton_row_dd_block(zr, zr_lo, zi, zi_lo, n, c, p, rid, iters);
+}
+
+void newton_row_sweep(const double *zr, const double *zi,
+                      const double *damping, const double *tol,
+                      const int *max_iters, int n, const KernelPoly &c,
+                      const NewtonParams &p, int *rid, int *iters) {
+  newton_row_sweep_block(zr, zi, damping, tol, max_iters, n, c, p, rid,
+                         iters);
+}
+
+int lanes() { return VecD::lanes; }
+
+} // namespace NF_SIMD_NS
+} // namespace simd
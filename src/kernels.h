@@ -0,0 +1,100 @@
+#pragma once
+// Runtime-dispatched row kernels. The batch Newton kernel (newton_simd.h) is
+// compiled for several ISA levels and the best one the CPU supports is picked
+// once at startup.
+#include "newton.h"
+#include "polynomials.h"
+#include <complex>
+#include <string>
+#include <vector>
+
+// Flat view of the polynomial data the row kernels read.
+struct KernelPoly {
+  const double *cre, *cim; // coefficients, highest degree first
+  int degree;
+  const double *rre, *rim; // roots, for labelling
+  int nroots;
+  // RootTraps::r2 per root, gate2 and steps; trap_steps < 0 disables
+  const double *rtrap2 = nullptr;
+  double trap_gate2 = 0.0;
+  int trap_steps = -1;
+};
+
+// Split real/imag copies of Poly::coeffs() and Poly::roots().
+struct PolyPlanes {
+  std::vector<double> cre, cim, rre, rim;
+  PolyPlanes() = default;
+  explicit PolyPlanes(const Poly &poly) {
+    for (const auto &c : poly.coeffs()) {
+      cre.push_back(c.real());
+      cim.push_back(c.imag());
+    }
+    for (const auto &r : poly.roots()) {
+      rre.push_back(r.real());
+      rim.push_back(r.imag());
+    }
+  }
+  KernelPoly view() const {
+    return {cre.data(), cim.data(), (int)cre.size() - 1,
+            rre.data(), rim.data(), (int)rre.size()};
+  }
+  // As view(), with the trap disks of t (built for these roots).
+  KernelPoly view(const RootTraps &t) const {
+    KernelPoly k = view();
+    if (t.steps >= 0 && t.r2.size() == rre.size()) {
+      k.rtrap2 = t.r2.data();
+      k.trap_gate2 = t.gate2;
+      k.trap_steps = t.steps;
+    }
+    return k;
+  }
+};
+
+// Iterates n starting points (zr[i], zi[i]), writing the nearest root id (or
+// -1) and the iteration count per point.
+using RowKernelFn = void (*)(const double *zr, const double *zi, int n,
+                             const KernelPoly &poly, const NewtonParams &p,
+                             int *rid, int *iters);
+
+// As RowKernelFn with a float32 first pass (--precision mixed); returns how
+// many points were recomputed in double.
+using RowMixedFn = int (*)(const double *zr, const double *zi, int n,
+                           const KernelPoly &poly, const NewtonParams &p,
+                           int *rid, int *iters);
+
+// Deep zoom: starting points are double-double (zr + zr_lo, zi + zi_lo) and
+// the iteration runs in double-double. Method::Newton only.
+using RowDeepFn = void (*)(const double *zr, const double *zr_lo,
+                           const double *zi, const double *zi_lo, int n,
+                           const KernelPoly &poly, const NewtonParams &p,
+                           int *rid, int *iters);
+
+// Parameter sweeps: point i iterates with damping[i], tol[i] and
+// max_iters[i] in place of p's, so the lanes of one block can carry several
+// variants of the same starting point.
+using RowSweepFn = void (*)(const double *zr, const double *zi,
+                            const double *damping, const double *tol,
+                            const int *max_iters, int n,
+                            const KernelPoly &poly, const NewtonParams &p,
+                            int *rid, int *iters);
+
+struct KernelVariant {
+  const char *name;
+  int lanes; // double lanes; the float pass of row_mixed has twice as many
+  RowKernelFn row;
+  RowMixedFn row_mixed;
+  RowDeepFn row_dd;
+  RowSweepFn row_sweep;
+};
+
+// Bumped whenever the iteration's results change (kernels, traps, cycle
+// check, labelling), so tiles cached by older builds are not reused.
+constexpr int kKernelVersion = 1;
+
+// Variants compiled into this binary, from the most portable to the widest.
+const std::vector<KernelVariant> &kernel_variants();
+bool kernel_supported(const KernelVariant &k);
+
+// "auto" picks the widest variant the CPU supports; otherwise the named one.
+// Returns nullptr if the name is unknown or the CPU lacks the ISA.
+const KernelVariant *select_kernel(const std::string &isa);
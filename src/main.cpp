@@ -1,14 +1,27 @@
+#include <algorithm>
 #include <cmath>
 #include <complex>
 #include <cstdio>
 #include <cstdlib>
+#include <filesystem>
+#include <memory>
 #include <optional>
 #include <string>
 #include <vector>
 
+#include "animate.h"
+#include "batch.h"
+#include "cache.h"
 #include "image.h"
+#include "kernels.h"
 #include "newton.h"
 #include "polynomials.h"
+#include "pyramid.h"
+#include "raw.h"
+#include "render.h"
+#include "server.h"
+#include "stream.h"
+#include "sweep.h"
 #include "timing.h"
 
 #if defined(HAVE_OPENMP) || defined(_OPENMP)
@@ -20,21 +33,135 @@ struct Args {
   int W = 1024, H = 768;
   int max_iters = 300;
   double tol = 1e-12, damping = 1.0;
+  double cycle_tol = 1e-9;
+  bool traps = true;
+  std::string precision = "double";
+  bool verify = false;
+  bool thread_stats = false;
+  bool adaptive = false;
+  bool symmetry = true;
+  int aa = 1;
+  std::string colormap = "turbo";
+  int adaptive_band = RenderOptions{}.band;
   double xmin = -2, xmax = 2, ymin = -1.5, ymax = 1.5;
+  std::string center_re, center_im; // --center, parsed as double-double
+  double width = 0.0;
   int threads = 0;
+  std::string isa = "auto";
+  std::string method = "newton";
   std::string out_prefix = "run/out";
+  int png_level = 6;
+  int strip_rows = 0;
+  std::string format = "png";
+  bool pyramid = false;
+  std::string pyramid_layout = "dzi";
+  int max_level = -1;
+  bool pyramid_flags = false; // --pyramid-layout or --max-level given
+  std::string cache_dir;
+  double cache_max_mb = 1024.0;
+  std::string serve; // address
+  int workers = 0;
+  double serve_cache_mb = 256.0;
+  std::string batch, batch_summary; // manifest, summary path
+  std::string animate;              // keyframe file
+  std::string anim_format = "y4m", anim_out = "-", anim_image = "basins";
+  int fps = 30;
+  bool anim_reuse = true;
+  std::string sweep, sweep_summary; // spec, summary path
+  bool sweep_images = false;
 };
 
 static void usage() {
   std::puts("newton_fractals\n"
-            "  --poly ID           (z3-1 | z5-1 | z3-2z+2)\n"
+            "  --poly ID           (z3-1 | z5-1 | z3-2z+2 |\n"
+            "                       tight-clusters-archipelagos |\n"
+            "                       mixed-radii-pentagon-stack |\n"
+            "                       coeffs:C0,C1,... | coeffs-file:PATH)\n"
             "  --size WxH          (default 1024x768)\n"
-            "  --max-iters N       (default 300)\n"
+            "  --max-iters N       (default 300, at most 65535)\n"
             "  --tol EPS           (default 1e-12)\n"
             "  --damping A         (default 1.0)\n"
+            "  --cycle-tol EPS     (attracting-cycle check, 0=off;\n"
+            "                       default 1e-9)\n"
+            "  --no-traps          (iterate every point to tol instead of\n"
+            "                       stopping in a root's attraction disk)\n"
+            "  --method M          (newton | halley | householder3 |\n"
+            "                       schroder | all; default newton)\n"
             "  --bounds xmin xmax ymin ymax\n"
+            "  --center RE IM      (with --width: view around a center given\n"
+            "  --width W            to ~32 digits; overrides --bounds)\n"
             "  --threads T         (0=auto)\n"
-            "  --out PREFIX        (default run/out)\n");
+            "  --thread-stats      (busy/idle time and tiles per thread)\n"
+            "  --isa NAME          (auto | scalar | sse2 | avx2 | avx512)\n"
+            "  --precision P       (double | mixed: float32 first pass,\n"
+            "                       double where it is unsure)\n"
+            "  --adaptive          (iterate rectangle borders, fill uniform\n"
+            "                       interiors: Mariani-Silver)\n"
+            "  --adaptive-band B   (iteration spread a filled border may\n"
+            "                       have; default 2)\n"
+            "  --aa N              (NxN jittered samples on basin\n"
+            "                       boundaries, N <= 16; default 1 = off)\n"
+            "  --no-symmetry       (iterate every pixel even when the\n"
+            "                       polynomial's symmetry could fill some)\n"
+            "  --colormap C        (iteration image: turbo | hsv;\n"
+            "                       default turbo)\n"
+            "  --verify            (also render every pixel in double and\n"
+            "                       report basin mismatches)\n"
+            "  --out PREFIX        (default run/out)\n"
+            "  --format F          (png | raw: PREFIX.nfr with the label\n"
+            "                       and iteration planes, for mmap and\n"
+            "                       newton_colorize; default png)\n"
+            "  --png-level L       (deflate effort 0-9, 0 = stored;\n"
+            "                       default 6)\n"
+            "  --strip-rows N      (render and write N rows at a time:\n"
+            "                       memory for a few strips, not the\n"
+            "                       image; iterations scaled by\n"
+            "                       --max-iters; default 0 = off)\n"
+            "  --pyramid           (256px tiles at every zoom level under\n"
+            "                       PREFIX_basins_files/ etc.; resumes\n"
+            "                       an interrupted run)\n"
+            "  --pyramid-layout L  (dzi | xyz; default dzi)\n"
+            "  --max-level N       (pyramid: render no finer than level\n"
+            "                       N, halving --size as needed)\n"
+            "  --cache DIR         (reuse 256px result tiles stored in DIR\n"
+            "                       by earlier runs at the same scale and\n"
+            "                       parameters; the view snaps to the\n"
+            "                       tile grid by < 1/2 pixel)\n"
+            "  --cache-max-mb M    (evict least recently used tiles above\n"
+            "                       M MiB; default 1024)\n"
+            "  --serve ADDR        (answer GET /tile/Z/X/Y.png and /stats\n"
+            "                       over HTTP on unix:PATH, HOST:PORT or\n"
+            "                       PORT until SIGINT; the options above\n"
+            "                       are the defaults, --bounds the world)\n"
+            "  --workers N         (serve: render threads; default one per\n"
+            "                       thread of --threads)\n"
+            "  --serve-cache-mb M  (serve: in-memory tile LRU; default\n"
+            "                       256)\n"
+            "  --batch FILE        (one render per JSON line, keys named\n"
+            "                       like these options; the options\n"
+            "                       given are the defaults)\n"
+            "  --batch-summary F   (per-job timings, tab-separated;\n"
+            "                       default FILE.summary.tsv)\n"
+            "  --animate KEYS      (stream the frames between keyframes\n"
+            "                       'FRAME RE IM WIDTH [max_iters=N\n"
+            "                       damping=A tol=E]' as raw video;\n"
+            "                       --size is the frame size)\n"
+            "  --anim-format F     (y4m | rgba; default y4m)\n"
+            "  --anim-out PATH     (file or named pipe; default - =\n"
+            "                       stdout, messages go to stderr)\n"
+            "  --anim-image I      (basins | iters; default basins)\n"
+            "  --fps N             (y4m frame rate; default 30)\n"
+            "  --no-anim-reuse     (render every frame whole, even on\n"
+            "                       integer-pixel pans)\n"
+            "  --sweep SPEC        (every combination of e.g.\n"
+            "                       damping=0.5:1.0:0.05,tol=1e-6,1e-9\n"
+            "                       (keys damping, tol, max_iters) in\n"
+            "                       one pass, without root traps)\n"
+            "  --sweep-summary F   (per-variant basin fractions and\n"
+            "                       iterations, tab-separated; default\n"
+            "                       PREFIX_sweep.tsv)\n"
+            "  --sweep-images      (also PREFIX_sweepNNN_basins.png and\n"
+            "                       _iters.png per variant)\n");
 }
 
 static bool parse_size(const std::string &s, int &W, int &H) {
@@ -71,15 +198,90 @@ int main(int argc, char **argv) {
       a.tol = std::atof(need(1));
     else if (k == "--damping")
       a.damping = std::atof(need(1));
+    else if (k == "--cycle-tol")
+      a.cycle_tol = std::atof(need(1));
+    else if (k == "--no-traps")
+      a.traps = false;
     else if (k == "--bounds") {
       a.xmin = std::atof(need(1));
       a.xmax = std::atof(need(1));
       a.ymin = std::atof(need(1));
       a.ymax = std::atof(need(1));
-    } else if (k == "--threads")
+    } else if (k == "--center") {
+      a.center_re = need(1);
+      a.center_im = need(1);
+    } else if (k == "--width")
+      a.width = std::atof(need(1));
+    else if (k == "--threads")
       a.threads = std::atoi(need(1));
+    else if (k == "--thread-stats")
+      a.thread_stats = true;
+    else if (k == "--method")
+      a.method = need(1);
+    else if (k == "--isa")
+      a.isa = need(1);
+    else if (k == "--precision")
+      a.precision = need(1);
+    else if (k == "--adaptive")
+      a.adaptive = true;
+    else if (k == "--adaptive-band")
+      a.adaptive_band = std::atoi(need(1));
+    else if (k == "--aa")
+      a.aa = std::atoi(need(1));
+    else if (k == "--colormap")
+      a.colormap = need(1);
+    else if (k == "--no-symmetry")
+      a.symmetry = false;
+    else if (k == "--verify")
+      a.verify = true;
     else if (k == "--out")
       a.out_prefix = need(1);
+    else if (k == "--format")
+      a.format = need(1);
+    else if (k == "--pyramid")
+      a.pyramid = true;
+    else if (k == "--pyramid-layout") {
+      a.pyramid_layout = need(1);
+      a.pyramid_flags = true;
+    } else if (k == "--max-level") {
+      a.max_level = std::atoi(need(1));
+      a.pyramid_flags = true;
+    } else if (k == "--cache")
+      a.cache_dir = need(1);
+    else if (k == "--cache-max-mb")
+      a.cache_max_mb = std::atof(need(1));
+    else if (k == "--serve")
+      a.serve = need(1);
+    else if (k == "--workers")
+      a.workers = std::atoi(need(1));
+    else if (k == "--serve-cache-mb")
+      a.serve_cache_mb = std::atof(need(1));
+    else if (k == "--batch")
+      a.batch = need(1);
+    else if (k == "--batch-summary")
+      a.batch_summary = need(1);
+    else if (k == "--animate")
+      a.animate = need(1);
+    else if (k == "--anim-format")
+      a.anim_format = need(1);
+    else if (k == "--anim-out")
+      a.anim_out = need(1);
+    else if (k == "--anim-image")
+      a.anim_image = need(1);
+    else if (k == "--fps")
+      a.fps = std::atoi(need(1));
+    else if (k == "--no-anim-reuse")
+      a.anim_reuse = false;
+    else if (k == "--sweep")
+      a.sweep = need(1);
+    else if (k == "--sweep-summary")
+      a.sweep_summary = need(1);
+    else if (k == "--sweep-images")
+      a.sweep_images = true;
+    else if (k == "--strip-rows")
+      a.strip_rows = std::atoi(need(1));
+    else if (k == "--png-level")
+      a.png_level = std::atoi(need(1));
     else {
       usage();
       return 1;
@@ -92,52 +294,633 @@ int main(int argc, char **argv) {
 #endif
   }
 
-  auto poly = make_poly(a.poly);
+  if (a.precision != "double" && a.precision != "mixed") {
+    usage();
+    return 1;
+  }
+  // --animate to stdout keeps stdout for the frames
+  std::FILE *msg = !a.animate.empty() && a.anim_out == "-" ? stderr : stdout;
+#ifdef USE_SIMD
+  const KernelVariant *kernel = select_kernel(a.isa);
+  if (!kernel) {
+    std::fprintf(stderr, "ISA '%s' is unknown or not supported by this CPU\n",
+                 a.isa.c_str());
+    return 1;
+  }
+  std::fprintf(msg, "Kernel: %s (%d lanes)\n", kernel->name,
+               kernel->lanes);
+#else
+  if (a.isa != "auto" && a.isa != "scalar") {
+    std::fprintf(stderr, "built without ENABLE_SIMD: only --isa scalar\n");
+    return 1;
+  }
+  std::fprintf(msg, "Kernel: scalar (USE_SIMD off)\n");
+  if (a.precision == "mixed") {
+    std::fprintf(stderr, "--precision mixed needs the ENABLE_SIMD kernels\n");
+    return 1;
+  }
+#endif
+
+  Timer setup;
+  std::unique_ptr<Poly> poly;
+  try {
+    poly = make_poly(a.poly);
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
   auto roots = poly->roots();
+  if (auto *pc = dynamic_cast<const PolyCoeffs *>(poly.get())) {
+    const auto &st = pc->root_stats();
+    std::fprintf(msg,
+                 "Roots of degree %d found in %.6f seconds (%d Aberth "
+                 "sweeps%s), setup %.6f seconds\n",
+                 pc->degree(), st.seconds, st.iterations,
+                 st.converged ? "" : ", NOT converged", setup.seconds());
+  }
 
-  ImageRGBA bas(a.W, a.H), iters(a.W, a.H);
-  const double dx = (a.xmax - a.xmin) / double(a.W),
-               dy = (a.ymax - a.ymin) / double(a.H);
+  Viewport view;
+  view.W = a.W;
+  view.H = a.H;
+  view.xmin = a.xmin;
+  view.xmax = a.xmax;
+  view.ymin = a.ymin;
+  view.ymax = a.ymax;
+  if (!a.center_re.empty() || a.width > 0.0) {
+    if (a.center_re.empty() || !(a.width > 0.0)) {
+      std::fprintf(stderr, "--center and --width go together\n");
+      return 1;
+    }
+    try {
+      view.set_center(parse_dd(a.center_re), parse_dd(a.center_im), a.width);
+    } catch (const std::exception &e) {
+      std::fprintf(stderr, "%s\n", e.what());
+      return 1;
+    }
+  }
 
   auto colors =
       make_basin_palette((int)roots.size(), BasinPalette::Pastel, &roots);
-  RGBA no_conv{0, 0, 0, 255};
 
   NewtonParams np;
   np.max_iters = a.max_iters;
   np.tol = a.tol;
   np.damping = a.damping;
+  np.cycle_tol = a.cycle_tol;
+  np.root_traps = a.traps;
+  np.mixed_precision = a.precision == "mixed";
+
+  std::vector<Method> methods;
+  if (a.method == "all") {
+    methods = {Method::Newton, Method::Halley, Method::Householder3,
+               Method::Schroder};
+  } else {
+    Method m;
+    if (!parse_method(a.method, m)) {
+      usage();
+      return 1;
+    }
+    methods = {m};
+  }
+
+  RenderOptions ro;
+  ro.adaptive = a.adaptive;
+  ro.band = a.adaptive_band;
+  ro.symmetry = a.symmetry;
+  ro.aa = a.aa;
+  if (a.aa < 1 || a.aa > kMaxAA) {
+    std::fprintf(stderr, "--aa must be 1..%d\n", kMaxAA);
+    return 1;
+  }
+
+  IterColormap cmap;
+  if (!parse_colormap(a.colormap, cmap)) {
+    usage();
+    return 1;
+  }
+  if (a.format != "png" && a.format != "raw") {
+    usage();
+    return 1;
+  }
+  if (a.pyramid_layout != "dzi" && a.pyramid_layout != "xyz") {
+    usage();
+    return 1;
+  }
+  if (a.pyramid && (a.strip_rows > 0 || a.verify || a.format == "raw")) {
+    std::fprintf(stderr, "--pyramid writes its own tiles; it does not go "
+                         "with --strip-rows, --verify or --format raw\n");
+    return 1;
+  }
+  if (a.pyramid_flags && !a.pyramid) {
+    std::fprintf(stderr, "--pyramid-layout and --max-level need --pyramid\n");
+    return 1;
+  }
+  if (!a.cache_dir.empty() && (a.strip_rows > 0 || a.pyramid || a.verify)) {
+    std::fprintf(stderr, "--cache does not go with --strip-rows, --pyramid "
+                         "or --verify\n");
+    return 1;
+  }
+  if (!(a.cache_max_mb >= 0.0)) {
+    std::fprintf(stderr, "--cache-max-mb must be >= 0\n");
+    return 1;
+  }
+  if (a.strip_rows > 0 && a.format == "raw") {
+    std::fprintf(stderr, "--format raw writes the whole result; drop "
+                         "--strip-rows\n");
+    return 1;
+  }
+  if (a.strip_rows < 0 || (a.strip_rows > 0 && a.verify)) {
+    std::fprintf(stderr, "--strip-rows must be >= 0, and --verify needs the "
+                         "whole image\n");
+    return 1;
+  }
+  if (a.png_level < 0 || a.png_level > 9) {
+    std::fprintf(stderr, "--png-level must be 0..9\n");
+    return 1;
+  }
+  if (a.max_iters < 1 || a.max_iters > kMaxResultIters) {
+    std::fprintf(stderr, "--max-iters must be 1..%d\n", kMaxResultIters);
+    return 1;
+  }
+  if (roots.size() > (size_t)kMaxWideRoots) {
+    std::fprintf(stderr, "at most %d roots can be labelled, got %zu\n",
+                 kMaxWideRoots, roots.size());
+    return 1;
+  }
+  // Their files and tallies hold 8-bit labels
+  if (roots.size() > (size_t)kMaxLabelRoots &&
+      (a.format == "raw" || !a.cache_dir.empty() || !a.sweep.empty())) {
+    std::fprintf(stderr, "--format raw, --cache and --sweep take at most %d "
+                         "roots, got %zu\n",
+                 kMaxLabelRoots, roots.size());
+    return 1;
+  }
+
+  if (!a.batch.empty()) {
+    if (a.strip_rows > 0 || a.pyramid || a.verify || a.format == "raw" ||
+        !a.cache_dir.empty() || !a.serve.empty() || !a.animate.empty() ||
+        !a.sweep.empty() || methods.size() > 1) {
+      std::fprintf(stderr, "--batch runs whole renders; it does not go "
+                           "with --strip-rows, --pyramid, --verify, "
+                           "--format raw, --cache, --serve, --animate, "
+                           "--sweep or --method all\n");
+      return 1;
+    }
+    BatchJob job;
+    job.poly = a.poly;
+    job.view = view;
+    job.center_re = a.center_re;
+    job.center_im = a.center_im;
+    job.width = a.width;
+    job.np = np;
+    job.np.method = methods[0];
+    job.ro = ro;
+    job.colormap = cmap;
+    job.png_level = a.png_level;
+    job.out = a.out_prefix;
+    const std::string summary =
+        !a.batch_summary.empty()
+            ? a.batch_summary
+            : std::filesystem::path(a.batch).replace_extension().string() +
+                  ".summary.tsv";
+#ifdef USE_SIMD
+    const BatchStats bs = run_batch(a.batch, job, kernel, summary);
+#else
+    const BatchStats bs = run_batch(a.batch, job, nullptr, summary);
+#endif
+    if (!bs.error.empty()) {
+      std::fprintf(stderr, "%s\n", bs.error.c_str());
+      return 1;
+    }
+    std::printf("Batch: %d jobs (%d failed), %.1f Mpixels in %.6f seconds "
+                "(%.1f jobs/s)\n",
+                bs.jobs, bs.failed, 1e-6 * double(bs.pixels), bs.seconds,
+                double(bs.jobs) / std::max(bs.seconds, 1e-9));
+    std::printf("Batch: setup %.6f s, compute %.6f s, encode %.6f s; "
+                "encoding overlapped compute for %.6f s\n",
+                bs.setup_seconds, bs.compute_seconds, bs.encode_seconds,
+                std::max(0.0, bs.setup_seconds + bs.compute_seconds +
+                                  bs.encode_seconds - bs.seconds));
+    std::printf("Peak RSS %.1f MiB\n",
+                double(peak_rss_bytes()) / (1024.0 * 1024.0));
+    std::printf("Wrote %s\n", summary.c_str());
+    return bs.failed == 0 ? 0 : 1;
+  }
 
-  Timer t;
-  int maxk = 1;
-#pragma omp parallel for schedule(static) reduction(max : maxk)
-  for (int y = 0; y < a.H; y++) {
-    for (int x = 0; x < a.W; x++) {
-      std::complex<double> z0(a.xmin + (x + 0.5) * dx, a.ymin + (y + 0.5) * dy);
-      auto [rid, k] = newton_iterate(z0, *poly, roots, np);
-      if (k > maxk)
-        maxk = k;
-      bas.at(x, y) = (rid >= 0) ? colors[rid] : no_conv;
-      unsigned char g = (unsigned char)(k < 255 ? k : 255);
-      iters.at(x, y) = RGBA{g, g, g, 255};
-    }
-  }
-  double secs = t.seconds();
-  std::printf("Computed in %.6f seconds for %dx%d, max_iters=%d\n", secs, a.W,
-              a.H, a.max_iters);
-
-  // map iterations to turbo
-  for (int y = 0; y < a.H; y++) {
-    for (int x = 0; x < a.W; x++) {
-      double v = iters.at(x, y).r / double(maxk);
-      iters.at(x, y) = turbo_colormap(v);
-    }
-  }
-
-  std::string out_b = a.out_prefix + "_basins.png";
-  std::string out_i = a.out_prefix + "_iters.png";
-  bas.save_png(out_b);
-  iters.save_png(out_i);
-  std::printf("Wrote %s and %s\n", out_b.c_str(), out_i.c_str());
+  if (!a.serve.empty()) {
+    if (a.strip_rows > 0 || a.pyramid || a.verify || a.format == "raw" ||
+        !a.cache_dir.empty() || !a.animate.empty() || !a.sweep.empty() ||
+        methods.size() > 1) {
+      std::fprintf(stderr, "--serve renders tiles on request; it does not "
+                           "go with --strip-rows, --pyramid, --verify, "
+                           "--format raw, --cache, --animate, --sweep or "
+                           "--method all\n");
+      return 1;
+    }
+    if (a.workers < 0 || !(a.serve_cache_mb >= 0.0)) {
+      std::fprintf(stderr, "--workers and --serve-cache-mb must be >= 0\n");
+      return 1;
+    }
+    ServeOptions so;
+    so.listen = a.serve;
+    so.workers = a.workers;
+    so.lru_bytes = (uint64_t)(a.serve_cache_mb * 1024.0 * 1024.0);
+    so.poly = a.poly;
+    so.np = np;
+    so.np.method = methods[0];
+    so.ro = ro;
+    so.colormap = cmap;
+    so.png.level = a.png_level;
+    so.world = view;
+#ifdef USE_SIMD
+    TileServer server(so, kernel);
+#else
+    TileServer server(so, nullptr);
+#endif
+    block_stop_signals(); // before any thread starts
+    std::string err;
+    if (!server.start(&err)) {
+      std::fprintf(stderr, "%s\n", err.c_str());
+      return 1;
+    }
+    const ServeStats s0 = server.stats();
+    std::printf("Serving %dpx tiles of %s on %s with %d worker%s; "
+                "Ctrl-C stops\n",
+                kServeTile, a.poly.c_str(), a.serve.c_str(), s0.workers,
+                s0.workers == 1 ? "" : "s");
+    std::fflush(stdout);
+    wait_stop_signal();
+    server.stop();
+    const ServeStats s = server.stats();
+    std::printf("Served %lld tile requests in %.1f seconds: %lld hits, "
+                "%lld coalesced, %lld rendered (%.3f ms each), %lld "
+                "errors, %lld refused\n",
+                s.requests, s.seconds, s.hits, s.coalesced, s.rendered,
+                s.render_ms, s.errors, s.refused);
+    std::printf("Latency p50 %.3f ms, p99 %.3f ms, max %.3f ms; queue "
+                "depth max %d; LRU %lld tiles, %.1f MiB\n",
+                s.p50_ms, s.p99_ms, s.max_ms, s.max_queue_depth, s.lru_tiles,
+                double(s.lru_bytes) / (1024.0 * 1024.0));
+    return 0;
+  }
+
+  if (!a.animate.empty()) {
+    if (a.strip_rows > 0 || a.pyramid || a.verify || a.format == "raw" ||
+        !a.cache_dir.empty() || !a.sweep.empty() || methods.size() > 1) {
+      std::fprintf(stderr, "--animate streams whole frames; it does not "
+                           "go with --strip-rows, --pyramid, --verify, "
+                           "--format raw, --cache, --sweep or --method "
+                           "all\n");
+      return 1;
+    }
+    AnimateOptions ao;
+    ao.out = a.anim_out;
+    ao.format = a.anim_format;
+    ao.fps = a.fps;
+    ao.iters = a.anim_image == "iters";
+    ao.colormap = cmap;
+    ao.reuse = a.anim_reuse;
+    if ((ao.format != "y4m" && ao.format != "rgba") || a.fps < 1 ||
+        (a.anim_image != "basins" && a.anim_image != "iters")) {
+      usage();
+      return 1;
+    }
+    np.method = methods[0];
+    std::vector<Keyframe> keys;
+    std::string err;
+    if (!load_keyframes(a.animate, np, keys, err)) {
+      std::fprintf(stderr, "%s\n", err.c_str());
+      return 1;
+    }
+#ifdef USE_SIMD
+    const AnimateStats as = render_animation(*poly, roots, np, a.W, a.H, keys,
+                                             kernel, colors, ro, ao);
+#else
+    const AnimateStats as = render_animation(*poly, roots, np, a.W, a.H, keys,
+                                             nullptr, colors, ro, ao);
+#endif
+    if (!as.ok) {
+      std::fprintf(stderr, "%s\n", as.error.c_str());
+      return 1;
+    }
+    std::fprintf(msg,
+                 "Animation: %d frames of %dx%d in %.6f seconds (%.1f "
+                 "frames/s), %.1f MiB of %s\n",
+                 as.frames, a.W, a.H, as.seconds,
+                 double(as.frames) / std::max(as.seconds, 1e-9),
+                 double(as.bytes) / (1024.0 * 1024.0), ao.format.c_str());
+    std::fprintf(msg,
+                 "Animation: compute %.6f s, encode %.6f s; %d frames "
+                 "shifted, %.1f%% of pixels reused\n",
+                 as.compute_seconds, as.encode_seconds, as.shifted_frames,
+                 100.0 * double(as.reused_pixels) /
+                     double(std::max(as.pixels, 1LL)));
+    return 0;
+  }
+
+  if (!a.sweep.empty()) {
+    if (a.strip_rows > 0 || a.pyramid || a.verify || a.format == "raw" ||
+        !a.cache_dir.empty() || methods.size() > 1 || a.adaptive ||
+        a.aa > 1 || a.precision == "mixed") {
+      std::fprintf(stderr, "--sweep iterates every pixel in double; it does "
+                           "not go with --strip-rows, --pyramid, --verify, "
+                           "--format raw, --cache, --method all, "
+                           "--adaptive, --aa or --precision mixed\n");
+      return 1;
+    }
+    np.method = methods[0];
+    std::vector<NewtonParams> variants;
+    std::string err;
+    if (!parse_sweep(a.sweep, np, variants, err)) {
+      std::fprintf(stderr, "%s\n", err.c_str());
+      return 1;
+    }
+#ifdef USE_SIMD
+    const KernelVariant *k = kernel;
+#else
+    const KernelVariant *k = nullptr;
+#endif
+    std::vector<BasinResult> results;
+    SweepStats ss;
+    try {
+      ss = sweep_basins(*poly, roots, variants, view, k,
+                        a.sweep_images ? &results : nullptr);
+    } catch (const std::exception &e) {
+      std::fprintf(stderr, "%s\n", e.what());
+      return 1;
+    }
+    std::printf("Sweep: %zu variants of %dx%d in %.6f seconds (%.3f "
+                "ns/pixel/variant)\n",
+                variants.size(), a.W, a.H, ss.seconds,
+                1e9 * ss.seconds / double(std::max(ss.points, 1LL)));
+    std::printf("%8s %10s %6s %12s %10s %6s\n", "damping", "tol", "iters",
+                "nonconverged", "mean_iters", "p99");
+    const double px = double(a.W) * a.H;
+    for (const SweepVariantStats &vs : ss.variants)
+      std::printf("%8.4g %10.3g %6d %11.4f%% %10.3f %6d\n", vs.np.damping,
+                  vs.np.tol, vs.np.max_iters,
+                  100.0 * double(vs.cycle_pixels + vs.no_root_pixels) / px,
+                  vs.mean_iters, vs.p99_iters);
+    const std::string summary = !a.sweep_summary.empty()
+                                    ? a.sweep_summary
+                                    : a.out_prefix + "_sweep.tsv";
+    if (!write_sweep_summary(summary, ss)) {
+      std::fprintf(stderr, "could not write %s\n", summary.c_str());
+      return 1;
+    }
+    std::printf("Wrote %s\n", summary.c_str());
+    if (a.sweep_images) {
+      PngOptions po;
+      po.level = a.png_level;
+      ImageRGBA img;
+      for (size_t i = 0; i < results.size(); i++) {
+        char tag[32];
+        std::snprintf(tag, sizeof tag, "_sweep%03zu", i);
+        const std::string out_b = a.out_prefix + tag + "_basins.png";
+        const std::string out_i = a.out_prefix + tag + "_iters.png";
+        colorize_basins(results[i], colors, img);
+        bool saved = write_png(out_b, img, po);
+        colorize_iterations(results[i], ss.variants[i].max_k, img, cmap);
+        saved = write_png(out_i, img, po) && saved;
+        if (!saved) {
+          std::fprintf(stderr, "could not write %s / %s\n", out_b.c_str(),
+                       out_i.c_str());
+          return 1;
+        }
+      }
+      std::printf("Wrote %s_sweep000_basins.png .. _sweep%03zu_iters.png\n",
+                  a.out_prefix.c_str(), results.size() - 1);
+    }
+    return 0;
+  }
+
+  // One result and one image, reused across methods
+  BasinResult res;
+  ImageRGBA img;
+  for (Method m : methods) {
+    np.method = m;
+#ifdef USE_SIMD
+    const KernelVariant *k = kernel;
+#else
+    const KernelVariant *k = nullptr;
+#endif
+    std::string prefix = a.out_prefix;
+    if (methods.size() > 1)
+      prefix += std::string("_") + method_name(m);
+    const std::string out_b = prefix + "_basins.png";
+    const std::string out_i = prefix + "_iters.png";
+    StreamStats ss;
+    PngOptions po;
+    po.level = a.png_level;
+    if (a.pyramid) {
+      PyramidOptions pyo;
+      pyo.layout = a.pyramid_layout;
+      pyo.max_level = a.max_level;
+      pyo.png = po;
+      pyo.colormap = cmap;
+      const PyramidStats ps =
+          render_pyramid(*poly, roots, np, view, k, colors, ro, pyo, prefix);
+      if (!ps.ok) {
+        std::fprintf(stderr, "%s\n", ps.error.c_str());
+        return 1;
+      }
+      const RenderStats &st = ps.render;
+      std::printf("Pyramid: %d levels, %d blocks (%d resumed), %lld tiles\n",
+                  ps.levels, ps.blocks, ps.blocks_resumed, ps.tiles);
+      if (ps.blocks > ps.blocks_resumed)
+        std::printf("Method %s: mean iters %.3f, p99 iters %d; cycle "
+                    "pixels %lld, no-root pixels %lld\n",
+                    method_name(m), st.mean_iters, st.p99_iters,
+                    st.cycle_pixels, st.no_root_pixels);
+      std::printf("Rendered in %.6f seconds (compute %.6f), encoded in "
+                  "%.6f seconds, wall %.6f seconds\n",
+                  ps.render_seconds, st.seconds, ps.encode_seconds,
+                  ps.seconds);
+      std::printf("Peak RSS %.1f MiB\n",
+                  double(peak_rss_bytes()) / (1024.0 * 1024.0));
+      if (a.pyramid_layout == "dzi")
+        std::printf("Wrote %s_basins.dzi and %s_iters.dzi\n",
+                    prefix.c_str(), prefix.c_str());
+      else
+        std::printf("Wrote %s_basins/ and %s_iters/\n", prefix.c_str(),
+                    prefix.c_str());
+      continue;
+    }
+    if (a.strip_rows > 0) {
+      StreamOptions so;
+      so.strip_rows = a.strip_rows;
+      so.png = po;
+      so.colormap = cmap;
+      ss = render_streamed(*poly, roots, np, view, k, colors, ro, so, out_b,
+                           out_i);
+    }
+    CacheOptions co;
+    co.dir = a.cache_dir;
+    co.max_bytes = (uint64_t)(a.cache_max_mb * 1024.0 * 1024.0);
+    CacheStats cs;
+    const RenderStats st =
+        a.strip_rows > 0        ? ss.render
+        : !co.dir.empty()       ? render_cached(*poly, roots, np, view, k, res,
+                                                ro, co, cs)
+                                : render_basins(*poly, roots, np, view, k,
+                                                res, ro);
+    std::printf("Computed in %.6f seconds for %dx%d, max_iters=%d\n",
+                st.seconds, a.W, a.H, a.max_iters);
+    std::printf("Method %s: mean iters %.3f, p99 iters %d, %.3f ns/pixel\n",
+                method_name(m), st.mean_iters, st.p99_iters,
+                1e9 * st.seconds / (double(a.W) * a.H));
+    std::printf("Cycle pixels %lld, no-root pixels %lld\n", st.cycle_pixels,
+                st.no_root_pixels);
+    if (!co.dir.empty()) {
+      std::printf("Cache: %d of %d tiles hit (%.1f%%), %d computed in %.6f "
+                  "seconds; read %.6f s, wrote %.6f s (%.1f KiB)\n",
+                  cs.hits, cs.tiles, 100.0 * cs.hits / std::max(cs.tiles, 1),
+                  cs.tiles - cs.hits, cs.compute_seconds, cs.read_seconds,
+                  cs.write_seconds, double(cs.bytes_written) / 1024.0);
+      std::printf("Cache: %.1f of %.1f MiB after evicting %d tiles; view "
+                  "snapped by (%.3f, %.3f) pixels\n",
+                  double(cs.bytes_total) / (1024.0 * 1024.0), a.cache_max_mb,
+                  cs.evicted, cs.shift_x, cs.shift_y);
+    }
+    if (st.deep)
+      std::printf("Deep zoom: iterated in double-double (pixel %.3g)\n",
+                  view.dx());
+    else if (view.needs_dd())
+      std::printf("Deep zoom needs --method newton; %s ran in double\n",
+                  method_name(m));
+    const PoolStats &ps = st.pool;
+    if (!ps.busy.empty()) {
+      const auto [lo, hi] = std::minmax_element(ps.busy.begin(), ps.busy.end());
+      const double idle = *std::max_element(ps.idle.begin(), ps.idle.end());
+      int ntiles = 0;
+      for (int n : ps.tiles)
+        ntiles += n;
+      std::printf("Tiles: %d of %dpx on %zu threads, %lld steals; busy "
+                  "%.4f-%.4f s, idle max %.4f s (%.1f%%)\n",
+                  ntiles, kTileSize, ps.busy.size(),
+                  ps.steals, *lo, *hi, idle, 100.0 * idle / ps.seconds);
+      if (a.thread_stats)
+        for (size_t i = 0; i < ps.busy.size(); i++)
+          std::printf("  thread %zu: busy %.4f s, idle %.4f s, %d tiles\n", i,
+                      ps.busy[i], ps.idle[i], ps.tiles[i]);
+    }
+    const double npix = double(a.W) * a.H;
+    if (np.mixed_precision)
+      std::printf("Mixed precision: %lld pixels (%.2f%%) recomputed in "
+                  "double\n",
+                  st.redone_pixels, 100.0 * double(st.redone_pixels) / npix);
+    if (st.iterated_pixels < (long long)npix)
+      std::printf("Iterated %lld of %.0f pixels (%.2f%%)\n",
+                  st.iterated_pixels, npix,
+                  100.0 * double(st.iterated_pixels) / npix);
+    if (a.aa > 1) {
+      // Brute force would iterate every pixel aa^2 times; estimate its time
+      // from the first pass's cost per iterated pixel
+      const double n2 = double(a.aa) * a.aa;
+      const double first = st.seconds - st.aa_seconds;
+      const double brute =
+          first / double(std::max(st.iterated_pixels, 1LL)) * npix * n2;
+      std::printf("Anti-aliasing: refined %lld pixels (%.2f%%) with %dx%d "
+                  "samples in %.6f seconds\n",
+                  st.aa_pixels, 100.0 * double(st.aa_pixels) / npix, a.aa,
+                  a.aa, st.aa_seconds);
+      std::printf("Anti-aliasing: %.0f samples, %.2f%% of brute-force "
+                  "supersampling; %.2f%% of its estimated %.6f seconds\n",
+                  double(st.iterated_pixels + st.aa_samples),
+                  100.0 * double(st.iterated_pixels + st.aa_samples) /
+                      (npix * n2),
+                  100.0 * st.seconds / brute, brute);
+    }
+    if (a.verify) {
+      // Brute force: every pixel, in double
+      NewtonParams ref = np;
+      ref.mixed_precision = false;
+      RenderOptions bf;
+      bf.symmetry = false;
+      bf.aa = ro.aa;
+      BasinResult rr;
+      RenderStats rs = render_basins(*poly, roots, ref, view, k, rr, bf);
+      long long diff = 0, kdiff = 0;
+      int kmax = 0;
+      for (size_t i = 0; i < rr.iters.size(); i++) {
+        diff += res.wide ? res.label16[i] != rr.label16[i]
+                         : res.label[i] != rr.label[i];
+        const int dk = std::abs(int(res.iters[i]) - int(rr.iters[i]));
+        kdiff += dk != 0;
+        kmax = std::max(kmax, dk);
+      }
+      std::printf("Verify: %lld basin pixels (%.4f%%) differ from the double "
+                  "render (%.6f seconds)\n",
+                  diff, 100.0 * double(diff) / npix, rs.seconds);
+      std::printf("Verify: %lld iteration counts (%.4f%%) differ, by at most "
+                  "%d\n",
+                  kdiff, 100.0 * double(kdiff) / npix, kmax);
+    }
+
+    if (a.strip_rows > 0) {
+      std::printf("Streamed %d strips of %d rows: compute %.6f s, encode "
+                  "%.6f s, wall %.6f s (%.1f + %.1f KiB)\n",
+                  ss.strips, a.strip_rows, st.seconds, ss.encode_seconds,
+                  ss.seconds, double(ss.bytes_basins) / 1024.0,
+                  double(ss.bytes_iters) / 1024.0);
+      std::printf("Peak RSS %.1f MiB\n",
+                  double(peak_rss_bytes()) / (1024.0 * 1024.0));
+      if (!ss.ok) {
+        std::fprintf(stderr, "could not write %s / %s\n", out_b.c_str(),
+                     out_i.c_str());
+        return 1;
+      }
+      std::printf("Wrote %s and %s\n", out_b.c_str(), out_i.c_str());
+      continue;
+    }
+    if (a.format == "raw") {
+      RawInfo info;
+      info.poly = poly->id();
+      info.roots = roots;
+      info.np = np;
+      info.view = view;
+      info.max_k = st.max_k;
+      const std::string out_r = prefix + ".nfr";
+      Timer tw;
+      if (!write_raw(out_r, info, res)) {
+        std::fprintf(stderr, "could not write %s\n", out_r.c_str());
+        return 1;
+      }
+      std::error_code ec;
+      const auto size_r = std::filesystem::file_size(out_r, ec);
+      std::printf("Wrote %s in %.6f seconds (%.1f KiB)\n", out_r.c_str(),
+                  tw.seconds(), double(size_r) / 1024.0);
+      continue;
+    }
+    // max_k comes from the render's per-thread histograms: no extra pass
+    Timer tc;
+    colorize_basins(res, colors, img);
+    const double cb = tc.seconds();
+    tc.reset();
+    bool saved = img.save_png(out_b, a.png_level);
+    double enc = tc.seconds();
+    tc.reset();
+    colorize_iterations(res, st.max_k, img, cmap);
+    const double ci = tc.seconds();
+    tc.reset();
+    saved = img.save_png(out_i, a.png_level) && saved;
+    enc += tc.seconds();
+    std::printf("Colorized in %.6f seconds (basins %.6f, iterations %.6f; "
+                "%.3f ns/pixel)\n",
+                cb + ci, cb, ci, 1e9 * (cb + ci) / npix);
+    if (!saved) {
+      std::fprintf(stderr, "could not write %s / %s\n", out_b.c_str(),
+                   out_i.c_str());
+      return 1;
+    }
+    std::error_code ec;
+    const auto size_b = std::filesystem::file_size(out_b, ec);
+    const auto size_i = std::filesystem::file_size(out_i, ec);
+    std::printf("Encoded PNGs in %.6f seconds (%.1f + %.1f KiB)\n", enc,
+                double(size_b) / 1024.0, double(size_i) / 1024.0);
+    std::printf("Peak RSS %.1f MiB\n",
+                double(peak_rss_bytes()) / (1024.0 * 1024.0));
+    std::printf("Wrote %s and %s\n", out_b.c_str(), out_i.c_str());
+  }
   return 0;
 }
@@ -0,0 +1,243 @@
+#include "net.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define NF_HAVE_SOCKETS 1
+#endif
+
+namespace {
+
+constexpr size_t kMaxHead = 16 << 10;
+constexpr size_t kMaxBody = size_t(1) << 30;
+
+int fail(std::string *err, const std::string &msg) {
+  if (err)
+    *err = msg;
+  return -1;
+}
+
+#ifdef NF_HAVE_SOCKETS
+// Unix socket path, or host and port
+struct Address {
+  bool unix_path = false;
+  std::string path, host = "127.0.0.1", port;
+};
+
+bool parse_address(const std::string &addr, Address &a, std::string *err) {
+  if (addr.rfind("unix:", 0) == 0) {
+    a.unix_path = true;
+    a.path = addr.substr(5);
+    if (!a.path.empty() && a.path.size() < sizeof(sockaddr_un{}.sun_path))
+      return true;
+    fail(err, "bad unix socket path in '" + addr + "'");
+    return false;
+  }
+  const size_t colon = addr.rfind(':');
+  if (colon != std::string::npos) {
+    a.host = addr.substr(0, colon);
+    a.port = addr.substr(colon + 1);
+  } else {
+    a.port = addr;
+  }
+  if (!a.host.empty() && !a.port.empty() &&
+      a.port.find_first_not_of("0123456789") == std::string::npos)
+    return true;
+  fail(err, "address '" + addr + "' is not unix:PATH, HOST:PORT or PORT");
+  return false;
+}
+
+// socket(2) + bind(2) or connect(2) on the address
+int open_socket(const std::string &addr, bool server, std::string *err) {
+  Address a;
+  if (!parse_address(addr, a, err))
+    return -1;
+  if (a.unix_path) {
+    sockaddr_un sa{};
+    sa.sun_family = AF_UNIX;
+    std::memcpy(sa.sun_path, a.path.c_str(), a.path.size() + 1);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+      return fail(err, "socket: " + std::string(std::strerror(errno)));
+    if (server)
+      unlink(a.path.c_str());
+    const auto *p = reinterpret_cast<const sockaddr *>(&sa);
+    if ((server ? bind(fd, p, sizeof sa) : connect(fd, p, sizeof sa)) != 0) {
+      const std::string e = std::strerror(errno);
+      close(fd);
+      return fail(err, addr + ": " + e);
+    }
+    return fd;
+  }
+  addrinfo hints{}, *res = nullptr;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (const int rc =
+          getaddrinfo(a.host.c_str(), a.port.c_str(), &hints, &res))
+    return fail(err, addr + ": " + gai_strerror(rc));
+  int fd = -1;
+  std::string e = "no address";
+  for (addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0)
+      continue;
+    const int one = 1;
+    if (server)
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    else // requests and replies are small: send them at once
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    if ((server ? bind(fd, ai->ai_addr, ai->ai_addrlen)
+                : connect(fd, ai->ai_addr, ai->ai_addrlen)) != 0) {
+      e = std::strerror(errno);
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(res);
+  if (fd < 0)
+    return fail(err, addr + ": " + e);
+  return fd;
+}
+#endif
+
+} // namespace
+
+#ifdef NF_HAVE_SOCKETS
+
+int listen_on(const std::string &addr, std::string *err) {
+  const int fd = open_socket(addr, true, err);
+  if (fd >= 0 && listen(fd, 128) != 0) {
+    const std::string e = std::strerror(errno);
+    close(fd);
+    return fail(err, addr + ": " + e);
+  }
+  return fd;
+}
+
+int connect_to(const std::string &addr, std::string *err) {
+  return open_socket(addr, false, err);
+}
+
+int accept_on(int listen_fd, int timeout_ms) {
+  pollfd p{listen_fd, POLLIN, 0};
+  if (poll(&p, 1, timeout_ms) != 1)
+    return -1;
+  const int fd = accept(listen_fd, nullptr, nullptr);
+  if (fd >= 0) {
+    const int one = 1; // fails harmlessly on unix sockets
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof one);
+#endif
+  }
+  return fd;
+}
+
+void shutdown_socket(int fd) { shutdown(fd, SHUT_RDWR); }
+
+void close_socket(int fd) { close(fd); }
+
+bool send_all(int fd, const void *p, size_t n) {
+#ifdef MSG_NOSIGNAL
+  const int flags = MSG_NOSIGNAL; // a closed peer is an error, not SIGPIPE
+#else
+  const int flags = 0;
+#endif
+  const char *c = static_cast<const char *>(p);
+  while (n > 0) {
+    const ssize_t k = send(fd, c, n, flags);
+    if (k < 0 && errno == EINTR)
+      continue;
+    if (k <= 0)
+      return false;
+    c += k;
+    n -= (size_t)k;
+  }
+  return true;
+}
+
+#else
+
+int listen_on(const std::string &, std::string *err) {
+  return fail(err, "sockets need a POSIX system");
+}
+int connect_to(const std::string &, std::string *err) {
+  return fail(err, "sockets need a POSIX system");
+}
+int accept_on(int, int) { return -1; }
+void shutdown_socket(int) {}
+void close_socket(int) {}
+bool send_all(int, const void *, size_t) { return false; }
+
+#endif
+
+std::string HttpMessage::header(const std::string &name) const {
+  for (const auto &h : headers)
+    if (h.first == name)
+      return h.second;
+  return "";
+}
+
+bool read_http(int fd, std::string &buf, HttpMessage &m) {
+#ifdef NF_HAVE_SOCKETS
+  char chunk[16 << 10];
+  auto more = [&] {
+    for (;;) {
+      const ssize_t k = recv(fd, chunk, sizeof chunk, 0);
+      if (k < 0 && errno == EINTR)
+        continue;
+      if (k <= 0)
+        return false;
+      buf.append(chunk, (size_t)k);
+      return true;
+    }
+  };
+  size_t end;
+  while ((end = buf.find("\r\n\r\n")) == std::string::npos)
+    if (buf.size() > kMaxHead || !more())
+      return false;
+  m = HttpMessage{};
+  size_t at = buf.find("\r\n");
+  m.start = buf.substr(0, at);
+  while (at < end) {
+    const size_t next = buf.find("\r\n", at + 2);
+    const std::string line = buf.substr(at + 2, next - at - 2);
+    at = next;
+    const size_t colon = line.find(':');
+    if (colon == std::string::npos)
+      return false;
+    std::string name = line.substr(0, colon);
+    std::transform(name.begin(), name.end(), name.begin(),
+                   [](unsigned char c) { return (char)std::tolower(c); });
+    const size_t v = line.find_first_not_of(" \t", colon + 1);
+    m.headers.push_back(
+        {name, v == std::string::npos ? "" : line.substr(v)});
+  }
+  buf.erase(0, end + 4);
+  const std::string len = m.header("content-length");
+  const size_t n = len.empty() ? 0 : std::strtoull(len.c_str(), nullptr, 10);
+  if (n > kMaxBody)
+    return false;
+  while (buf.size() < n)
+    if (!more())
+      return false;
+  m.body = buf.substr(0, n);
+  buf.erase(0, n);
+  return true;
+#else
+  (void)fd;
+  (void)buf;
+  (void)m;
+  return false;
+#endif
+}
@@ -0,0 +1,36 @@
+#pragma once
+// Just enough sockets and HTTP/1.1 for the tile server (--serve) and
+// newton_client: blocking I/O on local addresses, one message at a time per
+// connection, bodies sized by Content-Length. Addresses are "unix:PATH", or
+// "HOST:PORT" / "PORT" (127.0.0.1) for TCP. POSIX only; elsewhere every
+// call fails with an error saying so.
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A listening socket on addr, or -1 with *err set. A unix socket file left
+// behind by an earlier server is replaced.
+int listen_on(const std::string &addr, std::string *err);
+// A connected socket, or -1 with *err set.
+int connect_to(const std::string &addr, std::string *err);
+// Waits up to timeout_ms for a connection on a listening socket; -1 when
+// none came or on error.
+int accept_on(int listen_fd, int timeout_ms);
+// Wakes any thread blocked reading fd; close_socket still has to follow.
+void shutdown_socket(int fd);
+void close_socket(int fd);
+bool send_all(int fd, const void *p, size_t n);
+
+struct HttpMessage {
+  std::string start; // request line or status line
+  std::vector<std::pair<std::string, std::string>> headers; // names lowercase
+  std::string body;
+  // The first header called name (lowercase), or "".
+  std::string header(const std::string &name) const;
+};
+
+// Reads the next message from fd. buf holds bytes read past the message,
+// for the next call on the same connection. False on end of stream, errors
+// and heads over 16 KiB or bodies over 1 GiB.
+bool read_http(int fd, std::string &buf, HttpMessage &m);
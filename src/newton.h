@@ -1,31 +1,210 @@
 #pragma once
 #include "polynomials.h"
+#include <algorithm>
+#include <cmath>
 #include <complex>
 #include <limits>
+#include <span>
+#include <string>
 #include <tuple>
+#include <type_traits>
 #include <vector>
 
+// Root-finding iteration. The higher-order schemes need f'' (and f''' for
+// householder3) from Poly::eval_jet; Schroder's method keeps quadratic
+// convergence on multiple and tightly clustered roots.
+enum class Method { Newton, Halley, Householder3, Schroder };
+
+inline const char *method_name(Method m) {
+  switch (m) {
+  case Method::Newton:
+    return "newton";
+  case Method::Halley:
+    return "halley";
+  case Method::Householder3:
+    return "householder3";
+  case Method::Schroder:
+    return "schroder";
+  }
+  return "?";
+}
+
+inline bool parse_method(const std::string &s, Method &m) {
+  for (Method c : {Method::Newton, Method::Halley, Method::Householder3,
+                   Method::Schroder})
+    if (s == method_name(c)) {
+      m = c;
+      return true;
+    }
+  return false;
+}
+
 struct NewtonParams {
   int max_iters = 100;
   double tol = 1e-10;
   double damping = 1.0; // alpha in (0,1]
+  Method method = Method::Newton;
+  // Brent-style cycle check: an iterate that returns within cycle_tol of the
+  // saved point, away from every root, ends the pixel as a cycle. 0 disables.
+  double cycle_tol = 1e-9;
+  bool root_traps = true; // see make_root_traps
+  // Float32 first pass, double only where it cannot classify a point. Row
+  // kernels only (KernelVariant::row_mixed).
+  bool mixed_precision = false;
+};
+
+// Root id returned for starting points caught in an attracting cycle.
+constexpr int kCycleRid = -2;
+
+// Undamped step of the given method as num / den.
+inline void method_step_terms(Method m, const PolyJet &j,
+                              std::complex<double> &num,
+                              std::complex<double> &den) {
+  const auto &f = j.f, &d1 = j.d1, &d2 = j.d2;
+  switch (m) {
+  case Method::Halley: // 2 f f' / (2 f'^2 - f f'')
+    num = 2.0 * f * d1;
+    den = 2.0 * d1 * d1 - f * d2;
+    break;
+  case Method::Householder3:
+    // f (f'^2 - f f''/2) / (f'^3 - f f' f'' + f^2 f'''/6)
+    num = f * (d1 * d1 - 0.5 * f * d2);
+    den = d1 * d1 * d1 - f * d1 * d2 + f * f * j.d3 / 6.0;
+    break;
+  case Method::Schroder: // f f' / (f'^2 - f f'')
+    num = f * d1;
+    den = d1 * d1 - f * d2;
+    break;
+  case Method::Newton:
+    num = f;
+    den = d1;
+    break;
+  }
+}
+
+// Index of the root within 1e-5 of z, or -1 (kCycleRid for cycles is set by
+// the iteration, never here).
+inline int nearest_root(std::complex<double> z,
+                        const std::vector<std::complex<double>> &roots) {
+  int rid = -1;
+  double best = std::numeric_limits<double>::infinity();
+  for (int i = 0; i < (int)roots.size(); ++i) {
+    double d = std::abs(z - roots[(size_t)i]);
+    if (d < best) {
+      best = d;
+      rid = i;
+    }
+  }
+  if (best > 1e-5)
+    rid = -1;
+  return rid;
+}
+
+// Disks around the roots from which damped Newton provably converges to that
+// root (Smale's gamma theorem: u = gamma |z - root| <= (3 - sqrt 7) / 2 gives
+// |N(z) - root| <= u / psi(u) |z - root| with psi(u) = 1 - 4u + 2u^2, and the
+// ratio is at most 1/2 there). A point that lands in a disk with enough
+// iterations left is labelled at once: it would reach the 1e-5 labelling
+// radius before max_iters and stop nowhere else, so the basin is unchanged.
+struct RootTraps {
+  std::vector<std::complex<double>> c; // disk centers (the roots)
+  std::vector<double> r2;              // squared radii; 0 = no trap
+  double gate2 = 0.0; // longer steps cannot end in a disk, skip the scan
+  int steps = -1;     // iterations a trapped point may still need; -1 = off
+
+  // Root whose disk holds z, or -1.
+  int find(std::complex<double> z) const {
+    for (size_t i = 0; i < c.size(); ++i)
+      if (std::norm(z - c[i]) < r2[i])
+        return (int)i;
+    return -1;
+  }
 };
 
+// Traps for p, or an empty set when p cannot use them: only Method::Newton
+// with 0 < damping < 4/3 contracts in the disks, and degrees above 256 skip
+// the O(n^3) gamma computation.
+inline RootTraps make_root_traps(const Poly &poly,
+                                 const std::vector<std::complex<double>> &roots,
+                                 const NewtonParams &p) {
+  using cd = std::complex<double>;
+  RootTraps t;
+  const double a = p.damping, label = 1e-5, reach = 0.5 * label;
+  const double q = std::abs(1.0 - a) + 0.5 * a; // contraction per step
+  const std::vector<cd> c = poly.coeffs();
+  const size_t n = c.size() - 1;
+  if (!p.root_traps || p.method != Method::Newton || !(a > 0.0) ||
+      !(q < 1.0) || n > 256 || 2.0 * p.tol / a >= label)
+    return t;
+  // Half the theorem's bound leaves room for error in the computed roots
+  const double u0 = 0.5 * (3.0 - std::sqrt(7.0)) / 2.0;
+  double rmax = 0.0;
+  for (const cd &z : roots) {
+    // Taylor coefficients b_k = f^(k)(z) / k! by repeated synthetic division
+    std::vector<cd> w(c), b;
+    for (size_t m = n; b.size() <= n; --m) {
+      for (size_t j = 1; j <= m; ++j)
+        w[j] += w[j - 1] * z;
+      b.push_back(w[m]);
+    }
+    double gamma = 0.0;
+    for (size_t k = 2; k <= n; ++k)
+      gamma = std::max(gamma, std::pow(std::abs(b[k] / b[1]),
+                                       1.0 / double(k - 1)));
+    // |f| < tol must not stop a point outside the labelling radius
+    double r = 0.0;
+    if (std::abs(b[1]) * reach > p.tol && gamma > 0.0 && std::isfinite(gamma))
+      r = u0 / gamma;
+    t.c.push_back(z);
+    t.r2.push_back(r * r);
+    rmax = std::max(rmax, r);
+  }
+  if (rmax <= reach)
+    return RootTraps{};
+  // Undamped: e_j <= e_0 / 2^(2^j - 1), i.e. e_{j+1} = e_j^2 / (2 e_0);
+  // damped: e_j <= q^j e_0
+  int steps = 0;
+  for (double e = rmax; e > reach; ++steps)
+    e *= a == 1.0 ? e / (2.0 * rmax) : q;
+  t.steps = steps;
+  // Inside a disk |step| <= a (1 + 1/2) |z - root|
+  t.gate2 = (1.5 * a * rmax) * (1.5 * a * rmax);
+  return t;
+}
+
+// P is Poly or one of its final concrete types; the latter inline eval/deriv.
+// traps (from make_root_traps with the same p) ends a point early once it is
+// inside a root's trap disk.
+template <class P>
 inline std::tuple<int, int>
-newton_iterate(std::complex<double> z0, const Poly &poly,
+newton_iterate(std::complex<double> z0, const P &poly,
                const std::vector<std::complex<double>> &roots,
-               const NewtonParams &p) {
+               const NewtonParams &p, const RootTraps *traps = nullptr) {
   using cd = std::complex<double>;
   cd z = z0;
   int k = 0;
   const double tiny = 1e-30;
+  // Brent: compare against a point saved at power-of-two step counts
+  cd zs = z0;
+  int power = 1, lam = 0;
   for (; k < p.max_iters; ++k) {
-    cd f = poly.eval(z);
-    cd fp = poly.deriv(z);
-    double denom = std::abs(fp);
-    if (denom < tiny)
-      break; // near critical point
-    cd step = p.damping * f / fp;
+    cd f, step;
+    if (p.method == Method::Newton) {
+      cd fp;
+      std::tie(f, fp) = poly.eval_and_deriv(z);
+      double denom = std::abs(fp);
+      if (denom < tiny)
+        break; // near critical point
+      step = p.damping * f / fp;
+    } else {
+      const PolyJet j = poly.eval_jet(z);
+      cd num, den;
+      method_step_terms(p.method, j, num, den);
+      if (std::abs(j.d1) < tiny || std::abs(den) < tiny)
+        break;
+      f = j.f;
+      step = p.damping * num / den;
+    }
     cd z1 = z - step;
     if (std::abs(z1 - z) < p.tol || std::abs(f) < p.tol) {
       z = z1;
@@ -33,18 +212,106 @@ newton_iterate(std::complex<double> z0, const Poly &poly,
       break;
     }
     z = z1;
+    if (traps && traps->steps >= 0 && k + 1 + traps->steps <= p.max_iters &&
+        std::norm(step) < traps->gate2) {
+      if (int t = traps->find(z); t >= 0)
+        return {t, k + 1};
+    }
+    if (p.cycle_tol > 0.0) {
+      if (std::abs(z - zs) < p.cycle_tol && nearest_root(z, roots) < 0)
+        return {kCycleRid, k + 1};
+      if (++lam == power) {
+        zs = z;
+        power *= 2;
+        lam = 0;
+      }
+    }
   }
   // Choose nearest root if close; else -1
-  int rid = -1;
-  double best = std::numeric_limits<double>::infinity();
-  for (int i = 0; i < (int)roots.size(); ++i) {
-    double d = std::abs(z - roots[(size_t)i]);
-    if (d < best) {
-      best = d;
-      rid = i;
+  return {nearest_root(z, roots), k};
+}
+
+// Row form of newton_iterate: same stopping rules per point, but each step
+// evaluates all still-active points with one Poly::eval_newton_step call.
+// Method::Newton only (see newton_row_scalar).
+template <class P>
+inline void newton_iterate_row(std::span<const std::complex<double>> z0,
+                               const P &poly,
+                               const std::vector<std::complex<double>> &roots,
+                               const NewtonParams &p, std::span<int> rid,
+                               std::span<int> iters,
+                               const RootTraps *traps = nullptr) {
+  using cd = std::complex<double>;
+  const size_t n = z0.size();
+  const double tiny = 1e-30;
+  std::vector<cd> z(z0.begin(), z0.end()), zs(z), za(n), f(n), fp(n);
+  std::vector<size_t> active(n);
+  std::vector<int> label(n, -1); // set when a point stops on a trap or cycle
+  for (size_t i = 0; i < n; ++i) {
+    active[i] = i;
+    iters[i] = 0;
+  }
+  size_t m = n;
+  // Every point starts together, so one Brent schedule serves the row
+  int power = 1, lam = 0;
+  for (int k = 0; k < p.max_iters && m > 0; ++k) {
+    const bool save = p.cycle_tol > 0.0 && ++lam == power;
+    const bool trap = traps && traps->steps >= 0 &&
+                      k + 1 + traps->steps <= p.max_iters;
+    for (size_t j = 0; j < m; ++j)
+      za[j] = z[active[j]];
+    poly.eval_newton_step(std::span<const cd>(za.data(), m),
+                          std::span<cd>(f.data(), m),
+                          std::span<cd>(fp.data(), m));
+    size_t m2 = 0;
+    for (size_t j = 0; j < m; ++j) {
+      const size_t i = active[j];
+      if (std::abs(fp[j]) < tiny)
+        continue; // near critical point
+      const cd step = p.damping * f[j] / fp[j];
+      const cd z1 = za[j] - step;
+      ++iters[i];
+      z[i] = z1;
+      if (std::abs(z1 - za[j]) < p.tol || std::abs(f[j]) < p.tol)
+        continue;
+      if (trap && std::norm(step) < traps->gate2) {
+        if ((label[i] = traps->find(z1)) >= 0)
+          continue;
+      }
+      if (p.cycle_tol > 0.0) {
+        if (std::abs(z1 - zs[i]) < p.cycle_tol && nearest_root(z1, roots) < 0) {
+          label[i] = kCycleRid;
+          continue;
+        }
+        if (save)
+          zs[i] = z1;
+      }
+      active[m2++] = i;
+    }
+    m = m2;
+    if (save) {
+      power *= 2;
+      lam = 0;
     }
   }
-  if (best > 1e-5)
-    rid = -1;
-  return {rid, k};
+  for (size_t i = 0; i < n; ++i)
+    rid[i] = label[i] != -1 ? label[i] : nearest_root(z[i], roots);
+}
+
+// Scalar row loop: per-point newton_iterate when P is a concrete (inlined)
+// polynomial, the batched eval_newton_step path when only Poly is known.
+template <class P>
+inline void newton_row_scalar(std::span<const std::complex<double>> z0,
+                              const P &poly,
+                              const std::vector<std::complex<double>> &roots,
+                              const NewtonParams &p, std::span<int> rid,
+                              std::span<int> iters,
+                              const RootTraps *traps = nullptr) {
+  if (std::is_same_v<P, Poly> && p.method == Method::Newton) {
+    newton_iterate_row(z0, poly, roots, p, rid, iters, traps);
+  } else {
+    for (size_t i = 0; i < z0.size(); ++i)
+      std::tie(rid[i], iters[i]) =
+          newton_iterate(z0[i], poly, roots, p, traps);
+  }
 }
@@ -0,0 +1,795 @@
+#pragma once
+// Batch Newton kernel: iterates a lane group of starting points at once with
+// split real/imag registers and per-lane convergence masks. The lane width is
+// picked from the target ISA of the translation unit (AVX-512: 8, AVX2: 4,
+// SSE2: 2, otherwise 1).
+//
+// This header is compiled once per ISA level (src/kernel_isa.cpp), so all of
+// it lives in the NF_SIMD_NS namespace and it calls nothing that is shared with
+// other translation units.
+#include "kernels.h"
+#include <cmath>
+
+#if !defined(NF_FORCE_SCALAR) &&                                               \
+    (defined(__AVX512F__) || defined(__AVX2__) || defined(__SSE2__) ||         \
+     defined(_M_X64))
+#define NF_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#ifndef NF_SIMD_NS
+#define NF_SIMD_NS native
+#endif
+
+namespace simd {
+namespace NF_SIMD_NS {
+
+#if defined(NF_SIMD_X86) && defined(__AVX512F__)
+struct VecD {
+  static constexpr int lanes = 8;
+  static constexpr const char *name = "avx512";
+  using scalar = double;
+  using reg = __m512d;
+  using mask = __mmask8;
+  static reg set1(double v) { return _mm512_set1_pd(v); }
+  static reg load(const double *p) { return _mm512_loadu_pd(p); }
+  static void store(double *p, reg v) { _mm512_storeu_pd(p, v); }
+  static reg add(reg a, reg b) { return _mm512_add_pd(a, b); }
+  static reg sub(reg a, reg b) { return _mm512_sub_pd(a, b); }
+  static reg mul(reg a, reg b) { return _mm512_mul_pd(a, b); }
+  static reg div(reg a, reg b) { return _mm512_div_pd(a, b); }
+  static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_pd(a, b, c); }
+  static reg fnmadd(reg a, reg b, reg c) { return _mm512_fnmadd_pd(a, b, c); }
+  static constexpr bool has_fma = true; // fmsub is exact (a * b - c)
+  static reg fmsub(reg a, reg b, reg c) { return _mm512_fmsub_pd(a, b, c); }
+  static mask lt(reg a, reg b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+  static mask all() { return (mask)0xFF; }
+  static mask and_(mask a, mask b) { return (mask)(a & b); }
+  static mask or_(mask a, mask b) { return (mask)(a | b); }
+  static mask andnot(mask a, mask b) { return (mask)(~a & b); } // !a & b
+  static reg select(mask m, reg a, reg b) {
+    return _mm512_mask_blend_pd(m, b, a);
+  }
+  static int bits(mask m) { return (int)m; }
+};
+#elif defined(NF_SIMD_X86) && defined(__AVX2__)
+struct VecD {
+  static constexpr int lanes = 4;
+  static constexpr const char *name = "avx2";
+  using scalar = double;
+  using reg = __m256d;
+  using mask = __m256d;
+  static reg set1(double v) { return _mm256_set1_pd(v); }
+  static reg load(const double *p) { return _mm256_loadu_pd(p); }
+  static void store(double *p, reg v) { _mm256_storeu_pd(p, v); }
+  static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+  static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+  static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+  static reg div(reg a, reg b) { return _mm256_div_pd(a, b); }
+#if defined(__FMA__)
+  static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_pd(a, b, c); }
+  static reg fnmadd(reg a, reg b, reg c) { return _mm256_fnmadd_pd(a, b, c); }
+  static constexpr bool has_fma = true;
+  static reg fmsub(reg a, reg b, reg c) { return _mm256_fmsub_pd(a, b, c); }
+#else
+  static reg fmadd(reg a, reg b, reg c) { return add(mul(a, b), c); }
+  static reg fnmadd(reg a, reg b, reg c) { return sub(c, mul(a, b)); }
+  static constexpr bool has_fma = false;
+#endif
+  static mask lt(reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+  static mask all() { return _mm256_castsi256_pd(_mm256_set1_epi64x(-1)); }
+  static mask and_(mask a, mask b) { return _mm256_and_pd(a, b); }
+  static mask or_(mask a, mask b) { return _mm256_or_pd(a, b); }
+  static mask andnot(mask a, mask b) { return _mm256_andnot_pd(a, b); }
+  static reg select(mask m, reg a, reg b) { return _mm256_blendv_pd(b, a, m); }
+  static int bits(mask m) { return _mm256_movemask_pd(m); }
+};
+#elif defined(NF_SIMD_X86)
+struct VecD {
+  static constexpr int lanes = 2;
+  static constexpr const char *name = "sse2";
+  using scalar = double;
+  using reg = __m128d;
+  using mask = __m128d;
+  static reg set1(double v) { return _mm_set1_pd(v); }
+  static reg load(const double *p) { return _mm_loadu_pd(p); }
+  static void store(double *p, reg v) { _mm_storeu_pd(p, v); }
+  static reg add(reg a, reg b) { return _mm_add_pd(a, b); }
+  static reg sub(reg a, reg b) { return _mm_sub_pd(a, b); }
+  static reg mul(reg a, reg b) { return _mm_mul_pd(a, b); }
+  static reg div(reg a, reg b) { return _mm_div_pd(a, b); }
+  static reg fmadd(reg a, reg b, reg c) { return add(mul(a, b), c); }
+  static reg fnmadd(reg a, reg b, reg c) { return sub(c, mul(a, b)); }
+  // Without FMA the double-double kernel uses Dekker's product, which the
+  // compiler would break by contracting it if FMA were enabled after all
+#if defined(__FMA__)
+  static constexpr bool has_fma = true;
+  static reg fmsub(reg a, reg b, reg c) { return _mm_fmsub_pd(a, b, c); }
+#else
+  static constexpr bool has_fma = false;
+#endif
+  static mask lt(reg a, reg b) { return _mm_cmplt_pd(a, b); }
+  static mask all() { return _mm_castsi128_pd(_mm_set1_epi64x(-1)); }
+  static mask and_(mask a, mask b) { return _mm_and_pd(a, b); }
+  static mask or_(mask a, mask b) { return _mm_or_pd(a, b); }
+  static mask andnot(mask a, mask b) { return _mm_andnot_pd(a, b); }
+  static reg select(mask m, reg a, reg b) {
+    return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b));
+  }
+  static int bits(mask m) { return _mm_movemask_pd(m); }
+};
+#else
+struct VecD {
+  static constexpr int lanes = 1;
+  static constexpr const char *name = "scalar";
+  using scalar = double;
+  using reg = double;
+  using mask = bool;
+  static reg set1(double v) { return v; }
+  static reg load(const double *p) { return *p; }
+  static void store(double *p, reg v) { *p = v; }
+  static reg add(reg a, reg b) { return a + b; }
+  static reg sub(reg a, reg b) { return a - b; }
+  static reg mul(reg a, reg b) { return a * b; }
+  static reg div(reg a, reg b) { return a / b; }
+  static reg fmadd(reg a, reg b, reg c) { return a * b + c; }
+  static reg fnmadd(reg a, reg b, reg c) { return c - a * b; }
+#if defined(__FMA__)
+  static constexpr bool has_fma = true;
+  static reg fmsub(reg a, reg b, reg c) { return std::fma(a, b, -c); }
+#else
+  static constexpr bool has_fma = false;
+#endif
+  static mask lt(reg a, reg b) { return a < b; }
+  static mask all() { return true; }
+  static mask and_(mask a, mask b) { return a && b; }
+  static mask or_(mask a, mask b) { return a || b; }
+  static mask andnot(mask a, mask b) { return !a && b; }
+  static reg select(mask m, reg a, reg b) { return m ? a : b; }
+  static int bits(mask m) { return m ? 1 : 0; }
+};
+#endif
+
+// Single-precision lanes for --precision mixed: twice the width of VecD.
+#if defined(NF_SIMD_X86) && defined(__AVX512F__)
+struct VecF {
+  static constexpr int lanes = 16;
+  using scalar = float;
+  using reg = __m512;
+  using mask = __mmask16;
+  static reg set1(double v) { return _mm512_set1_ps((float)v); }
+  static reg load(const float *p) { return _mm512_loadu_ps(p); }
+  static void store(float *p, reg v) { _mm512_storeu_ps(p, v); }
+  static reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+  static reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+  static reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+  static reg div(reg a, reg b) { return _mm512_div_ps(a, b); }
+  static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_ps(a, b, c); }
+  static reg fnmadd(reg a, reg b, reg c) { return _mm512_fnmadd_ps(a, b, c); }
+  static mask lt(reg a, reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+  static mask all() { return (mask)0xFFFF; }
+  static mask and_(mask a, mask b) { return (mask)(a & b); }
+  static mask or_(mask a, mask b) { return (mask)(a | b); }
+  static mask andnot(mask a, mask b) { return (mask)(~a & b); } // !a & b
+  static reg select(mask m, reg a, reg b) {
+    return _mm512_mask_blend_ps(m, b, a);
+  }
+  static int bits(mask m) { return (int)m; }
+};
+#elif defined(NF_SIMD_X86) && defined(__AVX2__)
+struct VecF {
+  static constexpr int lanes = 8;
+  using scalar = float;
+  using reg = __m256;
+  using mask = __m256;
+  static reg set1(double v) { return _mm256_set1_ps((float)v); }
+  static reg load(const float *p) { return _mm256_loadu_ps(p); }
+  static void store(float *p, reg v) { _mm256_storeu_ps(p, v); }
+  static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+  static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+  static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+  static reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+#if defined(__FMA__)
+  static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_ps(a, b, c); }
+  static reg fnmadd(reg a, reg b, reg c) { return _mm256_fnmadd_ps(a, b, c); }
+#else
+  static reg fmadd(reg a, reg b, reg c) { return add(mul(a, b), c); }
+  static reg fnmadd(reg a, reg b, reg c) { return sub(c, mul(a, b)); }
+#endif
+  static mask lt(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  static mask all() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+  static mask and_(mask a, mask b) { return _mm256_and_ps(a, b); }
+  static mask or_(mask a, mask b) { return _mm256_or_ps(a, b); }
+  static mask andnot(mask a, mask b) { return _mm256_andnot_ps(a, b); }
+  static reg select(mask m, reg a, reg b) { return _mm256_blendv_ps(b, a, m); }
+  static int bits(mask m) { return _mm256_movemask_ps(m); }
+};
+#elif defined(NF_SIMD_X86)
+struct VecF {
+  static constexpr int lanes = 4;
+  using scalar = float;
+  using reg = __m128;
+  using mask = __m128;
+  static reg set1(double v) { return _mm_set1_ps((float)v); }
+  static reg load(const float *p) { return _mm_loadu_ps(p); }
+  static void store(float *p, reg v) { _mm_storeu_ps(p, v); }
+  static reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+  static reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+  static reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+  static reg div(reg a, reg b) { return _mm_div_ps(a, b); }
+  static reg fmadd(reg a, reg b, reg c) { return add(mul(a, b), c); }
+  static reg fnmadd(reg a, reg b, reg c) { return sub(c, mul(a, b)); }
+  static mask lt(reg a, reg b) { return _mm_cmplt_ps(a, b); }
+  static mask all() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+  static mask and_(mask a, mask b) { return _mm_and_ps(a, b); }
+  static mask or_(mask a, mask b) { return _mm_or_ps(a, b); }
+  static mask andnot(mask a, mask b) { return _mm_andnot_ps(a, b); }
+  static reg select(mask m, reg a, reg b) {
+    return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+  }
+  static int bits(mask m) { return _mm_movemask_ps(m); }
+};
+#else
+struct VecF {
+  static constexpr int lanes = 1;
+  using scalar = float;
+  using reg = float;
+  using mask = bool;
+  static reg set1(double v) { return (float)v; }
+  static reg load(const float *p) { return *p; }
+  static void store(float *p, reg v) { *p = v; }
+  static reg add(reg a, reg b) { return a + b; }
+  static reg sub(reg a, reg b) { return a - b; }
+  static reg mul(reg a, reg b) { return a * b; }
+  static reg div(reg a, reg b) { return a / b; }
+  static reg fmadd(reg a, reg b, reg c) { return a * b + c; }
+  static reg fnmadd(reg a, reg b, reg c) { return c - a * b; }
+  static mask lt(reg a, reg b) { return a < b; }
+  static mask all() { return true; }
+  static mask and_(mask a, mask b) { return a && b; }
+  static mask or_(mask a, mask b) { return a || b; }
+  static mask andnot(mask a, mask b) { return !a && b; }
+  static reg select(mask m, reg a, reg b) { return m ? a : b; }
+  static int bits(mask m) { return m ? 1 : 0; }
+};
+#endif
+
+// Complex value in split real/imag registers.
+template <class V> struct Cx {
+  typename V::reg r, i;
+};
+
+template <class V> inline Cx<V> cmul(Cx<V> a, Cx<V> b) {
+  return {V::fnmadd(a.i, b.i, V::mul(a.r, b.r)),
+          V::fmadd(a.i, b.r, V::mul(a.r, b.i))};
+}
+// a * b + c
+template <class V> inline Cx<V> cmuladd(Cx<V> a, Cx<V> b, Cx<V> c) {
+  return {V::fnmadd(a.i, b.i, V::fmadd(a.r, b.r, c.r)),
+          V::fmadd(a.i, b.r, V::fmadd(a.r, b.i, c.i))};
+}
+template <class V> inline Cx<V> csub(Cx<V> a, Cx<V> b) {
+  return {V::sub(a.r, b.r), V::sub(a.i, b.i)};
+}
+template <class V> inline Cx<V> cscale(Cx<V> a, typename V::reg s) {
+  return {V::mul(a.r, s), V::mul(a.i, s)};
+}
+template <class V> inline typename V::reg cnorm(Cx<V> a) {
+  return V::fmadd(a.r, a.r, V::mul(a.i, a.i));
+}
+// max(|a.r|, |a.i|): a divided by it has a norm in [1, 2]
+template <class V> inline typename V::reg cmaxabs(Cx<V> a) {
+  using reg = typename V::reg;
+  const reg zero = V::set1(0.0);
+  const reg ar = V::select(V::lt(a.r, zero), V::sub(zero, a.r), a.r);
+  const reg ai = V::select(V::lt(a.i, zero), V::sub(zero, a.i), a.i);
+  return V::select(V::lt(ar, ai), ai, ar);
+}
+
+// Double-double lanes (value = hi + lo) for deep zoom. Sums use the cheap
+// "sloppy" addition, whose error is relative to the operands rather than the
+// result; that is the same bound Horner's rule has in plain double.
+template <class V> struct DDv {
+  typename V::reg hi, lo;
+};
+
+template <class V>
+inline DDv<V> dd_quick_two_sum(typename V::reg a, typename V::reg b) {
+  const auto s = V::add(a, b);
+  return {s, V::sub(b, V::sub(s, a))};
+}
+template <class V>
+inline DDv<V> dd_two_sum(typename V::reg a, typename V::reg b) {
+  const auto s = V::add(a, b), bb = V::sub(s, a);
+  return {s, V::add(V::sub(a, V::sub(s, bb)), V::sub(b, bb))};
+}
+template <class V>
+inline DDv<V> dd_two_prod(typename V::reg a, typename V::reg b) {
+  const auto p = V::mul(a, b);
+  if constexpr (V::has_fma) {
+    return {p, V::fmsub(a, b, p)};
+  } else {
+    // Dekker's split into 26-bit halves
+    const auto split = V::set1(134217729.0);
+    const auto ta = V::mul(split, a), tb = V::mul(split, b);
+    const auto ah = V::sub(ta, V::sub(ta, a)), al = V::sub(a, ah);
+    const auto bh = V::sub(tb, V::sub(tb, b)), bl = V::sub(b, bh);
+    auto e = V::sub(V::mul(ah, bh), p);
+    e = V::add(V::add(e, V::mul(ah, bl)), V::mul(al, bh));
+    return {p, V::add(e, V::mul(al, bl))};
+  }
+}
+template <class V> inline DDv<V> dd_add(DDv<V> a, DDv<V> b) {
+  const DDv<V> s = dd_two_sum<V>(a.hi, b.hi);
+  return dd_quick_two_sum<V>(s.hi, V::add(s.lo, V::add(a.lo, b.lo)));
+}
+template <class V> inline DDv<V> dd_sub(DDv<V> a, DDv<V> b) {
+  const DDv<V> s = dd_two_sum<V>(a.hi, V::sub(V::set1(0.0), b.hi));
+  return dd_quick_two_sum<V>(s.hi, V::add(s.lo, V::sub(a.lo, b.lo)));
+}
+template <class V> inline DDv<V> dd_add_d(DDv<V> a, typename V::reg b) {
+  const DDv<V> s = dd_two_sum<V>(a.hi, b);
+  return dd_quick_two_sum<V>(s.hi, V::add(s.lo, a.lo));
+}
+template <class V> inline DDv<V> dd_mul(DDv<V> a, DDv<V> b) {
+  const DDv<V> p = dd_two_prod<V>(a.hi, b.hi);
+  const auto cross = V::fmadd(a.hi, b.lo, V::mul(a.lo, b.hi));
+  return dd_quick_two_sum<V>(p.hi, V::add(p.lo, cross));
+}
+template <class V> inline DDv<V> dd_mul_d(DDv<V> a, typename V::reg b) {
+  const DDv<V> p = dd_two_prod<V>(a.hi, b);
+  return dd_quick_two_sum<V>(p.hi, V::fmadd(a.lo, b, p.lo));
+}
+template <class V> inline DDv<V> dd_div(DDv<V> a, DDv<V> b) {
+  const auto q1 = V::div(a.hi, b.hi);
+  const DDv<V> r = dd_sub(a, dd_mul_d(b, q1));
+  const auto q2 = V::div(r.hi, b.hi);
+  const DDv<V> r2 = dd_sub(r, dd_mul_d(b, q2));
+  return dd_add_d(dd_quick_two_sum<V>(q1, q2), V::div(r2.hi, b.hi));
+}
+template <class V>
+inline DDv<V> dd_select(typename V::mask m, DDv<V> a, DDv<V> b) {
+  return {V::select(m, a.hi, b.hi), V::select(m, a.lo, b.lo)};
+}
+
+// Trap-disk and Brent cycle checks shared by the lane kernels. Cycles use a
+// schedule common to all lanes, which is exact because they start together.
+template <class V> struct LaneStops {
+  using reg = typename V::reg;
+  using mask = typename V::mask;
+  using C = Cx<V>;
+  const KernelPoly &c;
+  const NewtonParams &p;
+  const bool cyc_on, trap_on;
+  const reg ctol2, gate2;
+  reg lab = V::set1(-1.0); // per-lane label, see newton_block
+  C zs;
+  int power = 1, lam = 0;
+
+  LaneStops(const KernelPoly &c_, const NewtonParams &p_, C z0)
+      : c(c_), p(p_), cyc_on(p_.cycle_tol > 0.0),
+        trap_on(c_.trap_steps >= 0 && c_.rtrap2),
+        ctol2(V::set1(p_.cycle_tol * p_.cycle_tol)),
+        gate2(V::set1(c_.trap_gate2)), zs(z0) {}
+
+  // After step it + 1 moved the lanes to z (squared step length step2):
+  // takes trapped and cycling lanes out of active and records their labels.
+  void apply(int it, C z, reg step2, mask &active) {
+    if (trap_on && it + 1 + c.trap_steps <= p.max_iters) {
+      mask g = V::and_(active, V::lt(step2, gate2));
+      for (int j = 0; j < c.nroots && V::bits(g) != 0; ++j) {
+        C d = csub(z, C{V::set1(c.rre[j]), V::set1(c.rim[j])});
+        mask in = V::and_(g, V::lt(cnorm(d), V::set1(c.rtrap2[j])));
+        lab = V::select(in, V::set1(double(j)), lab);
+        g = V::andnot(in, g);
+        active = V::andnot(in, active);
+      }
+    }
+    if (cyc_on) {
+      mask near = V::and_(active, V::lt(cnorm(csub(z, zs)), ctol2));
+      if (V::bits(near) != 0) {
+        // Back at the saved point but not at a root: an attracting cycle
+        reg best = V::set1(1.0); // only compared with 1e-10
+        for (int j = 0; j < c.nroots; ++j) {
+          C d = csub(z, C{V::set1(c.rre[j]), V::set1(c.rim[j])});
+          reg d2 = cnorm(d);
+          best = V::select(V::lt(d2, best), d2, best);
+        }
+        mask cyc = V::andnot(V::lt(best, V::set1(1e-10)), near);
+        lab = V::select(cyc, V::set1(double(kCycleRid)), lab);
+        active = V::andnot(cyc, active);
+      }
+      if (++lam == power) {
+        zs = z;
+        power *= 2;
+        lam = 0;
+      }
+    }
+  }
+};
+
+// Damping, squared tolerance and iteration cap of each lane. From one
+// NewtonParams they are the same in every lane; parameter sweeps load a
+// different variant into each (newton_row_sweep_block).
+template <class V> struct LaneParams {
+  using reg = typename V::reg;
+  reg damp, tol2, cap;
+  int max_iters;     // largest cap: the loop bound
+  bool caps = false; // caps differ, so lanes stop at their own
+
+  explicit LaneParams(const NewtonParams &p)
+      : damp(V::set1(p.damping)), tol2(V::set1(p.tol * p.tol)),
+        cap(V::set1(double(p.max_iters))), max_iters(p.max_iters) {}
+  LaneParams(reg damp_, reg tol2_, reg cap_, int max_iters_, bool caps_)
+      : damp(damp_), tol2(tol2_), cap(cap_), max_iters(max_iters_),
+        caps(caps_) {}
+};
+
+// Iterates V::lanes starting points (zr, zi) in place with method M. On
+// return zr/zi hold the final iterates and k the per-lane iteration count,
+// with the same stopping rules as newton_iterate. lab_out gets the root id of
+// lanes that stopped in a trap disk, kCycleRid for cycles, otherwise -1.
+// Damping, tol and max_iters come from lp; the rest of p applies to all.
+template <class V, Method M, class T = typename V::scalar>
+inline void newton_block(T *zr_io, T *zi_io, T *k_out, T *lab_out,
+                         const KernelPoly &c, const NewtonParams &p,
+                         const LaneParams<V> &lp) {
+  using reg = typename V::reg;
+  using mask = typename V::mask;
+  using C = Cx<V>;
+  const int n = c.degree;
+  // |f'|^2 below this counts as a critical point (1e-60 underflows float)
+  const double tiny2 = sizeof(T) == sizeof(double) ? 1e-60 : 1e-30;
+  // |den|^2 from this on is recomputed scaled, well short of overflow
+  const double big2 = sizeof(T) == sizeof(double) ? 1e150 : 1e18;
+  const reg tiny2v = V::set1(tiny2), big2v = V::set1(big2), tol2 = lp.tol2;
+  const reg damp = lp.damp, one = V::set1(1.0);
+  const reg zero = V::set1(0.0), two = V::set1(2.0), three = V::set1(3.0);
+  C z{V::load(zr_io), V::load(zi_io)};
+  reg cnt = V::set1(0.0);
+  mask active = V::all();
+  LaneStops<V> stops(c, p, z);
+  for (int it = 0; it < lp.max_iters; ++it) {
+    // Fused Horner for f and the derivatives M needs
+    C f{V::set1(c.cre[0]), V::set1(c.cim[0])};
+    C d1{zero, zero}, d2{zero, zero}, d3{zero, zero};
+    for (int j = 1; j <= n; ++j) {
+      if constexpr (M == Method::Householder3)
+        d3 = cmuladd(d3, z, cscale(d2, three));
+      if constexpr (M != Method::Newton)
+        d2 = cmuladd(d2, z, cscale(d1, two));
+      d1 = cmuladd(d1, z, f);
+      f = cmuladd(f, z, C{V::set1(c.cre[j]), V::set1(c.cim[j])});
+    }
+    C num = f, den = d1;
+    if constexpr (M == Method::Halley) {
+      num = cscale(cmul(f, d1), two);
+      den = csub(cscale(cmul(d1, d1), two), cmul(f, d2));
+    } else if constexpr (M == Method::Schroder) {
+      num = cmul(f, d1);
+      den = csub(cmul(d1, d1), cmul(f, d2));
+    } else if constexpr (M == Method::Householder3) {
+      const C d1sq = cmul(d1, d1), fd2 = cmul(f, d2);
+      num = cmul(f, csub(d1sq, cscale(fd2, V::set1(0.5))));
+      den = cmuladd(cmul(f, f), cscale(d3, V::set1(1.0 / 6.0)),
+                    cmul(d1, csub(d1sq, fd2)));
+    }
+    // Lanes with a near-critical derivative stop without counting the step
+    mask ok = V::andnot(V::lt(cnorm(d1), tiny2v), active);
+    if constexpr (M != Method::Newton)
+      ok = V::andnot(V::lt(cnorm(den), tiny2v), ok);
+    C ds = den;
+    const reg n2 = cnorm(den);
+    reg s = V::div(damp, n2), f2 = cnorm(f);
+    // Far from the roots of a high degree |den|^2 overflows, and damp / inf
+    // would make a zero step that passes for convergence. Then den (and f
+    // for f2) is divided by its larger part first, as complex division does
+    if (V::bits(V::andnot(V::lt(n2, big2v), ok))) [[unlikely]] {
+      const reg m = cmaxabs(den), mf = cmaxabs(f);
+      ds = cscale(den, V::div(one, m));
+      s = V::div(damp, V::mul(m, cnorm(ds)));
+      f2 = V::select(V::lt(mf, one), f2,
+                     V::mul(V::mul(mf, mf), cnorm(cscale(f, V::div(one, mf)))));
+    }
+    reg sr = V::mul(V::fmadd(num.r, ds.r, V::mul(num.i, ds.i)), s);
+    reg si = V::mul(V::fnmadd(num.r, ds.i, V::mul(num.i, ds.r)), s);
+    reg step2 = V::fmadd(sr, sr, V::mul(si, si));
+    mask conv = V::and_(ok, V::or_(V::lt(step2, tol2), V::lt(f2, tol2)));
+    cnt = V::select(ok, V::add(cnt, one), cnt);
+    z.r = V::select(ok, V::sub(z.r, sr), z.r);
+    z.i = V::select(ok, V::sub(z.i, si), z.i);
+    active = V::andnot(conv, ok);
+    stops.apply(it, z, step2, active);
+    // After the checks, as a lane's last step gets them with one cap
+    if (lp.caps)
+      active = V::and_(active, V::lt(cnt, lp.cap));
+    if (V::bits(active) == 0)
+      break;
+  }
+  V::store(zr_io, z.r);
+  V::store(zi_io, z.i);
+  V::store(k_out, cnt);
+  V::store(lab_out, stops.lab);
+}
+
+template <class V, class T = typename V::scalar>
+inline void newton_block(T *zr_io, T *zi_io, T *k_out, T *lab_out,
+                         const KernelPoly &c, const NewtonParams &p,
+                         const LaneParams<V> &lp) {
+  switch (p.method) {
+  case Method::Halley:
+    return newton_block<V, Method::Halley>(zr_io, zi_io, k_out, lab_out, c,
+                                           p, lp);
+  case Method::Householder3:
+    return newton_block<V, Method::Householder3>(zr_io, zi_io, k_out, lab_out,
+                                                 c, p, lp);
+  case Method::Schroder:
+    return newton_block<V, Method::Schroder>(zr_io, zi_io, k_out, lab_out, c,
+                                             p, lp);
+  default:
+    return newton_block<V, Method::Newton>(zr_io, zi_io, k_out, lab_out, c,
+                                           p, lp);
+  }
+}
+
+template <class V, class T = typename V::scalar>
+inline void newton_block(T *zr_io, T *zi_io, T *k_out, T *lab_out,
+                         const KernelPoly &c, const NewtonParams &p) {
+  newton_block<V, T>(zr_io, zi_io, k_out, lab_out, c, p, LaneParams<V>(p));
+}
+
+// newton_block for deep zoom: Newton's method with z, f and f' in
+// double-double, so that starting points closer together than a double ulp
+// still follow their own orbits. Trap and cycle checks use the hi words.
+template <class V>
+inline void newton_block_dd(double *zr_io, double *zrl_io, double *zi_io,
+                            double *zil_io, double *k_out, double *lab_out,
+                            const KernelPoly &c, const NewtonParams &p) {
+  using reg = typename V::reg;
+  using mask = typename V::mask;
+  using D = DDv<V>;
+  const reg tiny2 = V::set1(1e-60), tol2 = V::set1(p.tol * p.tol);
+  const reg damp = V::set1(p.damping), one = V::set1(1.0);
+  const reg zero = V::set1(0.0);
+  D zr{V::load(zr_io), V::load(zrl_io)}, zi{V::load(zi_io), V::load(zil_io)};
+  reg cnt = zero;
+  mask active = V::all();
+  LaneStops<V> stops(c, p, Cx<V>{zr.hi, zi.hi});
+  for (int it = 0; it < p.max_iters; ++it) {
+    D fr{V::set1(c.cre[0]), zero}, fi{V::set1(c.cim[0]), zero};
+    D dr{zero, zero}, di{zero, zero};
+    for (int j = 1; j <= c.degree; ++j) {
+      // d = d * z + f, then f = f * z + c_j
+      const D dr1 = dd_add(dd_sub(dd_mul(dr, zr), dd_mul(di, zi)), fr);
+      di = dd_add(dd_add(dd_mul(dr, zi), dd_mul(di, zr)), fi);
+      dr = dr1;
+      const D fr1 = dd_add_d(dd_sub(dd_mul(fr, zr), dd_mul(fi, zi)),
+                             V::set1(c.cre[j]));
+      fi = dd_add_d(dd_add(dd_mul(fr, zi), dd_mul(fi, zr)), V::set1(c.cim[j]));
+      fr = fr1;
+    }
+    // step = damping * f * conj(f') / |f'|^2, with f' scaled by inv (its
+    // larger part's reciprocal, as in newton_block) so |f'|^2 cannot
+    // overflow; inv cancels exactly whatever its rounding
+    const Cx<V> d1{dr.hi, di.hi};
+    const mask ok = V::andnot(V::lt(cnorm(d1), tiny2), active);
+    const reg inv = V::div(one, cmaxabs(d1));
+    const D sdr = dd_mul_d(dr, inv), sdi = dd_mul_d(di, inv);
+    const D den = dd_add(dd_mul(sdr, sdr), dd_mul(sdi, sdi));
+    const D nr = dd_add(dd_mul(fr, sdr), dd_mul(fi, sdi));
+    const D ni = dd_sub(dd_mul(fi, sdr), dd_mul(fr, sdi));
+    const D sr = dd_mul_d(dd_mul_d(dd_div(nr, den), inv), damp);
+    const D si = dd_mul_d(dd_mul_d(dd_div(ni, den), inv), damp);
+    const reg step2 = V::fmadd(sr.hi, sr.hi, V::mul(si.hi, si.hi));
+    const Cx<V> fh{fr.hi, fi.hi};
+    const reg mf = cmaxabs(fh);
+    const reg f2 =
+        V::select(V::lt(mf, one), cnorm(fh),
+                  V::mul(V::mul(mf, mf), cnorm(cscale(fh, V::div(one, mf)))));
+    mask conv = V::and_(ok, V::or_(V::lt(step2, tol2), V::lt(f2, tol2)));
+    cnt = V::select(ok, V::add(cnt, one), cnt);
+    zr = dd_select<V>(ok, dd_sub(zr, sr), zr);
+    zi = dd_select<V>(ok, dd_sub(zi, si), zi);
+    active = V::andnot(conv, ok);
+    stops.apply(it, Cx<V>{zr.hi, zi.hi}, step2, active);
+    if (V::bits(active) == 0)
+      break;
+  }
+  V::store(zr_io, zr.hi);
+  V::store(zrl_io, zr.lo);
+  V::store(zi_io, zi.hi);
+  V::store(zil_io, zi.lo);
+  V::store(k_out, cnt);
+  V::store(lab_out, stops.lab);
+}
+
+// Index of the root within 1e-5 of z, or -1 (nearest_root without sqrt).
+inline int nearest_root_planes(double zr, double zi, const KernelPoly &c) {
+  int rid = -1;
+  double best = 1e300;
+  for (int i = 0; i < c.nroots; ++i) {
+    double ddr = zr - c.rre[i], ddi = zi - c.rim[i];
+    double d2 = ddr * ddr + ddi * ddi;
+    if (d2 < best) {
+      best = d2;
+      rid = i;
+    }
+  }
+  return best > 1e-10 ? -1 : rid;
+}
+
+// Row entry point (RowKernelFn) for this ISA level.
+inline void newton_row_block(const double *zr, const double *zi, int n,
+                             const KernelPoly &c, const NewtonParams &p,
+                             int *rid, int *iters) {
+  constexpr int L = VecD::lanes;
+  double br[L], bi[L], bk[L], bl[L];
+  for (int i0 = 0; i0 < n; i0 += L) {
+    const int m = n - i0 < L ? n - i0 : L;
+    // Pad a short tail with its last point so every lane does useful work
+    for (int l = 0; l < L; ++l) {
+      const int j = i0 + (l < m ? l : m - 1);
+      br[l] = zr[j];
+      bi[l] = zi[j];
+    }
+    newton_block<VecD>(br, bi, bk, bl, c, p);
+    for (int l = 0; l < m; ++l) {
+      rid[i0 + l] =
+          bl[l] != -1.0 ? (int)bl[l] : nearest_root_planes(br[l], bi[l], c);
+      iters[i0 + l] = (int)bk[l];
+    }
+  }
+}
+
+// Row entry point for parameter sweeps (RowSweepFn): as newton_row_block,
+// with point i iterating under damping[i], tol[i] and max_iters[i], so a
+// block can hold several variants of one starting point.
+inline void newton_row_sweep_block(const double *zr, const double *zi,
+                                   const double *damping, const double *tol,
+                                   const int *max_iters, int n,
+                                   const KernelPoly &c, const NewtonParams &p,
+                                   int *rid, int *iters) {
+  constexpr int L = VecD::lanes;
+  double br[L], bi[L], bk[L], bl[L], bd[L], bt[L], bc[L];
+  for (int i0 = 0; i0 < n; i0 += L) {
+    const int m = n - i0 < L ? n - i0 : L;
+    int cap = 0;
+    bool caps = false;
+    for (int l = 0; l < L; ++l) {
+      const int j = i0 + (l < m ? l : m - 1);
+      br[l] = zr[j];
+      bi[l] = zi[j];
+      bd[l] = damping[j];
+      bt[l] = tol[j] * tol[j];
+      bc[l] = double(max_iters[j]);
+      caps = caps || (l > 0 && max_iters[j] != cap);
+      cap = max_iters[j] > cap ? max_iters[j] : cap;
+    }
+    const LaneParams<VecD> lp(VecD::load(bd), VecD::load(bt),
+                              VecD::load(bc), cap, caps);
+    newton_block<VecD>(br, bi, bk, bl, c, p, lp);
+    for (int l = 0; l < m; ++l) {
+      rid[i0 + l] =
+          bl[l] != -1.0 ? (int)bl[l] : nearest_root_planes(br[l], bi[l], c);
+      iters[i0 + l] = (int)bk[l];
+    }
+  }
+}
+
+// Row entry point for deep zoom (RowDeepFn): as newton_row_block with
+// double-double starting points (zr + zr_lo, zi + zi_lo). Method::Newton.
+inline void newton_row_dd_block(const double *zr, const double *zr_lo,
+                                const double *zi, const double *zi_lo, int n,
+                                const KernelPoly &c, const NewtonParams &p,
+                                int *rid, int *iters) {
+  constexpr int L = VecD::lanes;
+  double br[L], brl[L], bi[L], bil[L], bk[L], bl[L];
+  for (int i0 = 0; i0 < n; i0 += L) {
+    const int m = n - i0 < L ? n - i0 : L;
+    for (int l = 0; l < L; ++l) {
+      const int j = i0 + (l < m ? l : m - 1);
+      br[l] = zr[j];
+      brl[l] = zr_lo[j];
+      bi[l] = zi[j];
+      bil[l] = zi_lo[j];
+    }
+    newton_block_dd<VecD>(br, brl, bi, bil, bk, bl, c, p);
+    for (int l = 0; l < m; ++l) {
+      rid[i0 + l] =
+          bl[l] != -1.0 ? (int)bl[l] : nearest_root_planes(br[l], bi[l], c);
+      iters[i0 + l] = (int)bk[l];
+    }
+  }
+}
+
+// The float pass of --precision mixed needs a polynomial whose Horner sums
+// stay well inside float range.
+inline bool float_safe(const KernelPoly &c) {
+  if (c.degree > 64)
+    return false;
+  for (int j = 0; j <= c.degree; ++j)
+    if (!(c.cre[j] * c.cre[j] + c.cim[j] * c.cim[j] < 1e30))
+      return false;
+  return true;
+}
+
+// Label for a float iterate: the root it ended within 1e-4 of, provided every
+// other root is at least ten times farther away; otherwise -1.
+inline int classify_float(double zr, double zi, const KernelPoly &c) {
+  int rid = -1;
+  double best = 1e300, second = 1e300;
+  for (int i = 0; i < c.nroots; ++i) {
+    double ddr = zr - c.rre[i], ddi = zi - c.rim[i];
+    double d2 = ddr * ddr + ddi * ddi;
+    if (d2 < best) {
+      second = best;
+      best = d2;
+      rid = i;
+    } else if (d2 < second) {
+      second = d2;
+    }
+  }
+  return best < 1e-8 && second > 100.0 * best ? rid : -1;
+}
+
+// Row entry point for --precision mixed (RowMixedFn). A float pass with twice
+// the lanes labels the points that settle cleanly on a root; the rest (no
+// convergence within the float iteration cap, critical points, ambiguous
+// endings) are recomputed by newton_row_block. Returns that count.
+inline int newton_row_mixed_block(const double *zr, const double *zi, int n,
+                                  const KernelPoly &c, const NewtonParams &p,
+                                  int *rid, int *iters) {
+  if (p.method != Method::Newton || !float_safe(c)) {
+    newton_row_block(zr, zi, n, c, p, rid, iters);
+    return n;
+  }
+  NewtonParams pf = p;
+  pf.tol = p.tol > 1e-6 ? p.tol : 1e-6; // float resolves steps to ~1e-7
+  pf.max_iters = p.max_iters < 64 ? p.max_iters : 64;
+  pf.cycle_tol = 0.0; // cycles end at the cap and go to double
+  constexpr int L = VecF::lanes, B = 256;
+  float br[L], bi[L], bk[L], bl[L];
+  double fr[B], fi[B];
+  int fidx[B], frid[B], fk[B];
+  int redone = 0;
+  for (int b0 = 0; b0 < n; b0 += B) {
+    const int nb = n - b0 < B ? n - b0 : B;
+    int nf = 0;
+    for (int i0 = 0; i0 < nb; i0 += L) {
+      const int m = nb - i0 < L ? nb - i0 : L;
+      for (int l = 0; l < L; ++l) {
+        const int j = b0 + i0 + (l < m ? l : m - 1);
+        br[l] = (float)zr[j];
+        bi[l] = (float)zi[j];
+      }
+      newton_block<VecF>(br, bi, bk, bl, c, pf);
+      for (int l = 0; l < m; ++l) {
+        const int i = b0 + i0 + l, k = (int)bk[l];
+        int r = (int)bl[l]; // trapped root, or -1
+        if (r < 0 && k < pf.max_iters)
+          r = classify_float(br[l], bi[l], c);
+        if (r >= 0) {
+          rid[i] = r;
+          iters[i] = k;
+        } else {
+          fidx[nf] = i;
+          fr[nf] = zr[i];
+          fi[nf] = zi[i];
+          ++nf;
+        }
+      }
+    }
+    if (nf > 0) {
+      newton_row_block(fr, fi, nf, c, p, frid, fk);
+      for (int j = 0; j < nf; ++j) {
+        rid[fidx[j]] = frid[j];
+        iters[fidx[j]] = fk[j];
+      }
+      redone += nf;
+    }
+  }
+  return redone;
+}
+
+} // namespace NF_SIMD_NS
+} // namespace simd
@@ -0,0 +1,76 @@
+#pragma once
+// A single-slot encode pipeline: one encoder thread for a whole run, handed
+// one slot at a time, so that slot k is encoded while slot k + 1 is computed
+// and the encoder's OpenMP team is started once. The encode callback runs on
+// that thread; --strip-rows, --batch and --animate keep two slots, one
+// being computed while the other is encoded.
+#include "tiles.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+template <class Slot> class EncodePipeline {
+public:
+  explicit EncodePipeline(std::function<void(Slot &)> encode)
+      : encode_(std::move(encode)), threads_(pool_threads()),
+        thread_([this] { run(); }) {}
+  ~EncodePipeline() { close(); }
+  EncodePipeline(const EncodePipeline &) = delete;
+  EncodePipeline &operator=(const EncodePipeline &) = delete;
+
+  // Waits until the slot handed over last has been encoded.
+  void finish() {
+    std::unique_lock<std::mutex> lk(mu_);
+    cv_.wait(lk, [&] { return !todo_; });
+  }
+
+  // Hands s to the encoder; call finish() first so the slot is free.
+  void push(Slot &s) {
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      todo_ = &s;
+    }
+    cv_.notify_all();
+  }
+
+  // Encodes what is pending and stops the thread.
+  void close() {
+    if (!thread_.joinable())
+      return;
+    finish();
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      quit_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+  }
+
+private:
+  void run() {
+#if defined(_OPENMP)
+    omp_set_num_threads(threads_);
+#endif
+    std::unique_lock<std::mutex> lk(mu_);
+    for (;;) {
+      cv_.wait(lk, [&] { return todo_ || quit_; });
+      if (!todo_)
+        return;
+      lk.unlock();
+      encode_(*todo_);
+      lk.lock();
+      todo_ = nullptr;
+      cv_.notify_all();
+    }
+  }
+
+  std::function<void(Slot &)> encode_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  Slot *todo_ = nullptr;
+  bool quit_ = false;
+  int threads_;
+  std::thread thread_; // last: started once the rest is set up
+};
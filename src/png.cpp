@@ -0,0 +1,791 @@
+#include "png.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+namespace {
+
+// ---- checksums ----
+
+// CRC-32 tables for slice-by-8: t[k][b] is the CRC of byte b followed by k
+// zero bytes, so eight input bytes take eight independent lookups.
+struct CrcTables {
+  uint32_t t[8][256];
+  CrcTables() {
+    for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++)
+        c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      t[0][n] = c;
+    }
+    for (uint32_t n = 0; n < 256; n++)
+      for (int k = 1; k < 8; k++)
+        t[k][n] = (t[k - 1][n] >> 8) ^ t[0][t[k - 1][n] & 0xff];
+  }
+};
+const CrcTables &crc_tables() {
+  static const CrcTables tab;
+  return tab;
+}
+
+inline uint32_t load32le(const uint8_t *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+inline void put32be(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)(v >> 24);
+  p[1] = (uint8_t)(v >> 16);
+  p[2] = (uint8_t)(v >> 8);
+  p[3] = (uint8_t)v;
+}
+
+// ---- deflate ----
+
+constexpr int kWindow = 32768, kMinMatch = 3, kMaxMatch = 258;
+constexpr int kHashBits = 15;
+constexpr size_t kBlockSyms = 1 << 15; // symbols per Huffman block
+
+const uint16_t kLenBase[29] = {3,  4,  5,  6,   7,   8,   9,   10,  11, 13,
+                               15, 17, 19, 23,  27,  31,  35,  43,  51, 59,
+                               67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t kLenExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                               2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t kDistBase[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const uint8_t kDistExtra[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+const uint8_t kClOrder[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                              11, 4,  12, 3, 13, 2, 14, 1, 15};
+
+// Length -> length code - 257, and distance - 1 -> distance code (below 256
+// directly, above by (d - 1) >> 7, as zlib does).
+struct CodeTables {
+  uint8_t len[kMaxMatch + 1];
+  uint8_t dist_lo[256], dist_hi[256];
+  CodeTables() {
+    for (int c = 0; c < 29; c++) {
+      const int top = c == 28 ? kMaxMatch : kLenBase[c] + (1 << kLenExtra[c]);
+      for (int l = kLenBase[c]; l < std::min(top, kMaxMatch + 1); l++)
+        len[l] = (uint8_t)c;
+    }
+    len[kMaxMatch] = 28;
+    for (int c = 0; c < 30; c++)
+      for (int d = kDistBase[c]; d < kDistBase[c] + (1 << kDistExtra[c]);
+           d++) {
+        if (d <= 256)
+          dist_lo[d - 1] = (uint8_t)c;
+        else
+          dist_hi[(d - 1) >> 7] = (uint8_t)c;
+      }
+  }
+  int dist_code(int d) const {
+    return d <= 256 ? dist_lo[d - 1] : dist_hi[(d - 1) >> 7];
+  }
+};
+const CodeTables &code_tables() {
+  static const CodeTables tab;
+  return tab;
+}
+
+// LSB-first bit packer appending to a byte vector.
+struct BitWriter {
+  std::vector<uint8_t> &out;
+  uint64_t acc = 0;
+  int n = 0;
+  void put(uint32_t bits, int len) {
+    acc |= (uint64_t)bits << n;
+    n += len;
+    while (n >= 8) {
+      out.push_back((uint8_t)acc);
+      acc >>= 8;
+      n -= 8;
+    }
+  }
+  void align() {
+    if (n > 0)
+      put(0, 8 - n);
+  }
+};
+
+// Code lengths, at most limit bits, for the symbols with nonzero freq. A
+// plain Huffman tree; while it is too deep the frequencies are halved
+// (keeping every used symbol), which flattens it.
+void huffman_lengths(const uint32_t *freq, int n, int limit, uint8_t *len) {
+  std::vector<uint32_t> f(freq, freq + n);
+  std::fill(len, len + n, 0);
+  for (;;) {
+    std::vector<int> sym;
+    for (int i = 0; i < n; i++)
+      if (f[(size_t)i])
+        sym.push_back(i);
+    if (sym.empty())
+      return;
+    if (sym.size() == 1) {
+      // Two one-bit codes: inflaters reject an incomplete code-length code
+      len[sym[0]] = 1;
+      len[sym[0] == 0 ? 1 : 0] = 1;
+      return;
+    }
+    std::sort(sym.begin(), sym.end(), [&](int a, int b) {
+      return f[(size_t)a] != f[(size_t)b] ? f[(size_t)a] < f[(size_t)b]
+                                          : a < b;
+    });
+    // Two-queue construction: leaves in sym order, internal nodes in the
+    // order they are made (already sorted by weight)
+    const size_t m = sym.size();
+    std::vector<uint64_t> w(2 * m);
+    std::vector<int> parent(2 * m, -1);
+    for (size_t i = 0; i < m; i++)
+      w[i] = f[(size_t)sym[i]];
+    size_t leaf = 0, node = m, made = m;
+    auto take = [&]() {
+      if (leaf < m && (node == made || w[leaf] <= w[node]))
+        return leaf++;
+      return node++;
+    };
+    while (made < 2 * m - 1) {
+      const size_t a = take(), b = take();
+      w[made] = w[a] + w[b];
+      parent[a] = parent[b] = (int)made;
+      ++made;
+    }
+    std::vector<int> depth(2 * m - 1, 0);
+    int deepest = 0;
+    for (size_t i = 2 * m - 1; i-- > 0;) {
+      if (parent[i] >= 0)
+        depth[i] = depth[(size_t)parent[i]] + 1;
+      if (i < m)
+        deepest = std::max(deepest, depth[i]);
+    }
+    if (deepest <= limit) {
+      for (size_t i = 0; i < m; i++)
+        len[sym[i]] = (uint8_t)depth[i];
+      return;
+    }
+    for (uint32_t &x : f)
+      x = x ? (x >> 1) | 1 : 0;
+  }
+}
+
+// Canonical codes for the lengths, bit-reversed for the LSB-first stream.
+void canonical_codes(const uint8_t *len, int n, uint16_t *code) {
+  int count[16] = {0}, next[16] = {0};
+  for (int i = 0; i < n; i++)
+    count[len[i]]++;
+  count[0] = 0;
+  for (int b = 1, c = 0; b < 16; b++) {
+    c = (c + count[b - 1]) << 1;
+    next[b] = c;
+  }
+  for (int i = 0; i < n; i++) {
+    if (!len[i])
+      continue;
+    uint32_t c = (uint32_t)next[len[i]]++, r = 0;
+    for (int b = 0; b < len[i]; b++, c >>= 1)
+      r = (r << 1) | (c & 1);
+    code[i] = (uint16_t)r;
+  }
+}
+
+// A literal (dist == 0) or a match.
+struct Sym {
+  uint16_t lit_or_len, dist;
+};
+
+void put_stored(BitWriter &bw, const uint8_t *p, size_t n, bool final) {
+  do {
+    const size_t k = std::min<size_t>(n, 65535);
+    bw.put(final && k == n ? 1 : 0, 1);
+    bw.put(0, 2);
+    bw.align();
+    bw.put((uint32_t)k, 16);
+    bw.put((uint32_t)(~k & 0xffff), 16);
+    bw.out.insert(bw.out.end(), p, p + k);
+    p += k;
+    n -= k;
+  } while (n > 0);
+}
+
+// One block: dynamic Huffman, or stored when that is smaller. raw is the
+// input the symbols cover.
+void put_block(BitWriter &bw, const std::vector<Sym> &syms, const uint8_t *raw,
+               size_t raw_n) {
+  const CodeTables &ct = code_tables();
+  uint32_t lf[286] = {0}, df[30] = {0};
+  for (const Sym &s : syms) {
+    if (s.dist == 0) {
+      lf[s.lit_or_len]++;
+    } else {
+      lf[257 + ct.len[s.lit_or_len]]++;
+      df[ct.dist_code(s.dist)]++;
+    }
+  }
+  lf[256] = 1;
+  uint8_t ll[286], dl[30];
+  huffman_lengths(lf, 286, 15, ll);
+  huffman_lengths(df, 30, 15, dl);
+  if (std::all_of(dl, dl + 30, [](uint8_t l) { return l == 0; }))
+    dl[0] = 1; // at least one distance code
+  int hlit = 286, hdist = 30;
+  while (hlit > 257 && ll[hlit - 1] == 0)
+    --hlit;
+  while (hdist > 1 && dl[hdist - 1] == 0)
+    --hdist;
+  // Code lengths, run-length coded with 16 (repeat previous), 17 and 18
+  // (zeros)
+  uint8_t lens[286 + 30];
+  std::copy(ll, ll + hlit, lens);
+  std::copy(dl, dl + hdist, lens + hlit);
+  const int nl = hlit + hdist;
+  std::vector<std::pair<uint8_t, uint8_t>> rle; // symbol, extra value
+  uint32_t cf[19] = {0};
+  for (int i = 0; i < nl;) {
+    int run = 1;
+    while (i + run < nl && lens[i + run] == lens[i])
+      ++run;
+    if (lens[i] == 0 && run >= 3) {
+      const int k = std::min(run, 138);
+      rle.push_back(k >= 11 ? std::make_pair(uint8_t(18), uint8_t(k - 11))
+                            : std::make_pair(uint8_t(17), uint8_t(k - 3)));
+      i += k;
+    } else if (lens[i] != 0 && run >= 4) {
+      rle.push_back({lens[i], 0});
+      const int k = std::min(run - 1, 6);
+      rle.push_back({16, (uint8_t)(k - 3)});
+      i += 1 + k;
+    } else {
+      rle.push_back({lens[i], 0});
+      i += 1;
+    }
+  }
+  for (const auto &r : rle)
+    cf[r.first]++;
+  uint8_t cl[19];
+  huffman_lengths(cf, 19, 7, cl);
+  int hclen = 19;
+  while (hclen > 4 && cl[kClOrder[hclen - 1]] == 0)
+    --hclen;
+
+  uint64_t bits = 3 + 5 + 5 + 4 + 3 * (uint64_t)hclen;
+  for (const auto &r : rle)
+    bits += cl[r.first] + (r.first == 16 ? 2 : r.first == 17 ? 3
+                           : r.first == 18 ? 7 : 0);
+  for (int s = 0; s < 286; s++)
+    bits += (uint64_t)lf[s] * ll[s];
+  for (int c = 0; c < 29; c++)
+    bits += (uint64_t)lf[257 + c] * kLenExtra[c];
+  for (int c = 0; c < 30; c++)
+    bits += (uint64_t)df[c] * (dl[c] + kDistExtra[c]);
+  const uint64_t stored = (raw_n + 5 * (raw_n / 65535 + 1)) * 8 + 7;
+  if (stored < bits) {
+    put_stored(bw, raw, raw_n, false);
+    return;
+  }
+
+  uint16_t lc[286] = {0}, dc[30] = {0}, cc[19] = {0};
+  canonical_codes(ll, 286, lc);
+  canonical_codes(dl, 30, dc);
+  canonical_codes(cl, 19, cc);
+  bw.put(0, 1); // not final
+  bw.put(2, 2); // dynamic Huffman
+  bw.put((uint32_t)(hlit - 257), 5);
+  bw.put((uint32_t)(hdist - 1), 5);
+  bw.put((uint32_t)(hclen - 4), 4);
+  for (int i = 0; i < hclen; i++)
+    bw.put(cl[kClOrder[i]], 3);
+  for (const auto &r : rle) {
+    bw.put(cc[r.first], cl[r.first]);
+    if (r.first >= 16)
+      bw.put(r.second, r.first == 16 ? 2 : r.first == 17 ? 3 : 7);
+  }
+  for (const Sym &s : syms) {
+    if (s.dist == 0) {
+      bw.put(lc[s.lit_or_len], ll[s.lit_or_len]);
+      continue;
+    }
+    const int c = ct.len[s.lit_or_len];
+    bw.put(lc[257 + c], ll[257 + c]);
+    bw.put((uint32_t)(s.lit_or_len - kLenBase[c]), kLenExtra[c]);
+    const int d = ct.dist_code(s.dist);
+    bw.put(dc[d], dl[d]);
+    bw.put((uint32_t)(s.dist - kDistBase[d]), kDistExtra[d]);
+  }
+  bw.put(lc[256], ll[256]);
+}
+
+inline uint32_t hash3(const uint8_t *p) {
+  const uint32_t v = (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+                     (uint32_t)p[2] << 16;
+  return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+// Length of the common prefix of a and b, at most max.
+inline int match_len(const uint8_t *a, const uint8_t *b, int max) {
+  int l = 0;
+  while (l + 8 <= max) {
+    uint64_t x, y;
+    std::memcpy(&x, a + l, 8);
+    std::memcpy(&y, b + l, 8);
+    if (x != y) {
+#if defined(__GNUC__)
+      if constexpr (std::endian::native == std::endian::little)
+        return l + (__builtin_ctzll(x ^ y) >> 3);
+#endif
+      break;
+    }
+    l += 8;
+  }
+  while (l < max && a[l] == b[l])
+    ++l;
+  return l;
+}
+
+// Filters of one row into out[0] (type byte) .. out[row_bytes]; prev is the
+// row above (all zeros for the first). Each candidate is scored by the sum
+// of its bytes as signed values, the usual heuristic.
+void filter_row(const uint8_t *cur, const uint8_t *prev, size_t row_bytes,
+                int bpp, bool adaptive, uint8_t *out, uint8_t *tmp) {
+  out[0] = 0;
+  std::memcpy(out + 1, cur, row_bytes);
+  if (!adaptive)
+    return;
+  auto score = [&](const uint8_t *p) {
+    uint64_t s = 0;
+    for (size_t i = 0; i < row_bytes; i++)
+      s += (uint64_t)std::abs((int)(int8_t)p[i]);
+    return s;
+  };
+  uint64_t best = score(out + 1);
+  const size_t b = (size_t)bpp;
+  for (uint8_t type = 1; type <= 4; type++) {
+    for (size_t i = 0; i < row_bytes; i++) {
+      const int a = i >= b ? cur[i - b] : 0, u = prev[i];
+      const int c = i >= b ? prev[i - b] : 0;
+      int pred;
+      if (type == 1) {
+        pred = a;
+      } else if (type == 2) {
+        pred = u;
+      } else if (type == 3) {
+        pred = (a + u) >> 1;
+      } else {
+        const int p = a + u - c, pa = std::abs(p - a), pb = std::abs(p - u),
+                  pc = std::abs(p - c);
+        pred = pa <= pb && pa <= pc ? a : pb <= pc ? u : c;
+      }
+      tmp[i] = (uint8_t)(cur[i] - pred);
+    }
+    const uint64_t s = score(tmp);
+    if (s < best) {
+      best = s;
+      out[0] = type;
+      std::memcpy(out + 1, tmp, row_bytes);
+    }
+  }
+}
+
+} // namespace
+
+uint32_t crc32_update(uint32_t crc, const uint8_t *p, size_t n) {
+  const auto &t = crc_tables().t;
+  crc = ~crc;
+  while (n >= 8) {
+    const uint32_t a = load32le(p) ^ crc, b = load32le(p + 4);
+    crc = t[7][a & 0xff] ^ t[6][(a >> 8) & 0xff] ^ t[5][(a >> 16) & 0xff] ^
+          t[4][a >> 24] ^ t[3][b & 0xff] ^ t[2][(b >> 8) & 0xff] ^
+          t[1][(b >> 16) & 0xff] ^ t[0][b >> 24];
+    p += 8;
+    n -= 8;
+  }
+  while (n--)
+    crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+uint32_t adler32_update(uint32_t adler, const uint8_t *p, size_t n) {
+  // 5552 bytes is the most that cannot overflow 32 bits before the modulo
+  constexpr uint32_t kBase = 65521;
+  constexpr size_t kNMax = 5552;
+  uint32_t s1 = adler & 0xffff, s2 = adler >> 16;
+  while (n > 0) {
+    const size_t k = std::min(n, kNMax);
+    for (size_t i = 0; i < k; i++) {
+      s1 += p[i];
+      s2 += s1;
+    }
+    s1 %= kBase;
+    s2 %= kBase;
+    p += k;
+    n -= k;
+  }
+  return s2 << 16 | s1;
+}
+
+uint32_t adler32_combine(uint32_t a, uint32_t b, size_t len_b) {
+  constexpr uint64_t kBase = 65521;
+  const uint64_t rem = len_b % kBase;
+  uint64_t s1 = a & 0xffff;
+  uint64_t s2 = rem * s1 % kBase;
+  s1 += (b & 0xffff) + kBase - 1;
+  s2 += (a >> 16) + (b >> 16) + kBase - rem;
+  s1 %= kBase;
+  s2 %= kBase;
+  return (uint32_t)(s2 << 16 | s1);
+}
+
+void deflate_strip(const uint8_t *in, size_t n, int level,
+                   std::vector<uint8_t> &out) {
+  BitWriter bw{out};
+  level = std::clamp(level, 0, 9);
+  if (level == 0) {
+    if (n > 0)
+      put_stored(bw, in, n, false);
+  } else {
+    // Greedy LZ77 over hash chains; deeper chains find longer matches
+    static const int chain_of[10] = {0, 4, 8, 16, 32, 64, 128, 256, 1024,
+                                     4096};
+    static const int nice_of[10] = {0, 16, 32, 32, 64, 128, 128, 258, 258,
+                                    258};
+    const int max_chain = chain_of[level], nice = nice_of[level];
+    std::vector<int64_t> head((size_t)1 << kHashBits, -1);
+    std::vector<int64_t> prev((size_t)kWindow, -1);
+    std::vector<Sym> syms;
+    syms.reserve(kBlockSyms);
+    size_t block_start = 0;
+    auto insert = [&](size_t i) {
+      const uint32_t h = hash3(in + i);
+      prev[i & (kWindow - 1)] = head[h];
+      head[h] = (int64_t)i;
+    };
+    size_t i = 0;
+    while (i < n) {
+      int best = 0, best_d = 0;
+      if (i + kMinMatch <= n) {
+        const int64_t first = head[hash3(in + i)];
+        insert(i);
+        const int max = (int)std::min<size_t>(kMaxMatch, n - i);
+        int64_t cand = first;
+        for (int chain = max_chain;
+             cand >= 0 && (int64_t)i - cand <= kWindow && chain > 0;
+             --chain) {
+          const uint8_t *c = in + cand;
+          if (c[best] == in[i + (size_t)best]) {
+            const int l = match_len(c, in + i, max);
+            if (l > best) {
+              best = l;
+              best_d = (int)((int64_t)i - cand);
+              if (l >= nice || l == max)
+                break;
+            }
+          }
+          const int64_t next = prev[(size_t)cand & (kWindow - 1)];
+          if (next >= cand)
+            break; // slot reused by a newer position
+          cand = next;
+        }
+      }
+      if (best >= kMinMatch) {
+        syms.push_back({(uint16_t)best, (uint16_t)best_d});
+        for (size_t j = i + 1; j < i + (size_t)best && j + kMinMatch <= n;
+             j++)
+          insert(j);
+        i += (size_t)best;
+      } else {
+        syms.push_back({in[i], 0});
+        ++i;
+      }
+      if (syms.size() == kBlockSyms) {
+        put_block(bw, syms, in + block_start, i - block_start);
+        syms.clear();
+        block_start = i;
+      }
+    }
+    if (!syms.empty())
+      put_block(bw, syms, in + block_start, n - block_start);
+  }
+  // Empty stored block: ends the strip on a byte boundary
+  bw.put(0, 3);
+  bw.align();
+  bw.put(0x0000, 16);
+  bw.put(0xffff, 16);
+}
+
+void deflate_finish(std::vector<uint8_t> &out) {
+  BitWriter bw{out};
+  bw.put(1, 1); // final
+  bw.put(1, 2); // fixed Huffman
+  bw.put(0, 7); // end of block
+  bw.align();
+}
+
+PngWriter::~PngWriter() {
+  if (f_)
+    std::fclose(f_);
+}
+
+bool PngWriter::put(const void *p, size_t n) {
+  if (mem_) {
+    const auto *b = static_cast<const uint8_t *>(p);
+    mem_->insert(mem_->end(), b, b + n);
+    return true;
+  }
+  return std::fwrite(p, 1, n, f_) == n;
+}
+
+bool PngWriter::chunk(const char *type, const uint8_t *data, size_t n) {
+  // Chunk lengths are 31 bits; callers keep chunks far below that
+  uint8_t head[8];
+  put32be(head, (uint32_t)n);
+  std::memcpy(head + 4, type, 4);
+  uint32_t crc = crc32_update(0, head + 4, 4);
+  crc = crc32_update(crc, data, n);
+  uint8_t tail[4];
+  put32be(tail, crc);
+  ok_ = ok_ && put(head, 8) && (n == 0 || put(data, n)) && put(tail, 4);
+  written_ += 12 + n;
+  return ok_;
+}
+
+bool PngWriter::open(const std::string &path, int W, int H, PngColor color,
+                     const std::vector<RGBA> &palette,
+                     const PngOptions &opt) {
+  if (f_)
+    std::fclose(f_);
+  f_ = nullptr;
+  mem_ = nullptr;
+  ok_ = false;
+  if (W <= 0 || H <= 0 ||
+      (color == PngColor::Indexed &&
+       (palette.empty() || palette.size() > 256)))
+    return false;
+  f_ = std::fopen(path.c_str(), "wb");
+  if (!f_)
+    return false;
+  return begin(W, H, color, palette, opt);
+}
+
+bool PngWriter::open(std::vector<uint8_t> *out, int W, int H,
+                     PngColor color, const std::vector<RGBA> &palette,
+                     const PngOptions &opt) {
+  if (f_)
+    std::fclose(f_);
+  f_ = nullptr;
+  mem_ = nullptr;
+  ok_ = false;
+  if (!out || W <= 0 || H <= 0 ||
+      (color == PngColor::Indexed &&
+       (palette.empty() || palette.size() > 256)))
+    return false;
+  mem_ = out;
+  return begin(W, H, color, palette, opt);
+}
+
+// Signature, IHDR and PLTE, once the sink is open.
+bool PngWriter::begin(int W, int H, PngColor color,
+                      const std::vector<RGBA> &palette,
+                      const PngOptions &opt) {
+  W_ = W;
+  H_ = H;
+  next_ = 0;
+  color_ = color;
+  opt_ = opt;
+  adler_ = 1;
+  written_ = 0;
+  last_row_.clear();
+  static const uint8_t sig[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+  ok_ = put(sig, 8);
+  written_ += 8;
+  uint8_t ihdr[13];
+  put32be(ihdr, (uint32_t)W);
+  put32be(ihdr + 4, (uint32_t)H);
+  ihdr[8] = 8; // bit depth
+  ihdr[9] = (uint8_t)color;
+  ihdr[10] = ihdr[11] = ihdr[12] = 0;
+  chunk("IHDR", ihdr, 13);
+  if (color == PngColor::Indexed) {
+    std::vector<uint8_t> plte;
+    for (const RGBA &c : palette)
+      plte.insert(plte.end(), {c.r, c.g, c.b});
+    chunk("PLTE", plte.data(), plte.size());
+  }
+  return ok_;
+}
+
+bool PngWriter::write_rows(int y0, int n, const RowFn &row) {
+  if ((!f_ && !mem_) || y0 != next_ || n < 0 || y0 + n > H_)
+    return false;
+  const int bpp = bytes_per_pixel();
+  const size_t row_bytes = (size_t)W_ * (size_t)bpp;
+  const int per =
+      opt_.strip_rows > 0
+          ? opt_.strip_rows
+          : (int)std::clamp<size_t>((256 << 10) / (row_bytes + 1), 1, 4096);
+  const int strips = (n + per - 1) / per;
+  // Palette images keep filter 0, as the PNG spec recommends
+  const bool adaptive = color_ != PngColor::Indexed;
+  // Strips compress in parallel and are written in order: at most one
+  // compressed strip per thread waits for its turn
+#pragma omp parallel
+  {
+    std::vector<uint8_t> prev(row_bytes), cur(row_bytes), tmp(row_bytes);
+    std::vector<uint8_t> raw, z;
+#pragma omp for schedule(dynamic, 1) ordered
+    for (int s = 0; s < strips; s++) {
+      const int a = y0 + s * per, b = std::min(a + per, y0 + n);
+      raw.resize((size_t)(b - a) * (row_bytes + 1));
+      if (a == 0)
+        std::fill(prev.begin(), prev.end(), 0);
+      else if (a == y0)
+        prev = last_row_;
+      else
+        row(a - 1, prev.data());
+      for (int y = a; y < b; y++) {
+        row(y, cur.data());
+        filter_row(cur.data(), prev.data(), row_bytes, bpp, adaptive,
+                   raw.data() + (size_t)(y - a) * (row_bytes + 1),
+                   tmp.data());
+        std::swap(cur, prev);
+      }
+      z.clear();
+      if (a == 0)
+        z.insert(z.end(), {0x78, 0x9c}); // zlib header: deflate, 32K window
+      deflate_strip(raw.data(), raw.size(), opt_.level, z);
+      const uint32_t ad = adler32_update(1, raw.data(), raw.size());
+#pragma omp ordered
+      {
+        adler_ = adler32_combine(adler_, ad, raw.size());
+        if (s == strips - 1)
+          last_row_ = prev;
+        for (size_t o = 0; o < z.size(); o += (size_t)1 << 30)
+          chunk("IDAT", z.data() + o, std::min(z.size() - o, (size_t)1 << 30));
+      }
+    }
+  }
+  next_ = y0 + n;
+  return ok_;
+}
+
+bool PngWriter::close() {
+  if (!f_ && !mem_)
+    return false;
+  if (next_ == H_) {
+    std::vector<uint8_t> z;
+    deflate_finish(z);
+    z.resize(z.size() + 4);
+    put32be(z.data() + z.size() - 4, adler_);
+    chunk("IDAT", z.data(), z.size());
+    chunk("IEND", nullptr, 0);
+  } else {
+    ok_ = false;
+  }
+  if (f_)
+    ok_ = std::fclose(f_) == 0 && ok_;
+  f_ = nullptr;
+  mem_ = nullptr;
+  return ok_;
+}
+
+namespace {
+
+// write_png and encode_png: open(w, W, H, color, palette) opens the sink.
+template <class Open>
+bool put_image(const ImageRGBA &img, Open &&open) {
+  if (img.width <= 0 || img.height <= 0 ||
+      img.pixels.size() != (size_t)img.width * (size_t)img.height)
+    return false;
+  auto key = [](RGBA c) {
+    return (uint32_t)c.r | (uint32_t)c.g << 8 | (uint32_t)c.b << 16 |
+           (uint32_t)c.a << 24;
+  };
+  // Distinct colors into an open-addressed table, giving up past 256
+  constexpr size_t kSlots = 1024;
+  std::array<uint32_t, kSlots> keys;
+  std::array<int16_t, kSlots> index;
+  index.fill(-1);
+  auto slot = [&](uint32_t k) {
+    size_t h = (k * 2654435761u) >> 22;
+    while (index[h] >= 0 && keys[h] != k)
+      h = (h + 1) & (kSlots - 1);
+    return h;
+  };
+  std::vector<RGBA> palette;
+  bool opaque = true, indexed = true;
+  uint32_t last = key(img.pixels[0]) ^ 1;
+  for (const RGBA &c : img.pixels) {
+    opaque = opaque && c.a == 255;
+    const uint32_t k = key(c);
+    if (k == last || !indexed)
+      continue;
+    last = k;
+    const size_t h = slot(k);
+    if (index[h] >= 0)
+      continue;
+    if (palette.size() == 256) {
+      indexed = false;
+      continue;
+    }
+    keys[h] = k;
+    index[h] = (int16_t)palette.size();
+    palette.push_back(c);
+  }
+  // Palettes here are opaque; a tRNS chunk would be needed otherwise
+  indexed = indexed && opaque;
+  const PngColor color = indexed  ? PngColor::Indexed
+                         : opaque ? PngColor::RGB
+                                  : PngColor::RGBA;
+  PngWriter w;
+  if (!open(w, img.width, img.height, color, palette))
+    return false;
+  const int W = img.width;
+  w.write_rows(0, img.height, [&](int y, uint8_t *dst) {
+    const RGBA *p = img.pixels.data() + (size_t)y * (size_t)W;
+    if (color == PngColor::Indexed) {
+      uint32_t k = key(p[0]);
+      uint8_t i = (uint8_t)index[slot(k)];
+      for (int x = 0; x < W; x++) {
+        if (key(p[x]) != k) {
+          k = key(p[x]);
+          i = (uint8_t)index[slot(k)];
+        }
+        dst[x] = i;
+      }
+    } else if (color == PngColor::RGB) {
+      for (int x = 0; x < W; x++) {
+        dst[3 * x] = p[x].r;
+        dst[3 * x + 1] = p[x].g;
+        dst[3 * x + 2] = p[x].b;
+      }
+    } else {
+      std::memcpy(dst, p, (size_t)W * 4);
+    }
+  });
+  return w.close();
+}
+
+} // namespace
+
+bool write_png(const std::string &path, const ImageRGBA &img,
+               const PngOptions &opt) {
+  return put_image(img, [&](PngWriter &w, int W, int H, PngColor c,
+                            const std::vector<RGBA> &pal) {
+    return w.open(path, W, H, c, pal, opt);
+  });
+}
+
+bool encode_png(std::vector<uint8_t> &out, const ImageRGBA &img,
+                const PngOptions &opt) {
+  out.clear();
+  return put_image(img, [&](PngWriter &w, int W, int H, PngColor c,
+                            const std::vector<RGBA> &pal) {
+    return w.open(&out, W, H, c, pal, opt);
+  });
+}
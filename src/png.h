@@ -0,0 +1,93 @@
+#pragma once
+// PNG encoder: adaptive row filters, deflate over independent strips of rows
+// compressed in parallel (pigz-style: each strip ends on a byte boundary with
+// an empty stored block, so the compressed strips simply concatenate), and
+// one IDAT chunk per strip written as soon as it and the strips before it
+// are done. Checksums: slice-by-8 CRC-32 per chunk, Adler-32 per strip
+// combined in order.
+#include "image.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+uint32_t crc32_update(uint32_t crc, const uint8_t *p, size_t n);
+uint32_t adler32_update(uint32_t adler, const uint8_t *p, size_t n);
+// Adler-32 of A followed by B, from adler(A), adler(B) and len(B).
+uint32_t adler32_combine(uint32_t a, uint32_t b, size_t len_b);
+
+// Raw deflate of n bytes into out (appended). Ends with an empty stored
+// block, byte-aligned and not final, so outputs can be concatenated; a
+// stream is finished with deflate_finish. level 0 stores, 1-9 trade speed
+// for size as in zlib.
+void deflate_strip(const uint8_t *in, size_t n, int level,
+                   std::vector<uint8_t> &out);
+// Appends an empty final block.
+void deflate_finish(std::vector<uint8_t> &out);
+
+enum class PngColor { Indexed = 3, RGB = 2, RGBA = 6 };
+
+struct PngOptions {
+  int level = 6;      // deflate level, 0-9
+  int strip_rows = 0; // rows per compressed strip; 0 = about 256 KiB
+};
+
+// Streams one image: open, write_rows any number of times in order, close.
+class PngWriter {
+public:
+  // row(y, dst) writes the packed pixels of row y (bytes_per_pixel() * W
+  // bytes: palette indices, RGB or RGBA); it is called from several threads
+  // at once for different rows.
+  using RowFn = std::function<void(int y, uint8_t *dst)>;
+
+  PngWriter() = default;
+  PngWriter(const PngWriter &) = delete;
+  PngWriter &operator=(const PngWriter &) = delete;
+  ~PngWriter();
+
+  // palette: up to 256 entries, for PngColor::Indexed.
+  bool open(const std::string &path, int W, int H, PngColor color,
+            const std::vector<RGBA> &palette = {},
+            const PngOptions &opt = {});
+  // The same, appending the file to *out instead of writing it to disk.
+  bool open(std::vector<uint8_t> *out, int W, int H, PngColor color,
+            const std::vector<RGBA> &palette = {},
+            const PngOptions &opt = {});
+  // Rows [y0, y0 + n); y0 must be where the last call stopped. Rows are
+  // compressed in parallel strips, so pass many at a time.
+  bool write_rows(int y0, int n, const RowFn &row);
+  // Writes the end of the stream; false if any write failed or rows are
+  // missing.
+  bool close();
+
+  int bytes_per_pixel() const {
+    return color_ == PngColor::RGBA ? 4 : color_ == PngColor::RGB ? 3 : 1;
+  }
+  uint64_t bytes_written() const { return written_; }
+
+private:
+  bool begin(int W, int H, PngColor color, const std::vector<RGBA> &palette,
+             const PngOptions &opt);
+  bool put(const void *p, size_t n);
+  bool chunk(const char *type, const uint8_t *data, size_t n);
+
+  std::FILE *f_ = nullptr;
+  std::vector<uint8_t> *mem_ = nullptr; // memory sink instead of f_
+  int W_ = 0, H_ = 0, next_ = 0;
+  PngColor color_ = PngColor::RGBA;
+  PngOptions opt_;
+  uint32_t adler_ = 1;
+  bool ok_ = false;
+  uint64_t written_ = 0;
+  std::vector<uint8_t> last_row_; // last row written, for the Up filters
+};
+
+// Writes img with the smallest color type that holds it exactly: a palette
+// when it has at most 256 colors (basin images), RGB when it is opaque.
+bool write_png(const std::string &path, const ImageRGBA &img,
+               const PngOptions &opt = {});
+// The same into memory: out is replaced by the PNG file's bytes.
+bool encode_png(std::vector<uint8_t> &out, const ImageRGBA &img,
+                const PngOptions &opt = {});
@@ -0,0 +1,34 @@
+#include "poly_cache.h"
+#include <exception>
+#include <utility>
+
+std::shared_ptr<const PolyEntry> PolyCache::get(const std::string &id,
+                                                std::string &err) {
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    auto it = polys_.find(id);
+    if (it != polys_.end())
+      return it->second;
+  }
+  // Built outside the lock: a coefficient list may take a while. Two
+  // callers may both build a new polynomial; the second copy is dropped.
+  auto e = std::make_shared<PolyEntry>();
+  try {
+    e->poly = make_poly(id);
+  } catch (const std::exception &ex) {
+    err = ex.what();
+    return nullptr;
+  }
+  e->roots = e->poly->roots();
+  if (e->roots.size() > (size_t)kMaxWideRoots) {
+    err = "at most " + std::to_string(kMaxWideRoots) +
+          " roots can be labelled";
+    return nullptr;
+  }
+  e->colors = make_basin_palette((int)e->roots.size(), BasinPalette::Pastel,
+                                 &e->roots);
+  std::lock_guard<std::mutex> lk(mu_);
+  if (polys_.size() >= kMaxPolys) // renders in flight keep their own
+    polys_.clear();
+  return polys_.emplace(id, std::move(e)).first->second;
+}
@@ -0,0 +1,31 @@
+#pragma once
+// Polynomials by id, with their roots and basin palettes, built once and
+// shared by the renders that use them (--serve, --batch).
+#include "render.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A polynomial with what rendering and coloring it needs
+struct PolyEntry {
+  std::unique_ptr<Poly> poly;
+  std::vector<std::complex<double>> roots;
+  std::vector<RGBA> colors;
+};
+constexpr size_t kMaxPolys = 64; // distinct polynomials kept
+
+// Thread-safe. When kMaxPolys ids are held the cache is emptied; entries
+// already handed out stay valid through their shared_ptr.
+class PolyCache {
+public:
+  // The entry for id, or nullptr with err set when id does not parse or
+  // has more roots than can be labelled.
+  std::shared_ptr<const PolyEntry> get(const std::string &id,
+                                       std::string &err);
+
+private:
+  std::mutex mu_;
+  std::unordered_map<std::string, std::shared_ptr<const PolyEntry>> polys_;
+};
@@ -1,40 +1,163 @@
 #pragma once
+#include "roots.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <complex>
+#include <fstream>
 #include <memory>
+#include <numeric>
+#include <span>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 static const double pi = 3.14159265358979323846;
 
+// f and its first three derivatives at one point.
+struct PolyJet {
+  std::complex<double> f, d1, d2, d3;
+};
+
+// Symmetries the iteration inherits from the polynomial: p(w z) = c p(z) for
+// w = e^(2 pi i / rotation) (rotation = 1: none), and p(conj z) = conj p(z)
+// when conjugate. Together they generate the dihedral group of the roots.
+struct PolySymmetry {
+  int rotation = 1;
+  bool conjugate = false;
+};
+
 struct Poly {
   virtual ~Poly() = default;
   virtual std::complex<double> eval(std::complex<double> z) const = 0;
   virtual std::complex<double> deriv(std::complex<double> z) const = 0;
   virtual std::vector<std::complex<double>> roots() const = 0;
   virtual const char *id() const = 0;
+
+  // f(z) and f'(z) in one pass. The default calls eval and deriv.
+  virtual std::pair<std::complex<double>, std::complex<double>>
+  eval_and_deriv(std::complex<double> z) const {
+    return {eval(z), deriv(z)};
+  }
+
+  // Batch eval_and_deriv for one Newton step over a row of points: a single
+  // virtual call per row instead of two per point. f and fp hold at least
+  // z.size() elements.
+  virtual void eval_newton_step(std::span<const std::complex<double>> z,
+                                std::span<std::complex<double>> f,
+                                std::span<std::complex<double>> fp) const {
+    for (size_t i = 0; i < z.size(); ++i)
+      std::tie(f[i], fp[i]) = eval_and_deriv(z[i]);
+  }
+
+  // f, f', f'', f''' for the higher-order iteration methods. The default runs
+  // Horner over coeffs(); the built-in polynomials override it.
+  virtual PolyJet eval_jet(std::complex<double> z) const {
+    const auto c = coeffs();
+    PolyJet j{c[0], 0.0, 0.0, 0.0};
+    for (size_t k = 1; k < c.size(); ++k) {
+      j.d3 = j.d3 * z + 3.0 * j.d2;
+      j.d2 = j.d2 * z + 2.0 * j.d1;
+      j.d1 = j.d1 * z + j.f;
+      j.f = j.f * z + c[k];
+    }
+    return j;
+  }
+
+  // The default reads coeffs(): rotation is the gcd of the exponent gaps
+  // d - k over the nonzero z^k, conjugate means all coefficients are real.
+  // Only exact zeros count, so expanded roots rarely show a symmetry; the
+  // built-in polynomials state theirs.
+  virtual PolySymmetry symmetry() const {
+    const auto c = coeffs();
+    PolySymmetry s;
+    int g = 0;
+    s.conjugate = true;
+    for (size_t i = 0; i < c.size(); ++i) {
+      if (i > 0 && c[i] != 0.0)
+        g = std::gcd(g, (int)i);
+      s.conjugate = s.conjugate && c[i].imag() == 0.0;
+    }
+    s.rotation = std::max(g, 1);
+    return s;
+  }
+
+  // Monomial coefficients, highest degree first. The default expands the
+  // (monic) product over roots(); used by the batch/SIMD kernels.
+  virtual std::vector<std::complex<double>> coeffs() const {
+    std::vector<std::complex<double>> c{1.0};
+    for (const auto &r : roots()) {
+      c.push_back(0.0);
+      for (size_t j = c.size() - 1; j > 0; --j)
+        c[j] -= r * c[j - 1];
+    }
+    return c;
+  }
+};
+
+// Implements the batch entry point with the derived class's inline
+// eval_and_deriv, so the loop body is not a virtual call.
+template <class Derived> struct PolyBatch : Poly {
+  void eval_newton_step(std::span<const std::complex<double>> z,
+                        std::span<std::complex<double>> f,
+                        std::span<std::complex<double>> fp) const override {
+    const auto &self = static_cast<const Derived &>(*this);
+    for (size_t i = 0; i < z.size(); ++i)
+      std::tie(f[i], fp[i]) = self.Derived::eval_and_deriv(z[i]);
+  }
 };
 
-struct PolyZ3Minus1 : Poly {
+// The concrete polynomials are final and define eval/deriv in-class, so a
+// caller templated on the concrete type (see visit_poly) gets them inlined.
+struct PolyZ3Minus1 final : PolyBatch<PolyZ3Minus1> {
+  static constexpr int degree = 3;
   std::complex<double> eval(std::complex<double> z) const override {
     return z * z * z - 1.0;
   }
   std::complex<double> deriv(std::complex<double> z) const override {
     return 3.0 * z * z;
   }
+  std::pair<std::complex<double>, std::complex<double>>
+  eval_and_deriv(std::complex<double> z) const override {
+    return {z * z * z - 1.0, 3.0 * z * z};
+  }
+  PolyJet eval_jet(std::complex<double> z) const override {
+    return {z * z * z - 1.0, 3.0 * z * z, 6.0 * z, 6.0};
+  }
   std::vector<std::complex<double>> roots() const override {
     using cd = std::complex<double>;
     return {cd(1, 0), std::polar(1.0, 2.0 * pi / 3.0),
             std::polar(1.0, -2.0 * pi / 3.0)};
   }
+  std::vector<std::complex<double>> coeffs() const override {
+    return {1.0, 0.0, 0.0, -1.0};
+  }
+  PolySymmetry symmetry() const override { return {3, true}; }
   const char *id() const override { return "z3-1"; }
 };
 
-struct PolyZ5Minus1 : Poly {
+struct PolyZ5Minus1 final : PolyBatch<PolyZ5Minus1> {
+  static constexpr int degree = 5;
+  // Explicit products: std::pow on complex goes through log/exp
   std::complex<double> eval(std::complex<double> z) const override {
-    return std::pow(z, 5) - 1.0;
+    const auto z2 = z * z;
+    return z2 * z2 * z - 1.0;
   }
   std::complex<double> deriv(std::complex<double> z) const override {
-    return 5.0 * std::pow(z, 4);
+    const auto z2 = z * z;
+    return 5.0 * (z2 * z2);
+  }
+  std::pair<std::complex<double>, std::complex<double>>
+  eval_and_deriv(std::complex<double> z) const override {
+    const auto z2 = z * z, z4 = z2 * z2;
+    return {z4 * z - 1.0, 5.0 * z4};
+  }
+  PolyJet eval_jet(std::complex<double> z) const override {
+    const auto z2 = z * z, z4 = z2 * z2;
+    return {z4 * z - 1.0, 5.0 * z4, 20.0 * z2 * z, 60.0 * z2};
   }
   std::vector<std::complex<double>> roots() const override {
     using cd = std::complex<double>;
@@ -44,16 +167,28 @@ struct PolyZ5Minus1 : Poly {
       r.push_back(std::polar(1.0, 2.0 * pi * k / 5.0));
     return r;
   }
+  std::vector<std::complex<double>> coeffs() const override {
+    return {1.0, 0.0, 0.0, 0.0, 0.0, -1.0};
+  }
+  PolySymmetry symmetry() const override { return {5, true}; }
   const char *id() const override { return "z5-1"; }
 };
 
-struct PolyZ3Minus2ZPlus2 : Poly {
+struct PolyZ3Minus2ZPlus2 final : PolyBatch<PolyZ3Minus2ZPlus2> {
+  static constexpr int degree = 3;
   std::complex<double> eval(std::complex<double> z) const override {
     return z * z * z - 2.0 * z + 2.0;
   }
   std::complex<double> deriv(std::complex<double> z) const override {
     return 3.0 * z * z - 2.0;
   }
+  std::pair<std::complex<double>, std::complex<double>>
+  eval_and_deriv(std::complex<double> z) const override {
+    return {z * z * z - 2.0 * z + 2.0, 3.0 * z * z - 2.0};
+  }
+  PolyJet eval_jet(std::complex<double> z) const override {
+    return {z * z * z - 2.0 * z + 2.0, 3.0 * z * z - 2.0, 6.0 * z, 6.0};
+  }
   std::vector<std::complex<double>> roots() const override {
     // Numerical roots (precomputed)
     using cd = std::complex<double>;
@@ -61,18 +196,23 @@ struct PolyZ3Minus2ZPlus2 : Poly {
             cd(0.8846461771193157, 0.5897428050222055),
             cd(0.8846461771193157, -0.5897428050222055)};
   }
+  std::vector<std::complex<double>> coeffs() const override {
+    return {1.0, 0.0, -2.0, 2.0};
+  }
+  PolySymmetry symmetry() const override { return {1, true}; }
   const char *id() const override { return "z3-2z+2"; }
 };
 
-struct PolyTightClusters : Poly {
+struct PolyTightClusters final : PolyBatch<PolyTightClusters> {
   using cd = std::complex<double>;
+  static constexpr int degree = 8;
 
   // radius of the small 4-point clusters around ±1
   static constexpr double r = 0.12;
 
   // Precomputed roots: 4 around +1 and 4 around -1, at 90° offsets
-  static const std::vector<cd> &rootsList() {
-    static const std::vector<cd> R = {
+  static const std::array<cd, degree> &rootsList() {
+    static const std::array<cd, degree> R = {
         cd(1.0 + r, 0.0),  // 1 + 0.12
         cd(1.0, r),        // 1 + 0.12i
         cd(1.0 - r, 0.0),  // 1 - 0.12
@@ -94,35 +234,57 @@ struct PolyTightClusters : Poly {
   }
 
   std::complex<double> deriv(std::complex<double> z) const override {
-    // p'(z) = p(z) * sum_j 1/(z - r_j)
-    cd p = eval(z);
-    cd s(0.0, 0.0);
+    return eval_and_deriv(z).second;
+  }
+
+  std::pair<std::complex<double>, std::complex<double>>
+  eval_and_deriv(std::complex<double> z) const override {
+    // Product rule, one factor at a time: (p * (z - r))' = p' * (z - r) + p.
+    // No divisions, and well defined on an exact root hit.
+    cd p(1.0, 0.0), dp(0.0, 0.0);
     for (const cd &rj : rootsList()) {
-      s += cd(1.0, 0.0) / (z - rj);
+      const cd t = z - rj;
+      dp = dp * t + p;
+      p *= t;
     }
-    return p * s;
+    return {p, dp};
+  }
+
+  PolyJet eval_jet(std::complex<double> z) const override {
+    PolyJet j{1.0, 0.0, 0.0, 0.0};
+    for (const cd &rj : rootsList()) {
+      const cd t = z - rj;
+      j.d3 = j.d3 * t + 3.0 * j.d2;
+      j.d2 = j.d2 * t + 2.0 * j.d1;
+      j.d1 = j.d1 * t + j.f;
+      j.f *= t;
+    }
+    return j;
   }
 
   std::vector<std::complex<double>> roots() const override {
-    return rootsList();
+    return {rootsList().begin(), rootsList().end()};
   }
 
+  PolySymmetry symmetry() const override { return {2, true}; }
   const char *id() const override { return "tight-clusters-archipelagos"; }
 };
 
-struct PolyMixedRadiiPentagonStack : Poly {
+struct PolyMixedRadiiPentagonStack final
+    : PolyBatch<PolyMixedRadiiPentagonStack> {
   using cd = std::complex<double>;
+  static constexpr int degree = 15;
 
-  static const std::vector<cd> &rootsList() {
-    static std::vector<cd> R = [] {
-      std::vector<cd> v;
-      v.reserve(15);
+  static const std::array<cd, degree> &rootsList() {
+    static const std::array<cd, degree> R = [] {
+      std::array<cd, degree> v;
+      size_t i = 0;
       constexpr double tau = 6.28318530717958647692; // 2π
       constexpr double radii[3] = {1.0, 2.0, 0.5};
       for (double r : radii) {
         for (int k = 0; k < 5; ++k) {
           double theta = tau * k / 5.0;
-          v.emplace_back(std::polar(r, theta)); // r * e^{i theta}
+          v[i++] = std::polar(r, theta); // r * e^{i theta}
         }
       }
       return v;
@@ -139,22 +301,189 @@ struct PolyMixedRadiiPentagonStack : Poly {
   }
 
   std::complex<double> deriv(std::complex<double> z) const override {
-    // p'(z) = p(z) * sum_j 1/(z - r_j)
-    cd p = eval(z);
-    cd s(0.0, 0.0);
+    return eval_and_deriv(z).second;
+  }
+
+  std::pair<std::complex<double>, std::complex<double>>
+  eval_and_deriv(std::complex<double> z) const override {
+    // Product rule, one factor at a time: (p * (z - r))' = p' * (z - r) + p.
+    // No divisions, and well defined on an exact root hit.
+    cd p(1.0, 0.0), dp(0.0, 0.0);
+    for (const cd &rj : rootsList()) {
+      const cd t = z - rj;
+      dp = dp * t + p;
+      p *= t;
+    }
+    return {p, dp};
+  }
+
+  PolyJet eval_jet(std::complex<double> z) const override {
+    PolyJet j{1.0, 0.0, 0.0, 0.0};
     for (const cd &rj : rootsList()) {
-      s += cd(1.0, 0.0) / (z - rj);
+      const cd t = z - rj;
+      j.d3 = j.d3 * t + 3.0 * j.d2;
+      j.d2 = j.d2 * t + 2.0 * j.d1;
+      j.d1 = j.d1 * t + j.f;
+      j.f *= t;
     }
-    return p * s;
+    return j;
   }
 
   std::vector<std::complex<double>> roots() const override {
-    return rootsList();
+    return {rootsList().begin(), rootsList().end()};
   }
 
+  PolySymmetry symmetry() const override { return {5, true}; }
   const char *id() const override { return "mixed-radii-pentagon-stack"; }
 };
 
+// Generic polynomial from its coefficients (highest degree first), e.g.
+// "coeffs:1,0,-2,2" for z^3 - 2z + 2. Evaluation is a fused Horner loop over
+// split real/imag coefficient planes; the roots are found once at
+// construction (find_roots).
+struct PolyCoeffs final : PolyBatch<PolyCoeffs> {
+  using cd = std::complex<double>;
+
+  PolyCoeffs(std::vector<cd> c, std::string id) : id_(std::move(id)) {
+    auto nz = std::find_if(c.begin(), c.end(), [](cd x) { return x != 0.0; });
+    c.erase(c.begin(), nz);
+    if (c.size() < 2)
+      throw std::runtime_error("polynomial needs degree >= 1: " + id_);
+    c_ = std::move(c);
+    for (const cd &x : c_) {
+      re_.push_back(x.real());
+      im_.push_back(x.imag());
+    }
+    roots_ = find_roots(c_, &stats_);
+  }
+
+  int degree() const { return (int)c_.size() - 1; }
+  const RootFindStats &root_stats() const { return stats_; }
+
+  std::complex<double> eval(std::complex<double> z) const override {
+    return eval_and_deriv(z).first;
+  }
+  std::complex<double> deriv(std::complex<double> z) const override {
+    return eval_and_deriv(z).second;
+  }
+
+  std::pair<std::complex<double>, std::complex<double>>
+  eval_and_deriv(std::complex<double> z) const override {
+    const double zr = z.real(), zi = z.imag();
+    double fr = re_[0], fi = im_[0], dr = 0.0, di = 0.0;
+    for (size_t j = 1; j < re_.size(); ++j) {
+      const double ndr = dr * zr - di * zi + fr;
+      const double ndi = dr * zi + di * zr + fi;
+      const double nfr = fr * zr - fi * zi + re_[j];
+      const double nfi = fr * zi + fi * zr + im_[j];
+      dr = ndr;
+      di = ndi;
+      fr = nfr;
+      fi = nfi;
+    }
+    return {cd(fr, fi), cd(dr, di)};
+  }
+
+  PolyJet eval_jet(std::complex<double> z) const override {
+    PolyJet j{c_[0], 0.0, 0.0, 0.0};
+    for (size_t k = 1; k < c_.size(); ++k) {
+      j.d3 = j.d3 * z + 3.0 * j.d2;
+      j.d2 = j.d2 * z + 2.0 * j.d1;
+      j.d1 = j.d1 * z + j.f;
+      j.f = j.f * z + c_[k];
+    }
+    return j;
+  }
+
+  // Points innermost over short blocks so the Horner recurrence runs across
+  // independent lanes and the coefficient planes stream once per block.
+  void eval_newton_step(std::span<const std::complex<double>> z,
+                        std::span<std::complex<double>> f,
+                        std::span<std::complex<double>> fp) const override {
+    constexpr size_t B = 8;
+    for (size_t i0 = 0; i0 < z.size(); i0 += B) {
+      const size_t m = std::min(B, z.size() - i0);
+      double zr[B], zi[B], fr[B], fi[B], dr[B] = {}, di[B] = {};
+      for (size_t b = 0; b < B; ++b) {
+        const cd zb = z[i0 + std::min(b, m - 1)];
+        zr[b] = zb.real();
+        zi[b] = zb.imag();
+        fr[b] = re_[0];
+        fi[b] = im_[0];
+      }
+      for (size_t j = 1; j < re_.size(); ++j) {
+        const double cr = re_[j], ci = im_[j];
+        for (size_t b = 0; b < B; ++b) {
+          const double ndr = dr[b] * zr[b] - di[b] * zi[b] + fr[b];
+          const double ndi = dr[b] * zi[b] + di[b] * zr[b] + fi[b];
+          const double nfr = fr[b] * zr[b] - fi[b] * zi[b] + cr;
+          const double nfi = fr[b] * zi[b] + fi[b] * zr[b] + ci;
+          dr[b] = ndr;
+          di[b] = ndi;
+          fr[b] = nfr;
+          fi[b] = nfi;
+        }
+      }
+      for (size_t b = 0; b < m; ++b) {
+        f[i0 + b] = cd(fr[b], fi[b]);
+        fp[i0 + b] = cd(dr[b], di[b]);
+      }
+    }
+  }
+
+  std::vector<std::complex<double>> roots() const override { return roots_; }
+  std::vector<std::complex<double>> coeffs() const override { return c_; }
+  const char *id() const override { return id_.c_str(); }
+
+private:
+  std::vector<cd> c_, roots_;
+  std::vector<double> re_, im_;
+  std::string id_;
+  RootFindStats stats_;
+};
+
+// "coeffs:1,0,-2,2" (real coefficients) or "coeffs-file:PATH", where the file
+// lists one coefficient per line as "re" or "re im", highest degree first.
+inline std::unique_ptr<Poly> make_coeff_poly(const std::string &s) {
+  std::vector<std::complex<double>> c;
+  std::string rest;
+  if (s.rfind("coeffs:", 0) == 0) {
+    std::stringstream ss(s.substr(7));
+    for (std::string tok; std::getline(ss, tok, ',');) {
+      size_t used = 0;
+      double v = 0.0;
+      try {
+        v = std::stod(tok, &used);
+      } catch (const std::exception &) {
+        used = 0;
+      }
+      if (used == 0 || !std::isfinite(v) ||
+          tok.find_first_not_of(" \t", used) != std::string::npos)
+        throw std::runtime_error("bad coefficient '" + tok + "' in " + s);
+      c.emplace_back(v, 0.0);
+    }
+  } else {
+    const std::string path = s.substr(12);
+    std::ifstream in(path);
+    if (!in)
+      throw std::runtime_error("cannot open coefficient file: " + path);
+    for (std::string line; std::getline(in, line);) {
+      if (line.find_first_not_of(" \t\r") == std::string::npos ||
+          line[line.find_first_not_of(" \t")] == '#')
+        continue;
+      std::istringstream ls(line);
+      double re = 0.0, im = 0.0;
+      // No imaginary part is fine; one that does not parse is not
+      const bool ok = ls >> re && (ls >> im || ls.eof());
+      if (!ok || !std::isfinite(re) || !std::isfinite(im))
+        throw std::runtime_error("bad coefficient line '" + line + "' in " +
+                                 path);
+      c.emplace_back(re, im);
+    }
+  }
+  return std::make_unique<PolyCoeffs>(std::move(c), s);
+}
+
 inline std::unique_ptr<Poly> make_poly(const std::string &s) {
   if (s == "z3-1")
     return std::make_unique<PolyZ3Minus1>();
@@ -166,5 +495,27 @@ inline std::unique_ptr<Poly> make_poly(const std::string &s) {
     return std::make_unique<PolyTightClusters>();
   if (s == "mixed-radii-pentagon-stack")
     return std::make_unique<PolyMixedRadiiPentagonStack>();
+  if (s.rfind("coeffs:", 0) == 0 || s.rfind("coeffs-file:", 0) == 0)
+    return make_coeff_poly(s);
   throw std::runtime_error("unknown polynomial id: " + s);
 }
+
+// Calls f(const P &) with the concrete type behind poly, picked once by id
+// like make_poly, so a templated render loop sees non-virtual eval/deriv.
+// Unknown types fall back to f(const Poly &).
+template <class F> decltype(auto) visit_poly(const Poly &poly, F &&f) {
+  const std::string id = poly.id();
+  if (id == "z3-1")
+    return f(static_cast<const PolyZ3Minus1 &>(poly));
+  if (id == "z5-1")
+    return f(static_cast<const PolyZ5Minus1 &>(poly));
+  if (id == "z3-2z+2")
+    return f(static_cast<const PolyZ3Minus2ZPlus2 &>(poly));
+  if (id == "tight-clusters-archipelagos")
+    return f(static_cast<const PolyTightClusters &>(poly));
+  if (id == "mixed-radii-pentagon-stack")
+    return f(static_cast<const PolyMixedRadiiPentagonStack &>(poly));
+  if (auto *pc = dynamic_cast<const PolyCoeffs *>(&poly))
+    return f(*pc);
+  return f(poly);
+}
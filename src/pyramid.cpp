@@ -0,0 +1,348 @@
+#include "pyramid.h"
+#include "timing.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Size of level l along an axis that is n pixels at the finest level F.
+int level_size(int n, int F, int l) {
+  const int s = F - l;
+  return (int)(((long long)n + (1LL << s) - 1) >> s);
+}
+
+int tiles_for(int n) { return (n + kPyramidTile - 1) / kPyramidTile; }
+
+// Where the tiles of one image (basins or iters) go.
+struct Layout {
+  std::string root; // PREFIX_basins
+  bool xyz = false;
+  int z0 = 0; // xyz: level written as Z = 0
+
+  std::string dir() const { return xyz ? root : root + "_files"; }
+  std::string level_dir(int l) const {
+    return dir() + "/" + std::to_string(xyz ? l - z0 : l);
+  }
+  std::string tile(int l, int c, int r) const {
+    return xyz ? level_dir(l) + "/" + std::to_string(c) + "/" +
+                     std::to_string(r) + ".png"
+               : level_dir(l) + "/" + std::to_string(c) + "_" +
+                     std::to_string(r) + ".png";
+  }
+  bool writes(int l) const { return !xyz || l >= z0; }
+};
+
+void crop(const ImageRGBA &in, int x0, int y0, int w, int h,
+          ImageRGBA &out) {
+  if (out.width != w || out.height != h)
+    out = ImageRGBA(w, h);
+  for (int y = 0; y < h; y++)
+    std::copy_n(&in.at(x0, y0 + y), w, &out.at(0, y));
+}
+
+// Cuts img, level l with its top-left corner at tile (c0, r0), into tiles
+// and writes them, several at a time.
+bool write_tiles(const ImageRGBA &img, const Layout &lay, int l, int c0,
+                 int r0, const PngOptions &png, long long &count) {
+  const int nc = tiles_for(img.width), nr = tiles_for(img.height);
+  int ok = 1;
+#pragma omp parallel for schedule(dynamic, 1) reduction(min : ok)
+  for (int i = 0; i < nc * nr; i++) {
+    const int c = i % nc, r = i / nc;
+    const int x0 = c * kPyramidTile, y0 = r * kPyramidTile;
+    ImageRGBA t;
+    crop(img, x0, y0, std::min(kPyramidTile, img.width - x0),
+         std::min(kPyramidTile, img.height - y0), t);
+    ok = std::min(ok, (int)write_png(lay.tile(l, c0 + c, r0 + r), t, png));
+  }
+  count += (long long)nc * nr;
+  return ok != 0;
+}
+
+// A finished block's coarsest tiles, both images: width, height, pixels.
+bool save_block(const std::string &path, const ImageRGBA img[2]) {
+  const std::string tmp = path + ".tmp";
+  std::FILE *f = std::fopen(tmp.c_str(), "wb");
+  if (!f)
+    return false;
+  const int32_t wh[2] = {img[0].width, img[0].height};
+  bool ok = std::fwrite(wh, sizeof wh, 1, f) == 1;
+  for (int i = 0; i < 2; i++)
+    ok = ok && std::fwrite(img[i].pixels.data(), sizeof(RGBA),
+                           img[i].pixels.size(), f) == img[i].pixels.size();
+  ok = std::fclose(f) == 0 && ok;
+  std::error_code ec;
+  if (ok)
+    fs::rename(tmp, path, ec); // whole or not at all
+  return ok && !ec;
+}
+
+bool load_block(const std::string &path, ImageRGBA img[2]) {
+  std::FILE *f = std::fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+  int32_t wh[2] = {0, 0};
+  bool ok = std::fread(wh, sizeof wh, 1, f) == 1 && wh[0] > 0 &&
+            wh[1] > 0 && wh[0] <= kPyramidTile && wh[1] <= kPyramidTile;
+  for (int i = 0; ok && i < 2; i++) {
+    img[i] = ImageRGBA(wh[0], wh[1]);
+    ok = std::fread(img[i].pixels.data(), sizeof(RGBA), img[i].pixels.size(),
+                    f) == img[i].pixels.size();
+  }
+  std::fclose(f);
+  return ok;
+}
+
+// Everything that changes the pixels; a partial pyramid made with other
+// parameters is thrown away. The coefficients and roots are spelled out:
+// a coeffs-file: id names only the file.
+std::string fingerprint(const Poly &poly,
+                        const std::vector<std::complex<double>> &roots,
+                        const NewtonParams &np, const Viewport &v,
+                        const KernelVariant *kernel, const RenderOptions &opt,
+                        const PyramidOptions &po,
+                        const std::vector<RGBA> &colors) {
+  std::string s = std::string(poly.id()) + "\nkernel ";
+  s.append(kernel ? kernel->name : "scalar-loop")
+      .append(" ")
+      .append(std::to_string(kKernelVersion))
+      .append("\ncoeffs");
+  auto num = [&](double x) {
+    char b[32];
+    std::snprintf(b, sizeof b, " %.17g", x);
+    s += b;
+  };
+  for (const auto &c : poly.coeffs()) {
+    num(c.real());
+    num(c.imag());
+  }
+  s += "\nroots";
+  for (const auto &r : roots) {
+    num(r.real());
+    num(r.imag());
+  }
+  auto word = [&](const std::string &w) { s.append(" ").append(w); };
+  s += "\nview";
+  word(std::to_string(v.W) + "x" + std::to_string(v.H));
+  for (double x : {v.xmin, v.xmax, v.ymin, v.ymax, v.xmin_lo, v.ymin_lo,
+                   v.span_x, v.span_y})
+    num(x);
+  s += "\nparams";
+  word(std::to_string(np.max_iters));
+  for (double x : {np.tol, np.damping, np.cycle_tol})
+    num(x);
+  for (int x : {(int)np.method, (int)np.root_traps, (int)np.mixed_precision,
+                (int)opt.adaptive, opt.band, opt.aa, (int)opt.symmetry})
+    word(std::to_string(x));
+  s += "\npyramid";
+  word(po.layout);
+  word(std::to_string(po.block_levels));
+  word(std::to_string((int)po.colormap));
+  s += "\ncolors";
+  for (const RGBA &c : colors)
+    word(std::to_string(c.r) + "," + std::to_string(c.g) + "," +
+         std::to_string(c.b));
+  return s + "\n";
+}
+
+std::string read_text(const std::string &path) {
+  std::string s;
+  if (std::FILE *f = std::fopen(path.c_str(), "rb")) {
+    char buf[4096];
+    for (size_t n; (n = std::fread(buf, 1, sizeof buf, f)) > 0;)
+      s.append(buf, n);
+    std::fclose(f);
+  }
+  return s;
+}
+
+bool write_text(const std::string &path, const std::string &s) {
+  std::FILE *f = std::fopen(path.c_str(), "wb");
+  if (!f)
+    return false;
+  const bool ok = std::fwrite(s.data(), 1, s.size(), f) == s.size();
+  return std::fclose(f) == 0 && ok;
+}
+
+} // namespace
+
+PyramidStats render_pyramid(const Poly &poly,
+                            const std::vector<std::complex<double>> &roots,
+                            const NewtonParams &np, const Viewport &v,
+                            const KernelVariant *kernel,
+                            const std::vector<RGBA> &colors,
+                            const RenderOptions &opt,
+                            const PyramidOptions &po,
+                            const std::string &prefix) {
+  Timer wall;
+  PyramidStats ps;
+  auto fail = [&](const std::string &msg) {
+    ps.error = msg;
+    return ps;
+  };
+  if (po.layout != "dzi" && po.layout != "xyz")
+    return fail("unknown pyramid layout " + po.layout);
+
+  // Levels of the full image; the cap renders a halved view instead
+  int L = 0;
+  while ((1LL << L) < std::max(v.W, v.H))
+    ++L;
+  const int F = po.max_level >= 0 ? std::min(po.max_level, L) : L;
+  Viewport fv = v;
+  fv.W = level_size(v.W, L, F);
+  fv.H = level_size(v.H, L, F);
+  ps.levels = F + 1;
+  const int k = std::clamp(po.block_levels, 0, F);
+  const int B = F - k; // level of a block's last tile
+  const int bpx = kPyramidTile << k;
+  int z0 = 0;
+  for (int l = 0; l <= F; l++)
+    if (std::max(level_size(fv.W, F, l), level_size(fv.H, F, l)) <=
+        kPyramidTile)
+      z0 = l;
+
+  Layout lay[2];
+  const char *kinds[2] = {"_basins", "_iters"};
+  std::error_code ec;
+  for (int i = 0; i < 2; i++) {
+    lay[i].root = prefix + kinds[i];
+    lay[i].xyz = po.layout == "xyz";
+    lay[i].z0 = z0;
+    for (int l = 0; l <= F && !ec; l++) {
+      if (!lay[i].writes(l))
+        continue;
+      fs::create_directories(lay[i].level_dir(l), ec);
+      for (int c = 0; lay[i].xyz && c < tiles_for(level_size(fv.W, F, l)) &&
+                      !ec;
+           c++)
+        fs::create_directories(lay[i].level_dir(l) + "/" + std::to_string(c),
+                               ec);
+    }
+  }
+  if (ec)
+    return fail("cannot create " + lay[0].dir() + ": " + ec.message());
+
+  // Resume only what these exact parameters produced
+  const std::string partial = prefix + "_pyramid.partial";
+  const std::string params =
+      fingerprint(poly, roots, np, fv, kernel, opt, po, colors);
+  if (read_text(partial + "/params") != params) {
+    fs::remove_all(partial, ec);
+    fs::create_directories(partial, ec);
+    if (ec || !write_text(partial + "/params", params))
+      return fail("cannot create " + partial);
+  }
+  auto block_path = [&](int bx, int by) {
+    return partial + "/" + std::to_string(bx) + "_" + std::to_string(by) +
+           ".rgba";
+  };
+
+  // The finest level, block by block, each halved down to level B
+  const int nbx = tiles_for(level_size(fv.W, F, B));
+  const int nby = tiles_for(level_size(fv.H, F, B));
+  BasinResult res;
+  ImageRGBA img[2], half[2];
+  bool ok = true;
+  for (int by = 0; by < nby && ok; by++)
+    for (int bx = 0; bx < nbx && ok; bx++) {
+      ++ps.blocks;
+      if (fs::exists(block_path(bx, by), ec)) {
+        ++ps.blocks_resumed;
+        continue;
+      }
+      Timer tr;
+      RenderOptions o = opt;
+      const int x0 = bx * bpx, w = std::min(bpx, fv.W - x0);
+      const int y0 = by * bpx, h = std::min(bpx, fv.H - y0);
+      o.col0 = x0;
+      o.cols = w;
+      o.row0 = y0;
+      o.rows = h;
+      merge_stats(ps.render,
+                  render_window(poly, roots, np, fv, kernel, res, o));
+      colorize_basins(res, colors, img[0]);
+      colorize_iterations(res, np.max_iters, img[1], po.colormap);
+      ps.render_seconds += tr.seconds();
+      Timer te;
+      for (int l = F;; --l) {
+        const int c0 = bx << (l - B), r0 = by << (l - B);
+        for (int i = 0; i < 2 && ok; i++)
+          ok = !lay[i].writes(l) ||
+               write_tiles(img[i], lay[i], l, c0, r0, po.png, ps.tiles);
+        if (l == B || !ok)
+          break;
+        for (int i = 0; i < 2; i++) {
+          downsample_half(img[i], half[i]);
+          std::swap(img[i], half[i]);
+        }
+      }
+      ok = ok && save_block(block_path(bx, by), img);
+      ps.encode_seconds += te.seconds();
+    }
+  if (!ok)
+    return fail("cannot write the tiles of " + prefix);
+
+  // Levels above the blocks: each tile is the four below it, halved.
+  // Depth-first, so only a few tiles per level are held at a time.
+  Timer te;
+  std::function<bool(int, int, int, ImageRGBA *)> build =
+      [&](int l, int c, int r, ImageRGBA *out) {
+        if (l == B)
+          return load_block(block_path(c, r), out);
+        const int w = level_size(fv.W, F, l + 1);
+        const int h = level_size(fv.H, F, l + 1);
+        const int x0 = 2 * c * kPyramidTile, y0 = 2 * r * kPyramidTile;
+        ImageRGBA big[2], child[2];
+        for (int i = 0; i < 2; i++)
+          big[i] = ImageRGBA(std::min(2 * kPyramidTile, w - x0),
+                             std::min(2 * kPyramidTile, h - y0));
+        for (int j = 0; j < 2; j++)
+          for (int i = 0; i < 2; i++) {
+            if (x0 + i * kPyramidTile >= w || y0 + j * kPyramidTile >= h)
+              continue;
+            if (!build(l + 1, 2 * c + i, 2 * r + j, child))
+              return false;
+            for (int m = 0; m < 2; m++)
+              for (int y = 0; y < child[m].height; y++)
+                std::copy_n(&child[m].at(0, y), child[m].width,
+                            &big[m].at(i * kPyramidTile,
+                                       j * kPyramidTile + y));
+          }
+        for (int m = 0; m < 2; m++) {
+          downsample_half(big[m], out[m]);
+          if (lay[m].writes(l)) {
+            if (!write_png(lay[m].tile(l, c, r), out[m], po.png))
+              return false;
+            ++ps.tiles;
+          }
+        }
+        return true;
+      };
+  ImageRGBA top[2];
+  if (B > 0 && !build(0, 0, 0, top))
+    return fail("cannot build the upper levels of " + prefix);
+  ps.encode_seconds += te.seconds();
+
+  for (int i = 0; i < 2 && !lay[i].xyz; i++) {
+    char xml[512];
+    std::snprintf(xml, sizeof xml,
+                  "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                  "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\""
+                  " Format=\"png\" Overlap=\"0\" TileSize=\"%d\">\n"
+                  "  <Size Width=\"%d\" Height=\"%d\"/>\n"
+                  "</Image>\n",
+                  kPyramidTile, fv.W, fv.H);
+    if (!write_text(lay[i].root + ".dzi", xml))
+      return fail("cannot write " + lay[i].root + ".dzi");
+  }
+  fs::remove_all(partial, ec);
+  summarize_iterations(ps.render);
+  ps.seconds = wall.seconds();
+  ps.ok = true;
+  return ps;
+}
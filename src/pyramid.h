@@ -0,0 +1,55 @@
+#pragma once
+// Tile pyramids for zoomable viewers: the basin and iteration images cut into
+// kPyramidTile-pixel PNG tiles at every power-of-two zoom level. Only the
+// finest level is rendered. It is computed in blocks of 2^block_levels x
+// 2^block_levels tiles, and each block is halved in place down to a single
+// tile, so a coarser tile is always the average of the four below it.
+// The levels above the blocks are built from the blocks' last tiles.
+//
+// Layouts: "dzi" writes PREFIX_basins.dzi with PREFIX_basins_files/L/C_R.png
+// (DeepZoom: level L is the image halved F - L times, down to 1x1 at 0);
+// "xyz" writes PREFIX_basins/Z/X/Y.png, Z = 0 being the first level that
+// fits in one tile. Likewise for _iters.
+//
+// Interrupted runs resume: a finished block leaves its last tiles in
+// PREFIX_pyramid.partial/, which a rerun with the same parameters loads
+// instead of rendering the block again. The directory is removed when the
+// pyramid is complete.
+#include "png.h"
+#include "render.h"
+#include <string>
+#include <vector>
+
+constexpr int kPyramidTile = 256;
+
+struct PyramidOptions {
+  std::string layout = "dzi"; // dzi | xyz
+  // Finest level to render, -1 = the full image. A lower cap renders the
+  // view at that level's (halved) size.
+  int max_level = -1;
+  int block_levels = 3; // a block is 8x8 finest tiles
+  PngOptions png;
+  IterColormap colormap = IterColormap::Turbo;
+};
+
+struct PyramidStats {
+  RenderStats render; // merged over the blocks rendered in this run
+  int levels = 0;     // finest level + 1
+  int blocks = 0, blocks_resumed = 0;
+  long long tiles = 0; // PNGs written, both images
+  double render_seconds = 0.0, encode_seconds = 0.0, seconds = 0.0;
+  bool ok = false;
+  std::string error;
+};
+
+// Renders v (its bounds; v.W x v.H is the finest level) and writes both
+// pyramids under prefix. Iteration colors are normalised by np.max_iters,
+// like --strip-rows, so tiles of different blocks agree.
+PyramidStats render_pyramid(const Poly &poly,
+                            const std::vector<std::complex<double>> &roots,
+                            const NewtonParams &np, const Viewport &v,
+                            const KernelVariant *kernel,
+                            const std::vector<RGBA> &colors,
+                            const RenderOptions &opt,
+                            const PyramidOptions &po,
+                            const std::string &prefix);
@@ -0,0 +1,242 @@
+#include "raw.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define NF_HAVE_MMAP 1
+#endif
+
+namespace {
+
+uint64_t align_up(uint64_t n) {
+  return (n + kRawAlign - 1) / kRawAlign * kRawAlign;
+}
+
+// Writes n bytes at offset `at`, zero-filling from the current offset.
+bool put_at(std::FILE *f, uint64_t &pos, uint64_t at, const void *p,
+            size_t n) {
+  static const uint8_t zeros[4096] = {};
+  while (pos < at) {
+    const size_t z = (size_t)std::min<uint64_t>(at - pos, sizeof zeros);
+    if (std::fwrite(zeros, 1, z, f) != z)
+      return false;
+    pos += z;
+  }
+  pos += n;
+  return n == 0 || std::fwrite(p, 1, n, f) == n;
+}
+
+bool fail(std::string *err, const std::string &msg) {
+  if (err)
+    *err = msg;
+  return false;
+}
+
+} // namespace
+
+bool write_raw(const std::string &path, const RawInfo &info,
+               const BasinResult &r) {
+  if (r.wide) // the label planes are 8-bit
+    return false;
+  const uint64_t npix = (uint64_t)r.W * (uint64_t)r.H;
+  const uint64_t nn = (uint64_t)r.aa * (uint64_t)r.aa;
+  RawHeader h{};
+  std::memcpy(h.magic, kRawMagic, sizeof h.magic);
+  h.version = kRawVersion;
+  h.byte_order = kRawByteOrder;
+  h.header_bytes = (uint32_t)sizeof(RawHeader);
+  h.width = r.W;
+  h.height = r.H;
+  h.aa = r.aa;
+  h.num_roots = (int32_t)info.roots.size();
+  h.max_k = info.max_k;
+  h.max_iters = info.np.max_iters;
+  h.method = (int32_t)info.np.method;
+  h.tol = info.np.tol;
+  h.damping = info.np.damping;
+  h.cycle_tol = info.np.cycle_tol;
+  h.root_traps = info.np.root_traps;
+  h.mixed_precision = info.np.mixed_precision;
+  const Viewport &v = info.view;
+  h.xmin = v.xmin;
+  h.xmax = v.xmax;
+  h.ymin = v.ymin;
+  h.ymax = v.ymax;
+  h.xmin_lo = v.xmin_lo;
+  h.ymin_lo = v.ymin_lo;
+  h.span_x = v.span_x;
+  h.span_y = v.span_y;
+  h.poly_offset = sizeof(RawHeader);
+  h.poly_bytes = info.poly.size();
+  h.roots_offset = (h.poly_offset + h.poly_bytes + 7) / 8 * 8;
+  h.label_offset = align_up(h.roots_offset + 16 * info.roots.size());
+  h.iters_offset = align_up(h.label_offset + npix);
+  uint64_t end = h.iters_offset + 2 * npix;
+  h.aa_count = r.aa_pixel.size();
+  if (h.aa_count > 0) {
+    h.aa_pixel_offset = align_up(end);
+    h.aa_label_offset = align_up(h.aa_pixel_offset + 4 * h.aa_count);
+    end = h.aa_label_offset + nn * h.aa_count;
+  }
+  h.file_bytes = end;
+
+  std::FILE *f = std::fopen(path.c_str(), "wb");
+  if (!f)
+    return false;
+  std::vector<double> roots;
+  for (const auto &z : info.roots) {
+    roots.push_back(z.real());
+    roots.push_back(z.imag());
+  }
+  uint64_t pos = 0;
+  bool ok = put_at(f, pos, 0, &h, sizeof h) &&
+            put_at(f, pos, h.poly_offset, info.poly.data(), h.poly_bytes) &&
+            put_at(f, pos, h.roots_offset, roots.data(),
+                   roots.size() * sizeof(double)) &&
+            put_at(f, pos, h.label_offset, r.label.data(), npix) &&
+            put_at(f, pos, h.iters_offset, r.iters.data(), 2 * npix);
+  if (h.aa_count > 0)
+    ok = ok &&
+         put_at(f, pos, h.aa_pixel_offset, r.aa_pixel.data(),
+                4 * h.aa_count) &&
+         put_at(f, pos, h.aa_label_offset, r.aa_label.data(),
+                nn * h.aa_count);
+  return std::fclose(f) == 0 && ok;
+}
+
+RawFile::~RawFile() { close(); }
+
+void RawFile::close() {
+#ifdef NF_HAVE_MMAP
+  if (mapped_)
+    munmap(const_cast<uint8_t *>(base_), size_);
+#endif
+  mapped_ = false;
+  copy_.clear();
+  base_ = nullptr;
+  size_ = 0;
+  hdr_ = nullptr;
+}
+
+bool RawFile::open(const std::string &path, std::string *err) {
+  close();
+#ifdef NF_HAVE_MMAP
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return fail(err, "cannot open " + path);
+  struct stat sb {};
+  if (fstat(fd, &sb) == 0 && sb.st_size > 0) {
+    void *p =
+        mmap(nullptr, (size_t)sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p != MAP_FAILED) {
+      base_ = static_cast<const uint8_t *>(p);
+      size_ = (size_t)sb.st_size;
+      mapped_ = true;
+    }
+  }
+  ::close(fd);
+  if (!mapped_)
+    return fail(err, "cannot map " + path);
+#else
+  std::FILE *f = std::fopen(path.c_str(), "rb");
+  if (!f)
+    return fail(err, "cannot open " + path);
+  uint8_t buf[1 << 16];
+  for (size_t n; (n = std::fread(buf, 1, sizeof buf, f)) > 0;)
+    copy_.insert(copy_.end(), buf, buf + n);
+  std::fclose(f);
+  base_ = copy_.data();
+  size_ = copy_.size();
+#endif
+  auto reject = [&](const std::string &msg) {
+    close();
+    return fail(err, path + msg);
+  };
+  const RawHeader *h = reinterpret_cast<const RawHeader *>(base_);
+  if (size_ < sizeof(RawHeader) ||
+      std::memcmp(h->magic, kRawMagic, sizeof kRawMagic) != 0)
+    return reject(" is not a raw result file");
+  if (h->byte_order != kRawByteOrder)
+    return reject(" was written with another byte order");
+  if (h->version != kRawVersion || h->header_bytes != sizeof(RawHeader))
+    return reject(": unsupported version " + std::to_string(h->version));
+  const uint64_t npix = (uint64_t)std::max(h->width, 0) *
+                        (uint64_t)std::max(h->height, 0);
+  const uint64_t nn = (uint64_t)std::max(h->aa, 0) * std::max(h->aa, 0);
+  // Each piece: offset, size, alignment
+  const uint64_t parts[][3] = {
+      {h->poly_offset, h->poly_bytes, 1},
+      {h->roots_offset, 16 * (uint64_t)std::max(h->num_roots, 0), 8},
+      {h->label_offset, npix, kRawAlign},
+      {h->iters_offset, 2 * npix, kRawAlign},
+      {h->aa_pixel_offset, 4 * h->aa_count, h->aa_count ? kRawAlign : 1},
+      {h->aa_label_offset, nn * h->aa_count, h->aa_count ? kRawAlign : 1}};
+  bool ok = h->width > 0 && h->height > 0 && h->aa >= 1 &&
+            h->aa <= kMaxAA && h->num_roots >= 0 && h->aa_count <= size_ &&
+            h->method >= 0 && h->method <= (int)Method::Schroder &&
+            h->file_bytes <= size_;
+  for (const auto &p : parts)
+    ok = ok && p[0] % p[2] == 0 && p[0] <= size_ && p[1] <= size_ - p[0];
+  // colorize_basins writes through aa_pixel
+  const uint32_t *aa_pixel =
+      reinterpret_cast<const uint32_t *>(base_ + h->aa_pixel_offset);
+  for (uint64_t j = 0; ok && j < h->aa_count; j++)
+    ok = aa_pixel[j] < npix;
+  if (!ok)
+    return reject(" is truncated or corrupt");
+  hdr_ = h;
+  return true;
+}
+
+RawInfo RawFile::info() const {
+  const RawHeader &h = *hdr_;
+  RawInfo r;
+  r.poly.assign(reinterpret_cast<const char *>(base_ + h.poly_offset),
+                h.poly_bytes);
+  const double *z =
+      reinterpret_cast<const double *>(base_ + h.roots_offset);
+  for (int i = 0; i < h.num_roots; i++)
+    r.roots.emplace_back(z[2 * i], z[2 * i + 1]);
+  r.np.max_iters = h.max_iters;
+  r.np.method = (Method)h.method;
+  r.np.tol = h.tol;
+  r.np.damping = h.damping;
+  r.np.cycle_tol = h.cycle_tol;
+  r.np.root_traps = h.root_traps != 0;
+  r.np.mixed_precision = h.mixed_precision != 0;
+  Viewport &v = r.view;
+  v.W = h.width;
+  v.H = h.height;
+  v.xmin = h.xmin;
+  v.xmax = h.xmax;
+  v.ymin = h.ymin;
+  v.ymax = h.ymax;
+  v.xmin_lo = h.xmin_lo;
+  v.ymin_lo = h.ymin_lo;
+  v.span_x = h.span_x;
+  v.span_y = h.span_y;
+  r.max_k = h.max_k;
+  return r;
+}
+
+BasinView RawFile::view() const {
+  const RawHeader &h = *hdr_;
+  BasinView v;
+  v.W = h.width;
+  v.H = h.height;
+  v.label = base_ + h.label_offset;
+  v.iters = reinterpret_cast<const uint16_t *>(base_ + h.iters_offset);
+  v.aa = h.aa;
+  v.aa_count = (size_t)h.aa_count;
+  if (h.aa_count > 0) {
+    v.aa_pixel =
+        reinterpret_cast<const uint32_t *>(base_ + h.aa_pixel_offset);
+    v.aa_label = base_ + h.aa_label_offset;
+  }
+  return v;
+}
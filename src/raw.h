@@ -0,0 +1,97 @@
+#pragma once
+// Raw result files (.nfr): the label and iteration planes of a render as they
+// sit in memory, behind a small versioned header, so analysis tools can mmap
+// them instead of decoding PNGs. Layout:
+//
+//   RawHeader                 (kRawHeaderBytes, at offset 0)
+//   polynomial id             (poly_bytes, no terminator)
+//   roots                     (num_roots pairs of doubles: re, im)
+//   label plane               (W * H uint8: root id, 254 cycle, 255 none)
+//   iters plane               (W * H uint16: exact iteration count)
+//   aa_pixel plane            (aa_count uint32 pixel indices, --aa only)
+//   aa_label plane            (aa_count * aa * aa uint8 sample labels)
+//
+// Every plane starts on a kRawAlign boundary (zero padding between), so a
+// mapped file gives aligned arrays at base + offset. Numbers are in the
+// writer's byte order; byte_order tells readers which it was.
+#include "newton.h"
+#include "render.h"
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+constexpr char kRawMagic[8] = {'N', 'F', 'R', 'A', 'W', '\r', '\n', '\x1a'};
+constexpr uint32_t kRawVersion = 1;
+constexpr uint32_t kRawByteOrder = 0x01020304;
+constexpr uint64_t kRawAlign = 4096; // page size: planes map on their own
+
+struct RawHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t header_bytes; // sizeof(RawHeader) when written
+  int32_t width, height;
+  int32_t aa;        // 1 = no aa planes
+  int32_t num_roots;
+  int32_t max_k;     // largest count in the iters plane (at least 1)
+  // NewtonParams
+  int32_t max_iters;
+  int32_t method;    // Method
+  double tol, damping, cycle_tol;
+  uint8_t root_traps, mixed_precision, reserved[6];
+  // Viewport (deep zoom fields as in Viewport)
+  double xmin, xmax, ymin, ymax, xmin_lo, ymin_lo, span_x, span_y;
+  // Offsets are from the start of the file, sizes in bytes
+  uint64_t poly_offset, poly_bytes;
+  uint64_t roots_offset;
+  uint64_t label_offset, iters_offset;
+  uint64_t aa_count, aa_pixel_offset, aa_label_offset;
+  uint64_t file_bytes;
+};
+constexpr size_t kRawHeaderBytes = 216;
+static_assert(sizeof(RawHeader) == kRawHeaderBytes,
+              "RawHeader layout is part of the file format");
+
+// What a raw file records besides the planes.
+struct RawInfo {
+  std::string poly; // Poly::id()
+  std::vector<std::complex<double>> roots;
+  NewtonParams np;
+  Viewport view;
+  int max_k = 1; // RenderStats::max_k
+};
+
+// Writes r with info to path; false if the file cannot be written, or for a
+// wide result (the planes hold 8-bit labels).
+bool write_raw(const std::string &path, const RawInfo &info,
+               const BasinResult &r);
+
+// A raw file opened for reading: memory-mapped where the platform has mmap
+// (the planes are then never copied), read into memory otherwise.
+class RawFile {
+public:
+  RawFile() = default;
+  RawFile(const RawFile &) = delete;
+  RawFile &operator=(const RawFile &) = delete;
+  ~RawFile();
+
+  // Checks the magic, version, byte order and that every plane lies inside
+  // the file; on failure returns false with a message in *err.
+  bool open(const std::string &path, std::string *err = nullptr);
+  void close();
+
+  const RawHeader &header() const { return *hdr_; }
+  // The fields as the renderer's types
+  RawInfo info() const;
+  // The planes, pointing into the mapping: valid until close()
+  BasinView view() const;
+
+private:
+  const uint8_t *base_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+  std::vector<uint8_t> copy_; // without mmap
+  const RawHeader *hdr_ = nullptr;
+};
@@ -0,0 +1,906 @@
+#include "render.h"
+#include "tiles.h"
+#include "timing.h"
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace {
+
+// Per-thread counters merged at the end of render_basins.
+struct Tally {
+  std::vector<long long> hist; // pixels per iteration count
+  long long cycles = 0, no_root = 0, redone = 0;
+  explicit Tally(size_t n) : hist(n, 0) {}
+  void merge(const Tally &o) {
+    for (size_t i = 0; i < hist.size(); i++)
+      hist[i] += o.hist[i];
+    cycles += o.cycles;
+    no_root += o.no_root;
+    redone += o.redone;
+  }
+};
+
+// Per-thread scratch: pixels to iterate (px, py) and their results, the
+// current tile's results, and the thread's counters.
+struct Worker {
+  Tally tally;
+  long long iterated = 0;
+  std::vector<double> zr, zrl, zi, zil;
+  std::vector<std::complex<double>> z0;
+  std::vector<int> px, py, rids, ks;
+  std::vector<double> fx, fy; // sample position inside the pixel, 0.5 = center
+  std::vector<int> trid, tk;          // tile results, row-major, stride tile.w
+  std::vector<int> rep, via;          // symmetry: representatives of a row
+  std::vector<unsigned char> known;   // adaptive: tile pixel already set
+  int n = 0;                          // points queued in px, py
+  Worker(size_t hist, size_t batch, size_t tile)
+      : tally(hist), zr(batch), zrl(batch), zi(batch), zil(batch), z0(batch),
+        px(batch), py(batch), rids(batch), ks(batch), fx(batch), fy(batch),
+        trid(tile), tk(tile),
+        rep(batch), via(batch), known(tile) {}
+};
+
+// Basin image color of a label.
+inline RGBA basin_color(uint8_t label, const std::vector<RGBA> &colors) {
+  if (label < kLabelCycle)
+    return colors[label];
+  return label == kLabelCycle ? RGBA{255, 0, 255, 255} : RGBA{0, 0, 0, 255};
+}
+
+// Counts one pixel's result in the tally.
+inline void count_pixel(int rid, int k, Tally &tl) {
+  ++tl.hist[(size_t)k];
+  tl.cycles += rid == kCycleRid;
+  tl.no_root += rid < 0 && rid != kCycleRid;
+}
+
+// A result's label plane, 8-bit or wide.
+struct Labels {
+  uint8_t *l8 = nullptr;
+  uint16_t *l16 = nullptr;
+
+  explicit Labels(BasinResult &r)
+      : l8(r.wide ? nullptr : r.label.data()),
+        l16(r.wide ? r.label16.data() : nullptr) {}
+  void set(size_t i, int rid) const {
+    if (l16)
+      l16[i] = label16_of(rid);
+    else
+      l8[i] = label_of(rid);
+  }
+  int rid(size_t i) const { return l16 ? rid_of(l16[i]) : rid_of(l8[i]); }
+  bool same(size_t i, size_t j) const {
+    return l16 ? l16[i] == l16[j] : l8[i] == l8[j];
+  }
+};
+
+// Writes one result into out (pixel i) and the tally.
+inline void store_pixel(size_t i, int rid, int k, const Labels &lab,
+                        BasinResult &out, Tally &tl) {
+  lab.set(i, rid);
+  out.iters[i] = (uint16_t)k;
+  count_pixel(rid, k, tl);
+}
+
+// sRGB <-> linear light, for blending subsamples.
+inline float srgb_to_linear(unsigned char c) {
+  static const auto lut = [] {
+    std::array<float, 256> t{};
+    for (int i = 0; i < 256; i++) {
+      const double v = i / 255.0;
+      t[(size_t)i] = (float)(v <= 0.04045 ? v / 12.92
+                                          : std::pow((v + 0.055) / 1.055, 2.4));
+    }
+    return t;
+  }();
+  return lut[c];
+}
+inline unsigned char linear_to_srgb(double v) {
+  v = std::clamp(v, 0.0, 1.0);
+  v = v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+  return (unsigned char)std::lround(v * 255.0);
+}
+
+// Jitter in [0, 1) for subsample s of grid pixel (x, y), axis a: a hash, so
+// renders are reproducible and independent of scheduling.
+inline double jitter(long long x, long long y, int s, int a) {
+  uint64_t h = (uint64_t)x * 0x9E3779B97F4A7C15ULL ^
+               (uint64_t)y * 0xC2B2AE3D27D4EB4FULL ^
+               (uint64_t)(uint32_t)(s * 2 + a) * 0x165667B19E3779F9ULL;
+  h ^= h >> 31;
+  h *= 0xBF58476D1CE4E5B9ULL;
+  h ^= h >> 29;
+  return double(h >> 11) * 0x1.0p-53;
+}
+
+// Symmetry of the polynomial that maps the view's pixel grid onto itself:
+// pixel (x, y) goes to (a x + b y + cx, c x + d y + cy), and a point that
+// reaches root j there reaches root inv[j] at (x, y).
+struct PixelSym {
+  int a, b, c, d, cx, cy;
+  std::vector<int> inv;
+};
+
+// The group elements z -> u z and z -> u conj(z), u in {1, i, -1, -i}, that
+// poly has and that land pixel centers on pixel centers (other rotations
+// never do). Empty unless every root maps onto a root; the elements found
+// form a group, which the fundamental domain below relies on.
+std::vector<PixelSym>
+grid_symmetries(const PolySymmetry &ps,
+                const std::vector<std::complex<double>> &roots,
+                const Viewport &v) {
+  using cd = std::complex<double>;
+  std::vector<PixelSym> out;
+  const double dx = v.dx(), dy = v.dy();
+  // u = i^k as a real 2x2 matrix on (Re, Im)
+  const int rot[4][4] = {
+      {1, 0, 0, 1}, {0, -1, 1, 0}, {-1, 0, 0, -1}, {0, 1, -1, 0}};
+  for (int conj = 0; conj < 2; ++conj) {
+    for (int k = 0; k < 4; ++k) {
+      const int order = k == 0 ? 1 : k == 2 ? 2 : 4;
+      if ((k == 0 && !conj) || ps.rotation % order != 0 ||
+          (conj && !ps.conjugate))
+        continue;
+      PixelSym g;
+      const int s = conj ? -1 : 1; // conj flips Im first
+      const int m00 = rot[k][0], m01 = rot[k][1] * s;
+      const int m10 = rot[k][2], m11 = rot[k][3] * s;
+      // Swapping axes needs square pixels
+      if (m01 != 0 && std::abs(dx - dy) > 1e-9 * dx)
+        continue;
+      // Pixel coordinates of the image of pixel (0, 0)
+      const double X = v.xmin + 0.5 * dx, Y = v.ymin + 0.5 * dy;
+      const double px = (m00 * X + m01 * Y - v.xmin) / dx - 0.5;
+      const double py = (m10 * X + m11 * Y - v.ymin) / dy - 0.5;
+      if (std::abs(px - std::round(px)) > 1e-6 ||
+          std::abs(py - std::round(py)) > 1e-6)
+        continue;
+      g = {m00, m01, m10, m11, (int)std::lround(px), (int)std::lround(py), {}};
+      g.inv.assign(roots.size(), -1);
+      for (size_t j = 0; j < roots.size(); ++j) {
+        const cd r = roots[j];
+        const cd gr(m00 * r.real() + m01 * r.imag(),
+                    m10 * r.real() + m11 * r.imag());
+        for (size_t i = 0; i < roots.size(); ++i)
+          if (std::abs(roots[i] - gr) <= 1e-6 * (1.0 + std::abs(r))) {
+            if (g.inv[i] >= 0)
+              return {}; // two roots map to one: cannot label
+            g.inv[i] = (int)j;
+          }
+      }
+      if (std::count(g.inv.begin(), g.inv.end(), -1) > 0)
+        return {};
+      out.push_back(std::move(g));
+    }
+  }
+  return out;
+}
+
+// Pixels whose results pixels x0 .. x0 + n - 1 of row y copy: for each,
+// the lowest index among its images that fall inside the view (rep), and
+// the element that maps it there (via, -1 for the pixel itself). Indices
+// and steps are linear in x, so the loops vectorize; runs for every pixel
+// of the view, twice.
+inline void representatives(int y, int x0, int n, const Viewport &v,
+                            const std::vector<PixelSym> &gs, int *rep,
+                            int *via) {
+  for (int i = 0; i < n; i++) {
+    rep[i] = y * v.W + x0 + i;
+    via[i] = -1;
+  }
+  for (int e = 0; e < (int)gs.size(); ++e) {
+    const PixelSym &g = gs[(size_t)e];
+    const int gx0 = g.a * x0 + g.b * y + g.cx, gy0 = g.c * x0 + g.d * y + g.cy;
+    const int step = g.c * v.W + g.a, o0 = gy0 * v.W + gx0;
+    for (int i = 0; i < n; i++) {
+      const int gx = gx0 + g.a * i, gy = gy0 + g.c * i, o = o0 + step * i;
+      const bool take =
+          gx >= 0 && gx < v.W && gy >= 0 && gy < v.H && o < rep[i];
+      rep[i] = take ? o : rep[i];
+      via[i] = take ? e : via[i];
+    }
+  }
+}
+
+// Mariani-Silver subdivision of one tile. The border of a rectangle is
+// iterated; if every border pixel reached the same root with iteration
+// counts within band of each other, the interior is filled (counts by a
+// Coons patch over the border), otherwise the rectangle is halved across
+// its longer side and both halves are treated the same way. Pixels on
+// shared edges are iterated once. Eval(w) iterates the w.n queued points.
+template <class Eval> struct Subdivider {
+  const Tile &t;
+  Worker &w;
+  Eval &eval;
+  int band;
+
+  size_t at(int x, int y) const {
+    return (size_t)y * (size_t)t.w + (size_t)x;
+  }
+  void flush() {
+    if (w.n == 0)
+      return;
+    eval(w);
+    for (int i = 0; i < w.n; i++) {
+      const size_t o = at(w.px[(size_t)i] - t.x0, w.py[(size_t)i] - t.y0);
+      w.trid[o] = w.rids[(size_t)i];
+      w.tk[o] = w.ks[(size_t)i];
+    }
+    w.iterated += w.n;
+    w.n = 0;
+  }
+  void add(int x, int y) {
+    if (w.known[at(x, y)])
+      return;
+    w.known[at(x, y)] = 1;
+    w.px[(size_t)w.n] = t.x0 + x;
+    w.py[(size_t)w.n] = t.y0 + y;
+    w.fx[(size_t)w.n] = w.fy[(size_t)w.n] = 0.5;
+    if (++w.n == (int)w.px.size())
+      flush();
+  }
+  // Rectangle [x0, x1] x [y0, y1] in tile coordinates, borders included.
+  void rect(int x0, int y0, int x1, int y1) {
+    for (int x = x0; x <= x1; x++) {
+      add(x, y0);
+      add(x, y1);
+    }
+    for (int y = y0 + 1; y < y1; y++) {
+      add(x0, y);
+      add(x1, y);
+    }
+    flush();
+    if (x1 - x0 < 2 || y1 - y0 < 2)
+      return; // no interior
+    const int r = w.trid[at(x0, y0)];
+    int kmin = w.tk[at(x0, y0)], kmax = kmin;
+    bool same = true;
+    auto check = [&](int x, int y) {
+      same = same && w.trid[at(x, y)] == r;
+      kmin = std::min(kmin, w.tk[at(x, y)]);
+      kmax = std::max(kmax, w.tk[at(x, y)]);
+    };
+    for (int x = x0; x <= x1; x++) {
+      check(x, y0);
+      check(x, y1);
+    }
+    for (int y = y0 + 1; y < y1; y++) {
+      check(x0, y);
+      check(x1, y);
+    }
+    if (same && kmax - kmin <= band) {
+      fill(x0, y0, x1, y1, r, kmin, kmax);
+    } else if (x1 - x0 <= 6 && y1 - y0 <= 6) {
+      for (int y = y0 + 1; y < y1; y++)
+        for (int x = x0 + 1; x < x1; x++)
+          add(x, y);
+      flush();
+    } else if (x1 - x0 >= y1 - y0) {
+      const int xm = (x0 + x1) / 2;
+      rect(x0, y0, xm, y1);
+      rect(xm, y0, x1, y1);
+    } else {
+      const int ym = (y0 + y1) / 2;
+      rect(x0, y0, x1, ym);
+      rect(x0, ym, x1, y1);
+    }
+  }
+  void fill(int x0, int y0, int x1, int y1, int r, int kmin, int kmax) {
+    auto k = [&](int x, int y) { return double(w.tk[at(x, y)]); };
+    const double sx = x1 - x0, sy = y1 - y0;
+    for (int y = y0 + 1; y < y1; y++) {
+      const double v = (y - y0) / sy;
+      for (int x = x0 + 1; x < x1; x++) {
+        const double u = (x - x0) / sx;
+        const double c =
+            (1 - v) * k(x, y0) + v * k(x, y1) + (1 - u) * k(x0, y) +
+            u * k(x1, y) -
+            ((1 - u) * (1 - v) * k(x0, y0) + u * (1 - v) * k(x1, y0) +
+             (1 - u) * v * k(x0, y1) + u * v * k(x1, y1));
+        const size_t o = at(x, y);
+        w.trid[o] = r;
+        w.tk[o] = std::clamp((int)std::lround(c), kmin, kmax);
+        w.known[o] = 1;
+      }
+    }
+  }
+};
+
+// Cuts r down to its w x h block at (x0, y0), in place, and takes the
+// pixels cut off out of st's counts.
+void crop_result(BasinResult &r, int x0, int y0, int w, int h,
+                 RenderStats &st) {
+  const Labels lab(r);
+  for (int y = 0; y < r.H; y++)
+    for (int x = 0; x < r.W; x++) {
+      if (x >= x0 && x < x0 + w && y >= y0 && y < y0 + h)
+        continue;
+      const size_t i = (size_t)y * (size_t)r.W + (size_t)x;
+      const int rid = lab.rid(i);
+      --st.hist[r.iters[i]];
+      st.cycle_pixels -= rid == kCycleRid;
+      st.no_root_pixels -= rid < 0 && rid != kCycleRid;
+    }
+  // Pixels only move towards the front, so copying forwards is safe
+  for (int y = 0; y < h; y++) {
+    const size_t s = (size_t)(y0 + y) * (size_t)r.W + (size_t)x0;
+    const size_t d = (size_t)y * (size_t)w;
+    if (s == d)
+      continue;
+    std::copy_n(&r.iters[s], w, &r.iters[d]);
+    if (r.wide)
+      std::copy_n(&r.label16[s], w, &r.label16[d]);
+    else
+      std::copy_n(&r.label[s], w, &r.label[d]);
+  }
+  const size_t nn = (size_t)r.aa * (size_t)r.aa;
+  size_t kept = 0;
+  for (size_t j = 0; j < r.aa_pixel.size(); j++) {
+    const int x = (int)(r.aa_pixel[j] % (uint32_t)r.W) - x0;
+    const int y = (int)(r.aa_pixel[j] / (uint32_t)r.W) - y0;
+    if (x < 0 || y < 0 || x >= w || y >= h)
+      continue;
+    r.aa_pixel[kept] = (uint32_t)((size_t)y * (size_t)w + (size_t)x);
+    if (kept != j && r.wide)
+      std::copy_n(&r.aa_label16[j * nn], nn, &r.aa_label16[kept * nn]);
+    else if (kept != j)
+      std::copy_n(&r.aa_label[j * nn], nn, &r.aa_label[kept * nn]);
+    ++kept;
+  }
+  const size_t npix = (size_t)w * (size_t)h;
+  r.W = w;
+  r.H = h;
+  r.iters.resize(npix);
+  r.label.resize(r.wide ? 0 : npix);
+  r.label16.resize(r.wide ? npix : 0);
+  r.aa_pixel.resize(kept);
+  r.aa_label.resize(r.wide ? 0 : kept * nn);
+  r.aa_label16.resize(r.wide ? kept * nn : 0);
+  st.aa_pixels = (long long)kept;
+  summarize_iterations(st);
+}
+
+} // namespace
+
+bool grid_origin(const Viewport &v, long long &gx, long long &gy) {
+  const double fx = v.xmin / v.dx(), fy = v.ymin / v.dy();
+  const bool ok = !v.needs_dd() && std::abs(fx) < 0x1p52 &&
+                  std::abs(fy) < 0x1p52;
+  gx = ok ? std::llround(fx) : 0;
+  gy = ok ? std::llround(fy) : 0;
+  return ok;
+}
+
+RenderStats render_basins(const Poly &poly,
+                          const std::vector<std::complex<double>> &roots,
+                          const NewtonParams &np, const Viewport &v,
+                          const KernelVariant *kernel, BasinResult &out,
+                          const RenderOptions &opt) {
+  if (roots.size() > (size_t)kMaxWideRoots)
+    throw std::runtime_error("at most " + std::to_string(kMaxWideRoots) +
+                             " roots can be labelled");
+  if (np.max_iters > kMaxResultIters)
+    throw std::runtime_error("max_iters above " +
+                             std::to_string(kMaxResultIters));
+  // The window [col0, col0 + W) x [row0, row0 + H) of the view; out holds
+  // just that
+  const int row0 = opt.rows > 0 ? opt.row0 : 0;
+  const int H = opt.rows > 0 ? opt.rows : v.H;
+  const int col0 = opt.cols > 0 ? opt.col0 : 0;
+  const int W = opt.cols > 0 ? opt.cols : v.W;
+  if (row0 < 0 || H <= 0 || row0 + H > v.H || col0 < 0 || W <= 0 ||
+      col0 + W > v.W)
+    throw std::runtime_error("window outside the view");
+  const size_t npix = (size_t)W * (size_t)H;
+  out.W = W;
+  out.H = H;
+  out.wide = roots.size() > (size_t)kMaxLabelRoots;
+  out.label.resize(out.wide ? 0 : npix);
+  out.label16.resize(out.wide ? npix : 0);
+  out.iters.resize(npix);
+  out.aa = 1;
+  out.aa_pixel.clear();
+  out.aa_label.clear();
+  out.aa_label16.clear();
+  const Labels lab(out);
+  const double dx = v.dx(), dy = v.dy();
+  const size_t nhist = (size_t)np.max_iters + 1;
+  const std::vector<Tile> tiles = make_tiles(W, H);
+  // A batch holds a tile row, any rectangle border in a tile, or the
+  // subsamples of one pixel
+  const int batch = std::max(4 * kTileSize, kMaxAA * kMaxAA);
+  std::vector<Worker> workers(
+      (size_t)pool_threads(),
+      Worker(nhist, (size_t)batch, (size_t)kTileSize * kTileSize));
+
+  Timer t;
+  const RootTraps traps = make_root_traps(poly, roots, np);
+  const bool deep = v.needs_dd() && np.method == Method::Newton;
+  // With symmetry only the fundamental domain (pixels that are their own
+  // representative) is iterated; a last pass writes every other pixel from
+  // its representative
+  const bool sym_ok = opt.symmetry && !deep && H == v.H && W == v.W &&
+                      (long long)v.W * v.H < INT_MAX;
+  const std::vector<PixelSym> syms =
+      sym_ok ? grid_symmetries(poly.symmetry(), roots, v)
+             : std::vector<PixelSym>{};
+  // Anti-aliasing: pixels with a differently labelled neighbor get aa x aa
+  // jittered samples (one per cell of an aa x aa grid), stored as labels for
+  // colorize_basins to blend. Iteration counts keep the center sample.
+  long long aa_pixels = 0, aa_samples = 0;
+  double aa_seconds = 0.0;
+  auto refine = [&](auto &eval) {
+    Timer ta;
+    const int n = std::min(opt.aa, kMaxAA), nn = n * n;
+    // Grid index of the window's pixel (0, 0), for the jitter
+    long long gx = opt.grid_x, gy = opt.grid_y;
+    if (!opt.with_grid)
+      grid_origin(v, gx, gy);
+    gx += col0;
+    gy += row0;
+    // Refined pixels get slots tile by tile, so the layout of aa_pixel does
+    // not depend on scheduling
+    std::vector<unsigned char> edge(npix, 0);
+    std::vector<size_t> slot(tiles.size() + 1, 0);
+    run_tiles(tiles, [&](const Tile &tile, int) {
+      size_t count = 0;
+      for (int y = tile.y0; y < tile.y0 + tile.h; y++)
+        for (int x = tile.x0; x < tile.x0 + tile.w; x++) {
+          const size_t c = (size_t)y * (size_t)W + (size_t)x;
+          bool e = false;
+          for (int j = std::max(y - 1, 0); j <= std::min(y + 1, H - 1); j++)
+            for (int i = std::max(x - 1, 0); i <= std::min(x + 1, W - 1);
+                 i++)
+              e = e || !lab.same((size_t)j * (size_t)W + (size_t)i, c);
+          edge[(size_t)y * (size_t)W + (size_t)x] = e;
+          count += e;
+        }
+      slot[(size_t)(&tile - tiles.data()) + 1] = count;
+    });
+    for (size_t i = 1; i < slot.size(); i++)
+      slot[i] += slot[i - 1];
+    out.aa = n;
+    out.aa_pixel.resize(slot.back());
+    if (out.wide)
+      out.aa_label16.resize(slot.back() * (size_t)nn);
+    else
+      out.aa_label.resize(slot.back() * (size_t)nn);
+    std::vector<long long> smp_n(workers.size(), 0);
+    run_tiles(tiles, [&](const Tile &tile, int tid) {
+      Worker &w = workers[(size_t)tid];
+      size_t next = slot[(size_t)(&tile - tiles.data())];
+      // Whole pixels per batch
+      const int per = (int)w.px.size() / nn;
+      int queued = 0;
+      auto flush = [&] {
+        if (queued == 0)
+          return;
+        eval(w);
+        for (int q = 0; q < queued; q++, next++) {
+          const int x = w.px[(size_t)(q * nn)], y = w.py[(size_t)(q * nn)];
+          out.aa_pixel[next] = (uint32_t)((size_t)y * (size_t)W + (size_t)x);
+          for (int s = 0; s < nn; s++) {
+            const size_t o = next * (size_t)nn + (size_t)s;
+            const int rid = w.rids[(size_t)(q * nn + s)];
+            if (out.wide)
+              out.aa_label16[o] = label16_of(rid);
+            else
+              out.aa_label[o] = label_of(rid);
+          }
+        }
+        smp_n[(size_t)tid] += w.n;
+        w.n = 0;
+        queued = 0;
+      };
+      for (int y = tile.y0; y < tile.y0 + tile.h; y++)
+        for (int x = tile.x0; x < tile.x0 + tile.w; x++) {
+          if (!edge[(size_t)y * (size_t)W + (size_t)x])
+            continue;
+          for (int s = 0; s < nn; s++) {
+            w.px[(size_t)w.n] = x;
+            w.py[(size_t)w.n] = y;
+            w.fx[(size_t)w.n] = (s % n + jitter(gx + x, gy + y, s, 0)) / n;
+            w.fy[(size_t)w.n] = (s / n + jitter(gx + x, gy + y, s, 1)) / n;
+            ++w.n;
+          }
+          if (++queued == per)
+            flush();
+        }
+      flush();
+    });
+    aa_pixels = (long long)out.aa_pixel.size();
+    for (size_t i = 0; i < workers.size(); i++)
+      aa_samples += smp_n[i];
+    aa_seconds = ta.seconds();
+  };
+  // eval(w) iterates the w.n samples (w.px + w.fx, w.py + w.fy) into
+  // w.rids / w.ks. run(eval) renders the view: tiles, the symmetric fill,
+  // and anti-aliasing.
+  auto run = [&](auto &&eval) {
+    PoolStats ps = run_tiles(tiles, [&](const Tile &tile, int tid) {
+      Worker &w = workers[(size_t)tid];
+      Subdivider<std::remove_reference_t<decltype(eval)>> sub{tile, w, eval,
+                                                              opt.band};
+      std::fill(w.known.begin(), w.known.end(), 0);
+      bool any = syms.empty();
+      if (!any) {
+        // Pixels outside the fundamental domain start out known: skipped
+        for (int y = 0; y < tile.h; y++) {
+          representatives(tile.y0 + y, tile.x0, tile.w, v, syms, w.rep.data(),
+                          w.via.data());
+          for (int x = 0; x < tile.w; x++) {
+            const bool mine = w.via[(size_t)x] < 0;
+            w.known[(size_t)y * (size_t)tile.w + (size_t)x] = !mine;
+            any = any || mine;
+          }
+        }
+        if (!any)
+          return; // all filled by symmetry
+        if (opt.adaptive)
+          std::fill(w.known.begin(), w.known.end(), 0);
+      }
+      if (opt.adaptive) {
+        sub.rect(0, 0, tile.w - 1, tile.h - 1);
+      } else {
+        for (int y = 0; y < tile.h; y++) {
+          for (int x = 0; x < tile.w; x++)
+            sub.add(x, y);
+          sub.flush();
+        }
+      }
+      // With symmetry only representatives are read back, and counted, in
+      // the fill pass; the rest of the row is stale until then
+      for (int y = 0; y < tile.h; y++)
+        for (int x = 0; x < tile.w; x++) {
+          const size_t o = (size_t)y * (size_t)tile.w + (size_t)x;
+          const size_t i = (size_t)(tile.y0 + y) * (size_t)W +
+                           (size_t)(tile.x0 + x);
+          if (syms.empty()) {
+            store_pixel(i, w.trid[o], w.tk[o], lab, out, w.tally);
+          } else {
+            lab.set(i, w.trid[o]);
+            out.iters[i] = (uint16_t)w.tk[o];
+          }
+        }
+    });
+    if (!syms.empty()) {
+      // By tile: the representatives of a tile lie in a few mirrored or
+      // transposed tiles, which stay in cache
+      run_tiles(tiles, [&](const Tile &tile, int tid) {
+        Worker &w = workers[(size_t)tid];
+        for (int y = tile.y0; y < tile.y0 + tile.h; y++) {
+          representatives(y, tile.x0, tile.w, v, syms, w.rep.data(),
+                          w.via.data());
+          const size_t row = (size_t)y * (size_t)W + (size_t)tile.x0;
+          for (int i = 0; i < tile.w; i++) {
+            const int e = w.via[(size_t)i];
+            if (e < 0) {
+              count_pixel(lab.rid(row + (size_t)i),
+                          out.iters[row + (size_t)i], w.tally);
+              continue;
+            }
+            // Representatives are never written here, so reading them
+            // while other tiles fill is safe
+            const size_t r = (size_t)w.rep[(size_t)i];
+            int rid = lab.rid(r);
+            if (rid >= 0)
+              rid = syms[(size_t)e].inv[(size_t)rid];
+            store_pixel(row + (size_t)i, rid, out.iters[r], lab, out,
+                        w.tally);
+          }
+        }
+      });
+    }
+    if (opt.aa > 1)
+      refine(eval);
+    return ps;
+  };
+  PoolStats pool;
+  if (deep) {
+    const KernelVariant *kv = kernel ? kernel : &kernel_variants().front();
+    const PolyPlanes planes(poly);
+    const KernelPoly kp = planes.view(traps);
+    const dd x0(v.xmin, v.xmin_lo), y0(v.ymin, v.ymin_lo);
+    pool = run([&](Worker &w) {
+      for (size_t i = 0; i < (size_t)w.n; i++) {
+        const dd zx = x0 + dd((w.px[i] + col0 + w.fx[i]) * dx);
+        const dd zy = y0 + dd((w.py[i] + row0 + w.fy[i]) * dy);
+        w.zr[i] = zx.hi;
+        w.zrl[i] = zx.lo;
+        w.zi[i] = zy.hi;
+        w.zil[i] = zy.lo;
+      }
+      kv->row_dd(w.zr.data(), w.zrl.data(), w.zi.data(), w.zil.data(), w.n,
+                 kp, np, w.rids.data(), w.ks.data());
+    });
+  } else if (kernel) {
+    const PolyPlanes planes(poly);
+    const KernelPoly kp = planes.view(traps);
+    pool = run([&](Worker &w) {
+      for (size_t i = 0; i < (size_t)w.n; i++) {
+        w.zr[i] = v.xmin + (w.px[i] + col0 + w.fx[i]) * dx;
+        w.zi[i] = v.ymin + (w.py[i] + row0 + w.fy[i]) * dy;
+      }
+      if (np.mixed_precision)
+        w.tally.redone += kernel->row_mixed(w.zr.data(), w.zi.data(), w.n, kp,
+                                            np, w.rids.data(), w.ks.data());
+      else
+        kernel->row(w.zr.data(), w.zi.data(), w.n, kp, np, w.rids.data(),
+                    w.ks.data());
+    });
+  } else {
+    // Instantiated per concrete polynomial: no virtual calls in the loop
+    visit_poly(poly, [&](const auto &P) {
+      pool = run([&](Worker &w) {
+        const size_t m = (size_t)w.n;
+        for (size_t i = 0; i < m; i++)
+          w.z0[i] = {v.xmin + (w.px[i] + col0 + w.fx[i]) * dx,
+                     v.ymin + (w.py[i] + row0 + w.fy[i]) * dy};
+        newton_row_scalar<std::decay_t<decltype(P)>>(
+            std::span(w.z0.data(), m), P, roots, np,
+            std::span(w.rids.data(), m), std::span(w.ks.data(), m), &traps);
+      });
+    });
+  }
+  Tally all(nhist);
+  long long iterated = 0;
+  for (const Worker &w : workers) {
+    all.merge(w.tally);
+    iterated += w.iterated;
+  }
+
+  RenderStats st;
+  st.seconds = t.seconds();
+  st.cycle_pixels = all.cycles;
+  st.no_root_pixels = all.no_root;
+  st.redone_pixels = all.redone;
+  st.deep = deep;
+  st.iterated_pixels = iterated;
+  st.aa_pixels = aa_pixels;
+  st.aa_samples = aa_samples;
+  st.aa_seconds = aa_seconds;
+  st.pool = std::move(pool);
+  st.hist = std::move(all.hist);
+  summarize_iterations(st);
+  return st;
+}
+
+RenderStats render_window(const Poly &poly,
+                          const std::vector<std::complex<double>> &roots,
+                          const NewtonParams &np, const Viewport &v,
+                          const KernelVariant *kernel, BasinResult &out,
+                          const RenderOptions &opt, bool beyond) {
+  const int row0 = opt.rows > 0 ? opt.row0 : 0;
+  const int H = opt.rows > 0 ? opt.rows : v.H;
+  const int col0 = opt.cols > 0 ? opt.col0 : 0;
+  const int W = opt.cols > 0 ? opt.cols : v.W;
+  const int a = opt.aa > 1 ? 1 : 0;
+  const int hl = beyond || col0 > 0 ? a : 0;
+  const int hr = beyond || col0 + W < v.W ? a : 0;
+  const int ht = beyond || row0 > 0 ? a : 0;
+  const int hb = beyond || row0 + H < v.H ? a : 0;
+  if (hl + hr + ht + hb == 0)
+    return render_basins(poly, roots, np, v, kernel, out, opt);
+  RenderOptions o = opt;
+  Viewport wv = v;
+  o.col0 = col0 - hl;
+  o.row0 = row0 - ht;
+  if (beyond) {
+    // The view a pixel larger all round, on the same grid
+    if (!o.with_grid)
+      grid_origin(v, o.grid_x, o.grid_y);
+    o.with_grid = true;
+    o.grid_x -= a;
+    o.grid_y -= a;
+    const double dx = v.dx(), dy = v.dy();
+    const dd x0 = dd(v.xmin, v.xmin_lo) - dd(a * dx);
+    const dd y0 = dd(v.ymin, v.ymin_lo) - dd(a * dy);
+    wv.W += 2 * a;
+    wv.H += 2 * a;
+    wv.xmin = x0.hi;
+    wv.xmin_lo = x0.lo;
+    wv.ymin = y0.hi;
+    wv.ymin_lo = y0.lo;
+    wv.span_x = wv.W * dx;
+    wv.span_y = wv.H * dy;
+    wv.xmax = (x0 + dd(wv.span_x)).hi;
+    wv.ymax = (y0 + dd(wv.span_y)).hi;
+    o.col0 += a;
+    o.row0 += a;
+  }
+  o.cols = W + hl + hr;
+  o.rows = H + ht + hb;
+  RenderStats st = render_basins(poly, roots, np, wv, kernel, out, o);
+  crop_result(out, hl, ht, W, H, st);
+  return st;
+}
+
+void summarize_iterations(RenderStats &st) {
+  long long total = 0, seen = 0;
+  for (long long n : st.hist)
+    total += n;
+  double sum = 0.0;
+  st.max_k = 1;
+  st.p99_iters = -1;
+  for (size_t k = 0; k < st.hist.size(); k++) {
+    if (st.hist[k] == 0)
+      continue;
+    st.max_k = std::max(st.max_k, (int)k);
+    sum += double(k) * double(st.hist[k]);
+    seen += st.hist[k];
+    if (st.p99_iters < 0 && seen * 100 >= total * 99)
+      st.p99_iters = (int)k;
+  }
+  st.mean_iters = total > 0 ? sum / double(total) : 0.0;
+  st.p99_iters = std::max(st.p99_iters, 0);
+}
+
+void merge_stats(RenderStats &all, const RenderStats &s) {
+  all.seconds += s.seconds;
+  all.cycle_pixels += s.cycle_pixels;
+  all.no_root_pixels += s.no_root_pixels;
+  all.redone_pixels += s.redone_pixels;
+  all.deep = all.deep || s.deep;
+  all.iterated_pixels += s.iterated_pixels;
+  all.aa_pixels += s.aa_pixels;
+  all.aa_samples += s.aa_samples;
+  all.aa_seconds += s.aa_seconds;
+  if (all.hist.size() < s.hist.size())
+    all.hist.resize(s.hist.size(), 0);
+  for (size_t k = 0; k < s.hist.size(); k++)
+    all.hist[k] += s.hist[k];
+  PoolStats &p = all.pool;
+  const PoolStats &q = s.pool;
+  p.seconds += q.seconds;
+  p.steals += q.steals;
+  if (p.busy.size() < q.busy.size()) {
+    p.busy.resize(q.busy.size(), 0.0);
+    p.idle.resize(q.busy.size(), 0.0);
+    p.tiles.resize(q.busy.size(), 0);
+  }
+  for (size_t i = 0; i < q.busy.size(); i++) {
+    p.busy[i] += q.busy[i];
+    p.idle[i] += q.idle[i];
+    p.tiles[i] += q.tiles[i];
+  }
+}
+
+void downsample_half(const ImageRGBA &in, ImageRGBA &out) {
+  const int W = (in.width + 1) / 2, H = (in.height + 1) / 2;
+  if (out.width != W || out.height != H)
+    out = ImageRGBA(W, H);
+#pragma omp parallel for schedule(static) if ((long long)W * H > 65536)
+  for (int y = 0; y < H; y++)
+    for (int x = 0; x < W; x++) {
+      // 2x2 inputs, fewer on an odd last row or column
+      double c[4] = {0.0, 0.0, 0.0, 0.0};
+      int n = 0;
+      for (int j = 2 * y; j < std::min(2 * y + 2, in.height); j++)
+        for (int i = 2 * x; i < std::min(2 * x + 2, in.width); i++) {
+          const RGBA &p = in.at(i, j);
+          c[0] += srgb_to_linear(p.r);
+          c[1] += srgb_to_linear(p.g);
+          c[2] += srgb_to_linear(p.b);
+          c[3] += p.a;
+          ++n;
+        }
+      out.at(x, y) = RGBA{linear_to_srgb(c[0] / n), linear_to_srgb(c[1] / n),
+                          linear_to_srgb(c[2] / n),
+                          (uint8_t)std::lround(c[3] / n)};
+    }
+}
+
+namespace {
+
+// colorize_basins over labels of type L, through per-slot color tables
+// (slot(l) picks a label's entry)
+template <class L, class Slot>
+void paint_basins(const BasinView &r, const L *label, const L *aa_label,
+                  const std::vector<RGBA> &pal,
+                  const std::vector<std::array<float, 3>> &lin, Slot slot,
+                  ImageRGBA &img) {
+  run_tiles(make_tiles(r.W, r.H), [&](const Tile &t, int) {
+    for (int y = t.y0; y < t.y0 + t.h; y++) {
+      const size_t o = (size_t)y * (size_t)r.W + (size_t)t.x0;
+      const L *l = label + o;
+      RGBA *p = img.pixels.data() + o;
+      for (int x = 0; x < t.w; x++)
+        p[x] = pal[slot(l[x])];
+    }
+  });
+  const size_t nn = (size_t)r.aa * (size_t)r.aa;
+  const long long m = (long long)r.aa_count;
+#pragma omp parallel for schedule(static)
+  for (long long j = 0; j < m; j++) {
+    double cr = 0.0, cg = 0.0, cb = 0.0;
+    for (size_t s = 0; s < nn; s++) {
+      const auto &c = lin[slot(aa_label[(size_t)j * nn + s])];
+      cr += c[0];
+      cg += c[1];
+      cb += c[2];
+    }
+    const double d = double(nn);
+    img.pixels[r.aa_pixel[(size_t)j]] =
+        RGBA{linear_to_srgb(cr / d), linear_to_srgb(cg / d),
+             linear_to_srgb(cb / d), 255};
+  }
+}
+
+} // namespace
+
+void colorize_basins(const BasinView &r, const std::vector<RGBA> &colors,
+                     ImageRGBA &img) {
+  if (img.width != r.W || img.height != r.H)
+    img = ImageRGBA(r.W, r.H);
+  // Color and linear-light color of every label: no branch per pixel. Wide
+  // labels get the roots' colors, then the cycle and no-root colors.
+  const size_t nc = colors.size();
+  std::vector<RGBA> pal(r.label16 ? nc + 2 : 256);
+  std::vector<std::array<float, 3>> lin(pal.size());
+  for (size_t l = 0; l < pal.size(); l++) {
+    RGBA c;
+    if (r.label16)
+      c = l < nc ? colors[l] : basin_color(l == nc ? kLabelCycle
+                                                   : kLabelNoRoot, colors);
+    else
+      c = l < kLabelCycle && l >= nc ? RGBA{0, 0, 0, 255}
+                                     : basin_color((uint8_t)l, colors);
+    pal[l] = c;
+    lin[l] = {srgb_to_linear(c.r), srgb_to_linear(c.g), srgb_to_linear(c.b)};
+  }
+  if (r.label16)
+    paint_basins(r, r.label16, r.aa_label16, pal, lin,
+                 [nc](uint16_t l) {
+                   return l < nc ? (size_t)l
+                                 : nc + (l == kLabelCycle16 ? 0 : 1);
+                 },
+                 img);
+  else
+    paint_basins(r, r.label, r.aa_label, pal, lin,
+                 [](uint8_t l) { return (size_t)l; }, img);
+}
+
+std::vector<RGBA> iteration_colors(int max_k, IterColormap cm) {
+  max_k = std::max(max_k, 1);
+  const std::vector<RGBA> &lut = colormap_lut(cm);
+  std::vector<RGBA> by_k((size_t)max_k + 1);
+  const int64_t last = kColormapLutSize - 1;
+  for (int64_t k = 0; k <= max_k; k++)
+    by_k[(size_t)k] = lut[(size_t)((2 * k * last + max_k) / (2 * max_k))];
+  return by_k;
+}
+
+void colorize_iterations(const BasinView &r, int max_k, ImageRGBA &img,
+                         IterColormap cm) {
+  if (img.width != r.W || img.height != r.H)
+    img = ImageRGBA(r.W, r.H);
+  max_k = std::max(max_k, 1);
+  const std::vector<RGBA> by_k = iteration_colors(max_k, cm);
+  const uint16_t top = (uint16_t)std::min(max_k, kMaxResultIters);
+  run_tiles(make_tiles(r.W, r.H), [&](const Tile &t, int) {
+    for (int y = t.y0; y < t.y0 + t.h; y++) {
+      const size_t o = (size_t)y * (size_t)r.W + (size_t)t.x0;
+      const uint16_t *k = r.iters + o;
+      RGBA *p = img.pixels.data() + o;
+      for (int x = 0; x < t.w; x++)
+        p[x] = by_k[std::min(k[x], top)];
+    }
+  });
+}
+
+int result_max_iters(const BasinView &r) {
+  const long long n = (long long)r.W * r.H;
+  int m = 1;
+#pragma omp parallel for reduction(max : m) schedule(static)
+  for (long long i = 0; i < n; i++)
+    m = std::max(m, (int)r.iters[(size_t)i]);
+  return m;
+}
@@ -0,0 +1,220 @@
+#pragma once
+#include "dd.h"
+#include "image.h"
+#include "kernels.h"
+#include "newton.h"
+#include "polynomials.h"
+#include "tiles.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+// Pixel grid over a rectangle of the complex plane. Pixel (x, y) samples
+// (xmin + (x + 0.5) * dx, ymin + (y + 0.5) * dy).
+struct Viewport {
+  int W = 1024, H = 768;
+  double xmin = -2, xmax = 2, ymin = -1.5, ymax = 1.5;
+  // Deep zoom (set_center): low words of a double-double xmin/ymin, and the
+  // spans, which xmax - xmin cannot resolve there. 0 = use xmax - xmin.
+  double xmin_lo = 0, ymin_lo = 0, span_x = 0, span_y = 0;
+  double dx() const { return (span_x > 0 ? span_x : xmax - xmin) / double(W); }
+  double dy() const { return (span_y > 0 ? span_y : ymax - ymin) / double(H); }
+
+  // View of the given width around a double-double center; the height
+  // follows the W:H aspect.
+  void set_center(dd cx, dd cy, double width) {
+    const double height = width * double(H) / double(W);
+    const dd x0 = cx - dd(0.5 * width), y0 = cy - dd(0.5 * height);
+    xmin = x0.hi;
+    xmin_lo = x0.lo;
+    ymin = y0.hi;
+    ymin_lo = y0.lo;
+    xmax = (cx + dd(0.5 * width)).hi;
+    ymax = (cy + dd(0.5 * height)).hi;
+    span_x = width;
+    span_y = height;
+  }
+
+  // True when a pixel spans fewer than 64 ulps of the largest coordinate:
+  // doubles would collapse neighbouring pixels, so render in double-double.
+  bool needs_dd() const {
+    const double m = std::max(std::max(std::abs(xmin), std::abs(xmax)),
+                              std::max(std::abs(ymin), std::abs(ymax)));
+    return std::min(dx(), dy()) < std::ldexp(m, -46);
+  }
+};
+
+struct RenderStats {
+  double seconds = 0.0;
+  int max_k = 1; // largest iteration count seen (at least 1)
+  double mean_iters = 0.0;
+  int p99_iters = 0;
+  long long cycle_pixels = 0;   // stopped on an attracting cycle
+  long long no_root_pixels = 0; // hit max_iters or a critical point
+  long long redone_pixels = 0;  // mixed precision: recomputed in double
+  bool deep = false;            // iterated in double-double
+  long long iterated_pixels = 0; // less than W * H with adaptive
+  long long aa_pixels = 0;       // refined by --aa
+  long long aa_samples = 0;      // iterated for them
+  double aa_seconds = 0.0;       // spent refining (part of seconds)
+  PoolStats pool;               // tile scheduling, per thread
+  std::vector<long long> hist;  // pixels per iteration count
+};
+
+struct RenderOptions {
+  // Mariani-Silver: iterate rectangle borders only and fill interiors whose
+  // border reached one root with iteration counts at most band apart
+  bool adaptive = false;
+  int band = 2;
+  // Iterate only a fundamental domain of Poly::symmetry() and fill the rest
+  // by mirroring / rotating, when the view's pixel grid allows it
+  bool symmetry = true;
+  // Anti-aliasing: aa x aa jittered samples for pixels on basin boundaries
+  // (a neighbor has another color); 1 = off, at most kMaxAA
+  int aa = 1;
+  // Render only rows [row0, row0 + rows) and columns [col0, col0 + cols) of
+  // the view (0 rows / cols: all), into a result of that size; symmetry is
+  // not used then
+  int row0 = 0, rows = 0;
+  int col0 = 0, cols = 0;
+  // --aa jitter is keyed on pixel indices in a grid that views of one pixel
+  // size share, so a view samples alike whole or cut into tiles. with_grid:
+  // the view's pixel (0, 0) is grid pixel (grid_x, grid_y); otherwise
+  // grid_origin places it.
+  bool with_grid = false;
+  long long grid_x = 0, grid_y = 0;
+};
+constexpr int kMaxAA = 16;
+
+// Index of v's pixel (0, 0) in the grid of pixels of its size laid from the
+// origin: xmin / dx and ymin / dy, rounded. False, with (0, 0), when those
+// do not fit a double (deep zoom); such views are their own grid.
+bool grid_origin(const Viewport &v, long long &gx, long long &gy);
+
+// Per-pixel results as a structure of arrays, row-major: a root label and the
+// exact iteration count, 3 bytes per pixel where two RGBA images took 8.
+// Colors are applied afterwards by colorize_basins / colorize_iterations.
+// Polynomials with more than kMaxLabelRoots roots get 16-bit labels instead
+// (wide: label16 and aa_label16 hold them, label and aa_label are empty).
+struct BasinResult {
+  int W = 0, H = 0;
+  std::vector<uint8_t> label;  // root id, kLabelCycle or kLabelNoRoot
+  std::vector<uint16_t> iters; // iteration count
+  // --aa: the refined pixels (y * W + x) and aa * aa sample labels for each,
+  // in the order of aa_pixel
+  int aa = 1;
+  std::vector<uint32_t> aa_pixel;
+  std::vector<uint8_t> aa_label;
+  bool wide = false;
+  std::vector<uint16_t> label16; // root id, kLabelCycle16 or kLabelNoRoot16
+  std::vector<uint16_t> aa_label16;
+};
+
+// Read-only planes of a result, owned elsewhere: a BasinResult, or a raw
+// file mapped into memory (raw.h). The colorize calls take this, so either
+// works without a copy.
+struct BasinView {
+  int W = 0, H = 0;
+  const uint8_t *label = nullptr;
+  const uint16_t *iters = nullptr;
+  int aa = 1;
+  size_t aa_count = 0; // refined pixels
+  const uint32_t *aa_pixel = nullptr;
+  const uint8_t *aa_label = nullptr; // aa * aa per refined pixel
+  // Wide results: label16 / aa_label16 instead of label / aa_label
+  const uint16_t *label16 = nullptr;
+  const uint16_t *aa_label16 = nullptr;
+
+  BasinView() = default;
+  BasinView(const BasinResult &r)
+      : W(r.W), H(r.H), label(r.label.data()), iters(r.iters.data()),
+        aa(r.aa), aa_count(r.aa_pixel.size()), aa_pixel(r.aa_pixel.data()),
+        aa_label(r.aa_label.data()),
+        label16(r.wide ? r.label16.data() : nullptr),
+        aa_label16(r.wide ? r.aa_label16.data() : nullptr) {}
+};
+constexpr uint8_t kLabelCycle = 254, kLabelNoRoot = 255;
+constexpr int kMaxLabelRoots = 254;   // roots a label can name
+constexpr uint16_t kLabelCycle16 = 65534, kLabelNoRoot16 = 65535;
+constexpr int kMaxWideRoots = 65534;   // roots a wide label can name
+constexpr int kMaxResultIters = 65535; // largest max_iters iters can hold
+
+inline uint8_t label_of(int rid) {
+  return rid >= 0 ? (uint8_t)rid : rid == kCycleRid ? kLabelCycle
+                                                    : kLabelNoRoot;
+}
+inline int rid_of(uint8_t label) {
+  return label < kLabelCycle ? label : label == kLabelCycle ? kCycleRid : -1;
+}
+inline uint16_t label16_of(int rid) {
+  return rid >= 0 ? (uint16_t)rid : rid == kCycleRid ? kLabelCycle16
+                                                     : kLabelNoRoot16;
+}
+inline int rid_of(uint16_t label) {
+  return label < kLabelCycle16 ? label
+         : label == kLabelCycle16 ? kCycleRid
+                                  : -1;
+}
+
+// Fills out with the root label of every pixel (kLabelNoRoot where no root
+// was reached, kLabelCycle where the orbit fell into an attracting cycle) and
+// its iteration count. The image is computed in kTileSize tiles on the
+// run_tiles work-stealing pool. kernel == nullptr runs the scalar loop
+// templated on the concrete polynomial, which ignores np.mixed_precision.
+// Views that need_dd() iterate in double-double with kernel->row_dd (the
+// scalar variant when kernel is nullptr); Method::Newton only, other methods
+// stay in double. opt.adaptive subdivides each tile instead of iterating
+// every pixel; interiors it fills are approximate. opt.symmetry copies
+// results across the polynomial's symmetries, with root ids permuted.
+// More than kMaxLabelRoots roots give a wide result. Throws
+// std::runtime_error for more than kMaxWideRoots roots or np.max_iters above
+// kMaxResultIters.
+RenderStats render_basins(const Poly &poly,
+                          const std::vector<std::complex<double>> &roots,
+                          const NewtonParams &np, const Viewport &v,
+                          const KernelVariant *kernel, BasinResult &out,
+                          const RenderOptions &opt = {});
+
+// As render_basins for opt's window (the whole view when unset), with the
+// --aa edge test reading one pixel across the window's edges: where the
+// view goes on past an edge, or at every edge with beyond (v is a tile of a
+// larger plane), the window is rendered a pixel larger and cropped. The
+// pixel counts cover the window only.
+RenderStats render_window(const Poly &poly,
+                          const std::vector<std::complex<double>> &roots,
+                          const NewtonParams &np, const Viewport &v,
+                          const KernelVariant *kernel, BasinResult &out,
+                          const RenderOptions &opt, bool beyond = false);
+
+// max_k, mean_iters and p99_iters from st.hist (after merging strips).
+void summarize_iterations(RenderStats &st);
+
+// Adds the counters, histogram and pool times of a partial render (a strip,
+// a pyramid block) to all's; summarize_iterations afterwards.
+void merge_stats(RenderStats &all, const RenderStats &s);
+
+// Basin image: colors[label] (black without a root, magenta on a cycle);
+// refined pixels blend their samples in linear light. img is reused when it
+// already has the result's size. Both colorize calls go tile by tile on the
+// run_tiles pool, through per-label / per-count tables built up front.
+void colorize_basins(const BasinView &r, const std::vector<RGBA> &colors,
+                     ImageRGBA &img);
+
+// Iteration counts through a colormap LUT, normalised by max_k
+// (RenderStats::max_k, or result_max_iters).
+void colorize_iterations(const BasinView &r, int max_k, ImageRGBA &img,
+                         IterColormap cm = IterColormap::Turbo);
+
+// The color of every count 0 .. max_k, picked from the LUT once, so a pixel
+// costs one lookup.
+std::vector<RGBA> iteration_colors(int max_k, IterColormap cm);
+
+// Halves img in both directions (rounding up) by averaging 2x2 pixels in
+// linear light, as --aa blends its samples.
+void downsample_half(const ImageRGBA &in, ImageRGBA &out);
+
+// Largest iteration count in r (at least 1): a vectorized max reduction over
+// the 16-bit counts, for results that come without RenderStats.
+int result_max_iters(const BasinView &r);
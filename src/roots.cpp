@@ -0,0 +1,104 @@
+#include "roots.h"
+#include "timing.h"
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <stdexcept>
+
+namespace {
+
+using cd = std::complex<double>;
+
+// p(z) and p'(z) by fused Horner.
+void horner(const std::vector<cd> &c, cd z, cd &f, cd &fp) {
+  f = c[0];
+  fp = 0.0;
+  for (size_t j = 1; j < c.size(); ++j) {
+    fp = fp * z + f;
+    f = f * z + c[j];
+  }
+}
+
+// Newton correction p(z)/p'(z). Outside the unit disk it is evaluated on the
+// reversed polynomial q(w) = w^n p(1/w) so high degrees do not overflow:
+// p/p' = q / (w (n q - w q')).
+cd newton_ratio(const std::vector<cd> &c, const std::vector<cd> &rev, cd z) {
+  cd f, fp;
+  if (std::abs(z) <= 1.0) {
+    horner(c, z, f, fp);
+    return f / fp;
+  }
+  const cd w = 1.0 / z;
+  horner(rev, w, f, fp);
+  const double n = double(c.size() - 1);
+  return f / (w * (n * f - w * fp));
+}
+
+} // namespace
+
+std::vector<cd> find_roots(const std::vector<cd> &coeffs,
+                           RootFindStats *stats) {
+  Timer t;
+  if (coeffs.size() < 2 || coeffs[0] == 0.0)
+    throw std::runtime_error("find_roots: need degree >= 1, c[0] != 0");
+  const int n = (int)coeffs.size() - 1;
+  std::vector<cd> c(coeffs);
+  for (auto &x : c)
+    x /= coeffs[0];
+  std::vector<cd> rev(c.rbegin(), c.rend());
+
+  // Initial guesses on a circle around the root centroid with radius the
+  // geometric mean of the root moduli, rotated off the real axis.
+  const cd centre = -c[1] / double(n);
+  double radius = std::pow(std::abs(c[(size_t)n]), 1.0 / n);
+  if (!(radius > 1e-12))
+    radius = 1.0;
+  std::vector<cd> z((size_t)n), w((size_t)n);
+  for (int k = 0; k < n; ++k)
+    z[(size_t)k] =
+        centre + std::polar(radius, 2.0 * std::numbers::pi * k / n + 0.4);
+
+  const int max_sweeps = 1000;
+  const double eps = 1e-14;
+  RootFindStats st;
+  for (; st.iterations < max_sweeps && !st.converged; ++st.iterations) {
+    // Jacobi-style sweep: every correction reads the previous iterates, so
+    // the roots are independent and the sweep parallelises.
+    int moving = 0;
+#pragma omp parallel for schedule(static) reduction(+ : moving) if (n > 64)
+    for (int k = 0; k < n; ++k) {
+      const cd zk = z[(size_t)k];
+      const cd ratio = newton_ratio(c, rev, zk);
+      cd s = 0.0;
+      for (int j = 0; j < n; ++j)
+        if (j != k)
+          s += 1.0 / (zk - z[(size_t)j]);
+      cd wk = ratio / (1.0 - ratio * s);
+      if (!std::isfinite(wk.real()) || !std::isfinite(wk.imag()))
+        wk = 0.0; // landed exactly on a root
+      w[(size_t)k] = wk;
+      if (std::abs(wk) > eps * std::max(1.0, std::abs(zk)))
+        ++moving;
+    }
+    for (int k = 0; k < n; ++k)
+      z[(size_t)k] -= w[(size_t)k];
+    st.converged = moving == 0;
+  }
+
+  // Newton polish against the original coefficients
+#pragma omp parallel for schedule(static) if (n > 64)
+  for (int k = 0; k < n; ++k) {
+    for (int it = 0; it < 3; ++it) {
+      const cd r = newton_ratio(c, rev, z[(size_t)k]);
+      // Only small corrections: near a multiple or clustered root a full
+      // Newton step could jump to a neighbouring root
+      if (!(std::abs(r) < 1e-6 * std::max(1.0, std::abs(z[(size_t)k]))))
+        break;
+      z[(size_t)k] -= r;
+    }
+  }
+  st.seconds = t.seconds();
+  if (stats)
+    *stats = st;
+  return z;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <complex>
+#include <vector>
+
+struct RootFindStats {
+  int iterations = 0;     // Aberth sweeps until every root settled
+  bool converged = false; // false if the sweep cap was hit
+  double seconds = 0.0;
+};
+
+// All roots of the polynomial with coefficients c (highest degree first,
+// c[0] != 0): simultaneous Aberth-Ehrlich iteration, parallel over roots,
+// followed by a Newton polish of each root.
+std::vector<std::complex<double>>
+find_roots(const std::vector<std::complex<double>> &c,
+           RootFindStats *stats = nullptr);
@@ -0,0 +1,628 @@
+#include "server.h"
+#include "net.h"
+#include "poly_cache.h"
+#include "polynomials.h"
+#include "timing.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <csignal>
+#include <pthread.h>
+#define NF_HAVE_SIGWAIT 1
+#endif
+
+namespace {
+
+struct Reply {
+  int status = 200;
+  std::string type = "image/png";
+  std::vector<uint8_t> body;
+};
+using ReplyPtr = std::shared_ptr<const Reply>;
+
+ReplyPtr text_reply(int status, const std::string &msg,
+                    const char *type = "text/plain") {
+  auto r = std::make_shared<Reply>();
+  r->status = status;
+  r->type = type;
+  r->body.assign(msg.begin(), msg.end());
+  r->body.push_back('\n');
+  return r;
+}
+
+const char *status_text(int status) {
+  switch (status) {
+  case 200:
+    return "OK";
+  case 400:
+    return "Bad Request";
+  case 404:
+    return "Not Found";
+  case 405:
+    return "Method Not Allowed";
+  case 503:
+    return "Service Unavailable";
+  default:
+    return "Internal Server Error";
+  }
+}
+
+// Everything a tile's pixels depend on, and the promise its waiters share
+struct TileJob {
+  std::string key;
+  std::shared_ptr<const PolyEntry> poly;
+  NewtonParams np;
+  RenderOptions ro;
+  bool iters = false; // image=iters
+  IterColormap colormap = IterColormap::Turbo;
+  int z = 0;
+  long long x = 0, y = 0;
+  std::promise<ReplyPtr> done;
+};
+
+std::string url_decode(const std::string &s) {
+  std::string out;
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == '+') {
+      out += ' ';
+    } else if (s[i] == '%' && i + 2 < s.size() &&
+               std::isxdigit((unsigned char)s[i + 1]) &&
+               std::isxdigit((unsigned char)s[i + 2])) {
+      out += (char)std::strtol(s.substr(i + 1, 2).c_str(), nullptr, 16);
+      i += 2;
+    } else {
+      out += s[i];
+    }
+  }
+  return out;
+}
+
+bool parse_ll(const std::string &s, long long &v) {
+  char *end = nullptr;
+  v = std::strtoll(s.c_str(), &end, 10);
+  return !s.empty() && *end == '\0';
+}
+
+bool parse_double(const std::string &s, double &v) {
+  char *end = nullptr;
+  v = std::strtod(s.c_str(), &end);
+  return !s.empty() && *end == '\0' && std::isfinite(v);
+}
+
+} // namespace
+
+Viewport tile_viewport(const Viewport &world, int z, long long x,
+                       long long y) {
+  const double sx = world.span_x > 0 ? world.span_x : world.xmax - world.xmin;
+  const double sy = world.span_y > 0 ? world.span_y : world.ymax - world.ymin;
+  const double side = std::max(sx, sy), ts = std::ldexp(side, -z);
+  const dd x0 = dd(world.xmin, world.xmin_lo) + dd(0.5 * (sx - side)) +
+                dd((double)x) * dd(ts);
+  const dd y0 = dd(world.ymin, world.ymin_lo) + dd(0.5 * (sy - side)) +
+                dd((double)y) * dd(ts);
+  Viewport v;
+  v.W = v.H = kServeTile;
+  v.xmin = x0.hi;
+  v.xmin_lo = x0.lo;
+  v.ymin = y0.hi;
+  v.ymin_lo = y0.lo;
+  v.span_x = v.span_y = ts;
+  v.xmax = (x0 + dd(ts)).hi;
+  v.ymax = (y0 + dd(ts)).hi;
+  return v;
+}
+
+std::string stats_json(const ServeStats &s) {
+  char b[1024];
+  std::snprintf(
+      b, sizeof b,
+      "{\"requests\": %lld, \"hits\": %lld, \"coalesced\": %lld, "
+      "\"rendered\": %lld, \"errors\": %lld, \"refused\": %lld, "
+      "\"queue_depth\": %d, \"max_queue_depth\": %d, \"busy_workers\": %d, "
+      "\"workers\": %d, \"connections\": %d, \"lru_tiles\": %lld, "
+      "\"lru_bytes\": %llu, \"p50_ms\": %.3f, \"p99_ms\": %.3f, "
+      "\"max_ms\": %.3f, \"render_ms\": %.3f, \"seconds\": %.3f}",
+      s.requests, s.hits, s.coalesced, s.rendered, s.errors, s.refused,
+      s.queue_depth, s.max_queue_depth, s.busy_workers, s.workers,
+      s.connections, s.lru_tiles, (unsigned long long)s.lru_bytes, s.p50_ms,
+      s.p99_ms, s.max_ms, s.render_ms, s.seconds);
+  return b;
+}
+
+struct TileServer::Impl {
+  ServeOptions opt;
+  const KernelVariant *kernel = nullptr;
+  Timer up;
+  int listen_fd = -1;
+  int omp_threads = 1; // per worker
+  std::atomic<bool> stopping{false};
+  std::thread acceptor;
+  std::vector<std::thread> workers;
+  // Connection threads, by id; only the acceptor (and stop, after it)
+  // touches this
+  std::map<std::thread::id, std::thread> conn_threads;
+  PolyCache polys; // has its own lock
+
+  mutable std::mutex mu; // guards everything below
+  std::condition_variable work_cv;
+  std::deque<std::unique_ptr<TileJob>> queue;
+  bool quit = false;
+  int busy = 0;
+  std::unordered_map<std::string, std::shared_future<ReplyPtr>> inflight;
+  std::list<std::pair<std::string, ReplyPtr>> lru; // most recent first
+  std::unordered_map<std::string, decltype(lru)::iterator> lru_index;
+  uint64_t lru_bytes = 0;
+  std::set<int> conns;
+  std::vector<std::thread::id> finished; // connection threads to join
+  ServeStats st;                         // the counters
+  std::vector<float> latency;            // ring of kLatencyWindow, in ms
+  long long renders_done = 0;
+  double render_seconds = 0.0;
+
+  bool parse_tile(const std::string &path, const std::string &query,
+                  TileJob &job, std::string &err);
+  std::pair<ReplyPtr, const char *> get(std::unique_ptr<TileJob> job);
+  void worker_loop();
+  void accept_loop();
+  void reap();
+  void serve_connection(int fd);
+  void record(double seconds, int status);
+};
+
+bool TileServer::Impl::parse_tile(const std::string &path,
+                                  const std::string &query, TileJob &job,
+                                  std::string &err) {
+  // /tile/Z/X/Y.png
+  long long z = -1, x = -1, y = -1;
+  const std::string rest = path.substr(6);
+  const size_t s1 = rest.find('/'), s2 = rest.find('/', s1 + 1);
+  const size_t ext = rest.rfind(".png");
+  if (s1 == std::string::npos || s2 == std::string::npos ||
+      ext == std::string::npos || ext + 4 != rest.size() ||
+      !parse_ll(rest.substr(0, s1), z) ||
+      !parse_ll(rest.substr(s1 + 1, s2 - s1 - 1), x) ||
+      !parse_ll(rest.substr(s2 + 1, ext - s2 - 1), y)) {
+    err = "expected /tile/Z/X/Y.png";
+    return false;
+  }
+  if (z < 0 || z > kServeMaxZoom || x < 0 || y < 0 || x >> z || y >> z) {
+    err = "tile out of range: zoom 0.." + std::to_string(kServeMaxZoom) +
+          ", x and y 0..2^zoom-1";
+    return false;
+  }
+  job.z = (int)z;
+  job.x = x;
+  job.y = y;
+  job.np = opt.np;
+  job.ro = opt.ro;
+  job.colormap = opt.colormap;
+  std::string poly = opt.poly, image = "basins";
+  for (size_t at = 0; at < query.size();) {
+    size_t amp = query.find('&', at);
+    if (amp == std::string::npos)
+      amp = query.size();
+    const std::string kv = query.substr(at, amp - at);
+    at = amp + 1;
+    if (kv.empty())
+      continue;
+    const size_t eq = kv.find('=');
+    const std::string k = url_decode(kv.substr(0, eq));
+    const std::string v =
+        eq == std::string::npos ? "" : url_decode(kv.substr(eq + 1));
+    long long n = 0;
+    bool ok = true;
+    if (k == "poly") {
+      // A file path would let a request read the server's files
+      poly = v;
+      ok = v.rfind("coeffs-file:", 0) != 0;
+    } else if (k == "method") {
+      ok = parse_method(v, job.np.method);
+    } else if (k == "max_iters") {
+      ok = parse_ll(v, n) && n >= 1 && n <= kMaxResultIters;
+      job.np.max_iters = (int)n;
+    } else if (k == "tol") {
+      ok = parse_double(v, job.np.tol) && job.np.tol > 0.0;
+    } else if (k == "damping") {
+      ok = parse_double(v, job.np.damping) && job.np.damping > 0.0;
+    } else if (k == "aa") {
+      ok = parse_ll(v, n) && n >= 1 && n <= kMaxAA;
+      job.ro.aa = (int)n;
+    } else if (k == "image") {
+      image = v;
+      ok = v == "basins" || v == "iters";
+    } else if (k == "colormap") {
+      ok = parse_colormap(v, job.colormap);
+    } else {
+      err = "unknown parameter '" + k + "'";
+      return false;
+    }
+    if (!ok) {
+      err = "bad value for " + k + ": '" + v + "'";
+      return false;
+    }
+  }
+  job.iters = image == "iters";
+  job.poly = polys.get(poly, err);
+  if (!job.poly)
+    return false;
+  char b[512];
+  std::snprintf(b, sizeof b,
+                "|%d|%d|%a|%a|%a|%d|%d|%d|%d|%d|%d|%d|%d|%lld|%lld",
+                (int)job.np.method, job.np.max_iters, job.np.tol,
+                job.np.damping, job.np.cycle_tol, job.np.root_traps,
+                job.np.mixed_precision, job.ro.adaptive, job.ro.band,
+                job.ro.aa, job.iters, job.iters ? (int)job.colormap : 0,
+                job.z, job.x, job.y);
+  job.key = poly + b;
+  return true;
+}
+
+// The reply for job and where it came from: the LRU, a render already in
+// flight, or a new render. Blocks until the tile is ready.
+std::pair<ReplyPtr, const char *>
+TileServer::Impl::get(std::unique_ptr<TileJob> job) {
+  std::unique_lock<std::mutex> lk(mu);
+  auto hit = lru_index.find(job->key);
+  if (hit != lru_index.end()) {
+    lru.splice(lru.begin(), lru, hit->second);
+    ++st.hits;
+    return {hit->second->second, "hit"};
+  }
+  std::shared_future<ReplyPtr> f;
+  const char *source = "coalesced";
+  auto running = inflight.find(job->key);
+  if (running != inflight.end()) {
+    f = running->second;
+    ++st.coalesced;
+  } else if (queue.size() >= (size_t)opt.max_queue) {
+    ++st.refused;
+    return {text_reply(503, "render queue full"), "refused"};
+  } else {
+    f = job->done.get_future().share();
+    inflight.emplace(job->key, f);
+    queue.push_back(std::move(job));
+    st.max_queue_depth = std::max(st.max_queue_depth, (int)queue.size());
+    ++st.rendered;
+    source = "rendered";
+    work_cv.notify_one();
+  }
+  lk.unlock();
+  return {f.get(), source};
+}
+
+void TileServer::Impl::worker_loop() {
+#if defined(_OPENMP)
+  omp_set_num_threads(omp_threads); // this thread's parallel regions
+#endif
+  // Reused from tile to tile
+  BasinResult res;
+  ImageRGBA img;
+  for (;;) {
+    std::unique_ptr<TileJob> job;
+    {
+      std::unique_lock<std::mutex> lk(mu);
+      work_cv.wait(lk, [&] { return quit || !queue.empty(); });
+      if (queue.empty())
+        return;
+      job = std::move(queue.front());
+      queue.pop_front();
+      ++busy;
+    }
+    Timer t;
+    ReplyPtr reply;
+    try {
+      // A tile of the zoom level's pixel grid, whose --aa edges read into
+      // the neighboring tiles
+      const Viewport v = tile_viewport(opt.world, job->z, job->x, job->y);
+      RenderOptions ro = job->ro;
+      ro.with_grid = true;
+      ro.grid_x = job->x * kServeTile;
+      ro.grid_y = job->y * kServeTile;
+      render_window(*job->poly->poly, job->poly->roots, job->np, v, kernel,
+                    res, ro, true);
+      // Normalised by max_iters, so neighboring tiles agree
+      if (job->iters)
+        colorize_iterations(res, job->np.max_iters, img, job->colormap);
+      else
+        colorize_basins(res, job->poly->colors, img);
+      auto r = std::make_shared<Reply>();
+      if (!encode_png(r->body, img, opt.png))
+        throw std::runtime_error("PNG encoding failed");
+      reply = std::move(r);
+    } catch (const std::exception &e) {
+      reply = text_reply(500, e.what());
+    }
+    const double s = t.seconds();
+    {
+      std::lock_guard<std::mutex> lk(mu);
+      --busy;
+      ++renders_done;
+      render_seconds += s;
+      const uint64_t bytes = reply->body.size() + job->key.size();
+      if (reply->status == 200 && bytes <= opt.lru_bytes) {
+        lru.emplace_front(job->key, reply);
+        lru_index[job->key] = lru.begin();
+        lru_bytes += bytes;
+        while (lru_bytes > opt.lru_bytes) {
+          const auto &old = lru.back();
+          lru_bytes -= old.second->body.size() + old.first.size();
+          lru_index.erase(old.first);
+          lru.pop_back();
+        }
+      }
+      // In the LRU before leaving inflight: no gap where a request for the
+      // tile would render it again
+      inflight.erase(job->key);
+    }
+    job->done.set_value(std::move(reply));
+  }
+}
+
+void TileServer::Impl::reap() {
+  std::vector<std::thread::id> done;
+  {
+    std::lock_guard<std::mutex> lk(mu);
+    done.swap(finished);
+  }
+  for (const auto &id : done) {
+    auto it = conn_threads.find(id);
+    if (it != conn_threads.end()) {
+      it->second.join();
+      conn_threads.erase(it);
+    }
+  }
+}
+
+void TileServer::Impl::accept_loop() {
+  while (!stopping) {
+    reap();
+    const int fd = accept_on(listen_fd, 100);
+    if (fd < 0)
+      continue;
+    bool full;
+    {
+      std::lock_guard<std::mutex> lk(mu);
+      full = (int)conns.size() >= opt.max_connections;
+      if (!full)
+        conns.insert(fd);
+    }
+    if (full) {
+      static const char busy_reply[] =
+          "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n"
+          "Connection: close\r\n\r\n";
+      send_all(fd, busy_reply, sizeof busy_reply - 1);
+      close_socket(fd);
+      std::lock_guard<std::mutex> lk(mu);
+      ++st.refused;
+      continue;
+    }
+    std::thread t([this, fd] { serve_connection(fd); });
+    const auto id = t.get_id();
+    conn_threads.emplace(id, std::move(t));
+  }
+}
+
+void TileServer::Impl::record(double seconds, int status) {
+  std::lock_guard<std::mutex> lk(mu);
+  if (status != 200 && status != 503)
+    ++st.errors;
+  latency[(size_t)(st.requests % kLatencyWindow)] = float(1e3 * seconds);
+  ++st.requests;
+}
+
+void TileServer::Impl::serve_connection(int fd) {
+  std::string buf;
+  HttpMessage m;
+  while (!stopping && read_http(fd, buf, m)) {
+    Timer t;
+    // "GET /tile/0/0/0.png?poly=z5-1 HTTP/1.1"
+    const size_t sp1 = m.start.find(' '), sp2 = m.start.rfind(' ');
+    if (sp1 == std::string::npos || sp2 <= sp1)
+      break;
+    const std::string method = m.start.substr(0, sp1);
+    const std::string target = m.start.substr(sp1 + 1, sp2 - sp1 - 1);
+    const std::string version = m.start.substr(sp2 + 1);
+    std::string conn = m.header("connection");
+    std::transform(conn.begin(), conn.end(), conn.begin(),
+                   [](unsigned char c) { return (char)std::tolower(c); });
+    const bool keep = version == "HTTP/1.1" ? conn != "close"
+                                            : conn == "keep-alive";
+    const size_t q = target.find('?');
+    const std::string path = target.substr(0, q);
+    const std::string query =
+        q == std::string::npos ? "" : target.substr(q + 1);
+
+    ReplyPtr reply;
+    const char *source = nullptr;
+    const bool tile = path.rfind("/tile/", 0) == 0;
+    if (method != "GET") {
+      reply = text_reply(405, "only GET");
+    } else if (path == "/stats") {
+      reply = text_reply(200, stats_json(stats_of(*this)),
+                         "application/json");
+    } else if (tile) {
+      auto job = std::make_unique<TileJob>();
+      std::string err;
+      if (parse_tile(path, query, *job, err))
+        std::tie(reply, source) = get(std::move(job));
+      else
+        reply = text_reply(400, err);
+    } else {
+      reply = text_reply(404, "try /tile/Z/X/Y.png or /stats");
+    }
+
+    char head[256];
+    const int n = std::snprintf(
+        head, sizeof head,
+        "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+        "Connection: %s\r\n%s%s%s\r\n",
+        reply->status, status_text(reply->status), reply->type.c_str(),
+        reply->body.size(), keep ? "keep-alive" : "close",
+        source ? "X-Tile-Source: " : "", source ? source : "",
+        source ? "\r\n" : "");
+    const bool sent = send_all(fd, head, (size_t)n) &&
+                      send_all(fd, reply->body.data(), reply->body.size());
+    if (tile)
+      record(t.seconds(), reply->status);
+    if (!sent || !keep)
+      break;
+  }
+  std::lock_guard<std::mutex> lk(mu);
+  conns.erase(fd);
+  close_socket(fd); // under mu: stop() never shuts down a reused fd
+  finished.push_back(std::this_thread::get_id());
+}
+
+TileServer::TileServer(const ServeOptions &opt, const KernelVariant *kernel)
+    : impl_(std::make_unique<Impl>()) {
+  impl_->opt = opt;
+  impl_->kernel = kernel;
+}
+
+TileServer::~TileServer() { stop(); }
+
+bool TileServer::start(std::string *err) {
+  Impl &s = *impl_;
+  std::string e;
+  if (!s.polys.get(s.opt.poly, e)) {
+    if (err)
+      *err = e;
+    return false;
+  }
+  s.listen_fd = listen_on(s.opt.listen, err);
+  if (s.listen_fd < 0)
+    return false;
+  const int threads = pool_threads();
+  const int n = s.opt.workers > 0 ? s.opt.workers : threads;
+  s.omp_threads = std::max(1, threads / n);
+  s.latency.assign(kLatencyWindow, 0.0f);
+  s.up.reset();
+  s.stopping = false;
+  s.quit = false;
+  for (int i = 0; i < n; i++)
+    s.workers.emplace_back([&s] { s.worker_loop(); });
+  s.acceptor = std::thread([&s] { s.accept_loop(); });
+  return true;
+}
+
+void TileServer::stop() {
+  Impl &s = *impl_;
+  if (s.listen_fd < 0)
+    return;
+  s.stopping = true;
+  s.acceptor.join();
+  close_socket(s.listen_fd);
+  s.listen_fd = -1;
+  if (s.opt.listen.rfind("unix:", 0) == 0) {
+    std::error_code ec;
+    std::filesystem::remove(s.opt.listen.substr(5), ec);
+  }
+  // Open connections: wake readers, let requests in progress finish
+  {
+    std::lock_guard<std::mutex> lk(s.mu);
+    for (int fd : s.conns)
+      shutdown_socket(fd);
+  }
+  for (auto &c : s.conn_threads)
+    c.second.join();
+  s.conn_threads.clear();
+  {
+    std::lock_guard<std::mutex> lk(s.mu);
+    s.finished.clear();
+    s.quit = true;
+  }
+  s.work_cv.notify_all();
+  for (auto &w : s.workers)
+    w.join();
+  s.workers.clear();
+}
+
+ServeStats TileServer::stats() const { return stats_of(*impl_); }
+
+ServeStats TileServer::stats_of(const Impl &s) {
+  ServeStats out;
+  std::vector<float> lat;
+  {
+    std::lock_guard<std::mutex> lk(s.mu);
+    out = s.st;
+    out.queue_depth = (int)s.queue.size();
+    out.busy_workers = s.busy;
+    out.workers = (int)s.workers.size();
+    out.connections = (int)s.conns.size();
+    out.lru_tiles = (long long)s.lru.size();
+    out.lru_bytes = s.lru_bytes;
+    out.render_ms = 1e3 * s.render_seconds /
+                    (double)std::max(s.renders_done, 1LL);
+    lat.assign(s.latency.begin(),
+               s.latency.begin() +
+                   std::min<long long>(s.st.requests, kLatencyWindow));
+  }
+  out.seconds = s.up.seconds();
+  if (!lat.empty()) {
+    auto pct = [&](double p) {
+      const size_t k =
+          std::min(lat.size() - 1, (size_t)(p * (double)lat.size()));
+      std::nth_element(lat.begin(), lat.begin() + (ptrdiff_t)k, lat.end());
+      return (double)lat[k];
+    };
+    out.p50_ms = pct(0.50);
+    out.p99_ms = pct(0.99);
+    out.max_ms = *std::max_element(lat.begin(), lat.end());
+  }
+  return out;
+}
+
+#ifdef NF_HAVE_SIGWAIT
+
+namespace {
+sigset_t stop_signals() {
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGINT);
+  sigaddset(&set, SIGTERM);
+  return set;
+}
+} // namespace
+
+void block_stop_signals() {
+  const sigset_t set = stop_signals();
+  pthread_sigmask(SIG_BLOCK, &set, nullptr);
+}
+
+void wait_stop_signal() {
+  const sigset_t set = stop_signals();
+  int sig = 0;
+  sigwait(&set, &sig);
+}
+
+#else
+
+void block_stop_signals() {}
+void wait_stop_signal() {
+  for (;;)
+    std::this_thread::sleep_for(std::chrono::hours(1));
+}
+
+#endif
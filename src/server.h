@@ -0,0 +1,93 @@
+#pragma once
+// Tile server (--serve): one long-lived process answers tile requests over
+// HTTP on a unix socket or a local TCP port. Polynomials, their roots and
+// palettes are built once per distinct --poly and kept; each worker
+// reuses its result and image buffers from tile to tile.
+//
+//   GET /tile/Z/X/Y.png[?poly=..&method=..&max_iters=..&tol=..&damping=..
+//                        &aa=..&image=basins|iters&colormap=turbo|hsv]
+//   GET /stats          (ServeStats as JSON)
+//
+// Tile (X, Y) of zoom Z is kServeTile pixels square, cut from the world
+// square split 2^Z times each way; rows go from ymin up, as image rows do.
+// Parameters a request leaves out take the server's command-line values.
+//
+// Finished tiles go into an in-memory LRU of encoded PNGs. A tile that is
+// already being rendered is not queued again: later requests for it wait
+// on the same render (coalescing). Renders run on a fixed pool of worker
+// threads fed by one queue; when too many are waiting, requests are
+// refused with 503 rather than queued without bound.
+#include "png.h"
+#include "render.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+constexpr int kServeTile = 256;
+constexpr int kServeMaxZoom = 52; // tile corners stay exact in doubles
+constexpr int kLatencyWindow = 8192; // tile requests p50 / p99 cover
+
+struct ServeOptions {
+  std::string listen = "8080"; // unix:PATH, HOST:PORT or PORT (net.h)
+  int workers = 0;             // 0 = one per OpenMP thread
+  uint64_t lru_bytes = 256ull << 20;
+  int max_queue = 1024;       // renders waiting for a worker
+  int max_connections = 256;  // open at once; more are refused
+  // Defaults for parameters a request leaves out
+  std::string poly = "z3-1";
+  NewtonParams np;
+  RenderOptions ro;
+  IterColormap colormap = IterColormap::Turbo;
+  PngOptions png;
+  // Zoom 0 is the square around world's center with its larger span
+  Viewport world;
+};
+
+struct ServeStats {
+  long long requests = 0; // tile requests answered, all outcomes
+  long long hits = 0, coalesced = 0, rendered = 0;
+  long long errors = 0, refused = 0;
+  int queue_depth = 0;     // renders waiting now
+  int max_queue_depth = 0; // since start
+  int busy_workers = 0, workers = 0;
+  int connections = 0;
+  long long lru_tiles = 0;
+  uint64_t lru_bytes = 0;
+  // Request latency in ms (read to reply sent), over the last
+  // kLatencyWindow tile requests
+  double p50_ms = 0.0, p99_ms = 0.0, max_ms = 0.0;
+  double render_ms = 0.0; // mean render + colorize + encode per tile
+  double seconds = 0.0;   // since start
+};
+
+std::string stats_json(const ServeStats &s);
+
+// The view of tile (x, y) at zoom z.
+Viewport tile_viewport(const Viewport &world, int z, long long x,
+                       long long y);
+
+class TileServer {
+public:
+  TileServer(const ServeOptions &opt, const KernelVariant *kernel);
+  TileServer(const TileServer &) = delete;
+  TileServer &operator=(const TileServer &) = delete;
+  ~TileServer(); // stops
+
+  // Builds the default polynomial, binds the address and starts the
+  // threads; false with *err set if any of it fails.
+  bool start(std::string *err);
+  // Stops accepting, lets open requests finish and joins every thread.
+  void stop();
+  ServeStats stats() const;
+
+private:
+  struct Impl;
+  static ServeStats stats_of(const Impl &s);
+  std::unique_ptr<Impl> impl_;
+};
+
+// For main: blocks SIGINT and SIGTERM in the calling thread, so threads
+// started afterwards inherit the mask, and wait_stop_signal returns once
+// either arrives. No-ops where signals are not POSIX.
+void block_stop_signals();
+void wait_stop_signal();
@@ -0,0 +1,113 @@
+#include "stream.h"
+#include "pipeline.h"
+#include "timing.h"
+#include <algorithm>
+#include <array>
+
+namespace {
+
+// One strip: its result and, for --aa, the colorized rows.
+struct Slot {
+  BasinResult res;
+  ImageRGBA rgba;
+  int y0 = 0, rows = 0;
+};
+
+} // namespace
+
+StreamStats render_streamed(const Poly &poly,
+                            const std::vector<std::complex<double>> &roots,
+                            const NewtonParams &np, const Viewport &v,
+                            const KernelVariant *kernel,
+                            const std::vector<RGBA> &colors,
+                            const RenderOptions &opt,
+                            const StreamOptions &so,
+                            const std::string &path_basins,
+                            const std::string &path_iters) {
+  Timer wall;
+  StreamStats out;
+  const int W = v.W, H = v.H;
+  const int strip = std::clamp(so.strip_rows, 1, H);
+  const bool aa = opt.aa > 1;
+  // Wide labels do not fit a PNG palette: colorized rows, as with --aa
+  const bool rgb = aa || roots.size() > (size_t)kMaxLabelRoots;
+
+  // Without --aa a basin row is its labels: label -> palette index, with
+  // the cycle and no-root colors after the roots' colors
+  std::vector<RGBA> palette(colors);
+  const int nc = (int)palette.size();
+  palette.push_back(RGBA{255, 0, 255, 255});
+  palette.push_back(RGBA{0, 0, 0, 255});
+  std::array<uint8_t, 256> index{};
+  for (int l = 0; l < 256; l++)
+    index[(size_t)l] = (uint8_t)(l < nc               ? l
+                                 : l == kLabelCycle ? nc
+                                                    : nc + 1);
+  const std::vector<RGBA> by_k = iteration_colors(np.max_iters, so.colormap);
+  const uint16_t top = (uint16_t)np.max_iters;
+
+  PngWriter png_b, png_i;
+  const PngColor basin_color = rgb ? PngColor::RGB : PngColor::Indexed;
+  if (!png_b.open(path_basins, W, H, basin_color, palette, so.png) ||
+      !png_i.open(path_iters, W, H, PngColor::RGB, {}, so.png))
+    return out;
+
+  auto encode = [&](Slot &s) {
+    Timer te;
+    if (rgb) {
+      colorize_basins(s.res, colors, s.rgba);
+      png_b.write_rows(s.y0, s.rows, [&](int y, uint8_t *d) {
+        const RGBA *p = &s.rgba.at(0, y - s.y0);
+        for (int x = 0; x < W; x++) {
+          d[3 * x] = p[x].r;
+          d[3 * x + 1] = p[x].g;
+          d[3 * x + 2] = p[x].b;
+        }
+      });
+    } else {
+      png_b.write_rows(s.y0, s.rows, [&](int y, uint8_t *d) {
+        const uint8_t *l =
+            s.res.label.data() + (size_t)(y - s.y0) * (size_t)W;
+        for (int x = 0; x < W; x++)
+          d[x] = index[l[x]];
+      });
+    }
+    png_i.write_rows(s.y0, s.rows, [&](int y, uint8_t *d) {
+      const uint16_t *k =
+          s.res.iters.data() + (size_t)(y - s.y0) * (size_t)W;
+      for (int x = 0; x < W; x++) {
+        const RGBA c = by_k[std::min(k[x], top)];
+        d[3 * x] = c.r;
+        d[3 * x + 1] = c.g;
+        d[3 * x + 2] = c.b;
+      }
+    });
+    out.encode_seconds += te.seconds();
+  };
+
+  EncodePipeline<Slot> encoder(encode);
+
+  // Two slots: one being computed, one being encoded
+  std::array<Slot, 2> slots;
+  for (int y0 = 0, k = 0; y0 < H; y0 += strip, k++) {
+    Slot &s = slots[(size_t)(k & 1)];
+    s.y0 = y0;
+    s.rows = std::min(strip, H - y0);
+    RenderOptions o = opt;
+    o.row0 = y0;
+    o.rows = s.rows;
+    merge_stats(out.render,
+                render_window(poly, roots, np, v, kernel, s.res, o));
+    ++out.strips;
+    encoder.finish();
+    encoder.push(s);
+  }
+  encoder.close();
+  const bool closed_b = png_b.close(), closed_i = png_i.close();
+  out.ok = closed_b && closed_i;
+  out.bytes_basins = png_b.bytes_written();
+  out.bytes_iters = png_i.bytes_written();
+  summarize_iterations(out.render);
+  out.seconds = wall.seconds();
+  return out;
+}
@@ -0,0 +1,40 @@
+#pragma once
+// Out-of-core rendering: the view is computed in horizontal strips and each
+// finished strip goes straight to the PNG encoders, so memory is a few
+// strips no matter how large the image is. Strip k + 1 is computed while
+// strip k is colorized, compressed and written on another thread.
+#include "png.h"
+#include "render.h"
+#include <string>
+#include <vector>
+
+struct StreamOptions {
+  int strip_rows = 256;
+  PngOptions png;
+  IterColormap colormap = IterColormap::Turbo;
+};
+
+struct StreamStats {
+  RenderStats render;     // merged over strips; seconds = compute time
+  int strips = 0;
+  double encode_seconds = 0.0; // colorize + compress + write, all strips
+  double seconds = 0.0;        // wall time of the whole run
+  uint64_t bytes_basins = 0, bytes_iters = 0;
+  bool ok = false; // both files written
+};
+
+// Renders v as render_basins would, writing the basin and iteration PNGs.
+// The iteration image is normalised by np.max_iters: the largest count is
+// not known until the last strip. Basins are palette PNGs, or RGB with
+// opt.aa > 1 or more than kMaxLabelRoots roots. With opt.aa > 1 strips
+// overlap by a row so boundary detection sees the neighbors. opt.symmetry
+// is ignored (a strip holds no mirror images).
+StreamStats render_streamed(const Poly &poly,
+                            const std::vector<std::complex<double>> &roots,
+                            const NewtonParams &np, const Viewport &v,
+                            const KernelVariant *kernel,
+                            const std::vector<RGBA> &colors,
+                            const RenderOptions &opt,
+                            const StreamOptions &so,
+                            const std::string &path_basins,
+                            const std::string &path_iters);
@@ -0,0 +1,319 @@
+#include "sweep.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Values of one key=... group; false on a malformed value
+bool parse_values(const std::string &text, std::vector<double> &out) {
+  char *end = nullptr;
+  const size_t c1 = text.find(':');
+  if (c1 == std::string::npos) {
+    const double x = std::strtod(text.c_str(), &end);
+    if (text.empty() || *end || !std::isfinite(x))
+      return false;
+    out.push_back(x);
+    return true;
+  }
+  const size_t c2 = text.find(':', c1 + 1);
+  if (c2 == std::string::npos)
+    return false;
+  const std::string sa = text.substr(0, c1),
+                    sb = text.substr(c1 + 1, c2 - c1 - 1),
+                    ss = text.substr(c2 + 1);
+  const double a = std::strtod(sa.c_str(), &end);
+  bool ok = !sa.empty() && !*end;
+  const double b = std::strtod(sb.c_str(), &end);
+  ok = ok && !sb.empty() && !*end;
+  const double s = std::strtod(ss.c_str(), &end);
+  ok = ok && !ss.empty() && !*end && s > 0.0 && b >= a && std::isfinite(b);
+  // The end point counts when rounding left it a hair short
+  const double n = ok ? std::floor((b - a) / s + 1e-9) + 1.0 : 0.0;
+  if (!ok || n > kMaxSweepVariants)
+    return false;
+  for (int i = 0; i < (int)n; i++)
+    out.push_back(a + i * s);
+  return true;
+}
+
+// One thread's share: starting points, the variants' parameters repeated
+// for kTileSize pixels, results, and per-variant label tallies
+struct Worker {
+  std::vector<double> zr, zi, damping, tol;
+  std::vector<int> max_iters, rid, k;
+  std::vector<std::complex<double>> z0; // scalar loop
+  std::vector<long long> labels; // (roots + 2) per variant
+};
+
+} // namespace
+
+bool parse_sweep(const std::string &spec, const NewtonParams &base,
+                 std::vector<NewtonParams> &variants, std::string &err) {
+  std::vector<std::pair<std::string, std::vector<double>>> axes;
+  size_t i = 0;
+  while (i <= spec.size()) {
+    const size_t comma = std::min(spec.find(',', i), spec.size());
+    std::string tok = spec.substr(i, comma - i);
+    i = comma + 1;
+    const size_t eq = tok.find('=');
+    if (eq != std::string::npos) {
+      std::string key = tok.substr(0, eq);
+      if (key == "max-iters")
+        key = "max_iters";
+      if (key != "damping" && key != "tol" && key != "max_iters") {
+        err = "unknown sweep key \"" + key + "\"";
+        return false;
+      }
+      for (const auto &a : axes)
+        if (a.first == key) {
+          err = "sweep key \"" + key + "\" given twice";
+          return false;
+        }
+      axes.push_back({key, {}});
+      tok = tok.substr(eq + 1);
+    } else if (axes.empty()) {
+      err = "sweep must start with key=";
+      return false;
+    }
+    auto &[key, vals] = axes.back();
+    if (!parse_values(tok, vals)) {
+      err = "bad sweep value \"" + tok + "\" for " + key;
+      return false;
+    }
+    for (double x : vals) {
+      const bool ok = key == "max_iters"
+                          ? x == std::floor(x) && x >= 1.0 &&
+                                x <= kMaxResultIters
+                          : x > 0.0;
+      if (!ok) {
+        err = "sweep " + key + " out of range";
+        return false;
+      }
+    }
+  }
+  size_t total = 1;
+  for (const auto &a : axes) {
+    total *= a.second.size();
+    if (total > (size_t)kMaxSweepVariants) {
+      err = "more than " + std::to_string(kMaxSweepVariants) +
+            " sweep variants";
+      return false;
+    }
+  }
+  variants.clear();
+  // Odometer over the axes, the last one turning fastest
+  std::vector<size_t> at(axes.size(), 0);
+  for (size_t n = 0; n < total; n++) {
+    NewtonParams np = base;
+    for (size_t a = 0; a < axes.size(); a++) {
+      const double x = axes[a].second[at[a]];
+      if (axes[a].first == "damping")
+        np.damping = x;
+      else if (axes[a].first == "tol")
+        np.tol = x;
+      else
+        np.max_iters = (int)x;
+    }
+    variants.push_back(np);
+    for (size_t a = axes.size(); a-- > 0;) {
+      if (++at[a] < axes[a].second.size())
+        break;
+      at[a] = 0;
+    }
+  }
+  return true;
+}
+
+SweepStats sweep_basins(const Poly &poly,
+                        const std::vector<std::complex<double>> &roots,
+                        const std::vector<NewtonParams> &variants,
+                        const Viewport &v, const KernelVariant *kernel,
+                        std::vector<BasinResult> *results) {
+  Timer t;
+  if (roots.size() > (size_t)kMaxLabelRoots)
+    throw std::runtime_error("at most " + std::to_string(kMaxLabelRoots) +
+                             " roots can be labelled");
+  if (v.needs_dd())
+    throw std::runtime_error("sweeps iterate in double; this view needs "
+                             "double-double");
+  for (const NewtonParams &np : variants)
+    if (np.max_iters < 1 || np.max_iters > kMaxResultIters)
+      throw std::runtime_error("max_iters must be 1.." +
+                               std::to_string(kMaxResultIters));
+  const int V = (int)variants.size(), W = v.W, H = v.H;
+  const int nr = (int)roots.size(), nl = nr + 2;
+  const double dx = v.dx(), dy = v.dy();
+  SweepStats ss;
+  if (V == 0)
+    return ss;
+  if (results) {
+    results->resize((size_t)V);
+    for (BasinResult &r : *results) {
+      r.W = W;
+      r.H = H;
+      r.label.resize((size_t)W * (size_t)H);
+      r.iters.resize((size_t)W * (size_t)H);
+      r.aa = 1;
+      r.aa_pixel.clear();
+      r.aa_label.clear();
+    }
+  }
+  // Method and cycle check are shared; the kernel takes the rest per point
+  NewtonParams shared = variants.front();
+  shared.root_traps = false;
+  shared.mixed_precision = false;
+
+  // A tile row holds each variant's run of pixels in turn: point s * w + i
+  // is pixel x0 + i under variant s. SIMD blocks take neighbouring pixels,
+  // whose orbits are alike, and straddle two variants where one run ends.
+  const size_t row_points = (size_t)kTileSize * (size_t)V;
+  std::vector<Worker> workers((size_t)pool_threads());
+  for (Worker &w : workers) {
+    w.zr.resize(row_points);
+    w.zi.resize(row_points);
+    w.rid.resize(row_points);
+    w.k.resize(row_points);
+    w.z0.resize((size_t)kTileSize);
+    w.labels.assign((size_t)V * (size_t)nl, 0);
+    w.damping.resize(row_points);
+    w.tol.resize(row_points);
+    w.max_iters.resize(row_points);
+  }
+  // Iteration counts per variant, one copy for all threads: per-thread
+  // copies would take threads x variants x max_iters counts. A tile row is
+  // added under hist_mu once it is iterated.
+  std::vector<std::vector<long long>> hist((size_t)V);
+  for (int s = 0; s < V; s++)
+    hist[(size_t)s].assign((size_t)variants[(size_t)s].max_iters + 1, 0);
+  std::mutex hist_mu;
+  // Counts row y of tile (and stores it in results)
+  auto tally = [&](Worker &w, const Tile &tile, int y) {
+    for (int s = 0; s < V; s++) {
+      for (int i = 0; i < tile.w; i++) {
+        const size_t o = (size_t)y * (size_t)W + (size_t)(tile.x0 + i);
+        const size_t q = (size_t)s * (size_t)tile.w + (size_t)i;
+        const uint8_t l = label_of(w.rid[q]);
+        const int k = w.k[q];
+        ++w.labels[(size_t)s * (size_t)nl +
+                   (size_t)(l < kLabelCycle ? l : l == kLabelCycle ? nr
+                                                                   : nr + 1)];
+        if (results) {
+          (*results)[(size_t)s].label[o] = l;
+          (*results)[(size_t)s].iters[o] = (uint16_t)k;
+        }
+      }
+    }
+    std::lock_guard<std::mutex> lk(hist_mu);
+    for (int s = 0; s < V; s++) {
+      const int *k = &w.k[(size_t)s * (size_t)tile.w];
+      for (int i = 0; i < tile.w; i++)
+        ++hist[(size_t)s][(size_t)k[i]];
+    }
+  };
+  const auto tiles = make_tiles(W, H);
+  if (kernel) {
+    const PolyPlanes planes(poly);
+    const KernelPoly kp = planes.view(); // no traps
+    ss.pool = run_tiles(tiles, [&](const Tile &tile, int tid) {
+      Worker &w = workers[(size_t)tid];
+      const int n = tile.w * V;
+      for (int s = 0, q = 0; s < V; s++)
+        for (int i = 0; i < tile.w; i++, q++) {
+          w.damping[(size_t)q] = variants[(size_t)s].damping;
+          w.tol[(size_t)q] = variants[(size_t)s].tol;
+          w.max_iters[(size_t)q] = variants[(size_t)s].max_iters;
+        }
+      for (int y = tile.y0; y < tile.y0 + tile.h; y++) {
+        const double zi = v.ymin + (y + 0.5) * dy;
+        for (int i = 0; i < tile.w; i++)
+          w.zr[(size_t)i] = v.xmin + (tile.x0 + i + 0.5) * dx;
+        for (int s = 1; s < V; s++)
+          std::copy_n(w.zr.begin(), tile.w, w.zr.begin() + s * tile.w);
+        std::fill_n(w.zi.begin(), n, zi);
+        kernel->row_sweep(w.zr.data(), w.zi.data(), w.damping.data(),
+                          w.tol.data(), w.max_iters.data(), n, kp, shared,
+                          w.rid.data(), w.k.data());
+        tally(w, tile, y);
+      }
+    });
+  } else {
+    // Instantiated per concrete polynomial, a variant's run at a time
+    visit_poly(poly, [&](const auto &P) {
+      using Pt = std::decay_t<decltype(P)>;
+      ss.pool = run_tiles(tiles, [&](const Tile &tile, int tid) {
+        Worker &w = workers[(size_t)tid];
+        const size_t m = (size_t)tile.w;
+        for (int y = tile.y0; y < tile.y0 + tile.h; y++) {
+          for (int i = 0; i < tile.w; i++)
+            w.z0[(size_t)i] = {v.xmin + (tile.x0 + i + 0.5) * dx,
+                               v.ymin + (y + 0.5) * dy};
+          for (int s = 0; s < V; s++) {
+            NewtonParams np = variants[(size_t)s];
+            np.root_traps = false;
+            newton_row_scalar<Pt>(std::span(w.z0.data(), m), P, roots, np,
+                                  std::span(w.rid.data() + (size_t)s * m, m),
+                                  std::span(w.k.data() + (size_t)s * m, m));
+          }
+          tally(w, tile, y);
+        }
+      });
+    });
+  }
+
+  for (int s = 0; s < V; s++) {
+    SweepVariantStats vs;
+    vs.np = variants[(size_t)s];
+    vs.root_pixels.assign((size_t)nr, 0);
+    RenderStats st;
+    st.hist = std::move(hist[(size_t)s]);
+    for (const Worker &w : workers) {
+      const long long *l = &w.labels[(size_t)s * (size_t)nl];
+      for (int r = 0; r < nr; r++)
+        vs.root_pixels[(size_t)r] += l[r];
+      vs.cycle_pixels += l[nr];
+      vs.no_root_pixels += l[nr + 1];
+    }
+    summarize_iterations(st);
+    vs.mean_iters = st.mean_iters;
+    vs.p99_iters = st.p99_iters;
+    vs.max_k = st.max_k;
+    ss.variants.push_back(std::move(vs));
+  }
+  ss.points = (long long)W * H * V;
+  ss.seconds = t.seconds();
+  return ss;
+}
+
+bool write_sweep_summary(const std::string &path, const SweepStats &st) {
+  std::FILE *f = std::fopen(path.c_str(), "w");
+  if (!f)
+    return false;
+  const size_t nr =
+      st.variants.empty() ? 0 : st.variants.front().root_pixels.size();
+  std::fprintf(f, "variant\tdamping\ttol\tmax_iters");
+  for (size_t r = 0; r < nr; r++)
+    std::fprintf(f, "\troot%zu", r);
+  std::fprintf(f, "\tcycle\tno_root\tnonconverged\tmean_iters\tp99_iters\n");
+  for (size_t i = 0; i < st.variants.size(); i++) {
+    const SweepVariantStats &v = st.variants[i];
+    long long total = v.cycle_pixels + v.no_root_pixels;
+    for (long long n : v.root_pixels)
+      total += n;
+    const double px = double(std::max(total, 1LL));
+    std::fprintf(f, "%zu\t%.6g\t%.6g\t%d", i, v.np.damping, v.np.tol,
+                 v.np.max_iters);
+    for (long long n : v.root_pixels)
+      std::fprintf(f, "\t%.6f", double(n) / px);
+    std::fprintf(f, "\t%.6f\t%.6f\t%.6f\t%.3f\t%d\n",
+                 double(v.cycle_pixels) / px, double(v.no_root_pixels) / px,
+                 double(v.cycle_pixels + v.no_root_pixels) / px,
+                 v.mean_iters, v.p99_iters);
+  }
+  return std::fclose(f) == 0;
+}
@@ -0,0 +1,58 @@
+#pragma once
+// Parameter sweeps (--sweep damping=0.5:1.0:0.05,tol=1e-6,1e-9,1e-12): many
+// NewtonParams variants of one view in a single pass over its pixels. Each
+// tile row's starting points are computed once and iterated under every
+// variant in one kernel call (KernelVariant::row_sweep), the parameters
+// going per lane: a block holds neighbouring pixels of one variant, or of
+// two where one variant's run ends, so short rows need no padding. (The
+// variants of a single pixel side by side diverge: damping 0.5 takes five
+// times the iterations of 1.0, and the block waits for its slowest lane.)
+//
+// Sweeps run without root traps: a trap ends a point as soon as its root is
+// certain, which drops exactly the final iterations a tol study measures.
+// Every pixel is iterated (no --adaptive, --aa or symmetry), in double.
+#include "render.h"
+#include <string>
+#include <vector>
+
+constexpr int kMaxSweepVariants = 4096;
+
+// The variants of spec over base. spec is key=values groups separated by
+// commas, where a value is a number or an A:B:STEP range (B included) and
+// keys are damping, tol and max_iters; the variants are every combination,
+// the last key varying fastest. False with err set on a bad spec.
+bool parse_sweep(const std::string &spec, const NewtonParams &base,
+                 std::vector<NewtonParams> &variants, std::string &err);
+
+struct SweepVariantStats {
+  NewtonParams np;
+  std::vector<long long> root_pixels; // per root
+  long long cycle_pixels = 0, no_root_pixels = 0;
+  double mean_iters = 0.0;
+  int p99_iters = 0;
+  int max_k = 1; // largest iteration count seen, as RenderStats::max_k
+};
+
+struct SweepStats {
+  std::vector<SweepVariantStats> variants;
+  long long points = 0; // pixels times variants
+  double seconds = 0.0;
+  PoolStats pool;
+};
+
+// Iterates every pixel of v under each variant in one tiled traversal on
+// the run_tiles pool. kernel == nullptr runs the scalar loop, a variant at a
+// time per tile row. With results, variant i's labels and counts go to
+// (*results)[i], as render_basins would write them for that variant without
+// traps and symmetry. Throws std::runtime_error when v needs double-double,
+// for more than kMaxLabelRoots roots or a max_iters above kMaxResultIters.
+SweepStats sweep_basins(const Poly &poly,
+                        const std::vector<std::complex<double>> &roots,
+                        const std::vector<NewtonParams> &variants,
+                        const Viewport &v, const KernelVariant *kernel,
+                        std::vector<BasinResult> *results = nullptr);
+
+// One tab-separated row per variant: damping, tol, max_iters, the fraction
+// of pixels in each root's basin, then on a cycle and with no root (the
+// non-convergence rate), mean and p99 iterations.
+bool write_sweep_summary(const std::string &path, const SweepStats &st);
@@ -0,0 +1,151 @@
+#pragma once
+// Image tiles and a work-stealing pool over them. Per-pixel cost varies by
+// two orders of magnitude between basin interiors and boundaries, so rows
+// handed out statically leave threads idle; small tiles taken from per-thread
+// queues, with idle threads stealing half of a busy thread's queue, keep
+// every thread working until the image is done.
+#include "timing.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+// 64x64 pixels: the tile's ids and counts (32 KiB) stay in L1/L2.
+constexpr int kTileSize = 64;
+
+struct Tile {
+  int x0, y0, w, h;
+};
+
+// Interleaves the bits of x and y, x in the even bits.
+inline uint64_t morton2(uint32_t x, uint32_t y) {
+  auto spread = [](uint64_t v) {
+    v = (v | (v << 16)) & 0x0000ffff0000ffffULL;
+    v = (v | (v << 8)) & 0x00ff00ff00ff00ffULL;
+    v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    v = (v | (v << 2)) & 0x3333333333333333ULL;
+    v = (v | (v << 1)) & 0x5555555555555555ULL;
+    return v;
+  };
+  return spread(x) | (spread(y) << 1);
+}
+
+// Tiles covering W x H in Morton (Z-curve) order, so any contiguous run of
+// tiles is a compact patch of the image. Edge tiles are clipped.
+inline std::vector<Tile> make_tiles(int W, int H, int size = kTileSize) {
+  std::vector<std::pair<uint64_t, Tile>> keyed;
+  for (int ty = 0; ty * size < H; ++ty)
+    for (int tx = 0; tx * size < W; ++tx) {
+      const int x0 = tx * size, y0 = ty * size;
+      keyed.push_back({morton2((uint32_t)tx, (uint32_t)ty),
+                       {x0, y0, std::min(size, W - x0),
+                        std::min(size, H - y0)}});
+    }
+  std::sort(keyed.begin(), keyed.end(),
+            [](const auto &a, const auto &b) { return a.first < b.first; });
+  std::vector<Tile> tiles;
+  tiles.reserve(keyed.size());
+  for (const auto &k : keyed)
+    tiles.push_back(k.second);
+  return tiles;
+}
+
+// Threads run_tiles will use at most; size per-thread state with this.
+inline int pool_threads() {
+#if defined(_OPENMP)
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+struct PoolStats {
+  double seconds = 0.0;
+  // Per thread that took part: time inside tile bodies, and the rest of the
+  // wall time (stealing, and waiting for the last tiles elsewhere)
+  std::vector<double> busy, idle;
+  std::vector<int> tiles; // tiles run per thread
+  long long steals = 0;
+};
+
+// Calls f(tile, thread) once for every tile, on the OpenMP team. Each thread
+// starts with a contiguous share of the Morton order and takes tiles from its
+// front; a thread that runs dry steals the back half of another thread's
+// queue. A queue is a [lo, hi) range of tile indices packed in one atomic
+// word, so both ends move with a single compare-exchange.
+template <class F>
+PoolStats run_tiles(const std::vector<Tile> &tiles, F &&f) {
+  struct alignas(64) Queue {
+    std::atomic<uint64_t> range{0};
+    double busy = 0.0;
+    int ran = 0;
+    long long steals = 0;
+  };
+  auto pack = [](uint64_t lo, uint64_t hi) { return lo << 32 | hi; };
+  std::vector<Queue> q((size_t)pool_threads());
+  int team = 1;
+  Timer wall;
+#pragma omp parallel
+  {
+    int tid = 0, nt = 1;
+#if defined(_OPENMP)
+    tid = omp_get_thread_num();
+    nt = omp_get_num_threads();
+#endif
+    const uint64_t n = tiles.size();
+    Queue &me = q[(size_t)tid];
+    me.range.store(pack(n * (uint64_t)tid / (uint64_t)nt,
+                        n * (uint64_t)(tid + 1) / (uint64_t)nt));
+    if (tid == 0)
+      team = nt;
+#pragma omp barrier
+    for (;;) {
+      uint64_t r = me.range.load();
+      const uint64_t lo = r >> 32, hi = r & 0xffffffffu;
+      if (lo < hi) {
+        if (!me.range.compare_exchange_weak(r, pack(lo + 1, hi)))
+          continue;
+        Timer t;
+        f(tiles[(size_t)lo], tid);
+        me.busy += t.seconds();
+        ++me.ran;
+        continue;
+      }
+      bool stole = false;
+      for (int s = 1; s < nt && !stole; ++s) {
+        Queue &v = q[(size_t)((tid + s) % nt)];
+        uint64_t vr = v.range.load();
+        for (;;) {
+          const uint64_t vlo = vr >> 32, vhi = vr & 0xffffffffu;
+          if (vlo >= vhi)
+            break;
+          const uint64_t mid = vhi - (vhi - vlo + 1) / 2;
+          if (v.range.compare_exchange_weak(vr, pack(vlo, mid))) {
+            me.range.store(pack(mid, vhi));
+            ++me.steals;
+            stole = true;
+            break;
+          }
+        }
+      }
+      // Every queue looked empty: what is left is already being run
+      if (!stole)
+        break;
+    }
+  }
+  PoolStats st;
+  st.seconds = wall.seconds();
+  for (int i = 0; i < team; ++i) {
+    const Queue &t = q[(size_t)i];
+    st.busy.push_back(t.busy);
+    st.idle.push_back(std::max(0.0, st.seconds - t.busy));
+    st.tiles.push_back(t.ran);
+    st.steals += t.steals;
+  }
+  return st;
+}
@@ -8,3 +8,23 @@ struct Timer {
     return std::chrono::duration<double>(clock::now() - t0).count();
   }
 };
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+// Peak resident set size of the process in bytes (0 where unsupported).
+inline long long peak_rss_bytes() {
+#if defined(__unix__) || defined(__APPLE__)
+  rusage ru{};
+  if (getrusage(RUSAGE_SELF, &ru) != 0)
+    return 0;
+#if defined(__APPLE__)
+  return (long long)ru.ru_maxrss; // bytes on macOS
+#else
+  return (long long)ru.ru_maxrss * 1024; // KiB on Linux
+#endif
+#else
+  return 0;
+#endif
+}
@@ -15,6 +15,7 @@
 #include "image.h"
 #include "newton.h"
 #include "polynomials.h"
+#include "render.h"
 
 #include <GL/gl.h>
 #include <GLFW/glfw3.h>
@@ -47,37 +48,29 @@ static void compute_images(State &S, ImageRGBA &basin, ImageRGBA &iters) {
   std::unique_ptr<Poly> poly(make_poly(S.poly_id));
   auto roots = poly->roots();
   NewtonParams np;
-  np.max_iters = S.max_iters;
+  np.max_iters = std::clamp(S.max_iters, 1, kMaxResultIters);
   np.tol = S.tol;
   np.damping = S.damping;
 
-  basin = ImageRGBA(S.W, S.H);
-  iters = ImageRGBA(S.W, S.H);
-  const double dx = (S.xmax - S.xmin) / double(S.W);
-  const double dy = (S.ymax - S.ymin) / double(S.H);
+  Viewport view;
+  view.W = S.W;
+  view.H = S.H;
+  view.xmin = S.xmin;
+  view.xmax = S.xmax;
+  view.ymin = S.ymin;
+  view.ymax = S.ymax;
 
   auto colors =
       make_basin_palette((int)roots.size(), BasinPalette::BlueGold, &roots);
-  RGBA no_conv{0, 0, 0, 255};
-  int max_k = 1;
-#pragma omp parallel for schedule(static) reduction(max : max_k)
-  for (int y = 0; y < S.H; y++) {
-    for (int x = 0; x < S.W; x++) {
-      std::complex<double> z0(S.xmin + (x + 0.5) * dx, S.ymin + (y + 0.5) * dy);
-      auto [rid, k] = newton_iterate(z0, *poly, roots, np);
-      if (k > max_k)
-        max_k = k;
-      basin.at(x, y) = (rid >= 0) ? colors[rid] : no_conv;
-      unsigned char g = (unsigned char)(k < 255 ? k : 255);
-      iters.at(x, y) = RGBA{g, g, g, 255};
-    }
-  }
-  for (int y = 0; y < S.H; y++) {
-    for (int x = 0; x < S.W; x++) {
-      double t = iters.at(x, y).r / double(max_k);
-      iters.at(x, y) = turbo_colormap(t);
-    }
-  }
+#ifdef USE_SIMD
+  static const KernelVariant *kernel = select_kernel("auto");
+#else
+  const KernelVariant *kernel = nullptr;
+#endif
+  BasinResult res;
+  RenderStats st = render_basins(*poly, roots, np, view, kernel, res);
+  colorize_basins(res, colors, basin);
+  colorize_iterations(res, st.max_k, iters);
 }
 
 int main() {
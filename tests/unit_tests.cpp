@@ -1,13 +1,38 @@
+#include "../src/animate.h"
+#include "../src/batch.h"
+#include "../src/cache.h"
+#include "../src/dd.h"
 #include "../src/image.h"
 #include "../src/newton.h"
+#include "../src/kernels.h"
+#include "../src/png.h"
 #include "../src/polynomials.h"
+#include "../src/pyramid.h"
+#include "../src/raw.h"
+#include "../src/render.h"
+#include "../src/net.h"
+#include "../src/server.h"
+#include "../src/stream.h"
+#include "../src/sweep.h"
+#include "../src/tiles.h"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <complex>
 #include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
 static bool approx_eq(std::complex<double> a, std::complex<double> b,
                       double eps = 1e-8) {
   return std::abs(a - b) < eps;
@@ -92,7 +117,7 @@ int test_golden() {
     sum = sum * 1315423911ull + px.r * 3 + px.g * 5 + px.b * 7 + px.a;
   }
   const unsigned long long GOLD =
-      16134397293084637927ull; // update if algorithm changes intentionally
+      9261921408081325428ull; // update if algorithm changes intentionally
   if (sum != GOLD) {
     std::fprintf(stderr, "Golden checksum mismatch: got %llu\n",
                  (unsigned long long)sum);
@@ -101,13 +126,2102 @@ int test_golden() {
   return 0;
 }
 
+// Every supported row kernel vs scalar newton_iterate on the built-in
+// polynomials
+int test_simd() {
+  int fails = 0;
+  const int W = 160, H = 120;
+  const char *ids[] = {"z3-1", "z5-1", "z3-2z+2", "tight-clusters-archipelagos",
+                       "mixed-radii-pentagon-stack"};
+  for (const auto &kv : kernel_variants()) {
+    if (!kernel_supported(kv))
+      continue;
+    for (const char *id : ids) {
+      auto poly = make_poly(id);
+      auto roots = poly->roots();
+      const PolyPlanes planes(*poly);
+      NewtonParams np;
+      np.max_iters = 200;
+      np.tol = 1e-12;
+      std::vector<double> zr(W), zi(W);
+      std::vector<int> rid(W), k(W);
+      int label_diff = 0, iter_diff = 0;
+      for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+          zr[(size_t)x] = -2.5 + (x + 0.5) * 5.0 / W;
+          zi[(size_t)x] = -2.0 + (y + 0.5) * 4.0 / H;
+        }
+        kv.row(zr.data(), zi.data(), W, planes.view(), np, rid.data(),
+               k.data());
+        for (int x = 0; x < W; x++) {
+          auto [r0, k0] = newton_iterate(
+              std::complex<double>(zr[(size_t)x], zi[(size_t)x]), *poly,
+              roots, np);
+          label_diff += r0 != rid[(size_t)x];
+          iter_diff += std::abs(k0 - k[(size_t)x]) > 1;
+        }
+      }
+      // Rounding differs (Horner + FMA), so only boundary pixels may disagree
+      if (label_diff > W * H / 200 || iter_diff > W * H / 50) {
+        std::fprintf(stderr, "%s: %s mismatch labels=%d iters=%d\n", kv.name,
+                     id, label_diff, iter_diff);
+        ++fails;
+      }
+    }
+  }
+  return fails;
+}
+
+// Fused eval_and_deriv and the row API agree with eval/deriv and the
+// per-point loop
+int test_fused() {
+  int fails = 0;
+  const char *ids[] = {"z3-1", "z5-1", "z3-2z+2", "tight-clusters-archipelagos",
+                       "mixed-radii-pentagon-stack"};
+  for (const char *id : ids) {
+    auto poly = make_poly(id);
+    auto roots = poly->roots();
+    std::vector<std::complex<double>> z0;
+    for (int i = 0; i < 64; i++)
+      z0.emplace_back(-2.0 + 0.0625 * i, 1.3 - 0.04 * i);
+    for (auto z : z0) {
+      auto [f, fp] = poly->eval_and_deriv(z);
+      double sf = std::max(1.0, std::abs(f)), sd = std::max(1.0, std::abs(fp));
+      if (std::abs(f - poly->eval(z)) > 1e-12 * sf ||
+          std::abs(fp - poly->deriv(z)) > 1e-12 * sd) {
+        std::fprintf(stderr, "%s: eval_and_deriv mismatch\n", id);
+        ++fails;
+        break;
+      }
+    }
+    NewtonParams np;
+    np.max_iters = 100;
+    std::vector<int> rid(z0.size()), k(z0.size());
+    newton_iterate_row<Poly>(z0, *poly, roots, np, rid, k);
+    for (size_t i = 0; i < z0.size(); i++) {
+      auto [r1, k1] = newton_iterate(z0[i], *poly, roots, np);
+      if (r1 != rid[i] || k1 != k[i]) {
+        std::fprintf(stderr, "%s: row/point mismatch at %zu\n", id, i);
+        ++fails;
+        break;
+      }
+    }
+    // An exact root hit must still be labelled
+    auto [r2, k2] = newton_iterate(roots.back(), *poly, roots, np);
+    if (r2 != (int)roots.size() - 1) {
+      std::fprintf(stderr, "%s: exact root not labelled\n", id);
+      ++fails;
+    }
+  }
+  return fails;
+}
+
+// Generic coefficient polynomial: roots found at startup match the
+// hand-typed ones and Newton converges onto them
+int test_coeffs() {
+  int fails = 0;
+  auto pc = make_poly("coeffs:1,0,-2,2");
+  PolyZ3Minus2ZPlus2 ref;
+  auto rc = pc->roots();
+  for (auto r : ref.roots()) {
+    double best = 1e9;
+    for (auto z : rc)
+      best = std::min(best, std::abs(z - r));
+    if (best > 1e-12) {
+      std::fprintf(stderr, "coeffs root (%g,%g) missing\n", r.real(),
+                   r.imag());
+      ++fails;
+    }
+  }
+  // Coefficients must be finite numbers, inline or in a file
+  {
+    int accepted = 0;
+    for (const char *bad : {"coeffs:nan,1", "coeffs:1,inf", "coeffs:1,-inf",
+                            "coeffs:1e400,1", "coeffs:1,x"}) {
+      try {
+        make_poly(bad);
+        std::fprintf(stderr, "coeffs: %s accepted\n", bad);
+        ++accepted;
+      } catch (const std::runtime_error &) {
+      }
+    }
+    const char *path = "coeffs_test.txt";
+    for (const char *text : {"1\nnan\n", "1\n1 inf\n", "1e400\n1\n",
+                             "1\n1 x\n"}) {
+      std::FILE *f = std::fopen(path, "w");
+      std::fputs(text, f);
+      std::fclose(f);
+      try {
+        make_poly(std::string("coeffs-file:") + path);
+        std::fprintf(stderr, "coeffs-file: '%s' accepted\n", text);
+        ++accepted;
+      } catch (const std::runtime_error &) {
+      }
+    }
+    std::FILE *f = std::fopen(path, "w");
+    std::fputs("# z^2 - i\n1\n0 0\n0 -1\n", f);
+    std::fclose(f);
+    try {
+      if (make_poly(std::string("coeffs-file:") + path)->roots().size() != 2)
+        ++accepted;
+    } catch (const std::runtime_error &e) {
+      std::fprintf(stderr, "coeffs-file: %s\n", e.what());
+      ++accepted;
+    }
+    std::remove(path);
+    fails += accepted;
+  }
+  // Degree 60: z^60 - 1 has the 60th roots of unity
+  std::string spec = "coeffs:1";
+  for (int i = 0; i < 59; i++)
+    spec += ",0";
+  spec += ",-1";
+  auto pu = make_poly(spec);
+  auto ru = pu->roots();
+  for (auto z : ru) {
+    auto zn = std::pow(z, 60);
+    if (std::abs(z) - 1.0 > 1e-12 || std::abs(zn - 1.0) > 1e-11) {
+      std::fprintf(stderr, "z^60-1 root off: (%g,%g)\n", z.real(), z.imag());
+      ++fails;
+      break;
+    }
+  }
+  NewtonParams np;
+  np.max_iters = 80;
+  const auto &pcu = static_cast<const PolyCoeffs &>(*pu);
+  auto [rid, k] = newton_iterate(ru[7] * 1.01, pcu, ru, np);
+  if (rid != 7) {
+    std::fprintf(stderr, "z^60-1: Newton did not reach root 7 (%d)\n", rid);
+    ++fails;
+  }
+  // Degree 200 out to radius 6: |f'|^2 overflows double, so the kernels
+  // must scale the division as std::complex does
+  std::string s200 = "coeffs:1";
+  for (int i = 0; i < 199; i++)
+    s200 += ",0";
+  s200 += ",-1";
+  auto p200 = make_poly(s200);
+  const auto r200 = p200->roots();
+  const auto &pc200 = static_cast<const PolyCoeffs &>(*p200);
+  const PolyPlanes planes200(*p200);
+  NewtonParams np200;
+  np200.max_iters = 2000;
+  const int W = 32, H = 24;
+  std::vector<std::complex<double>> z0(W);
+  std::vector<double> zr(W), zi(W);
+  std::vector<int> rs(W), ks(W), rid200(W), k200(W);
+  for (const auto &kv : kernel_variants()) {
+    if (!kernel_supported(kv))
+      continue;
+    int label_diff = 0;
+    for (int y = 0; y < H; y++) {
+      for (int x = 0; x < W; x++) {
+        zr[(size_t)x] = -6.0 + (x + 0.5) * 12.0 / W;
+        zi[(size_t)x] = -6.0 + (y + 0.5) * 12.0 / H;
+        z0[(size_t)x] = {zr[(size_t)x], zi[(size_t)x]};
+      }
+      newton_row_scalar<PolyCoeffs>(z0, pc200, r200, np200, rs, ks);
+      kv.row(zr.data(), zi.data(), W, planes200.view(), np200, rid200.data(),
+             k200.data());
+      for (int x = 0; x < W; x++)
+        label_diff += rs[(size_t)x] != rid200[(size_t)x];
+    }
+    if (label_diff > W * H / 50) {
+      std::fprintf(stderr, "z^200-1: %s kernel label mismatch %d\n", kv.name,
+                   label_diff);
+      ++fails;
+    }
+  }
+  try {
+    make_poly("coeffs:1,x");
+    ++fails;
+  } catch (const std::runtime_error &) {
+  }
+  return fails;
+}
+
+// Higher-order methods: converge from near each root, and the best row
+// kernel agrees with the scalar loop
+int test_methods() {
+  int fails = 0;
+  const char *ids[] = {"z3-1", "z5-1", "z3-2z+2", "tight-clusters-archipelagos",
+                       "mixed-radii-pentagon-stack", "coeffs:1,0,-2,2"};
+  const KernelVariant *kv = select_kernel("auto");
+  const int W = 80, H = 60;
+  for (Method m : {Method::Halley, Method::Householder3, Method::Schroder}) {
+    for (const char *id : ids) {
+      auto poly = make_poly(id);
+      auto roots = poly->roots();
+      NewtonParams np;
+      np.max_iters = 200;
+      np.tol = 1e-12;
+      np.method = m;
+      for (size_t i = 0; i < roots.size(); i++) {
+        auto z0 = roots[i] + std::complex<double>(1e-3, -1e-3);
+        auto [rid, k] = newton_iterate(z0, *poly, roots, np);
+        if (rid != (int)i || k > 6) {
+          std::fprintf(stderr, "%s/%s: root %zu -> %d in %d iters\n",
+                       method_name(m), id, i, rid, k);
+          ++fails;
+        }
+      }
+      const PolyPlanes planes(*poly);
+      std::vector<double> zr(W), zi(W);
+      std::vector<int> rid(W), k(W);
+      int label_diff = 0;
+      for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+          zr[(size_t)x] = -2.5 + (x + 0.5) * 5.0 / W;
+          zi[(size_t)x] = -2.0 + (y + 0.5) * 4.0 / H;
+        }
+        kv->row(zr.data(), zi.data(), W, planes.view(), np, rid.data(),
+                k.data());
+        for (int x = 0; x < W; x++) {
+          auto [r0, k0] = newton_iterate(
+              std::complex<double>(zr[(size_t)x], zi[(size_t)x]), *poly,
+              roots, np);
+          label_diff += r0 != rid[(size_t)x];
+        }
+      }
+      // Schroder basins are heavily fragmented, so rounding moves more of
+      // the boundary than for Newton
+      if (label_diff > W * H / 40) {
+        std::fprintf(stderr, "%s/%s: %s kernel label mismatch %d\n",
+                     method_name(m), id, kv->name, label_diff);
+        ++fails;
+      }
+    }
+  }
+  return fails;
+}
+
+// z^3-2z+2 has the superattracting 2-cycle 0 -> 1 -> 0: starts near 0 stop
+// early as cycles in every path, and a cycle-free image reports none
+int test_cycles() {
+  int fails = 0;
+  PolyZ3Minus2ZPlus2 p;
+  auto roots = p.roots();
+  NewtonParams np;
+  np.max_iters = 300;
+  np.tol = 1e-12;
+  std::vector<std::complex<double>> z0 = {{1e-4, 0.0}, {0.0, 1e-4},
+                                          {0.999, 0.0}, {-2.0, 0.3}};
+  std::vector<int> rid(z0.size()), k(z0.size());
+  newton_iterate_row<Poly>(z0, p, roots, np, rid, k);
+  for (size_t i = 0; i < z0.size(); i++) {
+    auto [r1, k1] = newton_iterate(z0[i], p, roots, np);
+    const bool want_cycle = i < 3;
+    if ((r1 == kCycleRid) != want_cycle || (want_cycle && k1 > 40) ||
+        r1 != rid[i] || k1 != k[i]) {
+      std::fprintf(stderr, "z^3-2z+2 start %zu: rid %d/%d iters %d/%d\n", i,
+                   r1, rid[i], k1, k[i]);
+      ++fails;
+    }
+  }
+  const PolyPlanes planes(p);
+  std::vector<double> zr, zi;
+  for (auto z : z0) {
+    zr.push_back(z.real());
+    zi.push_back(z.imag());
+  }
+  for (const auto &kv : kernel_variants()) {
+    if (!kernel_supported(kv))
+      continue;
+    kv.row(zr.data(), zi.data(), (int)zr.size(), planes.view(), np,
+           rid.data(), k.data());
+    for (size_t i = 0; i < 3; i++) {
+      if (rid[i] != kCycleRid) {
+        std::fprintf(stderr, "%s: start %zu not a cycle (%d)\n", kv.name, i,
+                     rid[i]);
+        ++fails;
+      }
+    }
+  }
+  // z^3-1 has no attracting cycles: nothing may be flagged
+  PolyZ3Minus1 q;
+  auto rq = q.roots();
+  const int W = 128, H = 128;
+  int flagged = 0;
+  for (int y = 0; y < H; y++) {
+    for (int x = 0; x < W; x++) {
+      std::complex<double> z(-2.0 + (x + 0.5) * 4.0 / W,
+                             -2.0 + (y + 0.5) * 4.0 / H);
+      flagged += std::get<0>(newton_iterate(z, q, rq, np)) == kCycleRid;
+    }
+  }
+  if (flagged) {
+    std::fprintf(stderr, "z^3-1: %d pixels flagged as cycles\n", flagged);
+    ++fails;
+  }
+  return fails;
+}
+
+// Trap disks end points early but must not change a single basin label, in
+// the scalar, row and kernel paths alike
+int test_traps() {
+  int fails = 0;
+  const char *ids[] = {"z3-1", "z5-1", "z3-2z+2", "tight-clusters-archipelagos",
+                       "mixed-radii-pentagon-stack", "coeffs:1,0,-2,2"};
+  const int W = 160, H = 120;
+  for (double damping : {1.0, 0.7}) {
+    for (const char *id : ids) {
+      auto poly = make_poly(id);
+      auto roots = poly->roots();
+      NewtonParams np;
+      np.max_iters = 200;
+      np.tol = 1e-12;
+      np.damping = damping;
+      const RootTraps traps = make_root_traps(*poly, roots, np);
+      if (traps.steps < 0) {
+        std::fprintf(stderr, "%s: no traps for damping %g\n", id, damping);
+        ++fails;
+        continue;
+      }
+      const PolyPlanes planes(*poly);
+      std::vector<std::complex<double>> z0(W);
+      std::vector<double> zr(W), zi(W);
+      std::vector<int> r0(W), k0(W), r1(W), k1(W);
+      long long label_diff = 0, it0 = 0, it1 = 0;
+      for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+          zr[(size_t)x] = -2.5 + (x + 0.5) * 5.0 / W;
+          zi[(size_t)x] = -2.0 + (y + 0.5) * 4.0 / H;
+          z0[(size_t)x] = {zr[(size_t)x], zi[(size_t)x]};
+        }
+        for (int x = 0; x < W; x++) {
+          auto [ra, ka] = newton_iterate(z0[(size_t)x], *poly, roots, np);
+          auto [rb, kb] =
+              newton_iterate(z0[(size_t)x], *poly, roots, np, &traps);
+          label_diff += ra != rb;
+          it0 += ka;
+          it1 += kb;
+        }
+        newton_iterate_row<Poly>(z0, *poly, roots, np, r0, k0);
+        newton_iterate_row<Poly>(z0, *poly, roots, np, r1, k1, &traps);
+        for (int x = 0; x < W; x++)
+          label_diff += r0[(size_t)x] != r1[(size_t)x];
+        for (const auto &kv : kernel_variants()) {
+          if (!kernel_supported(kv))
+            continue;
+          kv.row(zr.data(), zi.data(), W, planes.view(), np, r0.data(),
+                 k0.data());
+          kv.row(zr.data(), zi.data(), W, planes.view(traps), np, r1.data(),
+                 k1.data());
+          for (int x = 0; x < W; x++)
+            label_diff += r0[(size_t)x] != r1[(size_t)x];
+        }
+      }
+      if (label_diff != 0 || it1 >= it0) {
+        std::fprintf(stderr,
+                     "%s damping %g: %lld labels changed, iters %lld -> %lld\n",
+                     id, damping, label_diff, it0, it1);
+        ++fails;
+      }
+    }
+  }
+  // Higher-order methods have no trap theory here
+  NewtonParams hp;
+  hp.method = Method::Halley;
+  PolyZ3Minus1 p;
+  if (make_root_traps(p, p.roots(), hp).steps >= 0) {
+    std::fprintf(stderr, "traps enabled for halley\n");
+    ++fails;
+  }
+  return fails;
+}
+
+// Mixed precision: the float pass labels nearly every point, and the result
+// stays within a few boundary pixels of the double kernel
+int test_mixed() {
+  int fails = 0;
+  const char *ids[] = {"z3-1", "z5-1", "z3-2z+2", "tight-clusters-archipelagos",
+                       "mixed-radii-pentagon-stack"};
+  const int W = 160, H = 120;
+  for (const auto &kv : kernel_variants()) {
+    if (!kernel_supported(kv))
+      continue;
+    for (const char *id : ids) {
+      auto poly = make_poly(id);
+      const PolyPlanes planes(*poly);
+      NewtonParams np;
+      np.max_iters = 200;
+      np.tol = 1e-12;
+      std::vector<double> zr(W), zi(W);
+      std::vector<int> r0(W), k0(W), r1(W), k1(W);
+      int label_diff = 0, redone = 0;
+      for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+          zr[(size_t)x] = -2.5 + (x + 0.5) * 5.0 / W;
+          zi[(size_t)x] = -2.0 + (y + 0.5) * 4.0 / H;
+        }
+        kv.row(zr.data(), zi.data(), W, planes.view(), np, r0.data(),
+               k0.data());
+        redone += kv.row_mixed(zr.data(), zi.data(), W, planes.view(), np,
+                               r1.data(), k1.data());
+        for (int x = 0; x < W; x++)
+          label_diff += r0[(size_t)x] != r1[(size_t)x];
+      }
+      if (label_diff > W * H / 200 || redone > W * H / 10) {
+        std::fprintf(stderr, "%s: %s mixed labels differ %d, redone %d\n",
+                     kv.name, id, label_diff, redone);
+        ++fails;
+      }
+    }
+  }
+  // Methods without a float pass go straight to double
+  PolyZ3Minus1 p;
+  const PolyPlanes planes(p);
+  NewtonParams hp;
+  hp.method = Method::Halley;
+  double zr[3] = {0.3, -1.0, 2.0}, zi[3] = {0.1, 0.5, -1.0};
+  int rid[3], k[3];
+  if (select_kernel("auto")->row_mixed(zr, zi, 3, planes.view(), hp, rid,
+                                       k) != 3) {
+    std::fprintf(stderr, "halley: float pass used\n");
+    ++fails;
+  }
+  return fails;
+}
+
+// Double-double deep zoom: parsing, agreement with the double kernels at
+// normal zoom, and a basin boundary resolved far below a double ulp
+int test_deep() {
+  int fails = 0;
+  const dd tenth = parse_dd("0.1");
+  if (tenth.hi != 0.1 || std::abs(tenth.lo + 5.551115123125783e-18) > 1e-32) {
+    std::fprintf(stderr, "parse_dd(0.1) = %.17g + %.17g\n", tenth.hi,
+                 tenth.lo);
+    ++fails;
+  }
+  PolyZ3Minus1 p;
+  const PolyPlanes planes(p);
+  NewtonParams np;
+  np.max_iters = 200;
+  np.tol = 1e-12;
+  const int W = 160, H = 120;
+  std::vector<double> zr(W), zi(W), lo(W, 0.0);
+  std::vector<int> r0(W), k0(W), r1(W), k1(W);
+  for (const auto &kv : kernel_variants()) {
+    if (!kernel_supported(kv))
+      continue;
+    int label_diff = 0;
+    for (int y = 0; y < H; y++) {
+      for (int x = 0; x < W; x++) {
+        zr[(size_t)x] = -2.5 + (x + 0.5) * 5.0 / W;
+        zi[(size_t)x] = -2.0 + (y + 0.5) * 4.0 / H;
+      }
+      kv.row(zr.data(), zi.data(), W, planes.view(), np, r0.data(),
+             k0.data());
+      kv.row_dd(zr.data(), lo.data(), zi.data(), lo.data(), W, planes.view(),
+                np, r1.data(), k1.data());
+      for (int x = 0; x < W; x++)
+        label_diff += r0[(size_t)x] != r1[(size_t)x];
+    }
+    if (label_diff > W * H / 200) {
+      std::fprintf(stderr, "%s: row_dd differs from row on %d labels\n",
+                   kv.name, label_diff);
+      ++fails;
+    }
+  }
+  // Bisect a basin boundary on Im z = 0.3 to ~1e-23, then render 64 pixels
+  // across 1e-19 around it: doubles cannot tell those pixels apart
+  const KernelVariant *kv = select_kernel("auto");
+  auto label = [&](dd x) {
+    double xr = x.hi, xl = x.lo, yi = 0.3, yl = 0.0;
+    int r, k;
+    kv->row_dd(&xr, &xl, &yi, &yl, 1, planes.view(), np, &r, &k);
+    return r;
+  };
+  dd a(-1.5), b(1.5);
+  const int la = label(a), lb = label(b);
+  for (int i = 0; i < 75; i++) {
+    const dd m = a + (b - a) * dd(0.5);
+    (label(m) == la ? a : b) = m;
+  }
+  Viewport v;
+  v.W = 64;
+  v.H = 1;
+  v.set_center(a, dd(0.3), 1e-19);
+  const dd x0(v.xmin, v.xmin_lo);
+  for (int x = 0; x < v.W; x++) {
+    const dd z = x0 + dd((x + 0.5) * v.dx());
+    zr[(size_t)x] = z.hi;
+    lo[(size_t)x] = z.lo;
+    zi[(size_t)x] = 0.3;
+  }
+  std::vector<double> zil(W, 0.0);
+  kv->row_dd(zr.data(), lo.data(), zi.data(), zil.data(), v.W, planes.view(),
+             np, r1.data(), k1.data());
+  if (!v.needs_dd() || la == lb || r1[0] != la || r1[(size_t)v.W - 1] != lb) {
+    std::fprintf(stderr, "deep boundary: labels %d|%d, row ends %d..%d\n", la,
+                 lb, r1[0], r1[(size_t)v.W - 1]);
+    ++fails;
+  }
+  return fails;
+}
+
+// Tiles cover the image once, in Z order, and the work-stealing pool runs
+// each exactly once however many threads share it
+int test_tiles() {
+  int fails = 0;
+  const int W = 333, H = 201;
+  const std::vector<Tile> tiles = make_tiles(W, H, 32);
+  std::vector<int> cover((size_t)W * H, 0);
+  for (const Tile &t : tiles)
+    for (int y = t.y0; y < t.y0 + t.h; y++)
+      for (int x = t.x0; x < t.x0 + t.w; x++)
+        ++cover[(size_t)y * W + (size_t)x];
+  if (std::any_of(cover.begin(), cover.end(), [](int c) { return c != 1; })) {
+    std::fprintf(stderr, "tiles do not cover the image exactly once\n");
+    ++fails;
+  }
+  if (tiles.size() < 4 || tiles[1].x0 != 32 || tiles[1].y0 != 0 ||
+      tiles[2].x0 != 0 || tiles[2].y0 != 32 || morton2(3, 5) != 0x27) {
+    std::fprintf(stderr, "tiles not in Morton order\n");
+    ++fails;
+  }
+  for (int threads : {1, 3, 8}) {
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+#endif
+    std::vector<std::atomic<int>> runs(tiles.size());
+    const PoolStats st = run_tiles(tiles, [&](const Tile &t, int) {
+      // Uneven cost, as near basin boundaries
+      volatile double s = 0.0;
+      for (int i = 0; i < (t.x0 % 96 == 0 ? 20000 : 100); i++)
+        s = s + 1.0;
+      ++runs[(size_t)(&t - tiles.data())];
+    });
+    int ran = 0;
+    for (int n : st.tiles)
+      ran += n;
+    const bool once = std::all_of(runs.begin(), runs.end(),
+                                  [](const auto &r) { return r == 1; });
+    if (!once || ran != (int)tiles.size() || st.busy.empty() ||
+        st.busy.size() != st.idle.size()) {
+      std::fprintf(stderr, "%d threads: tiles not run exactly once\n",
+                   threads);
+      ++fails;
+    }
+  }
+  return fails;
+}
+
+// Mariani-Silver: far fewer pixels iterated, same basins as brute force
+int test_adaptive() {
+  int fails = 0;
+  PolyZ5Minus1 p;
+  const auto roots = p.roots();
+  NewtonParams np;
+  Viewport v;
+  v.W = 320;
+  v.H = 240;
+  for (const KernelVariant *kv : {(const KernelVariant *)nullptr,
+                                  select_kernel("auto")}) {
+    BasinResult r0, r1;
+    RenderOptions ro;
+    ro.symmetry = false;
+    const RenderStats s0 = render_basins(p, roots, np, v, kv, r0, ro);
+    ro.adaptive = true;
+    const RenderStats s1 = render_basins(p, roots, np, v, kv, r1, ro);
+    long long diff = 0;
+    for (size_t i = 0; i < r0.label.size(); i++)
+      diff += r0.label[i] != r1.label[i];
+    const long long total = (long long)v.W * v.H;
+    if (s0.iterated_pixels != total || s1.iterated_pixels * 10 > total * 7 ||
+        diff * 1000 > total) {
+      std::fprintf(stderr,
+                   "%s: iterated %lld / %lld of %lld, %lld basins differ\n",
+                   kv ? kv->name : "scalar", s0.iterated_pixels,
+                   s1.iterated_pixels, total, diff);
+      ++fails;
+    }
+  }
+  return fails;
+}
+
+// Symmetry: advertised groups, and a fundamental-domain render that matches
+// the full one where the grid allows it and falls back where it does not
+int test_symmetry() {
+  int fails = 0;
+  const auto sym = [](const std::string &id) {
+    return make_poly(id)->symmetry();
+  };
+  const PolySymmetry s4 = sym("coeffs:1,0,0,0,-1"), s1 = sym("z3-2z+2");
+  const PolySymmetry sc =
+      PolyCoeffs({1.0, 0.0, 0.0, std::complex<double>(0.0, 1.0)}, "z3+i")
+          .symmetry();
+  if (s4.rotation != 4 || !s4.conjugate || s1.rotation != 1 ||
+      !s1.conjugate || sym("z5-1").rotation != 5 ||
+      sym("coeffs:1,0,-2,2").rotation != 1 || sc.rotation != 3 ||
+      sc.conjugate) {
+    std::fprintf(stderr, "wrong advertised symmetry\n");
+    ++fails;
+  }
+  PolyTightClusters p;
+  const auto roots = p.roots();
+  NewtonParams np;
+  Viewport v;
+  v.W = 320;
+  v.H = 240;
+  const long long total = (long long)v.W * v.H;
+  // D2 (conjugate and z -> -z) on symmetric bounds; only the mirror in the
+  // imaginary axis when just x is symmetric; nothing when neither is
+  const struct {
+    double xmin, ymin;
+    long long want;
+  } cases[] = {{-2.0, -1.5, total / 4}, {-2.0, -1.3, total / 2},
+               {-1.9, -1.3, total}};
+  for (const auto &c : cases) {
+    v.xmin = c.xmin;
+    v.ymin = c.ymin;
+    for (const KernelVariant *kv : {(const KernelVariant *)nullptr,
+                                    select_kernel("auto")}) {
+      BasinResult r0, r1;
+      RenderOptions ro;
+      ro.symmetry = false;
+      render_basins(p, roots, np, v, kv, r0, ro);
+      ro.symmetry = true;
+      const RenderStats st = render_basins(p, roots, np, v, kv, r1, ro);
+      long long diff = 0;
+      for (size_t i = 0; i < r0.label.size(); i++)
+        diff += r0.label[i] != r1.label[i];
+      if (st.iterated_pixels != c.want || diff * 1000 > total) {
+        std::fprintf(stderr,
+                     "bounds from %g%+gi: iterated %lld (want %lld), %lld "
+                     "basins differ\n",
+                     c.xmin, c.ymin, st.iterated_pixels, c.want, diff);
+        ++fails;
+      }
+    }
+  }
+  return fails;
+}
+
+// Edge-only supersampling: only boundary pixels change, they blend two or
+// more basin colors, and the result does not depend on the thread count
+int test_aa() {
+  int fails = 0;
+  PolyZ3Minus1 p;
+  const auto roots = p.roots();
+  const auto colors = make_basin_palette((int)roots.size(),
+                                         BasinPalette::Pastel, &roots);
+  NewtonParams np;
+  Viewport v;
+  v.W = 200;
+  v.H = 150;
+  const long long total = (long long)v.W * v.H;
+  BasinResult r1, r4, q4;
+  RenderOptions ro;
+  render_basins(p, roots, np, v, nullptr, r1, ro);
+  ro.aa = 4;
+  const RenderStats st = render_basins(p, roots, np, v, nullptr, r4, ro);
+#ifdef _OPENMP
+  omp_set_num_threads(3);
+#endif
+  render_basins(p, roots, np, v, nullptr, q4, ro);
+  ImageRGBA b1, b4, c4;
+  colorize_basins(r1, colors, b1);
+  colorize_basins(r4, colors, b4);
+  colorize_basins(q4, colors, c4);
+  long long changed = 0, blended = 0;
+  for (size_t i = 0; i < b1.pixels.size(); i++) {
+    const RGBA &a = b1.pixels[i], &b = b4.pixels[i];
+    if (a.r == b.r && a.g == b.g && a.b == b.b)
+      continue;
+    ++changed;
+    blended += std::none_of(colors.begin(), colors.end(), [&](RGBA c) {
+      return c.r == b.r && c.g == b.g && c.b == b.b;
+    });
+  }
+  const bool same = std::equal(
+      b4.pixels.begin(), b4.pixels.end(), c4.pixels.begin(),
+      [](RGBA a, RGBA b) { return a.r == b.r && a.g == b.g && a.b == b.b; });
+  if (st.aa_pixels == 0 || st.aa_pixels * 5 > total ||
+      st.aa_samples != st.aa_pixels * 16 || changed > st.aa_pixels ||
+      blended * 2 < changed || !same) {
+    std::fprintf(stderr,
+                 "aa: refined %lld, samples %lld, changed %lld, blended "
+                 "%lld, thread-independent %d\n",
+                 st.aa_pixels, st.aa_samples, changed, blended, (int)same);
+    ++fails;
+  }
+  return fails;
+}
+
+// Structure-of-arrays result: labels and iteration counts past 255 are
+// exact, and the iteration image is normalised by the true maximum
+int test_soa() {
+  int fails = 0;
+  PolyZ3Minus1 p;
+  const auto roots = p.roots();
+  NewtonParams np;
+  np.max_iters = 2000;
+  np.damping = 0.1; // slow linear convergence: hundreds of steps
+  np.root_traps = false;
+  Viewport v;
+  v.W = 64;
+  v.H = 48;
+  BasinResult r;
+  const RenderStats st = render_basins(p, roots, np, v, nullptr, r);
+  long long wrong = 0;
+  int kmax = 0;
+  size_t at_max = 0;
+  for (int y = 0; y < v.H; y++)
+    for (int x = 0; x < v.W; x++) {
+      const size_t i = (size_t)y * (size_t)v.W + (size_t)x;
+      const std::complex<double> z0(v.xmin + (x + 0.5) * v.dx(),
+                                    v.ymin + (y + 0.5) * v.dy());
+      const auto [rid, k] = newton_iterate(z0, p, roots, np);
+      wrong += r.label[i] != label_of(rid) || r.iters[i] != k;
+      if (k > kmax) {
+        kmax = k;
+        at_max = i;
+      }
+    }
+  ImageRGBA img;
+  colorize_iterations(r, st.max_k, img);
+  const RGBA top = turbo_colormap(1.0), got = img.pixels[at_max];
+  if (wrong != 0 || kmax <= 255 || st.max_k != kmax || got.r != top.r ||
+      got.g != top.g || got.b != top.b) {
+    std::fprintf(stderr, "soa: %lld pixels wrong, max iters %d (stats %d)\n",
+                 wrong, kmax, st.max_k);
+    ++fails;
+  }
+  if (rid_of(label_of(kCycleRid)) != kCycleRid || rid_of(label_of(-1)) != -1 ||
+      rid_of(label_of(7)) != 7) {
+    std::fprintf(stderr, "soa: labels do not round-trip\n");
+    ++fails;
+  }
+  bool threw = false;
+  try {
+    np.max_iters = kMaxResultIters + 1;
+    render_basins(p, roots, np, v, nullptr, r);
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  if (!threw) {
+    std::fprintf(stderr, "soa: max_iters past 16 bits accepted\n");
+    ++fails;
+  }
+  // z^300 - 1: more roots than 8-bit labels name, so 16-bit ones
+  std::string spec = "coeffs:1";
+  for (int i = 0; i < 299; i++)
+    spec += ",0";
+  spec += ",-1";
+  auto pw = make_poly(spec);
+  const auto rw = pw->roots();
+  const auto colors =
+      make_basin_palette((int)rw.size(), BasinPalette::Pastel, &rw);
+  NewtonParams npw;
+  npw.max_iters = 200;
+  npw.root_traps = false;
+  Viewport vw;
+  vw.W = vw.H = 40;
+  vw.xmin = vw.ymin = -1.5;
+  vw.xmax = vw.ymax = 1.5;
+  RenderOptions ow;
+  ow.symmetry = false;
+  ow.aa = 2;
+  render_basins(*pw, rw, npw, vw, nullptr, r, ow);
+  colorize_basins(r, colors, img);
+  std::vector<char> refined(r.iters.size(), 0);
+  for (uint32_t px : r.aa_pixel)
+    refined[px] = 1;
+  wrong = 0;
+  int top_rid = -1;
+  for (int y = 0; y < vw.H; y++)
+    for (int x = 0; x < vw.W; x++) {
+      const size_t i = (size_t)y * (size_t)vw.W + (size_t)x;
+      const std::complex<double> z0(vw.xmin + (x + 0.5) * vw.dx(),
+                                    vw.ymin + (y + 0.5) * vw.dy());
+      const auto [rid, k] = newton_iterate(z0, *pw, rw, npw);
+      const RGBA c = rid >= 0 ? colors[(size_t)rid] : RGBA{0, 0, 0, 255};
+      const RGBA q = img.pixels[i];
+      wrong += r.label16[i] != label16_of(rid) || r.iters[i] != k ||
+               (!refined[i] && (q.r != c.r || q.g != c.g || q.b != c.b));
+      top_rid = std::max(top_rid, rid);
+    }
+  if (!r.wide || !r.label.empty() || r.aa_label16.empty() || wrong != 0 ||
+      top_rid < kMaxLabelRoots ||
+      rid_of(label16_of(kCycleRid)) != kCycleRid ||
+      rid_of(label16_of(299)) != 299) {
+    std::fprintf(stderr, "soa: z^300-1 wide labels, %lld pixels wrong\n",
+                 wrong);
+    ++fails;
+  }
+  return fails;
+}
+
+// LUT colorization: tables match the colormaps they sample, and colorize
+// passes give every pixel its label's color and its count's LUT entry
+int test_colorize() {
+  int fails = 0;
+  auto eq = [](RGBA a, RGBA b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+  };
+  const auto &lut = colormap_lut(IterColormap::Turbo);
+  if (lut.size() != (size_t)kColormapLutSize ||
+      colormap_lut(IterColormap::Hsv).size() != (size_t)kColormapLutSize ||
+      !eq(lut.front(), turbo_colormap(0.0)) ||
+      !eq(lut.back(), turbo_colormap(1.0)) ||
+      !eq(lut[2048], turbo_colormap(2048.0 / 4095.0))) {
+    std::fprintf(stderr, "colormap LUT does not sample turbo\n");
+    ++fails;
+  }
+  PolyZ3Minus1 p;
+  const auto roots = p.roots();
+  const auto colors = make_basin_palette((int)roots.size(),
+                                         BasinPalette::Pastel, &roots);
+  NewtonParams np;
+  Viewport v;
+  v.W = 130; // not a multiple of the tile size
+  v.H = 70;
+  BasinResult r;
+  const RenderStats st = render_basins(p, roots, np, v, nullptr, r);
+  ImageRGBA bas, its;
+  colorize_basins(r, colors, bas);
+  colorize_iterations(r, st.max_k, its);
+  long long bad = 0;
+  for (size_t i = 0; i < r.label.size(); i++) {
+    const int rid = rid_of(r.label[i]);
+    const RGBA want = rid >= 0 ? colors[(size_t)rid] : RGBA{0, 0, 0, 255};
+    const double t = r.iters[i] / double(st.max_k);
+    bad += !eq(bas.pixels[i], want) ||
+           !eq(its.pixels[i], lut[(size_t)std::lround(t * 4095.0)]);
+  }
+  if (bad != 0 || result_max_iters(r) != st.max_k) {
+    std::fprintf(stderr, "colorize: %lld pixels wrong, max %d vs %d\n", bad,
+                 result_max_iters(r), st.max_k);
+    ++fails;
+  }
+  return fails;
+}
+
+// Minimal inflate (RFC 1951) for checking the encoder: returns false on a
+// malformed stream.
+static bool inflate_raw(const std::vector<uint8_t> &in,
+                        std::vector<uint8_t> &out) {
+  size_t pos = 0;
+  uint32_t acc = 0;
+  int have = 0;
+  bool bad = false;
+  auto bits = [&](int n) -> uint32_t {
+    while (have < n) {
+      if (pos >= in.size()) {
+        bad = true;
+        return 0;
+      }
+      acc |= (uint32_t)in[pos++] << have;
+      have += 8;
+    }
+    const uint32_t v = acc & ((1u << n) - 1);
+    acc >>= n;
+    have -= n;
+    return v;
+  };
+  struct Huff {
+    std::vector<int> count, sym;
+  };
+  auto build = [](const uint8_t *len, int n) {
+    Huff h{std::vector<int>(16, 0), {}};
+    for (int i = 0; i < n; i++)
+      h.count[len[i]]++;
+    h.count[0] = 0;
+    for (int l = 1; l < 16; l++)
+      for (int i = 0; i < n; i++)
+        if (len[i] == l)
+          h.sym.push_back(i);
+    return h;
+  };
+  auto decode = [&](const Huff &h) {
+    int code = 0, first = 0, index = 0;
+    for (int l = 1; l < 16; l++) {
+      code |= (int)bits(1);
+      const int c = h.count[(size_t)l];
+      if (code - c < first)
+        return h.sym[(size_t)(index + code - first)];
+      index += c;
+      first = (first + c) << 1;
+      code <<= 1;
+    }
+    bad = true;
+    return 0;
+  };
+  static const int lbase[29] = {3,  4,  5,  6,  7,  8,  9,   10,  11,  13,
+                                15, 17, 19, 23, 27, 31, 35,  43,  51,  59,
+                                67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static const int lext[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                               2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+  static const int dbase[30] = {1,    2,    3,    4,     5,     7,    9,
+                                13,   17,   25,   33,    49,    65,   97,
+                                129,  193,  257,  385,   513,   769,  1025,
+                                1537, 2049, 3073, 4097,  6145,  8193, 12289,
+                                16385, 24577};
+  static const uint8_t order[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                    11, 4,  12, 3, 13, 2, 14, 1, 15};
+  for (bool last = false; !last && !bad;) {
+    last = bits(1);
+    const uint32_t type = bits(2);
+    if (type == 0) {
+      acc = 0;
+      have = 0;
+      if (pos + 4 > in.size())
+        return false;
+      const size_t n = in[pos] | in[pos + 1] << 8;
+      pos += 4;
+      if (pos + n > in.size())
+        return false;
+      out.insert(out.end(), in.begin() + (ptrdiff_t)pos,
+                 in.begin() + (ptrdiff_t)(pos + n));
+      pos += n;
+      continue;
+    }
+    uint8_t len[320] = {0};
+    int nl = 288, nd = 30;
+    if (type == 1) {
+      for (int i = 0; i < 288; i++)
+        len[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+      for (int i = 0; i < 30; i++)
+        len[288 + i] = 5;
+    } else if (type == 2) {
+      nl = (int)bits(5) + 257;
+      nd = (int)bits(5) + 1;
+      const int nc = (int)bits(4) + 4;
+      uint8_t cl[19] = {0};
+      for (int i = 0; i < nc; i++)
+        cl[order[i]] = (uint8_t)bits(3);
+      const Huff ch = build(cl, 19);
+      uint8_t all[320] = {0};
+      for (int i = 0; i < nl + nd && !bad;) {
+        const int sym = decode(ch);
+        int rep = 1, val = sym;
+        if (sym == 16) {
+          if (i == 0)
+            return false;
+          val = all[i - 1];
+          rep = 3 + (int)bits(2);
+        } else if (sym == 17) {
+          val = 0;
+          rep = 3 + (int)bits(3);
+        } else if (sym == 18) {
+          val = 0;
+          rep = 11 + (int)bits(7);
+        }
+        if (i + rep > nl + nd)
+          return false;
+        while (rep--)
+          all[i++] = (uint8_t)val;
+      }
+      std::copy(all, all + nl, len);
+      std::copy(all + nl, all + nl + nd, len + 288);
+    } else {
+      return false;
+    }
+    const Huff lh = build(len, nl), dh = build(len + 288, nd);
+    for (;;) {
+      const int sym = decode(lh);
+      if (bad)
+        return false;
+      if (sym < 256) {
+        out.push_back((uint8_t)sym);
+        continue;
+      }
+      if (sym == 256)
+        break;
+      const int l = lbase[sym - 257] + (int)bits(lext[sym - 257]);
+      const int dsym = decode(dh);
+      const int d = dbase[dsym] + (int)bits(dsym < 4 ? 0 : (dsym - 2) / 2);
+      if ((size_t)d > out.size())
+        return false;
+      for (int k = 0; k < l; k++)
+        out.push_back(out[out.size() - (size_t)d]);
+    }
+  }
+  return !bad;
+}
+
+// Reads a PNG written by PngWriter: checks the chunk CRCs and the Adler-32,
+// inflates and undoes the row filters. pixels gets the packed rows, as RGB
+// when expand is set and the image has a palette.
+static bool read_png(const std::string &path, int &color,
+                     std::vector<uint8_t> &pixels, bool expand = false) {
+  std::FILE *f = std::fopen(path.c_str(), "rb");
+  std::vector<uint8_t> file;
+  for (int c; f && (c = std::fgetc(f)) != EOF;)
+    file.push_back((uint8_t)c);
+  if (f)
+    std::fclose(f);
+  std::vector<uint8_t> zs, plte;
+  int W = 0;
+  bool ok = file.size() > 8;
+  for (size_t i = 8; ok && i + 12 <= file.size();) {
+    const uint32_t n = (uint32_t)file[i] << 24 | file[i + 1] << 16 |
+                       file[i + 2] << 8 | file[i + 3];
+    const uint8_t *t = file.data() + i + 4;
+    const uint8_t *e = t + 4 + n;
+    const uint32_t crc = (uint32_t)e[0] << 24 | e[1] << 16 | e[2] << 8 |
+                         e[3];
+    ok = crc == crc32_update(0, t, 4 + n);
+    if (std::memcmp(t, "IHDR", 4) == 0) {
+      W = t[4] << 24 | t[5] << 16 | t[6] << 8 | t[7];
+      color = t[13];
+    }
+    if (std::memcmp(t, "PLTE", 4) == 0)
+      plte.assign(t + 4, t + 4 + n);
+    if (std::memcmp(t, "IDAT", 4) == 0)
+      zs.insert(zs.end(), t + 4, t + 4 + n);
+    i += 12 + n;
+  }
+  std::vector<uint8_t> raw;
+  ok = ok && zs.size() > 6 &&
+       inflate_raw(std::vector<uint8_t>(zs.begin() + 2, zs.end() - 4), raw);
+  if (!ok)
+    return false;
+  const uint32_t want = (uint32_t)zs[zs.size() - 4] << 24 |
+                        zs[zs.size() - 3] << 16 | zs[zs.size() - 2] << 8 |
+                        zs[zs.size() - 1];
+  const size_t bpp = color == 6 ? 4 : color == 2 ? 3 : 1;
+  const size_t stride = bpp * (size_t)W;
+  if (adler32_update(1, raw.data(), raw.size()) != want ||
+      raw.size() % (stride + 1) != 0)
+    return false;
+  pixels.assign(raw.size() / (stride + 1) * stride, 0);
+  for (size_t y = 0; y * (stride + 1) < raw.size(); y++) {
+    const uint8_t *in = raw.data() + y * (stride + 1);
+    uint8_t *d = pixels.data() + y * stride;
+    const uint8_t *up = y > 0 ? d - stride : nullptr;
+    for (size_t x = 0; x < stride; x++) {
+      const int a = x >= bpp ? d[x - bpp] : 0, b = up ? up[x] : 0,
+                c = up && x >= bpp ? up[x - bpp] : 0;
+      const int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b),
+                pc = std::abs(p - c);
+      const int pred = in[0] == 1   ? a
+                       : in[0] == 2 ? b
+                       : in[0] == 3 ? (a + b) / 2
+                       : in[0] == 4 ? (pa <= pb && pa <= pc ? a
+                                       : pb <= pc           ? b
+                                                            : c)
+                                    : 0;
+      d[x] = (uint8_t)(in[1 + x] + pred);
+    }
+  }
+  if (expand && color == 3) {
+    std::vector<uint8_t> rgb(3 * pixels.size());
+    for (size_t i = 0; i < pixels.size(); i++)
+      for (size_t c = 0; c < 3; c++)
+        rgb[3 * i + c] = 3 * (size_t)pixels[i] + c < plte.size()
+                             ? plte[3 * (size_t)pixels[i] + c]
+                             : 0;
+    pixels = std::move(rgb);
+  }
+  return true;
+}
+
+// PNG encoder pieces: checksums, deflate strips that concatenate into one
+// stream, and a whole file whose chunks check out
+int test_png() {
+  int fails = 0;
+  const std::string check = "123456789", wiki = "Wikipedia";
+  auto bytes = [](const std::string &s) {
+    return reinterpret_cast<const uint8_t *>(s.data());
+  };
+  const uint32_t a1 = adler32_update(1, bytes(check), 4),
+                 a2 = adler32_update(1, bytes(check) + 4, 5);
+  if (crc32_update(0, bytes(check), 9) != 0xCBF43926u ||
+      adler32_update(1, bytes(wiki), 9) != 0x11E60398u ||
+      adler32_combine(a1, a2, 5) != adler32_update(1, bytes(check), 9)) {
+    std::fprintf(stderr, "png: checksum mismatch\n");
+    ++fails;
+  }
+  // Runs, repeats at every distance class, and noise
+  std::vector<uint8_t> data;
+  uint32_t seed = 12345;
+  for (int i = 0; i < 300000; i++) {
+    seed = seed * 1103515245u + 12345u;
+    const int kind = (i / 5000) % 3;
+    data.push_back(kind == 0   ? 0
+                   : kind == 1 ? (uint8_t)(i % 251)
+                               : (uint8_t)(seed >> 24));
+  }
+  for (int level : {0, 1, 6, 9}) {
+    std::vector<uint8_t> z, back;
+    const size_t half = data.size() / 3;
+    deflate_strip(data.data(), half, level, z);
+    deflate_strip(data.data() + half, data.size() - half, level, z);
+    deflate_finish(z);
+    if (!inflate_raw(z, back) || back != data) {
+      std::fprintf(stderr, "png: level %d does not round-trip\n", level);
+      ++fails;
+    }
+  }
+  // Few colors: palette; many: RGB. Chunk CRCs and the zlib stream hold
+  ImageRGBA img(300, 200);
+  for (int y = 0; y < img.height; y++)
+    for (int x = 0; x < img.width; x++)
+      img.at(x, y) = RGBA{(uint8_t)(x / 100 * 80), 40, 200, 255};
+  for (int many = 0; many < 2; many++) {
+    if (many) // 300 more colors
+      for (int i = 0; i < 300; i++)
+        img.at(i, 50) = RGBA{(uint8_t)i, (uint8_t)(i / 2), 9, 255};
+    PngOptions opt;
+    opt.strip_rows = 7; // many strips
+    const std::string path = "png_test.png";
+    if (!write_png(path, img, opt)) {
+      std::fprintf(stderr, "png: write failed\n");
+      ++fails;
+      continue;
+    }
+    int color = -1;
+    std::vector<uint8_t> pix;
+    bool ok = read_png(path, color, pix) &&
+              pix.size() == img.pixels.size() * (many ? 3 : 1);
+    std::remove(path.c_str());
+    for (size_t i = 0; ok && many && i < img.pixels.size(); i++)
+      ok = pix[3 * i] == img.pixels[i].r && pix[3 * i + 1] == img.pixels[i].g &&
+           pix[3 * i + 2] == img.pixels[i].b;
+    if (!ok || color != (many ? 2 : 3)) {
+      std::fprintf(stderr, "png: bad file (%s, color type %d)\n",
+                   many ? "many colors" : "palette", color);
+      ++fails;
+    }
+  }
+  return fails;
+}
+
+// Strip streaming: the files decode to the full render's images and the
+// merged stats match, with and without --aa (whose strips overlap)
+int test_stream() {
+  int fails = 0;
+  PolyZ3Minus1 p;
+  const auto roots = p.roots();
+  const auto colors = make_basin_palette((int)roots.size(),
+                                         BasinPalette::Pastel, &roots);
+  NewtonParams np;
+  np.max_iters = 60;
+  Viewport v;
+  v.W = 150;
+  v.H = 101; // last strip is short
+  const std::vector<RGBA> by_k = iteration_colors(np.max_iters,
+                                                  IterColormap::Turbo);
+  for (int aa : {0, 2}) {
+    RenderOptions opt;
+    opt.aa = aa;
+    BasinResult r;
+    const RenderStats st = render_basins(p, roots, np, v, nullptr, r, opt);
+    ImageRGBA bas;
+    colorize_basins(r, colors, bas);
+    StreamOptions so;
+    so.strip_rows = 20;
+    const std::string pb = "stream_basins.png", pi_ = "stream_iters.png";
+    const StreamStats ss = render_streamed(p, roots, np, v, nullptr, colors,
+                                           opt, so, pb, pi_);
+    int cb = -1, ci = -1;
+    std::vector<uint8_t> db, di;
+    const bool read = read_png(pb, cb, db) && read_png(pi_, ci, di);
+    std::remove(pb.c_str());
+    std::remove(pi_.c_str());
+    const size_t n = r.label.size();
+    long long bad = 0;
+    if (!ss.ok || !read || ci != 2 || di.size() != 3 * n ||
+        db.size() != (aa ? 3 : 1) * n) {
+      std::fprintf(stderr, "stream (aa %d): files not written\n", aa);
+      ++fails;
+      continue;
+    }
+    for (size_t i = 0; i < n; i++) {
+      const RGBA c = by_k[r.iters[i]];
+      bad += di[3 * i] != c.r || di[3 * i + 1] != c.g || di[3 * i + 2] != c.b;
+      if (aa) {
+        const RGBA b = bas.pixels[i];
+        bad += db[3 * i] != b.r || db[3 * i + 1] != b.g || db[3 * i + 2] != b.b;
+      } else {
+        const int rid = rid_of(r.label[i]);
+        const size_t want = rid >= 0 ? (size_t)rid
+                            : rid == kCycleRid ? colors.size()
+                                               : colors.size() + 1;
+        bad += db[i] != want;
+      }
+    }
+    const RenderStats &ms = ss.render;
+    if (bad != 0 || ss.strips != 6 || ms.hist != st.hist ||
+        ms.max_k != st.max_k || ms.cycle_pixels != st.cycle_pixels ||
+        ms.no_root_pixels != st.no_root_pixels) {
+      std::fprintf(stderr, "stream (aa %d): %lld pixels differ, %d strips\n",
+                   aa, bad, ss.strips);
+      ++fails;
+    }
+  }
+  return fails;
+}
+
+// Raw files: header fields and planes come back as written, aligned, and
+// colorize the same from the mapping; damaged files are refused
+int test_raw() {
+  int fails = 0;
+  PolyZ5Minus1 p;
+  const auto roots = p.roots();
+  const auto colors = make_basin_palette((int)roots.size(),
+                                         BasinPalette::Pastel, &roots);
+  RawInfo info;
+  info.poly = p.id();
+  info.roots = roots;
+  info.np.max_iters = 80;
+  info.np.damping = 0.75;
+  info.np.method = Method::Halley;
+  info.view.W = 97;
+  info.view.H = 61;
+  info.view.set_center(dd(0.25), dd(-0.125), 1.5);
+  RenderOptions opt;
+  opt.aa = 3;
+  BasinResult r;
+  const RenderStats st =
+      render_basins(p, roots, info.np, info.view, nullptr, r, opt);
+  info.max_k = st.max_k;
+  const std::string path = "raw_test.nfr";
+  if (!write_raw(path, info, r)) {
+    std::fprintf(stderr, "raw: write failed\n");
+    return 1;
+  }
+  {
+    RawFile f;
+    std::string err;
+    if (!f.open(path, &err)) {
+      std::fprintf(stderr, "raw: %s\n", err.c_str());
+      std::remove(path.c_str());
+      return 1;
+    }
+    const RawInfo back = f.info();
+    const BasinView v = f.view();
+    const size_t n = r.label.size();
+    const bool same =
+        back.poly == info.poly && back.roots == info.roots &&
+        back.np.max_iters == 80 && back.np.damping == 0.75 &&
+        back.np.method == Method::Halley &&
+        back.view.xmin_lo == info.view.xmin_lo &&
+        back.view.span_y == info.view.span_y && back.max_k == st.max_k &&
+        v.W == r.W && v.H == r.H && v.aa == 3 &&
+        v.aa_count == r.aa_pixel.size() && v.aa_count > 0 &&
+        std::equal(r.label.begin(), r.label.end(), v.label) &&
+        std::equal(r.iters.begin(), r.iters.end(), v.iters) &&
+        std::equal(r.aa_pixel.begin(), r.aa_pixel.end(), v.aa_pixel) &&
+        std::equal(r.aa_label.begin(), r.aa_label.end(), v.aa_label);
+    const bool aligned =
+        (uintptr_t)v.label % kRawAlign == 0 &&
+        (uintptr_t)v.iters % kRawAlign == 0 &&
+        (uintptr_t)v.aa_pixel % kRawAlign == 0;
+    ImageRGBA a, b;
+    colorize_basins(r, colors, a);
+    colorize_basins(v, colors, b);
+    bool colors_same = a.pixels.size() == b.pixels.size();
+    for (size_t i = 0; colors_same && i < n; i++)
+      colors_same = std::memcmp(&a.pixels[i], &b.pixels[i], 4) == 0;
+    if (!same || !aligned || !colors_same || result_max_iters(v) != st.max_k) {
+      std::fprintf(stderr, "raw: read back differs (fields %d, aligned %d, "
+                           "colors %d)\n",
+                   same, aligned, colors_same);
+      ++fails;
+    }
+  }
+  // Truncated and wrong-version files
+  std::FILE *f = std::fopen(path.c_str(), "rb");
+  std::vector<uint8_t> file;
+  for (int c; f && (c = std::fgetc(f)) != EOF;)
+    file.push_back((uint8_t)c);
+  if (f)
+    std::fclose(f);
+  for (int damage = 0; damage < 2; damage++) {
+    std::vector<uint8_t> bad = file;
+    if (damage == 0)
+      bad.resize(bad.size() - 100);
+    else
+      bad[8] = 99; // version
+    f = std::fopen(path.c_str(), "wb");
+    if (f) {
+      std::fwrite(bad.data(), 1, bad.size(), f);
+      std::fclose(f);
+    }
+    RawFile rf;
+    if (rf.open(path)) {
+      std::fprintf(stderr, "raw: damaged file %d accepted\n", damage);
+      ++fails;
+    }
+  }
+  std::remove(path.c_str());
+  return fails;
+}
+
+// Tile pyramid: the finest tiles are the full render, every coarser level
+// its 2x2 linear-light average, in both layouts, with block edges and
+// partial tiles
+int test_pyramid() {
+  int fails = 0;
+  PolyZ3Minus1 p;
+  const auto roots = p.roots();
+  const auto colors = make_basin_palette((int)roots.size(),
+                                         BasinPalette::Pastel, &roots);
+  NewtonParams np;
+  np.max_iters = 50;
+  Viewport v;
+  v.W = 600; // 3 x 2 tiles at level 10, blocks of 2 x 2
+  v.H = 300;
+  v.xmin = -2.56; // the block seam x = 512 runs through the origin
+  v.xmax = 0.44;
+  RenderOptions opt;
+  opt.aa = 2;
+  BasinResult r;
+  render_basins(p, roots, np, v, nullptr, r, opt);
+  // Refined pixels on both sides of the seam, which --aa must see across
+  int seam_aa = 0;
+  for (uint32_t px : r.aa_pixel)
+    seam_aa += px % (uint32_t)v.W == 511 || px % (uint32_t)v.W == 512;
+  if (seam_aa < 10) {
+    std::fprintf(stderr, "pyramid: only %d refined seam pixels\n", seam_aa);
+    ++fails;
+  }
+  std::vector<ImageRGBA> want[2];
+  want[0].resize(11);
+  want[1].resize(11);
+  colorize_basins(r, colors, want[0][10]);
+  colorize_iterations(r, np.max_iters, want[1][10]);
+  for (int l = 9; l >= 0; l--)
+    for (int i = 0; i < 2; i++)
+      downsample_half(want[i][(size_t)l + 1], want[i][(size_t)l]);
+  for (const char *layout : {"dzi", "xyz"}) {
+    const bool xyz = std::string(layout) == "xyz";
+    PyramidOptions po;
+    po.layout = layout;
+    po.block_levels = 1;
+    const std::string prefix = "pyramid_test";
+    const PyramidStats ps =
+        render_pyramid(p, roots, np, v, nullptr, colors, opt, po, prefix);
+    long long bad = 0, tiles = 0;
+    for (int i = 0; i < 2 && ps.ok; i++) {
+      const std::string root = prefix + (i ? "_iters" : "_basins");
+      for (int l = xyz ? 8 : 0; l <= 10; l++) { // z0 = 8: 150 x 75
+        const ImageRGBA &w = want[i][(size_t)l];
+        for (int c = 0; c * kPyramidTile < w.width; c++)
+          for (int t = 0; t * kPyramidTile < w.height; t++) {
+            const std::string path =
+                xyz ? root + "/" + std::to_string(l - 8) + "/" +
+                          std::to_string(c) + "/" + std::to_string(t) +
+                          ".png"
+                    : root + "_files/" + std::to_string(l) + "/" +
+                          std::to_string(c) + "_" + std::to_string(t) +
+                          ".png";
+            int color = -1;
+            std::vector<uint8_t> pix;
+            ++tiles;
+            if (!read_png(path, color, pix, true)) {
+              ++bad;
+              continue;
+            }
+            const int x0 = c * kPyramidTile, y0 = t * kPyramidTile;
+            const int tw = std::min(kPyramidTile, w.width - x0);
+            const int th = std::min(kPyramidTile, w.height - y0);
+            bad += pix.size() != 3 * (size_t)tw * (size_t)th;
+            for (int y = 0; y < th && pix.size() == 3 * (size_t)tw * th; y++)
+              for (int x = 0; x < tw; x++) {
+                const RGBA q = w.at(x0 + x, y0 + y);
+                const uint8_t *d = &pix[3 * ((size_t)y * tw + x)];
+                bad += d[0] != q.r || d[1] != q.g || d[2] != q.b;
+              }
+          }
+      }
+    }
+    const bool dzi_ok =
+        xyz || (std::filesystem::exists(prefix + "_basins.dzi") &&
+                std::filesystem::exists(prefix + "_iters_files/0/0_0.png"));
+    const bool partial_gone =
+        !std::filesystem::exists(prefix + "_pyramid.partial");
+    long long counted = 0; // the halo pixels once
+    for (long long n : ps.render.hist)
+      counted += n;
+    if (!ps.ok || bad != 0 || ps.levels != 11 || ps.blocks != 2 ||
+        ps.tiles != tiles || !dzi_ok || !partial_gone ||
+        counted != (long long)v.W * v.H) {
+      std::fprintf(stderr, "pyramid (%s): %s, %lld of %lld tiles wrong, "
+                           "%lld written\n",
+                   layout, ps.error.c_str(), bad, tiles, ps.tiles);
+      ++fails;
+    }
+    std::error_code ec;
+    for (const char *end : {"_basins", "_iters", "_basins_files",
+                            "_iters_files", "_basins.dzi", "_iters.dzi"})
+      std::filesystem::remove_all(prefix + end, ec);
+  }
+  return fails;
+}
+
+// Tile cache: a second render is all hits and identical, a pan by whole
+// pixels reuses the overlap, trimming evicts, and a damaged tile is a miss
+int test_cache() {
+  int fails = 0;
+  const std::string dir = "cache_test";
+  std::error_code ec;
+  std::filesystem::remove_all(dir, ec);
+  PolyZ3Minus1 p;
+  const auto roots = p.roots();
+  NewtonParams np;
+  np.max_iters = 60;
+  Viewport v; // dx = dy = 1/128: pans by whole pixels are exact
+  v.W = 600;
+  v.H = 300;
+  v.xmin = -2.0;
+  v.xmax = v.xmin + 600.0 / 128;
+  v.ymin = -1.0;
+  v.ymax = v.ymin + 300.0 / 128;
+  CacheOptions co;
+  co.dir = dir;
+  for (int aa : {1, 3}) {
+    RenderOptions opt;
+    opt.aa = aa;
+    BasinResult a, b, c;
+    CacheStats s1, s2, s3;
+    render_cached(p, roots, np, v, nullptr, a, opt, co, s1);
+    render_cached(p, roots, np, v, nullptr, b, opt, co, s2);
+    // 3 x 2 tiles from global pixel (-256, -128)
+    bool ok = s1.tiles == 6 && s1.hits == 0 && s2.hits == 6 &&
+              a.label == b.label && a.iters == b.iters &&
+              a.aa_pixel == b.aa_pixel && a.aa_label == b.aa_label &&
+              (aa == 1 || !a.aa_pixel.empty());
+    // The plain render samples the same points up to rounding, --aa
+    // jitter included
+    BasinResult r;
+    RenderOptions plain = opt;
+    plain.symmetry = false;
+    render_basins(p, roots, np, v, nullptr, r, plain);
+    long long diff = 0;
+    for (size_t i = 0; i < r.label.size(); i++)
+      diff += r.label[i] != a.label[i];
+    std::vector<int> slot(r.label.size(), -1);
+    for (size_t j = 0; j < a.aa_pixel.size(); j++)
+      slot[a.aa_pixel[j]] = (int)j;
+    const size_t nn = (size_t)aa * aa;
+    for (size_t j = 0; j < r.aa_pixel.size(); j++) {
+      const int k = slot[r.aa_pixel[j]];
+      diff += k < 0 || !std::equal(&r.aa_label[j * nn],
+                                   &r.aa_label[(j + 1) * nn],
+                                   &a.aa_label[(size_t)k * nn]);
+    }
+    diff += std::abs((long long)r.aa_pixel.size() -
+                     (long long)a.aa_pixel.size());
+    ok = ok && diff * 1000 < (long long)r.label.size();
+    // 300 pixels right, 20 down: tiles overlap
+    Viewport w = v;
+    w.xmin += 300.0 / 128;
+    w.xmax += 300.0 / 128;
+    w.ymin += 20.0 / 128;
+    w.ymax += 20.0 / 128;
+    render_cached(p, roots, np, w, nullptr, c, opt, co, s3);
+    long long bad = 0;
+    for (int y = 0; y < v.H - 20; y++)
+      for (int x = 0; x < v.W - 300; x++)
+        bad += c.label[(size_t)y * (size_t)v.W + (size_t)x] !=
+                   a.label[(size_t)(y + 20) * (size_t)v.W + (size_t)x + 300] ||
+               c.iters[(size_t)y * (size_t)v.W + (size_t)x] !=
+                   a.iters[(size_t)(y + 20) * (size_t)v.W + (size_t)x + 300];
+    ok = ok && s3.hits > 0 && s3.hits < s3.tiles && bad == 0;
+    if (!ok) {
+      std::fprintf(stderr, "cache (aa %d): hits %d/%d, %d/%d, %d/%d; %lld "
+                           "differ from the plain render, %lld after the "
+                           "pan\n",
+                   aa, s1.hits, s1.tiles, s2.hits, s2.tiles, s3.hits,
+                   s3.tiles, diff, bad);
+      ++fails;
+    }
+  }
+  // Truncate every tile: all misses, then all hits again
+  for (const auto &e : std::filesystem::recursive_directory_iterator(dir))
+    if (e.path().extension() == ".nft")
+      std::filesystem::resize_file(e.path(), 100);
+  BasinResult a;
+  CacheStats s;
+  render_cached(p, roots, np, v, nullptr, a, RenderOptions{}, co, s);
+  const int damaged_hits = s.hits;
+  render_cached(p, roots, np, v, nullptr, a, RenderOptions{}, co, s);
+  int evicted = 0;
+  const uint64_t left = trim_cache(dir, 1u << 20, &evicted);
+  if (damaged_hits != 0 || s.hits != s.tiles || left > (1u << 20) ||
+      evicted == 0) {
+    std::fprintf(stderr, "cache: %d hits on damaged tiles, %d/%d after; "
+                         "trim left %llu bytes, evicted %d\n",
+                 damaged_hits, s.hits, s.tiles, (unsigned long long)left,
+                 evicted);
+    ++fails;
+  }
+  std::filesystem::remove_all(dir, ec);
+  return fails;
+}
+
+// One GET on a new connection: the status, the body and X-Tile-Source
+static int http_get(const std::string &addr, const std::string &path,
+                    std::string &body, std::string &source) {
+  const int fd = connect_to(addr, nullptr);
+  if (fd < 0)
+    return 0;
+  const std::string req = "GET " + path + " HTTP/1.1\r\n\r\n";
+  std::string buf;
+  HttpMessage m;
+  const bool ok =
+      send_all(fd, req.data(), req.size()) && read_http(fd, buf, m);
+  close_socket(fd);
+  if (!ok || m.start.size() < 12)
+    return 0;
+  body = m.body;
+  source = m.header("x-tile-source");
+  return std::atoi(m.start.c_str() + 9);
+}
+
+// Tile server: a tile matches a direct render of its view, repeats are LRU
+// hits, concurrent requests for one tile share a render, bad requests get
+// 4xx, and /stats counts it all
+int test_serve() {
+  int fails = 0;
+#if defined(__unix__) || defined(__APPLE__)
+  const std::string addr = "unix:serve_test.sock";
+  ServeOptions so;
+  so.listen = addr;
+  so.workers = 2;
+  so.np.max_iters = 60;
+  TileServer server(so, nullptr);
+  std::string err;
+  if (!server.start(&err)) {
+    std::fprintf(stderr, "serve: %s\n", err.c_str());
+    return 1;
+  }
+  std::string body, src, src2;
+  const int status = http_get(addr, "/tile/1/1/0.png", body, src);
+  {
+    std::FILE *f = std::fopen("serve_test.png", "wb");
+    std::fwrite(body.data(), 1, body.size(), f);
+    std::fclose(f);
+  }
+  int color = 0;
+  std::vector<uint8_t> px;
+  const bool decoded = read_png("serve_test.png", color, px, true);
+  std::remove("serve_test.png");
+  PolyZ3Minus1 p;
+  const auto roots = p.roots();
+  BasinResult r;
+  render_basins(p, roots, so.np, tile_viewport(so.world, 1, 1, 0), nullptr,
+                r, so.ro);
+  ImageRGBA img;
+  colorize_basins(r, make_basin_palette(3, BasinPalette::Pastel, &roots),
+                  img);
+  long long bad = px.size() == img.pixels.size() * 3 ? 0 : 1;
+  for (size_t i = 0; !bad && i < img.pixels.size(); i++)
+    bad += px[3 * i] != img.pixels[i].r || px[3 * i + 1] != img.pixels[i].g ||
+           px[3 * i + 2] != img.pixels[i].b;
+  const int again = http_get(addr, "/tile/1/1/0.png", body, src2);
+  if (status != 200 || src != "rendered" || !decoded || bad != 0 ||
+      again != 200 || src2 != "hit") {
+    std::fprintf(stderr, "serve: %d %s, decoded %d, %lld pixels differ; "
+                         "again %d %s\n",
+                 status, src.c_str(), decoded, bad, again, src2.c_str());
+    ++fails;
+  }
+
+  // Eight at once for a new tile: one render
+  std::vector<std::string> sources(8);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < sources.size(); i++)
+    threads.emplace_back([&, i] {
+      std::string b;
+      if (http_get(addr, "/tile/4/3/9.png?image=iters", b, sources[i]) != 200)
+        sources[i] = "failed";
+    });
+  for (auto &t : threads)
+    t.join();
+  int rendered = 0, shared = 0;
+  for (const auto &s : sources) {
+    rendered += s == "rendered";
+    shared += s == "hit" || s == "coalesced";
+  }
+  if (rendered != 1 || shared != 7) {
+    std::fprintf(stderr, "serve: %d of 8 rendered, %d shared\n", rendered,
+                 shared);
+    ++fails;
+  }
+
+  const int s_zoom = http_get(addr, "/tile/2/4/0.png", body, src);
+  const int s_param = http_get(addr, "/tile/0/0/0.png?iters=9", body, src);
+  const int s_file =
+      http_get(addr, "/tile/0/0/0.png?poly=coeffs-file:/etc/hosts", body, src);
+  const int s_path = http_get(addr, "/nope", body, src);
+  const int s_stats = http_get(addr, "/stats", body, src);
+  // A reply is counted just after it is sent
+  ServeStats st = server.stats();
+  for (int i = 0; i < 200 && st.requests < 13; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    st = server.stats();
+  }
+  server.stop();
+  if (s_zoom != 400 || s_param != 400 || s_file != 400 || s_path != 404 ||
+      s_stats != 200 || body.find("\"p99_ms\"") == std::string::npos ||
+      st.requests != 13 || st.rendered != 2 || st.hits + st.coalesced != 8 ||
+      st.errors != 3 || st.queue_depth != 0 || !(st.p99_ms > 0.0) ||
+      st.lru_tiles != 2 || std::filesystem::exists("serve_test.sock")) {
+    std::fprintf(stderr, "serve: statuses %d %d %d %d %d; %s\n", s_zoom,
+                 s_param, s_file, s_path, s_stats, stats_json(st).c_str());
+    ++fails;
+  }
+
+  // No LRU room: every request renders
+  so.lru_bytes = 0;
+  TileServer cold(so, nullptr);
+  cold.start(&err);
+  http_get(addr, "/tile/0/0/0.png", body, src);
+  http_get(addr, "/tile/0/0/0.png", body, src2);
+  cold.stop();
+  if (src != "rendered" || src2 != "rendered") {
+    std::fprintf(stderr, "serve: without an LRU got %s, %s\n", src.c_str(),
+                 src2.c_str());
+    ++fails;
+  }
+
+  // --aa reads a pixel past the tile's edges, so its edge pixels see the
+  // neighboring tile and differ from a render of the tile alone
+  TileServer aa(so, nullptr);
+  aa.start(&err);
+  const int s_aa = http_get(addr, "/tile/1/1/0.png?aa=2", body, src);
+  aa.stop();
+  {
+    std::FILE *f = std::fopen("serve_test.png", "wb");
+    std::fwrite(body.data(), 1, body.size(), f);
+    std::fclose(f);
+  }
+  const bool aa_decoded = read_png("serve_test.png", color, px, true);
+  std::remove("serve_test.png");
+  RenderOptions ro = so.ro;
+  ro.aa = 2;
+  ro.with_grid = true;
+  ro.grid_x = kServeTile;
+  const auto colors = make_basin_palette(3, BasinPalette::Pastel, &roots);
+  ImageRGBA halo, alone;
+  render_window(p, roots, so.np, tile_viewport(so.world, 1, 1, 0), nullptr,
+                r, ro, true);
+  colorize_basins(r, colors, halo);
+  render_basins(p, roots, so.np, tile_viewport(so.world, 1, 1, 0), nullptr,
+                r, ro);
+  colorize_basins(r, colors, alone);
+  const int T = kServeTile;
+  long long aa_bad = px.size() == (size_t)T * T * 3 ? 0 : 1, edge = 0;
+  for (int y = 0; !aa_bad && y < T; y++)
+    for (int x = 0; x < T; x++) {
+      const RGBA &c = halo.at(x, y), &a = alone.at(x, y);
+      const uint8_t *q = &px[3 * ((size_t)y * T + x)];
+      aa_bad += q[0] != c.r || q[1] != c.g || q[2] != c.b;
+      edge += (x == 0 || y == 0 || x == T - 1 || y == T - 1) &&
+              (a.r != c.r || a.g != c.g || a.b != c.b);
+    }
+  if (s_aa != 200 || !aa_decoded || aa_bad != 0 || edge == 0) {
+    std::fprintf(stderr, "serve: --aa tile %d, decoded %d, %lld pixels "
+                         "differ, %lld edge pixels see the halo\n",
+                 s_aa, aa_decoded, aa_bad, edge);
+    ++fails;
+  }
+#endif
+  return fails;
+}
+
+// Batch manifests: lines override the defaults, a bad line fails alone, and
+// every image matches what a separate render would write
+int test_batch() {
+  int fails = 0;
+  BatchJob def;
+  def.np.max_iters = 80;
+  def.view.W = 96;
+  def.view.H = 64;
+  BatchJob j = def;
+  std::string err;
+  const bool parsed = parse_batch_job(
+      "{\"poly\": \"z5-1\", \"center\": [\"0.1\", -0.2], \"width\": 0.5,"
+      " \"size\": \"40x20\", \"traps\": false, \"aa\": 2}",
+      j, err);
+  BatchJob k = j; // bounds in a later line drop an inherited center
+  const bool bounds =
+      parse_batch_job("{\"bounds\": [-1, 1, -0.5, 0.5]}", k, err);
+  BatchJob bad = def;
+  const bool rejected =
+      !parse_batch_job("{\"size\": 40x20}", bad, err) &&
+      !parse_batch_job("{\"aa\": 99}", bad, err) &&
+      !parse_batch_job("{\"poly\": \"z3-1\"} x", bad, err);
+  if (!parsed || j.poly != "z5-1" || j.view.W != 40 || j.view.H != 20 ||
+      j.np.root_traps || j.ro.aa != 2 || j.np.max_iters != 80 ||
+      std::abs(j.view.xmin - (0.1 - 0.25)) > 1e-15 ||
+      std::abs(j.view.ymax - (-0.2 + 0.125)) > 1e-15 || !bounds ||
+      !k.center_re.empty() || k.view.span_x != 0.0 || k.view.xmin != -1.0 ||
+      !rejected) {
+    std::fprintf(stderr, "batch: parsing (%d %d %d) %s\n", parsed, bounds,
+                 rejected, err.c_str());
+    ++fails;
+  }
+
+  const std::string dir = "batch_test";
+  std::error_code ec;
+  std::filesystem::remove_all(dir, ec);
+  std::filesystem::create_directories(dir);
+  {
+    std::FILE *f = std::fopen((dir + "/jobs.jsonl").c_str(), "w");
+    std::fputs("# a comment, then a blank line\n\n"
+               "{\"out\": \"batch_test/a\"}\n"
+               "{\"poly\": \"bogus\", \"out\": \"batch_test/x\"}\n"
+               "{\"poly\": \"z5-1\", \"method\": \"halley\", \"aa\": 2, "
+               "\"out\": \"batch_test/sub/b\"}\n",
+               f);
+    std::fclose(f);
+  }
+  def.out = dir + "/default";
+  const BatchStats bs = run_batch(dir + "/jobs.jsonl", def, nullptr,
+                                  dir + "/summary.tsv");
+  int rows = 0;
+  {
+    std::FILE *f = std::fopen((dir + "/summary.tsv").c_str(), "r");
+    for (int c; f && (c = std::fgetc(f)) != EOF;)
+      rows += c == '\n';
+    if (f)
+      std::fclose(f);
+  }
+  // The same renders one at a time
+  long long bad_px = 0;
+  auto check = [&](const Poly &p, const BatchJob &job) {
+    const auto roots = p.roots();
+    BasinResult r;
+    const RenderStats st =
+        render_basins(p, roots, job.np, job.view, nullptr, r, job.ro);
+    ImageRGBA img;
+    int color = 0;
+    std::vector<uint8_t> px;
+    for (int image = 0; image < 2; image++) {
+      if (image == 0)
+        colorize_basins(r, make_basin_palette((int)roots.size(),
+                                              BasinPalette::Pastel, &roots),
+                        img);
+      else
+        colorize_iterations(r, st.max_k, img, job.colormap);
+      const std::string path =
+          job.out + (image == 0 ? "_basins.png" : "_iters.png");
+      if (!read_png(path, color, px, true) ||
+          px.size() != img.pixels.size() * 3) {
+        bad_px += 1 << 20;
+        continue;
+      }
+      for (size_t i = 0; i < img.pixels.size(); i++)
+        bad_px += px[3 * i] != img.pixels[i].r ||
+                  px[3 * i + 1] != img.pixels[i].g ||
+                  px[3 * i + 2] != img.pixels[i].b;
+    }
+  };
+  BatchJob a = def, b = def;
+  a.out = dir + "/a";
+  b.np.method = Method::Halley;
+  b.ro.aa = 2;
+  b.out = dir + "/sub/b";
+  check(PolyZ3Minus1(), a);
+  check(PolyZ5Minus1(), b);
+  if (!bs.ok || bs.jobs != 3 || bs.failed != 1 || rows != 4 || bad_px != 0 ||
+      std::filesystem::exists(dir + "/x_basins.png")) {
+    std::fprintf(stderr, "batch: %s; %d jobs, %d failed, %d summary rows, "
+                         "%lld pixels differ\n",
+                 bs.error.c_str(), bs.jobs, bs.failed, rows, bad_px);
+    ++fails;
+  }
+  std::filesystem::remove_all(dir, ec);
+  return fails;
+}
+
+// Animations: interpolation keeps the zoom's fixed point still, frames built
+// from the previous one on integer pans equal whole renders, and y4m framing
+// adds up
+int test_animate() {
+  int fails = 0;
+  const std::string dir = "animate_test";
+  std::error_code ec;
+  std::filesystem::remove_all(dir, ec);
+  std::filesystem::create_directories(dir);
+  auto write = [](const std::string &path, const char *text) {
+    std::FILE *f = std::fopen(path.c_str(), "w");
+    std::fputs(text, f);
+    std::fclose(f);
+  };
+  // 64x32 at width 4: pixels of 1/16, so the pan moves 2 and 1 pixels per
+  // frame exactly; then a zoom, then max_iters changes
+  write(dir + "/keys.txt", "# frame re im width\n"
+                           "0   0    0   4\n"
+                           "8   1    0.5 4   # pan\n"
+                           "12  1    0.5 2\n"
+                           "14  1    0.5 2   max_iters=120\n");
+  write(dir + "/bad.txt", "0 0 0 4\n0 1 0 4\n");
+  NewtonParams base;
+  base.max_iters = 60;
+  std::vector<Keyframe> keys, bad;
+  std::string err, err2;
+  const bool loaded = load_keyframes(dir + "/keys.txt", base, keys, err);
+  const bool rejected = !load_keyframes(dir + "/bad.txt", base, bad, err2);
+  if (!loaded || keys.size() != 4 || keys[2].max_iters != 60 ||
+      keys[3].max_iters != 120 || !rejected) {
+    std::fprintf(stderr, "animate: keyframes %s\n", err.c_str());
+    return 1;
+  }
+
+  // A zoom from (0, 0) at width 4 to (1, 0) at width 1 holds 4/3 still, so
+  // at width 2 the center is 2/3
+  {
+    const std::vector<Keyframe> zk = {{0, dd(0.0), dd(0.0), 4.0, 60, 1.0,
+                                       1e-12},
+                                      {10, dd(1.0), dd(0.0), 1.0, 60, 1.0,
+                                       1e-12}};
+    Viewport v;
+    NewtonParams np;
+    frame_at(zk, 5, 64, 64, base, v, np);
+    const double cx = v.xmin + 0.5 * v.span_x;
+    if (std::abs(v.span_x - 2.0) > 1e-12 || std::abs(cx - 2.0 / 3) > 1e-12) {
+      std::fprintf(stderr, "animate: mid-zoom width %g center %g\n",
+                   v.span_x, cx);
+      ++fails;
+    }
+  }
+
+  PolyZ3Minus1 poly;
+  const auto roots = poly.roots();
+  const auto colors =
+      make_basin_palette((int)roots.size(), BasinPalette::Pastel, &roots);
+  RenderOptions ro;
+  ro.symmetry = false; // strips never use it; whole frames would
+  const int W = 64, H = 32;
+  AnimateOptions ao;
+  ao.format = "rgba";
+  ao.out = dir + "/frames.rgba";
+  const AnimateStats as = render_animation(poly, roots, base, W, H, keys,
+                                           nullptr, colors, ro, ao);
+  ao.format = "y4m";
+  ao.out = dir + "/frames.y4m";
+  ao.reuse = false;
+  const AnimateStats ys = render_animation(poly, roots, base, W, H, keys,
+                                           nullptr, colors, ro, ao);
+  std::vector<uint8_t> rgba, y4m;
+  auto slurp = [](const std::string &path, std::vector<uint8_t> &out) {
+    std::FILE *f = std::fopen(path.c_str(), "rb");
+    uint8_t buf[4096];
+    for (size_t n; f && (n = std::fread(buf, 1, sizeof buf, f)) > 0;)
+      out.insert(out.end(), buf, buf + n);
+    if (f)
+      std::fclose(f);
+  };
+  slurp(dir + "/frames.rgba", rgba);
+  slurp(dir + "/frames.y4m", y4m);
+  const size_t frame = (size_t)W * H * 4;
+  if (!as.ok || !ys.ok || as.frames != 15 || ys.frames != 15 ||
+      as.shifted_frames != 8 || ys.shifted_frames != 0 ||
+      as.reused_pixels != 8LL * (W - 2) * (H - 1) ||
+      rgba.size() != 15 * frame) {
+    std::fprintf(stderr, "animate: %s %s; %d / %d frames, %d shifted, "
+                         "%lld reused, %zu bytes\n",
+                 as.error.c_str(), ys.error.c_str(), as.frames, ys.frames,
+                 as.shifted_frames, as.reused_pixels, rgba.size());
+    std::filesystem::remove_all(dir, ec);
+    return fails + 1;
+  }
+  // Every frame, shifted or not, as a whole render of its own
+  long long bad_px = 0;
+  BasinResult r;
+  ImageRGBA img;
+  for (int f = 0; f < 15; f++) {
+    Viewport v;
+    NewtonParams np;
+    frame_at(keys, f, W, H, base, v, np);
+    render_basins(poly, roots, np, v, nullptr, r, ro);
+    colorize_basins(r, colors, img);
+    bad_px += std::memcmp(rgba.data() + (size_t)f * frame,
+                          img.pixels.data(), frame) != 0;
+  }
+  const std::string head = "YUV4MPEG2 W64 H32 F30:1 Ip A1:1 C444\n";
+  const size_t y_frame = 6 + (size_t)W * H * 3;
+  bool framed = y4m.size() == head.size() + 15 * y_frame &&
+                std::memcmp(y4m.data(), head.data(), head.size()) == 0;
+  for (int f = 0; framed && f < 15; f++)
+    framed = std::memcmp(y4m.data() + head.size() + (size_t)f * y_frame,
+                         "FRAME\n", 6) == 0;
+  if (bad_px != 0 || !framed || ys.bytes != y4m.size()) {
+    std::fprintf(stderr, "animate: %lld frames differ, y4m framing %d "
+                         "(%zu bytes)\n",
+                 bad_px, framed, y4m.size());
+    ++fails;
+  }
+
+#if defined(__unix__) || defined(__APPLE__)
+  // Stdout is a pipe nobody reads: the write fails instead of SIGPIPE
+  // ending the process
+  int fds[2];
+  if (pipe(fds) == 0) {
+    std::fflush(stdout);
+    const int saved = dup(1);
+    close(fds[0]);
+    dup2(fds[1], 1);
+    close(fds[1]);
+    ao.out = "-";
+    const AnimateStats ps = render_animation(poly, roots, base, W, H, keys,
+                                             nullptr, colors, ro, ao);
+    std::fflush(stdout);
+    std::clearerr(stdout);
+    dup2(saved, 1);
+    close(saved);
+    if (ps.ok || ps.error != "could not write stdout") {
+      std::fprintf(stderr, "animate: closed pipe gave \"%s\"\n",
+                   ps.error.c_str());
+      ++fails;
+    }
+  }
+#endif
+  std::filesystem::remove_all(dir, ec);
+  return fails;
+}
+
+// Parameter sweeps: specs expand in order, and every variant of a single
+// pass equals a render of its own without traps, on every kernel
+int test_sweep() {
+  int fails = 0;
+  NewtonParams base;
+  std::vector<NewtonParams> vs, bad;
+  std::string err;
+  const bool parsed =
+      parse_sweep("damping=0.5:1.0:0.25,tol=1e-6,1e-9", base, vs, err);
+  const bool rejected = !parse_sweep("foo=1", base, bad, err) &&
+                        !parse_sweep("tol=0", base, bad, err) &&
+                        !parse_sweep("damping=1:0:0.1", base, bad, err) &&
+                        !parse_sweep("max_iters=1.5", base, bad, err) &&
+                        !parse_sweep("tol=1e-6,tol=1e-9", base, bad, err) &&
+                        !parse_sweep("1,2", base, bad, err);
+  if (!parsed || vs.size() != 6 || vs[0].damping != 0.5 ||
+      vs[0].tol != 1e-6 || vs[1].tol != 1e-9 || vs[5].damping != 1.0 ||
+      vs[5].max_iters != base.max_iters || !rejected) {
+    std::fprintf(stderr, "sweep: parsing (%d %zu %d)\n", parsed, vs.size(),
+                 rejected);
+    ++fails;
+  }
+
+  // Caps differ inside a SIMD block, and damping 0.6 leaves some points
+  // unconverged at 20 iterations
+  parse_sweep("damping=0.6,1.0,tol=1e-6,1e-10,max_iters=20,60", base, vs,
+              err);
+  PolyZ3Minus1 poly;
+  const auto roots = poly.roots();
+  Viewport v;
+  v.W = 80;
+  v.H = 60;
+  RenderOptions ro;
+  ro.symmetry = false;
+  std::vector<const KernelVariant *> kernels = {nullptr};
+  for (const auto &k : kernel_variants())
+    if (kernel_supported(k))
+      kernels.push_back(&k);
+  for (const KernelVariant *kv : kernels) {
+    std::vector<BasinResult> res;
+    const SweepStats ss = sweep_basins(poly, roots, vs, v, kv, &res);
+    long long bad_px = 0, bad_stats = 0;
+    BasinResult r;
+    for (size_t i = 0; i < vs.size(); i++) {
+      NewtonParams np = vs[i];
+      np.root_traps = false;
+      const RenderStats st = render_basins(poly, roots, np, v, kv, r, ro);
+      for (size_t p = 0; p < r.label.size(); p++)
+        bad_px += res[i].label[p] != r.label[p] ||
+                  res[i].iters[p] != r.iters[p];
+      const SweepVariantStats &s = ss.variants[i];
+      long long in_basins = 0;
+      for (long long n : s.root_pixels)
+        in_basins += n;
+      bad_stats += s.no_root_pixels != st.no_root_pixels ||
+                   s.cycle_pixels != st.cycle_pixels ||
+                   in_basins + s.no_root_pixels + s.cycle_pixels !=
+                       (long long)v.W * v.H ||
+                   std::abs(s.mean_iters - st.mean_iters) > 1e-9 ||
+                   s.p99_iters != st.p99_iters;
+    }
+    if (ss.variants.size() != 8 || bad_px != 0 || bad_stats != 0 ||
+        ss.points != 8LL * v.W * v.H) {
+      std::fprintf(stderr, "sweep (%s): %lld pixels, %lld stats differ\n",
+                   kv ? kv->name : "scalar", bad_px, bad_stats);
+      ++fails;
+    }
+    if (!kv) {
+      const std::string path = "sweep_test.tsv";
+      int rows = 0;
+      if (write_sweep_summary(path, ss)) {
+        std::FILE *f = std::fopen(path.c_str(), "r");
+        for (int c; f && (c = std::fgetc(f)) != EOF;)
+          rows += c == '\n';
+        if (f)
+          std::fclose(f);
+      }
+      std::remove(path.c_str());
+      if (rows != 9) {
+        std::fprintf(stderr, "sweep: %d summary rows\n", rows);
+        ++fails;
+      }
+    }
+  }
+  return fails;
+}
+
 int main(int argc, char **argv) {
   if (argc > 1 && std::string(argv[1]) == "--roots") {
     return test_roots();
   } else if (argc > 1 && std::string(argv[1]) == "--golden") {
     return test_golden();
+  } else if (argc > 1 && std::string(argv[1]) == "--simd") {
+    return test_simd();
+  } else if (argc > 1 && std::string(argv[1]) == "--fused") {
+    return test_fused();
+  } else if (argc > 1 && std::string(argv[1]) == "--coeffs") {
+    return test_coeffs();
+  } else if (argc > 1 && std::string(argv[1]) == "--methods") {
+    return test_methods();
+  } else if (argc > 1 && std::string(argv[1]) == "--cycles") {
+    return test_cycles();
+  } else if (argc > 1 && std::string(argv[1]) == "--traps") {
+    return test_traps();
+  } else if (argc > 1 && std::string(argv[1]) == "--mixed") {
+    return test_mixed();
+  } else if (argc > 1 && std::string(argv[1]) == "--deep") {
+    return test_deep();
+  } else if (argc > 1 && std::string(argv[1]) == "--tiles") {
+    return test_tiles();
+  } else if (argc > 1 && std::string(argv[1]) == "--adaptive") {
+    return test_adaptive();
+  } else if (argc > 1 && std::string(argv[1]) == "--symmetry") {
+    return test_symmetry();
+  } else if (argc > 1 && std::string(argv[1]) == "--aa") {
+    return test_aa();
+  } else if (argc > 1 && std::string(argv[1]) == "--soa") {
+    return test_soa();
+  } else if (argc > 1 && std::string(argv[1]) == "--colorize") {
+    return test_colorize();
+  } else if (argc > 1 && std::string(argv[1]) == "--png") {
+    return test_png();
+  } else if (argc > 1 && std::string(argv[1]) == "--stream") {
+    return test_stream();
+  } else if (argc > 1 && std::string(argv[1]) == "--raw") {
+    return test_raw();
+  } else if (argc > 1 && std::string(argv[1]) == "--pyramid") {
+    return test_pyramid();
+  } else if (argc > 1 && std::string(argv[1]) == "--cache") {
+    return test_cache();
+  } else if (argc > 1 && std::string(argv[1]) == "--serve") {
+    return test_serve();
+  } else if (argc > 1 && std::string(argv[1]) == "--batch") {
+    return test_batch();
+  } else if (argc > 1 && std::string(argv[1]) == "--animate") {
+    return test_animate();
+  } else if (argc > 1 && std::string(argv[1]) == "--sweep") {
+    return test_sweep();
   } else {
-    std::puts("Usage: unit_tests --roots | --golden");
+    std::puts("Usage: unit_tests --roots | --golden | --simd | --fused | "
+              "--coeffs | --methods | --cycles | --traps | --mixed | "
+              "--deep | --tiles | --adaptive | --symmetry | --aa | --soa | "
+              "--colorize | --png | --stream | --raw | --pyramid | --cache | "
+              "--serve | --batch | --animate | --sweep");
     return 0;
   }
 }